@@ -0,0 +1,156 @@
+/**
+	@file bench_big.c
+	@brief Benchmarks for osrfBigHash and osrfBigList at 1M entries.
+
+	These time whichever backend libopensrf was configured with: the native one by
+	default, or libJudy with --with-judy.  The backend's name is part of the corpus
+	label, so results from the two builds can be compared side by side.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <opensrf/osrf_big_hash.h>
+#include <opensrf/osrf_big_list.h>
+#include "osrf_bench.h"
+
+#ifndef OSRF_BIG_BACKEND
+#define OSRF_BIG_BACKEND "unknown"
+#endif
+
+/** @brief Number of entries in the hash and list being searched. */
+#define BIG_ENTRIES 1000000
+/** @brief Number of entries added per iteration of the build benchmarks. */
+#define BIG_BUILD_ENTRIES 65536
+/** @brief Multiplier for visiting the entries in a scattered order. */
+#define BIG_STRIDE 7919
+
+typedef struct {
+	char** keys;
+	char** missing;
+	osrfBigHash* hash;
+	osrfBigList* list;
+} BigCorpus;
+
+static void bench_hash_get_hit( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i )
+		osrfBigHashGet( c->hash, c->keys[ ( i * BIG_STRIDE ) % BIG_ENTRIES ] );
+}
+
+static void bench_hash_get_miss( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i )
+		osrfBigHashGet( c->hash, c->missing[ ( i * BIG_STRIDE ) % BIG_ENTRIES ] );
+}
+
+static void bench_hash_build( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	while( iters-- ) {
+		osrfBigHash* hash = osrfNewBigHash();
+		unsigned long i;
+		for( i = 0; i < BIG_BUILD_ENTRIES; ++i )
+			osrfBigHashSet( hash, c->keys[ i ], c->keys[ i ] );
+		for( i = 0; i < BIG_BUILD_ENTRIES; ++i )
+			osrfBigHashRemove( hash, c->keys[ i ] );
+		osrfBigHashFree( hash );
+	}
+}
+
+static void bench_hash_iterate( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	while( iters-- ) {
+		osrfBigHashIterator* itr = osrfNewBigHashIterator( c->hash );
+		while( osrfBigHashIteratorNext( itr ) )
+			;
+		osrfBigHashIteratorFree( itr );
+	}
+}
+
+static void bench_list_get( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i )
+		osrfBigListGetIndex( c->list, ( i * BIG_STRIDE ) % BIG_ENTRIES );
+}
+
+static void bench_list_build( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	while( iters-- ) {
+		osrfBigList* list = osrfNewBigList();
+		unsigned long i;
+		for( i = 0; i < BIG_BUILD_ENTRIES; ++i )
+			osrfBigListPush( list, c->keys[ i ] );
+		for( i = 0; i < BIG_BUILD_ENTRIES; ++i )
+			osrfBigListPop( list );
+		osrfBigListFree( list );
+	}
+}
+
+static void bench_list_iterate( void* ctx, unsigned long iters ) {
+	const BigCorpus* c = ctx;
+	while( iters-- ) {
+		osrfBigBigListIterator* itr = osrfNewBigListIterator( c->list );
+		while( osrfBigBigListIteratorNext( itr ) )
+			;
+		osrfBigBigListIteratorFree( itr );
+	}
+}
+
+void osrfBenchBig( void ) {
+	static const char* names[] = { "big_hash_get_hit", "big_hash_get_miss", "big_hash_iterate",
+		"big_hash_build", "big_list_get", "big_list_iterate", "big_list_build" };
+	BigCorpus c;
+	char buf[ 64 ];
+	unsigned long i;
+
+	// Building the corpus takes a while; skip it if nothing here will run
+	for( i = 0; i < sizeof( names ) / sizeof( names[0] ); ++i ) {
+		if( osrfBenchSelected( names[ i ], OSRF_BIG_BACKEND ) )
+			break;
+	}
+	if( i == sizeof( names ) / sizeof( names[0] ) )
+		return;
+
+	c.keys = safe_malloc( BIG_ENTRIES * sizeof( char* ) );
+	c.missing = safe_malloc( BIG_ENTRIES * sizeof( char* ) );
+	c.hash = osrfNewBigHash();
+	c.list = osrfNewBigList();
+	for( i = 0; i < BIG_ENTRIES; ++i ) {
+		snprintf( buf, sizeof( buf ), "open-ils.key.%lu", i );
+		c.keys[ i ] = strdup( buf );
+		snprintf( buf, sizeof( buf ), "open-ils.nokey.%lu", i );
+		c.missing[ i ] = strdup( buf );
+		osrfBigHashSet( c.hash, c.keys[ i ], c.keys[ i ] );
+		osrfBigListPush( c.list, c.keys[ i ] );
+	}
+
+	osrfBenchRun( "big_hash_get_hit", OSRF_BIG_BACKEND "_1m", 0, bench_hash_get_hit, &c );
+	osrfBenchRun( "big_hash_get_miss", OSRF_BIG_BACKEND "_1m", 0, bench_hash_get_miss, &c );
+	osrfBenchRun( "big_hash_iterate", OSRF_BIG_BACKEND "_1m", 0, bench_hash_iterate, &c );
+	osrfBenchRun( "big_hash_build", OSRF_BIG_BACKEND "_64k", 0, bench_hash_build, &c );
+	osrfBenchRun( "big_list_get", OSRF_BIG_BACKEND "_1m", 0, bench_list_get, &c );
+	osrfBenchRun( "big_list_iterate", OSRF_BIG_BACKEND "_1m", 0, bench_list_iterate, &c );
+	osrfBenchRun( "big_list_build", OSRF_BIG_BACKEND "_64k", 0, bench_list_build, &c );
+
+	osrfBigHashFree( c.hash );
+	osrfBigListFree( c.list );
+	for( i = 0; i < BIG_ENTRIES; ++i ) {
+		free( c.keys[ i ] );
+		free( c.missing[ i ] );
+	}
+	free( c.keys );
+	free( c.missing );
+}
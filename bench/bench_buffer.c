@@ -0,0 +1,97 @@
+/**
+	@file bench_buffer.c
+	@brief Benchmarks for growing_buffer and buffer_append_utf8().
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <opensrf/utils.h>
+#include <opensrf/osrf_utf8.h>
+#include "osrf_bench.h"
+
+/** @brief Number of pieces appended per iteration of the growing_buffer benchmarks. */
+#define PIECES 256
+
+static const char piece[] = "\"open-ils.field\":";   /* 17 bytes */
+
+/* Append short strings to a fresh buffer, as serializers do */
+static void bench_add( void* ctx, unsigned long iters ) {
+	while( iters-- ) {
+		growing_buffer* buf = buffer_init( 64 );
+		int i;
+		for( i = 0; i < PIECES; ++i )
+			buffer_add( buf, piece );
+		free( buffer_release( buf ) );
+	}
+}
+
+/* Append short strings of known length to a reused buffer */
+static void bench_add_n_reuse( void* ctx, unsigned long iters ) {
+	growing_buffer* buf = ctx;
+	while( iters-- ) {
+		int i;
+		buffer_reset( buf );
+		for( i = 0; i < PIECES; ++i )
+			buffer_add_n( buf, piece, sizeof( piece ) - 1 );
+	}
+}
+
+static void bench_add_char( void* ctx, unsigned long iters ) {
+	growing_buffer* buf = ctx;
+	while( iters-- ) {
+		int i;
+		buffer_reset( buf );
+		for( i = 0; i < PIECES * ( sizeof( piece ) - 1 ); ++i )
+			buffer_add_char( buf, 'x' );
+	}
+}
+
+static void bench_fadd( void* ctx, unsigned long iters ) {
+	growing_buffer* buf = ctx;
+	while( iters-- ) {
+		int i;
+		buffer_reset( buf );
+		for( i = 0; i < PIECES; ++i )
+			buffer_fadd( buf, "\"field_%d\":%d,", i, i * 7 );
+	}
+}
+
+static void bench_append_utf8( void* ctx, unsigned long iters ) {
+	const char* text = ctx;
+	growing_buffer* buf = buffer_init( 8192 );
+	while( iters-- ) {
+		buffer_reset( buf );
+		buffer_append_utf8( buf, text );
+	}
+	buffer_free( buf );
+}
+
+void osrfBenchBuffer( void ) {
+	size_t built = PIECES * ( sizeof( piece ) - 1 );
+	growing_buffer* buf = buffer_init( 64 );
+
+	osrfBenchRun( "growing_buffer_add", "fresh_4k", built, bench_add, NULL );
+	osrfBenchRun( "growing_buffer_add_n", "reused_4k", built, bench_add_n_reuse, buf );
+	osrfBenchRun( "growing_buffer_add_char", "reused_4k", built, bench_add_char, buf );
+	osrfBenchRun( "growing_buffer_fadd", "reused", 0, bench_fadd, buf );
+	buffer_free( buf );
+
+	char* marc = osrfBenchMarcText();
+	osrfBenchRun( "buffer_append_utf8", "marc", strlen( marc ), bench_append_utf8, marc );
+	free( marc );
+
+	char* ascii = osrfBenchFieldmapperJSON( 10 );
+	osrfBenchRun( "buffer_append_utf8", "ascii_json", strlen( ascii ),
+		bench_append_utf8, ascii );
+	free( ascii );
+}
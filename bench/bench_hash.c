@@ -0,0 +1,107 @@
+/**
+	@file bench_hash.c
+	@brief Benchmarks for osrfHash at varying sizes.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <opensrf/osrf_hash.h>
+#include "osrf_bench.h"
+
+/**
+	@brief An osrfHash of a given size, with its keys and some keys that aren't in it.
+*/
+typedef struct {
+	int size;
+	char** keys;
+	char** missing;
+	osrfHash* hash;
+} HashCorpus;
+
+static void bench_get_hit( void* ctx, unsigned long iters ) {
+	const HashCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i )
+		osrfHashGet( c->hash, c->keys[ i % c->size ] );
+}
+
+static void bench_get_miss( void* ctx, unsigned long iters ) {
+	const HashCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i )
+		osrfHashGet( c->hash, c->missing[ i % c->size ] );
+}
+
+/* Each iteration builds and frees a complete hash of the corpus size */
+static void bench_build( void* ctx, unsigned long iters ) {
+	const HashCorpus* c = ctx;
+	while( iters-- ) {
+		osrfHash* h = osrfNewHash();
+		int i;
+		for( i = 0; i < c->size; ++i )
+			osrfHashSet( h, c->keys[ i ], c->keys[ i ] );
+		osrfHashFree( h );
+	}
+}
+
+static void bench_iterate( void* ctx, unsigned long iters ) {
+	const HashCorpus* c = ctx;
+	while( iters-- ) {
+		osrfHashIterator* itr = osrfNewHashIterator( c->hash );
+		while( osrfHashIteratorNext( itr ) )
+			;
+		osrfHashIteratorFree( itr );
+	}
+}
+
+void osrfBenchHash( void ) {
+	static const int sizes[] = { 8, 64, 1024, 65536 };
+	int s;
+
+	for( s = 0; s < sizeof( sizes ) / sizeof( sizes[0] ); ++s ) {
+		HashCorpus c;
+		char name[ 32 ];
+		char buf[ 64 ];
+		int i;
+
+		c.size = sizes[ s ];
+		c.keys = safe_malloc( c.size * sizeof( char* ) );
+		c.missing = safe_malloc( c.size * sizeof( char* ) );
+		c.hash = osrfNewHash();
+		for( i = 0; i < c.size; ++i ) {
+			// Field-name-like keys, as in a JSON hash or a settings tree
+			snprintf( buf, sizeof( buf ), "open-ils.field_%d", i );
+			c.keys[ i ] = strdup( buf );
+			snprintf( buf, sizeof( buf ), "open-ils.other_%d", i );
+			c.missing[ i ] = strdup( buf );
+			osrfHashSet( c.hash, c.keys[ i ], c.keys[ i ] );
+		}
+
+		snprintf( name, sizeof( name ), "size_%d", c.size );
+		osrfBenchRun( "osrf_hash_get_hit", name, 0, bench_get_hit, &c );
+		osrfBenchRun( "osrf_hash_get_miss", name, 0, bench_get_miss, &c );
+		if( c.size <= 1024 ) {
+			osrfBenchRun( "osrf_hash_build", name, 0, bench_build, &c );
+			osrfBenchRun( "osrf_hash_iterate", name, 0, bench_iterate, &c );
+		}
+
+		osrfHashFree( c.hash );
+		for( i = 0; i < c.size; ++i ) {
+			free( c.keys[ i ] );
+			free( c.missing[ i ] );
+		}
+		free( c.keys );
+		free( c.missing );
+	}
+}
@@ -0,0 +1,104 @@
+/**
+	@file bench_json.c
+	@brief Benchmarks for parsing, serializing, cloning and searching jsonObjects.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <opensrf/osrf_json.h>
+#include "osrf_bench.h"
+
+/**
+	@brief A JSON payload, in both string and object form.
+*/
+typedef struct {
+	const char* name;
+	char* json;
+	size_t len;
+	jsonObject* obj;
+} JsonCorpus;
+
+static void bench_parse( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		jsonObjectFree( jsonParse( c->json ) );
+}
+
+static void bench_parse_raw( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		jsonObjectFree( jsonParseRaw( c->json ) );
+}
+
+static void bench_to_json( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		free( jsonObjectToJSON( c->obj ) );
+}
+
+static void bench_clone( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		jsonObjectFree( jsonObjectClone( c->obj ) );
+}
+
+static void bench_find_path_direct( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		jsonObjectFree( jsonObjectFindPath( c->obj, "/config/opensrf/loglevel" ) );
+}
+
+static void bench_find_path_anywhere( void* ctx, unsigned long iters ) {
+	const JsonCorpus* c = ctx;
+	while( iters-- )
+		jsonObjectFree( jsonObjectFindPath( c->obj, "//router/services/service" ) );
+}
+
+void osrfBenchJSON( void ) {
+	JsonCorpus corpora[] = {
+		{ "request",         osrfBenchRequestJSON(),        0, NULL },
+		{ "fieldmapper_10",  osrfBenchFieldmapperJSON( 10 ),  0, NULL },
+		{ "fieldmapper_500", osrfBenchFieldmapperJSON( 500 ), 0, NULL },
+		{ "config",          osrfBenchConfigJSON(),         0, NULL },
+	};
+	int ncorpora = sizeof( corpora ) / sizeof( corpora[0] );
+	int i;
+
+	for( i = 0; i < ncorpora; ++i ) {
+		corpora[ i ].len = strlen( corpora[ i ].json );
+		corpora[ i ].obj = jsonParse( corpora[ i ].json );
+	}
+
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "json_parse", corpora[ i ].name, corpora[ i ].len,
+			bench_parse, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "json_parse_raw", corpora[ i ].name, corpora[ i ].len,
+			bench_parse_raw, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "json_to_json", corpora[ i ].name, corpora[ i ].len,
+			bench_to_json, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "json_clone", corpora[ i ].name, corpora[ i ].len,
+			bench_clone, &corpora[ i ] );
+
+	osrfBenchRun( "json_find_path", "config_direct", 0,
+		bench_find_path_direct, &corpora[ 3 ] );
+	osrfBenchRun( "json_find_path", "config_anywhere", 0,
+		bench_find_path_anywhere, &corpora[ 3 ] );
+
+	for( i = 0; i < ncorpora; ++i ) {
+		jsonObjectFree( corpora[ i ].obj );
+		free( corpora[ i ].json );
+	}
+}
@@ -0,0 +1,223 @@
+/**
+	@file bench_message.c
+	@brief Benchmarks for the transport and application message layers.
+
+	These cover the work done for every message a client or server sends or receives:
+	wrapping an osrfMessage in a transport_message (message_prepare_xml), unwrapping it
+	(new_message_from_xml), and translating osrfMessages to and from JSON
+	(osrf_message_serialize, osrfMessageDeserialize).
+
+	For stream compression, stanza_deflate and stanza_inflate compress and decompress a
+	stanza the way a compressed transport_session does, with a sync flush, at zlib levels 1
+	(what the session uses) and 6 (zlib's default).  Each iteration starts from a reset
+	stream, so that a stanza can't refer back to its previous copy; a real stream carries
+	its history from one stanza to the next, and does at least as well.  The reset itself
+	takes several microseconds, which dominates the times for the smallest stanza.  The
+	compression ratio of each corpus goes to stderr.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <zlib.h>
+#include <opensrf/osrf_message.h>
+#include <opensrf/transport_message.h>
+#include "osrf_bench.h"
+
+#define BENCH_CLIENT "opensrf@public.localhost/_client_1700000000.123456_4321"
+#define BENCH_SERVER "opensrf@private.localhost/open-ils.actor_drone_at_localhost_1234"
+#define BENCH_ROUTER "router@private.localhost/router"
+
+/**
+	@brief One OpenSRF message, in every form the message layers deal with.
+*/
+typedef struct {
+	const char* name;
+	char* osrf_json;            /**< JSON array of osrfMessages. */
+	char* xml;                  /**< Complete transport-level stanza. */
+	osrfMessage* osrf_msg;      /**< The first osrfMessage, deserialized. */
+	transport_message* tmsg;    /**< Transport message with osrf_json as its body. */
+} MessageCorpus;
+
+static void bench_prepare_xml( void* ctx, unsigned long iters ) {
+	MessageCorpus* c = ctx;
+	while( iters-- ) {
+		free( c->tmsg->msg_xml );
+		c->tmsg->msg_xml = NULL;
+		message_prepare_xml( c->tmsg );
+	}
+}
+
+static void bench_from_xml( void* ctx, unsigned long iters ) {
+	const MessageCorpus* c = ctx;
+	while( iters-- )
+		message_free( new_message_from_xml( c->xml ) );
+}
+
+static void bench_deserialize( void* ctx, unsigned long iters ) {
+	const MessageCorpus* c = ctx;
+	osrfList* list = NULL;
+	while( iters-- )
+		list = osrfMessageDeserialize( c->osrf_json, list );
+	osrfListFree( list );
+}
+
+static void bench_serialize( void* ctx, unsigned long iters ) {
+	const MessageCorpus* c = ctx;
+	while( iters-- )
+		free( osrf_message_serialize( c->osrf_msg ) );
+}
+
+/**
+	@brief A stanza, compressed, and the streams to compress and decompress it.
+*/
+typedef struct {
+	const MessageCorpus* msg;
+	z_stream deflater;
+	z_stream inflater;
+	char* deflated;          /**< The stanza, compressed. */
+	size_t deflated_len;
+	size_t deflated_size;    /**< Capacity of deflated. */
+	char* inflated;          /**< The stanza, decompressed again. */
+} ZlibCorpus;
+
+static void bench_deflate( void* ctx, unsigned long iters ) {
+	ZlibCorpus* c = ctx;
+	while( iters-- ) {
+		deflateReset( &c->deflater );
+		c->deflater.next_in = (Bytef*) c->msg->xml;
+		c->deflater.avail_in = strlen( c->msg->xml );
+		c->deflater.next_out = (Bytef*) c->deflated;
+		c->deflater.avail_out = c->deflated_size;
+		deflate( &c->deflater, Z_SYNC_FLUSH );
+		c->deflated_len = c->deflated_size - c->deflater.avail_out;
+	}
+}
+
+static void bench_inflate( void* ctx, unsigned long iters ) {
+	ZlibCorpus* c = ctx;
+	size_t len = strlen( c->msg->xml );
+	while( iters-- ) {
+		inflateReset( &c->inflater );
+		c->inflater.next_in = (Bytef*) c->deflated;
+		c->inflater.avail_in = c->deflated_len;
+		c->inflater.next_out = (Bytef*) c->inflated;
+		c->inflater.avail_out = len;
+		inflate( &c->inflater, Z_SYNC_FLUSH );
+	}
+}
+
+/**
+	@brief Time compression of a stanza at a given level, and decompression of the result.
+*/
+static void bench_zlib( const MessageCorpus* msg, int level ) {
+	char name[ 64 ];
+	snprintf( name, sizeof( name ), "%s_level%d", msg->name, level );
+	if( !osrfBenchSelected( "stanza_deflate", name )
+			&& !osrfBenchSelected( "stanza_inflate", name ) )
+		return;
+
+	size_t len = strlen( msg->xml );
+	ZlibCorpus c;
+	memset( &c, 0, sizeof( c ) );
+	c.msg = msg;
+	deflateInit( &c.deflater, level );
+	inflateInit( &c.inflater );
+	c.deflated_size = deflateBound( &c.deflater, len ) + 16;
+	c.deflated = safe_malloc( c.deflated_size );
+	c.inflated = safe_malloc( len );
+
+	osrfBenchRun( "stanza_deflate", name, len, bench_deflate, &c );
+	bench_deflate( &c, 1 );
+	osrfBenchRun( "stanza_inflate", name, len, bench_inflate, &c );
+	if( memcmp( c.inflated, msg->xml, len ) )
+		fprintf( stderr, "stanza_inflate/%s: the stanza didn't survive\n", name );
+	fprintf( stderr, "stanza_deflate/%s: %lu bytes -> %lu (%.1f:1)\n", name,
+		(unsigned long) len, (unsigned long) c.deflated_len,
+		(double) len / c.deflated_len );
+
+	deflateEnd( &c.deflater );
+	inflateEnd( &c.inflater );
+	free( c.deflated );
+	free( c.inflated );
+}
+
+/**
+	@brief Fill in the derived forms of a message, given its JSON.
+*/
+static void corpus_init( MessageCorpus* c, const char* name, char* osrf_json ) {
+	c->name = name;
+	c->osrf_json = osrf_json;
+
+	osrfList* list = osrfMessageDeserialize( osrf_json, NULL );
+	c->osrf_msg = osrfListExtract( list, 0 );
+	osrfListFree( list );
+
+	c->tmsg = message_init( osrf_json, NULL, "1700000000.5861", BENCH_SERVER, BENCH_CLIENT );
+	message_set_osrf_xid( c->tmsg, "1700000000.58610000123" );
+	message_set_router_info( c->tmsg, BENCH_ROUTER, NULL, NULL, NULL, 0 );
+	message_prepare_xml( c->tmsg );
+	c->xml = strdup( c->tmsg->msg_xml );
+}
+
+static void corpus_free( MessageCorpus* c ) {
+	free( c->osrf_json );
+	free( c->xml );
+	osrfMessageFree( c->osrf_msg );
+	message_free( c->tmsg );
+}
+
+/**
+	@brief Build a RESULT message whose content is the given JSON.
+*/
+static char* result_json( char* content ) {
+	osrfMessage* msg = osrf_message_init( RESULT, 1, 1 );
+	osrf_message_set_status_info( msg, "osrfResult", "OK", OSRF_STATUS_OK );
+	osrf_message_set_result_content( msg, content );
+	char* json = osrf_message_serialize( msg );
+	osrfMessageFree( msg );
+	free( content );
+	return json;
+}
+
+void osrfBenchMessage( void ) {
+	MessageCorpus corpora[ 3 ];
+	int ncorpora = sizeof( corpora ) / sizeof( corpora[0] );
+	int i;
+
+	corpus_init( &corpora[ 0 ], "request", osrfBenchRequestJSON() );
+	corpus_init( &corpora[ 1 ], "result_fieldmapper_10",
+		result_json( osrfBenchFieldmapperJSON( 10 ) ) );
+	corpus_init( &corpora[ 2 ], "result_fieldmapper_500",
+		result_json( osrfBenchFieldmapperJSON( 500 ) ) );
+
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "message_prepare_xml", corpora[ i ].name, strlen( corpora[ i ].xml ),
+			bench_prepare_xml, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "new_message_from_xml", corpora[ i ].name, strlen( corpora[ i ].xml ),
+			bench_from_xml, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "osrfMessageDeserialize", corpora[ i ].name,
+			strlen( corpora[ i ].osrf_json ), bench_deserialize, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i )
+		osrfBenchRun( "osrf_message_serialize", corpora[ i ].name,
+			strlen( corpora[ i ].osrf_json ), bench_serialize, &corpora[ i ] );
+	for( i = 0; i < ncorpora; ++i ) {
+		bench_zlib( &corpora[ i ], 1 );
+		bench_zlib( &corpora[ i ], 6 );
+	}
+
+	for( i = 0; i < ncorpora; ++i )
+		corpus_free( &corpora[ i ] );
+}
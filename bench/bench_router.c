@@ -0,0 +1,324 @@
+/**
+	@file bench_router.c
+	@brief Benchmark for the router's main loop.
+
+	A child process runs an osrfRouter against a stand-in Jabber server in the parent.
+	The stand-in logs in every session that the router opens, registers one node for each
+	of a number of classes, and then sends requests to the classes in turn, as Jabber would
+	on behalf of clients.  Each iteration of router_route is one request routed: sent to a
+	class's session, and forwarded by the router to the class's node.  Up to ROUTE_WINDOW
+	requests are in flight at once, so ns_per_op is the reciprocal of the router's throughput.
+
+	Comparing classes_10 with classes_300 shows how the cost of routing a message depends
+	on the number of classes registered: both send requests to only ten of them.  The
+	classes_300_busy_* corpora send requests to 64 or to all 300 classes in turn, so that
+	each request in the window arrives on a different socket, and each socket's state is
+	colder; they show what the router pays per busy socket, rather than per class.  The
+	nodes_* corpora register several nodes, with load hints, for a single class, and
+	show what each routing policy costs to pick among them.  The workers_* corpora shard
+	the classes across that many worker processes; workers_0 routes in the one process, as
+	a router does by default.  Workers only pay off with CPUs to spare for them: on a host
+	with a single CPU, they add a hop and a context switch to every request, and are slower.
+	The body_* corpora route requests
+	with a large parameter, to show what the router spends on bodies that it never reads.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <sys/wait.h>
+#include <opensrf/utils.h>
+#include <opensrf/string_array.h>
+#include <opensrf/transport_message.h>
+#include "osrf_router.h"
+#include "osrf_bench.h"
+
+#define ROUTER_DOMAIN "localhost"
+/** @brief Greatest number of requests in flight at once. */
+#define ROUTE_WINDOW 64
+
+/** @brief One Jabber session of the router's, as seen by the stand-in server. */
+typedef struct {
+	int fd;
+	char* request;            /**< A request for this class, ready to send. */
+	unsigned long pending;    /**< Requests sent and not yet forwarded. */
+	int matched;              /**< How much of "</message>" we've seen, across reads. */
+} RouterSession;
+
+typedef struct {
+	int class_count;
+	int busy_count;           /**< How many of the classes we send requests to. */
+	RouterSession* classes;
+	unsigned long next;       /**< Index of the next class to send to. */
+	unsigned long in_flight;
+} RouterCorpus;
+
+/**
+	@brief Read until a buffer contains a marker.
+	@return 0 if it does, or -1 if the connection failed first.
+*/
+static int read_until( int fd, growing_buffer* got, const char* marker ) {
+	char buf[ 4096 ];
+	while( !strstr( OSRF_BUFFER_C_STR( got ), marker ) ) {
+		ssize_t n = read( fd, buf, sizeof( buf ) );
+		if( n <= 0 )
+			return -1;
+		buffer_add_n( got, buf, n );
+	}
+	return 0;
+}
+
+static int write_all( int fd, const char* data ) {
+	size_t len = strlen( data );
+	return write( fd, data, len ) == (ssize_t) len ? 0 : -1;
+}
+
+/**
+	@brief Accept a session from the router and log it in, whatever its credentials.
+	@return The file descriptor of the session, or -1 upon error.
+*/
+static int accept_session( int listener ) {
+	int fd = accept( listener, NULL, NULL );
+	if( fd < 0 )
+		return -1;
+
+	growing_buffer* got = buffer_init( 1024 );
+	int ok = read_until( fd, got, "streams'>" ) == 0
+		&& write_all( fd, "<stream:stream xmlns='jabber:client' "
+			"xmlns:stream='http://etherx.jabber.org/streams' id='bench'>" ) == 0;
+	buffer_reset( got );
+	ok = ok && read_until( fd, got, "</iq>" ) == 0
+		&& write_all( fd, "<iq type='result' id='123456789'/>" ) == 0;
+	buffer_free( got );
+
+	if( !ok ) {
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/**
+	@brief Read what the router has forwarded from a session, until it has forwarded all
+	the requests that we sent to it.
+	@return 0 if successful, or -1 if the connection failed.
+*/
+static int drain_session( RouterSession* s ) {
+	static const char marker[] = "</message>";
+	char buf[ 65536 ];
+	while( s->pending ) {
+		ssize_t n = read( s->fd, buf, sizeof( buf ) );
+		if( n <= 0 )
+			return -1;
+		ssize_t i;
+		for( i = 0; i < n; ++i ) {
+			// '<' occurs only at the start of the marker, so a mismatch can restart there
+			if( buf[ i ] == marker[ s->matched ] ) {
+				if( ++s->matched == sizeof( marker ) - 1 ) {
+					s->matched = 0;
+					s->pending--;
+				}
+			} else
+				s->matched = ( buf[ i ] == '<' ) ? 1 : 0;
+		}
+	}
+	return 0;
+}
+
+static int drain_all( RouterCorpus* c ) {
+	int i;
+	for( i = 0; i < c->busy_count; ++i )
+		if( drain_session( &c->classes[ i ] ) )
+			return -1;
+	c->in_flight = 0;
+	return 0;
+}
+
+static void bench_route( void* ctx, unsigned long iters ) {
+	RouterCorpus* c = ctx;
+	while( iters-- ) {
+		RouterSession* s = &c->classes[ c->next++ % c->busy_count ];
+		if( write_all( s->fd, s->request ) )
+			return;
+		s->pending++;
+		if( ++c->in_flight == ROUTE_WINDOW && drain_all( c ) )
+			return;
+	}
+	drain_all( c );
+}
+
+/** @brief The router in the child process, for the signal handler. */
+static osrfRouter* child_router;
+
+static void stop_router( int signo ) {
+	router_stop( child_router );
+}
+
+/**
+	@brief In a child process: run a router against the stand-in server, until told to stop.
+*/
+static void run_router( int port, const char* policy, int workers ) {
+	osrfStringArray* clients = osrfNewStringArray( 1 );
+	osrfStringArray* servers = osrfNewStringArray( 1 );
+	osrfStringArrayAdd( clients, ROUTER_DOMAIN );
+	osrfStringArrayAdd( servers, ROUTER_DOMAIN );
+
+	osrfRouter* router = osrfNewRouter( ROUTER_DOMAIN, "router", "router", "password",
+		port, clients, servers );
+	if( !router || osrfRouterSetPolicy( router, policy ) || osrfRouterConnect( router ) )
+		_exit( 1 );
+	osrfRouterSetWorkers( router, workers );
+
+	// Stopping gracefully, the router waits for its workers to stop too
+	child_router = router;
+	signal( SIGTERM, stop_router );
+	osrfRouterRun( router );
+	_exit( 0 );
+}
+
+/**
+	@brief Register a node for a class with the router, with some load hints.
+	@return 0 if successful, or -1 upon error.
+*/
+static int register_node( int router_fd, int class_index, int node_index ) {
+	char classname[ 32 ];
+	char node[ 64 ];
+	char hints[ 64 ];
+	snprintf( classname, sizeof( classname ), "open-ils.bench%d", class_index );
+	snprintf( node, sizeof( node ), "drone%d.%d@%s/node", class_index, node_index,
+		ROUTER_DOMAIN );
+	snprintf( hints, sizeof( hints ), "{\"capacity\":10,\"load\":%d}", node_index );
+
+	transport_message* msg = message_init( hints, NULL, "register", "router@"
+		ROUTER_DOMAIN "/router", node );
+	message_set_router_info( msg, NULL, NULL, classname, "register", 0 );
+	message_prepare_xml( msg );
+	int ret = write_all( router_fd, msg->msg_xml );
+	message_free( msg );
+	return ret;
+}
+
+/**
+	@brief Register a class with the router, and log in the session it opens for it.
+	@return The file descriptor of the class's session, or -1 upon error.
+*/
+static int register_class( int listener, int router_fd, int index, int node_count ) {
+	if( register_node( router_fd, index, 0 ) )
+		return -1;
+	int fd = accept_session( listener );
+
+	int i;
+	for( i = 1; fd >= 0 && i < node_count; ++i ) {
+		if( register_node( router_fd, index, i ) ) {
+			close( fd );
+			return -1;
+		}
+	}
+	return fd;
+}
+
+static void route_corpus( const char* name, int class_count, int busy_count,
+		int node_count, const char* policy, int workers, size_t body_bytes ) {
+	if( !osrfBenchSelected( "router_route", name ) )
+		return;
+
+	int listener = socket( AF_INET, SOCK_STREAM, 0 );
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof( addr );
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if( listener < 0 || bind( listener, (struct sockaddr*) &addr, sizeof( addr ) ) < 0
+			|| listen( listener, 16 ) < 0
+			|| getsockname( listener, (struct sockaddr*) &addr, &addr_len ) < 0 ) {
+		fprintf( stderr, "router_route/%s: unable to listen: %s\n", name, strerror( errno ) );
+		if( listener >= 0 )
+			close( listener );
+		return;
+	}
+
+	fflush( stdout );
+	pid_t pid = fork();
+	if( 0 == pid ) {
+		close( listener );
+		run_router( ntohs( addr.sin_port ), policy, workers );
+	}
+
+	RouterCorpus c;
+	c.class_count = 0;
+	c.busy_count = busy_count;
+	c.classes = safe_malloc( class_count * sizeof( RouterSession ) );
+	c.next = 0;
+	c.in_flight = 0;
+
+	// Padding for a large body: an extra string parameter that needs no escaping
+	char* padding = safe_malloc( body_bytes + 4 );
+	if( body_bytes ) {
+		padding[ 0 ] = ',';
+		padding[ 1 ] = '"';
+		memset( padding + 2, 'x', body_bytes );
+		padding[ body_bytes + 2 ] = '"';
+	}
+
+	int router_fd = accept_session( listener );
+	while( router_fd >= 0 && c.class_count < class_count ) {
+		RouterSession* s = &c.classes[ c.class_count ];
+		s->fd = register_class( listener, router_fd, c.class_count, node_count );
+		if( s->fd < 0 )
+			break;
+		s->request = va_list_to_string( "<message from='client@%s/bench' "
+			"to='router@%s/open-ils.bench%d'><thread>bench</thread>"
+			"<body>[{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"1\",\"type\":\"REQUEST\","
+			"\"payload\":{\"__c\":\"osrfMethod\",\"__p\":{\"method\":\"open-ils.bench.echo\","
+			"\"params\":[1,2,3%s]}}}}]</body></message>",
+			ROUTER_DOMAIN, ROUTER_DOMAIN, c.class_count, padding );
+		s->pending = 0;
+		s->matched = 0;
+		c.class_count++;
+	}
+
+	if( c.class_count == class_count )
+		osrfBenchRun( "router_route", name, body_bytes, bench_route, &c );
+	else
+		fprintf( stderr, "router_route/%s: unable to register %d classes\n",
+			name, class_count );
+
+	kill( pid, SIGTERM );
+	waitpid( pid, NULL, 0 );
+	int i;
+	for( i = 0; i < c.class_count; ++i ) {
+		close( c.classes[ i ].fd );
+		free( c.classes[ i ].request );
+	}
+	free( c.classes );
+	free( padding );
+	if( router_fd >= 0 )
+		close( router_fd );
+	close( listener );
+}
+
+void osrfBenchRouter( void ) {
+	route_corpus( "classes_10", 10, 10, 1, "round_robin", 0, 0 );
+	route_corpus( "classes_300", 300, 10, 1, "round_robin", 0, 0 );
+	route_corpus( "classes_300_busy_64", 300, 64, 1, "round_robin", 0, 0 );
+	route_corpus( "classes_300_busy_300", 300, 300, 1, "round_robin", 0, 0 );
+	route_corpus( "nodes_8_round_robin", 1, 1, 8, "round_robin", 0, 0 );
+	route_corpus( "nodes_8_least_loaded", 1, 1, 8, "least_loaded", 0, 0 );
+	route_corpus( "nodes_8_two_choices", 1, 1, 8, "two_choices", 0, 0 );
+	route_corpus( "workers_0", 64, 64, 1, "round_robin", 0, 0 );
+	route_corpus( "workers_2", 64, 64, 1, "round_robin", 2, 0 );
+	route_corpus( "workers_4", 64, 64, 1, "round_robin", 4, 0 );
+	route_corpus( "body_64k", 10, 10, 1, "round_robin", 0, 65536 );
+}
@@ -0,0 +1,273 @@
+/**
+	@file bench_socket.c
+	@brief Benchmarks for the socket_manager event loop.
+
+	For socket_wait_all, a socket_manager accepts a number of idle connections and 100
+	active ones over a UNIX domain socket.  Each iteration writes a byte to one of the active
+	connections and calls socket_wait_all() until the data callback fires, so ns_per_op is
+	the latency of a wakeup.  Comparing the corpora with and without idle connections shows
+	how that latency depends on the number of sockets managed.
+
+	For socket_receive, a child process writes a 5 MB response whenever asked, and each
+	iteration reads the whole response through the socket_manager.
+
+	For socket_send, each iteration sends one small message to a child process that reads
+	and discards everything, either with socket_send() (one system call per message) or
+	corked with socket_send_corked() (one per SOCKET_CORK_SIZE bytes, plus a flush at the
+	end of each batch of iterations).
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <opensrf/socket_bundle.h>
+#include "osrf_bench.h"
+
+/** @brief Number of connections that carry traffic. */
+#define ACTIVE_SOCKETS 100
+/** @brief Number of connections that sit idle, in the larger corpus. */
+#define IDLE_SOCKETS 5000
+/** @brief Size of the response read by each iteration of socket_receive. */
+#define RESPONSE_SIZE ( 5 * 1024 * 1024 )
+/** @brief Size of the message sent by each iteration of socket_send. */
+#define MESSAGE_SIZE 256
+
+typedef struct {
+	socket_manager* mgr;
+	int* clients;          /**< Client ends of the connections; the active ones first. */
+	int count;             /**< Number of connections. */
+	unsigned long received;
+	int server;            /**< Server end of the most recent connection to send data. */
+} SocketCorpus;
+
+static void data_received( void* blob, socket_manager* mgr, int sock_fd, char* data,
+		size_t len, int parent_id ) {
+	SocketCorpus* c = blob;
+	c->received += len;
+	c->server = sock_fd;
+}
+
+static void bench_wakeup( void* ctx, unsigned long iters ) {
+	SocketCorpus* c = ctx;
+	unsigned long i;
+	for( i = 0; i < iters; ++i ) {
+		unsigned long expected = c->received + 1;
+		if( send( c->clients[ i % ACTIVE_SOCKETS ], "x", 1, 0 ) != 1 )
+			return;
+		while( c->received < expected )
+			socket_wait_all( c->mgr, -1 );
+	}
+}
+
+static void bench_receive( void* ctx, unsigned long iters ) {
+	SocketCorpus* c = ctx;
+	while( iters-- ) {
+		unsigned long expected = c->received + RESPONSE_SIZE;
+		if( socket_send( c->server, "g" ) )
+			return;
+		while( c->received < expected )
+			socket_wait_all( c->mgr, -1 );
+	}
+}
+
+static void bench_send( void* ctx, unsigned long iters ) {
+	SocketCorpus* c = ctx;
+	char message[ MESSAGE_SIZE + 1 ];
+	memset( message, 'x', MESSAGE_SIZE );
+	message[ MESSAGE_SIZE ] = '\0';
+	while( iters-- ) {
+		if( socket_send( c->server, message ) )
+			return;
+	}
+}
+
+static void bench_send_corked( void* ctx, unsigned long iters ) {
+	SocketCorpus* c = ctx;
+	char message[ MESSAGE_SIZE ];
+	memset( message, 'x', MESSAGE_SIZE );
+	while( iters-- ) {
+		if( socket_send_corked( c->mgr, c->server, message, MESSAGE_SIZE ) < 0 )
+			return;
+	}
+	socket_flush( c->mgr, c->server, -1 );
+}
+
+/**
+	@brief In a child process: read and discard everything from a socket, until EOF.
+*/
+static void discard_input( int fd ) {
+	char buf[ 65536 ];
+	while( read( fd, buf, sizeof( buf ) ) > 0 )
+		;
+	_exit( 0 );
+}
+
+/**
+	@brief In a child process: write a response to a socket whenever asked, until EOF.
+*/
+static void serve_responses( int fd ) {
+	char* response = safe_malloc( RESPONSE_SIZE );
+	memset( response, 'x', RESPONSE_SIZE );
+	char request;
+	while( read( fd, &request, 1 ) == 1 ) {
+		size_t sent = 0;
+		while( sent < RESPONSE_SIZE ) {
+			ssize_t n = write( fd, response + sent, RESPONSE_SIZE - sent );
+			if( n <= 0 )
+				_exit( 1 );
+			sent += n;
+		}
+	}
+	_exit( 0 );
+}
+
+/**
+	@brief Connect a number of clients to a socket_manager's listener.
+	@return 0 if successful, or -1 if we ran out of file descriptors or something.
+*/
+static int corpus_init( SocketCorpus* c, const char* path, int count ) {
+	c->mgr = safe_malloc( sizeof( socket_manager ) );
+	c->mgr->data_received = data_received;
+	c->mgr->blob = c;
+	c->clients = safe_malloc( count * sizeof( int ) );
+	c->count = 0;
+	c->received = 0;
+
+	unlink( path );
+	if( socket_open_unix_server( c->mgr, path ) < 0 )
+		return -1;
+
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+
+	while( c->count < count ) {
+		int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+		if( fd < 0 )
+			return -1;
+		if( connect( fd, (struct sockaddr*) &addr, sizeof( addr ) ) < 0 ) {
+			close( fd );
+			return -1;
+		}
+		c->clients[ c->count++ ] = fd;
+		socket_wait_all( c->mgr, 1 );    // accept it
+	}
+	return 0;
+}
+
+static void corpus_free( SocketCorpus* c, const char* path ) {
+	int i;
+	for( i = 0; i < c->count; ++i )
+		close( c->clients[ i ] );
+	free( c->clients );
+	socket_manager_free( c->mgr );
+	unlink( path );
+}
+
+/**
+	@brief Raise the limit on open files as far as we're allowed, for the idle sockets.
+*/
+static void raise_fd_limit( void ) {
+	struct rlimit rl;
+	if( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur < rl.rlim_max ) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit( RLIMIT_NOFILE, &rl );
+	}
+}
+
+void osrfBenchSocket( void ) {
+	static const int idle[] = { 0, IDLE_SOCKETS };
+	int i;
+
+	raise_fd_limit();
+
+	for( i = 0; i < sizeof( idle ) / sizeof( idle[0] ); ++i ) {
+		SocketCorpus c;
+		char name[ 64 ];
+		char path[ 64 ];
+
+		snprintf( name, sizeof( name ), "idle_%d_active_%d", idle[ i ], ACTIVE_SOCKETS );
+		if( !osrfBenchSelected( "socket_wait_all", name ) )
+			continue;
+
+		snprintf( path, sizeof( path ), "/tmp/osrf_bench_%ld.sock", (long) getpid() );
+		if( corpus_init( &c, path, ACTIVE_SOCKETS + idle[ i ] ) == 0 )
+			osrfBenchRun( "socket_wait_all", name, 0, bench_wakeup, &c );
+		else
+			fprintf( stderr, "socket_wait_all/%s: unable to open %d connections: %s\n",
+				name, ACTIVE_SOCKETS + idle[ i ], strerror( errno ) );
+		corpus_free( &c, path );
+	}
+
+	if( osrfBenchSelected( "socket_receive", "5mb" ) ) {
+		SocketCorpus c;
+		char path[ 64 ];
+		snprintf( path, sizeof( path ), "/tmp/osrf_bench_%ld.sock", (long) getpid() );
+		if( corpus_init( &c, path, 1 ) == 0 ) {
+			fflush( stdout );
+			pid_t pid = fork();
+			if( 0 == pid ) {
+				socket_manager_free( c.mgr );    // lest we hold the server end open
+				serve_responses( c.clients[ 0 ] );
+			}
+
+			// Say hello, so that we know the server end of the connection
+			send( c.clients[ 0 ], "h", 1, 0 );
+			while( c.received < 1 )
+				socket_wait_all( c.mgr, -1 );
+			close( c.clients[ 0 ] );
+			c.count = 0;
+
+			if( pid > 0 ) {
+				osrfBenchRun( "socket_receive", "5mb", RESPONSE_SIZE, bench_receive, &c );
+				socket_disconnect( c.mgr, c.server );
+				waitpid( pid, NULL, 0 );
+			}
+		}
+		corpus_free( &c, path );
+	}
+
+	if( osrfBenchSelected( "socket_send", "256b" )
+			|| osrfBenchSelected( "socket_send_corked", "256b" ) ) {
+		SocketCorpus c;
+		char path[ 64 ];
+		snprintf( path, sizeof( path ), "/tmp/osrf_bench_%ld.sock", (long) getpid() );
+		if( corpus_init( &c, path, 1 ) == 0 ) {
+			// Say hello, so that we know the server end of the connection
+			send( c.clients[ 0 ], "h", 1, 0 );
+			while( c.received < 1 )
+				socket_wait_all( c.mgr, -1 );
+
+			fflush( stdout );
+			pid_t pid = fork();
+			if( 0 == pid ) {
+				socket_manager_free( c.mgr );    // lest we hold the server end open
+				discard_input( c.clients[ 0 ] );
+			}
+			close( c.clients[ 0 ] );
+			c.count = 0;
+
+			if( pid > 0 ) {
+				osrfBenchRun( "socket_send", "256b", MESSAGE_SIZE, bench_send, &c );
+				osrfBenchRun( "socket_send_corked", "256b", MESSAGE_SIZE, bench_send_corked, &c );
+				socket_disconnect( c.mgr, c.server );
+				waitpid( pid, NULL, 0 );
+			}
+		}
+		corpus_free( &c, path );
+	}
+}
@@ -0,0 +1,262 @@
+/**
+	@file bench_transport.c
+	@brief Benchmarks for the brokerless local transport.
+
+	Each iteration of transport_local_rtt sends a request message to an echo process and
+	waits for the reply, so ns_per_op is a round trip.  For the "direct" corpus the two
+	processes talk over transport_local sockets.  For the "relayed" corpus every frame
+	passes through a third process that forwards bytes between sockets and does nothing
+	else, the way a message through Jabber passes through the Jabber server.  The relay
+	parses nothing, so the difference between the two is a lower bound on what a broker
+	costs.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <opensrf/transport_local.h>
+#include "osrf_bench.h"
+
+#define CLIENT_JID "client@localhost/bench"
+#define ECHO_JID "echo@localhost/bench"
+/* The relay listens on behalf of these, and forwards to the real ones */
+#define RELAY_CLIENT_JID "relay-client@localhost/bench"
+#define RELAY_ECHO_JID "relay-echo@localhost/bench"
+
+/** @brief Largest number of connections that the relay forwards at once. */
+#define RELAY_MAX_PAIRS 16
+
+typedef struct {
+	transport_local* local;
+	const char* recipient;     /**< Where requests go. */
+	const char* sender;        /**< Where replies are to come back. */
+	char* body;
+	unsigned long replies;
+} TransportCorpus;
+
+static char* socket_path( const char* dir, const char* jid ) {
+	char* hash = md5sum( jid );
+	char* path = va_list_to_string( "%s/%s.sock", dir, hash );
+	free( hash );
+	return path;
+}
+
+static void reply_received( void* blob, transport_message* msg ) {
+	TransportCorpus* c = blob;
+	c->replies++;
+	message_free( msg );
+}
+
+static void bench_rtt( void* ctx, unsigned long iters ) {
+	TransportCorpus* c = ctx;
+	while( iters-- ) {
+		unsigned long expected = c->replies + 1;
+		transport_message* msg = message_init( c->body, NULL, "bench-thread",
+			c->recipient, c->sender );
+		int rc = local_send_msg( c->local, msg );
+		message_free( msg );
+		if( rc )
+			return;
+		while( c->replies < expected )
+			socket_wait_all( c->local->sock_mgr, -1 );
+	}
+}
+
+/** @brief The echo process's own transport, for its callback. */
+static transport_local* echo_local;
+
+static void echo_message( void* blob, transport_message* msg ) {
+	transport_message* reply = message_init( msg->body, NULL, msg->thread,
+		msg->sender, msg->recipient );
+	local_send_msg( echo_local, reply );
+	message_free( reply );
+	message_free( msg );
+}
+
+/**
+	@brief In a child process: send every message back where it came from, until killed.
+*/
+static void serve_echo( const char* dir ) {
+	socket_manager* mgr = safe_malloc( sizeof( socket_manager ) );
+	echo_local = local_init( mgr, dir, ECHO_JID, NULL, echo_message );
+	if( !echo_local )
+		_exit( 1 );
+	for( ;; )
+		socket_wait_all( mgr, -1 );
+}
+
+static int relay_listen( const char* dir, const char* jid ) {
+	struct sockaddr_un addr;
+	char* path = socket_path( dir, jid );
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+	free( path );
+
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 || bind( fd, (struct sockaddr*) &addr, sizeof( addr ) ) < 0
+			|| listen( fd, 8 ) < 0 )
+		_exit( 1 );
+	return fd;
+}
+
+static int relay_connect( const char* dir, const char* jid ) {
+	struct sockaddr_un addr;
+	char* path = socket_path( dir, jid );
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+	free( path );
+
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 || connect( fd, (struct sockaddr*) &addr, sizeof( addr ) ) < 0 )
+		_exit( 1 );
+	return fd;
+}
+
+/**
+	@brief In a child process: forward each connection to a relay socket on to the real
+	one, and bytes in both directions, until killed.
+*/
+static void serve_relay( const char* dir ) {
+	static const char* const targets[] = { ECHO_JID, CLIENT_JID };
+	struct pollfd fds[ 2 + 2 * RELAY_MAX_PAIRS ];
+	int nfds = 2;
+	char buf[ 65536 ];
+
+	fds[ 0 ].fd = relay_listen( dir, RELAY_ECHO_JID );
+	fds[ 1 ].fd = relay_listen( dir, RELAY_CLIENT_JID );
+
+	for( ;; ) {
+		int i;
+		for( i = 0; i < nfds; ++i )
+			fds[ i ].events = POLLIN;
+		if( poll( fds, nfds, -1 ) < 0 )
+			_exit( 1 );
+
+		for( i = 0; i < 2; ++i ) {
+			if( ( fds[ i ].revents & POLLIN ) && nfds < 2 + 2 * RELAY_MAX_PAIRS ) {
+				fds[ nfds++ ].fd = accept( fds[ i ].fd, NULL, NULL );
+				fds[ nfds++ ].fd = relay_connect( dir, targets[ i ] );
+			}
+		}
+
+		// Connections come in pairs, so each one's partner is its neighbor
+		for( i = 2; i < nfds; ++i ) {
+			if( fds[ i ].revents & ( POLLIN | POLLHUP ) ) {
+				ssize_t n = read( fds[ i ].fd, buf, sizeof( buf ) );
+				if( n <= 0 )
+					_exit( 0 );
+				if( write( fds[ i ^ 1 ].fd, buf, n ) != n )
+					_exit( 1 );
+			}
+		}
+	}
+}
+
+/**
+	@brief Wait until a child process has opened its socket.
+	@return 0 if it has, or -1 if it seems to have died trying.
+*/
+static int await_socket( const char* dir, const char* jid ) {
+	char* path = socket_path( dir, jid );
+	struct stat st;
+	int tries = 0;
+	while( stat( path, &st ) != 0 && ++tries < 1000 )
+		usleep( 1000 );
+	free( path );
+	return tries < 1000 ? 0 : -1;
+}
+
+static void remove_dir( const char* dir ) {
+	DIR* d = opendir( dir );
+	if( d ) {
+		struct dirent* entry;
+		while( ( entry = readdir( d ) ) ) {
+			if( entry->d_name[ 0 ] != '.' ) {
+				char* path = va_list_to_string( "%s/%s", dir, entry->d_name );
+				unlink( path );
+				free( path );
+			}
+		}
+		closedir( d );
+	}
+	rmdir( dir );
+}
+
+static pid_t spawn( void (*serve) ( const char* ), const char* dir ) {
+	fflush( stdout );
+	pid_t pid = fork();
+	if( 0 == pid )
+		serve( dir );
+	return pid;
+}
+
+static void stop( pid_t pid ) {
+	if( pid > 0 ) {
+		kill( pid, SIGTERM );
+		waitpid( pid, NULL, 0 );
+	}
+}
+
+void osrfBenchTransport( void ) {
+	int direct = osrfBenchSelected( "transport_local_rtt", "direct" );
+	int relayed = osrfBenchSelected( "transport_local_rtt", "relayed" );
+	if( !( direct || relayed ) )
+		return;
+
+	char dir[] = "/tmp/osrf_bench_XXXXXX";
+	if( !mkdtemp( dir ) ) {
+		fprintf( stderr, "transport_local_rtt: unable to make a directory: %s\n",
+			strerror( errno ) );
+		return;
+	}
+
+	TransportCorpus c;
+	c.body = osrfBenchRequestJSON();
+	c.replies = 0;
+	socket_manager* mgr = safe_malloc( sizeof( socket_manager ) );
+	c.local = local_init( mgr, dir, CLIENT_JID, &c, reply_received );
+
+	pid_t echo_pid = spawn( serve_echo, dir );
+	pid_t relay_pid = -1;
+	if( relayed )
+		relay_pid = spawn( serve_relay, dir );
+
+	if( c.local && echo_pid > 0 && await_socket( dir, ECHO_JID ) == 0 ) {
+		size_t bytes = strlen( c.body );
+
+		c.recipient = ECHO_JID;
+		c.sender = CLIENT_JID;
+		osrfBenchRun( "transport_local_rtt", "direct", bytes, bench_rtt, &c );
+
+		if( relay_pid > 0 && await_socket( dir, RELAY_CLIENT_JID ) == 0 ) {
+			c.recipient = RELAY_ECHO_JID;
+			c.sender = RELAY_CLIENT_JID;
+			osrfBenchRun( "transport_local_rtt", "relayed", bytes, bench_rtt, &c );
+		}
+	} else
+		fprintf( stderr, "transport_local_rtt: unable to start the echo process\n" );
+
+	stop( relay_pid );
+	stop( echo_pid );
+	local_free( c.local );
+	socket_manager_free( mgr );
+	free( c.body );
+	remove_dir( dir );
+}
@@ -0,0 +1,125 @@
+/**
+	@file corpus.c
+	@brief Representative payloads for the libopensrf microbenchmarks.
+
+	The payloads are generated rather than read from files, so that the benchmarks can
+	run from any directory, and so that their sizes can be varied.  They are modeled on
+	real OpenSRF traffic:
+
+	- a single REQUEST message, as a client sends it;
+	- an array of fieldmapper objects (class-hinted arrays), as a search or retrieve
+	  method returns them;
+	- MARC-like text with multi-byte UTF-8 and characters that JSON must escape;
+	- a configuration tree like opensrf_core.xml, as osrfConfig stores it.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <opensrf/utils.h>
+#include "osrf_bench.h"
+
+/**
+	@brief Return a single REQUEST message, as serialized by osrf_message_serialize().
+*/
+char* osrfBenchRequestJSON( void ) {
+	return strdup(
+		"[{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"1\",\"locale\":\"en-US\","
+		"\"tz\":\"America/New_York\",\"ingress\":\"opensrf\",\"type\":\"REQUEST\","
+		"\"payload\":{\"__c\":\"osrfMethod\",\"__p\":{\"method\":"
+		"\"open-ils.actor.user.fleshed.retrieve\",\"params\":["
+		"\"6f1c3a2be4d8a7c05f9e1b2d3c4a5f60\",1234567,[\"card\",\"cards\","
+		"\"standing_penalties\",\"addresses\",\"billing_address\",\"mailing_address\","
+		"\"stat_cat_entries\",\"settings\"]]}}}}]" );
+}
+
+/**
+	@brief Return an array of fieldmapper objects, modeled on actor.usr ("au").
+	@param count How many objects to generate.
+
+	Each object has 40 fields of mixed types, including a nested "ac" (card) object, a
+	timestamp, nulls, and strings with characters that need escaping.
+*/
+char* osrfBenchFieldmapperJSON( int count ) {
+	growing_buffer* buf = buffer_init( 1024 );
+	int i, j;
+
+	OSRF_BUFFER_ADD_CHAR( buf, '[' );
+	for( i = 0; i < count; ++i ) {
+		if( i )
+			OSRF_BUFFER_ADD_CHAR( buf, ',' );
+		buffer_fadd( buf,
+			"{\"__c\":\"au\",\"__p\":[[],null,\"t\",\"f\",%d,"
+			"\"%d Main St. \\\"Apt %d\\\"\",\"2019-0%d-1%dT10:3%d:00-0400\","
+			"{\"__c\":\"ac\",\"__p\":[\"t\",\"2990%08d\",%d,%d]},"
+			"\"patron%d@example.org\",\"Jos\\u00e9\",\"M\\u00fcller-%d\",\"\",null,"
+			"\"1%02d\",\"555-01%02d\"",
+			1000000 + i, i, i % 40, 1 + i % 9, i % 10, i % 10,
+			i, 2000 + i, 1000000 + i, i, i, i % 100, i % 100 );
+		for( j = 0; j < 25; ++j )
+			buffer_fadd( buf, ",%s", ( j % 3 == 0 ) ? "null" :
+				( j % 3 == 1 ) ? "\"f\"" : "\"42\"" );
+		OSRF_BUFFER_ADD( buf, "]}" );
+	}
+	OSRF_BUFFER_ADD_CHAR( buf, ']' );
+
+	return buffer_release( buf );
+}
+
+/**
+	@brief Return MARC-like text with multi-byte UTF-8, quotes, and control characters.
+*/
+char* osrfBenchMarcText( void ) {
+	static const char* fields[] = {
+		"=245  10$aLes mis\xC3\xA9rables /$cVictor Hugo ; traduit par \"Ren\xC3\xA9\" D\xC3\xBCrr.\n",
+		"=100  1\\$aHugo, Victor,$d1802-1885.\n",
+		"=260  \\\\$aParis :$bGallimard,$c\xC2\xA9""1995.\n",
+		"=500  \\\\$a\xE4\xB8\xAD\xE6\x96\x87\xE6\xA0\x87\xE9\xA2\x98 (Chinese title)\t\xE2\x80\x94 tab-separated.\n",
+		"=650  \\0$aFrance$xHistory$y19th century$vFiction.\n",
+		"=520  \\\\$aA story of redemption, set in \xC2\xAB""post-Napoleonic\xC2\xBB France.\n",
+	};
+	growing_buffer* buf = buffer_init( 4096 );
+	int i;
+	for( i = 0; i < 48; ++i )
+		OSRF_BUFFER_ADD( buf, fields[ i % ( sizeof( fields ) / sizeof( fields[0] ) ) ] );
+	return buffer_release( buf );
+}
+
+/**
+	@brief Return a configuration tree like the one osrfConfig builds from opensrf_core.xml.
+*/
+char* osrfBenchConfigJSON( void ) {
+	growing_buffer* buf = buffer_init( 4096 );
+	int i, j;
+
+	OSRF_BUFFER_ADD( buf, "{\"config\":{\"opensrf\":{\"routers\":{\"router\":[" );
+	for( i = 0; i < 4; ++i ) {
+		if( i )
+			OSRF_BUFFER_ADD_CHAR( buf, ',' );
+		buffer_fadd( buf, "{\"name\":\"router\",\"domain\":\"%s.localhost\","
+			"\"services\":{\"service\":[", i % 2 ? "public" : "private" );
+		for( j = 0; j < 20; ++j )
+			buffer_fadd( buf, "%s\"open-ils.service%d\"", j ? "," : "", j );
+		OSRF_BUFFER_ADD( buf, "]}}" );
+	}
+	OSRF_BUFFER_ADD( buf, "]},\"domain\":\"private.localhost\",\"username\":\"opensrf\","
+		"\"passwd\":\"password\",\"port\":\"5222\",\"logfile\":\"/openils/var/log/osrfsys.log\","
+		"\"loglevel\":\"3\",\"log_protect\":{\"match_string\":[\"open-ils.auth.authenticate\","
+		"\"open-ils.actor.patron.password\"]}},"
+		"\"gateway\":{\"client\":\"true\",\"router_name\":\"router\","
+		"\"domain\":\"public.localhost\",\"logfile\":\"/openils/var/log/gateway.log\"},"
+		"\"router\":{\"trusted_domains\":{\"server\":\"private.localhost\","
+		"\"client\":[\"private.localhost\",\"public.localhost\"]},"
+		"\"transport\":{\"server\":\"private.localhost\",\"port\":\"5222\"}}}}" );
+
+	return buffer_release( buf );
+}
@@ -0,0 +1,216 @@
+/**
+	@file osrf_bench.c
+	@brief Harness and entry point for the libopensrf microbenchmarks.
+
+	Usage: osrf_bench [-t seconds] [filter ...]
+
+	With no filters, run every benchmark.  Otherwise run only the benchmarks whose
+	"name/corpus" label contains at least one of the filters.  The -t option sets the
+	approximate time spent on each benchmark (default 0.5 seconds).
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <opensrf/log.h>
+#include "osrf_bench.h"
+
+/** @brief Target duration of one timed batch, in nanoseconds. */
+#define BENCH_BATCH_NS 2e5
+/** @brief Fewest batches to time, however long they take. */
+#define BENCH_MIN_SAMPLES 10
+/** @brief Most batches to time. */
+#define BENCH_MAX_SAMPLES 1000
+
+static double bench_seconds = 0.5;   /**< Time budget per benchmark. */
+static char** bench_filters = NULL;  /**< Substrings selecting benchmarks to run. */
+static int bench_filter_count = 0;   /**< Number of filters. */
+
+/*
+	Count allocations by interposing on the allocator.  glibc allows an application to
+	replace malloc() and friends, and routes its own internal allocations through the
+	replacements; we just count the calls and pass them on to glibc's implementation.
+*/
+#ifdef __GLIBC__
+
+extern void* __libc_malloc( size_t size );
+extern void* __libc_calloc( size_t n, size_t size );
+extern void* __libc_realloc( void* ptr, size_t size );
+extern void __libc_free( void* ptr );
+
+static unsigned long alloc_count = 0;
+
+void* malloc( size_t size ) {
+	++alloc_count;
+	return __libc_malloc( size );
+}
+
+void* calloc( size_t n, size_t size ) {
+	++alloc_count;
+	return __libc_calloc( n, size );
+}
+
+void* realloc( void* ptr, size_t size ) {
+	++alloc_count;
+	return __libc_realloc( ptr, size );
+}
+
+void free( void* ptr ) {
+	__libc_free( ptr );
+}
+
+#define ALLOC_COUNT() ((double) alloc_count)
+#else
+#define ALLOC_COUNT() (-1.0)
+#endif
+
+/**
+	@brief Return a monotonic timestamp in nanoseconds.
+*/
+static double now_ns( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_doubles( const void* a, const void* b ) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return ( x > y ) - ( x < y );
+}
+
+/**
+	@brief Return a percentile of a sorted array, by the nearest-rank method.
+*/
+static double percentile( const double* sorted, int n, double pct ) {
+	int rank = (int) ( pct / 100.0 * n + 0.999999 );
+	if( rank < 1 )
+		rank = 1;
+	if( rank > n )
+		rank = n;
+	return sorted[ rank - 1 ];
+}
+
+/**
+	@brief Decide whether a benchmark is selected by the command-line filters.
+	@param name Name of the operation.
+	@param corpus Name of the payload.
+	@return 1 if the benchmark should run, or 0 if not.
+
+	Benchmark groups with expensive setup may call this first, to skip the setup when none
+	of their benchmarks would run.
+*/
+int osrfBenchSelected( const char* name, const char* corpus ) {
+	if( 0 == bench_filter_count )
+		return 1;
+
+	char label[ 256 ];
+	snprintf( label, sizeof( label ), "%s/%s", name, corpus );
+	int i;
+	for( i = 0; i < bench_filter_count; ++i ) {
+		if( strstr( label, bench_filters[ i ] ) )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+	@brief Time a benchmark and print a line of JSON describing the results.
+	@param name Name of the operation, e.g. "json_parse".
+	@param corpus Name of the payload used, e.g. "fieldmapper_500".
+	@param bytes_per_op Bytes processed per iteration, for computing throughput; or 0.
+	@param func The benchmark body.
+	@param ctx Context pointer passed through to @a func.
+*/
+void osrfBenchRun( const char* name, const char* corpus, size_t bytes_per_op,
+		osrfBenchFunc func, void* ctx ) {
+
+	if( !osrfBenchSelected( name, corpus ) )
+		return;
+
+	// Warm up, then find a batch size that takes long enough to time accurately
+	func( ctx, 1 );
+	unsigned long batch = 1;
+	for( ;; ) {
+		double start = now_ns();
+		func( ctx, batch );
+		double elapsed = now_ns() - start;
+		if( elapsed >= BENCH_BATCH_NS || batch >= ( 1UL << 30 ) )
+			break;
+		batch *= ( elapsed > 0 && BENCH_BATCH_NS / elapsed < 16 ) ? 2 : 16;
+	}
+
+	double samples[ BENCH_MAX_SAMPLES ];
+	int nsamples = 0;
+	double total_ns = 0;
+	double allocs = 0;
+	double budget = bench_seconds * 1e9;
+
+	while( nsamples < BENCH_MAX_SAMPLES
+			&& ( nsamples < BENCH_MIN_SAMPLES || total_ns < budget ) ) {
+		double allocs_before = ALLOC_COUNT();
+		double start = now_ns();
+		func( ctx, batch );
+		double elapsed = now_ns() - start;
+		allocs += ALLOC_COUNT() - allocs_before;
+		total_ns += elapsed;
+		samples[ nsamples++ ] = elapsed / batch;
+	}
+
+	double iters = (double) batch * nsamples;
+	double ns_per_op = total_ns / iters;
+	qsort( samples, nsamples, sizeof( double ), compare_doubles );
+
+	printf( "{\"bench\":\"%s\",\"corpus\":\"%s\",\"iters\":%.0f,\"ns_per_op\":%.1f,"
+			"\"mb_per_s\":%.1f,\"allocs_per_op\":%.2f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,"
+			"\"p99_ns\":%.1f,\"min_ns\":%.1f,\"bytes_per_op\":%lu}\n",
+			name, corpus, iters, ns_per_op,
+			bytes_per_op ? bytes_per_op * 1e3 / ns_per_op : 0.0,
+			ALLOC_COUNT() < 0 ? -1.0 : allocs / iters,
+			percentile( samples, nsamples, 50 ), percentile( samples, nsamples, 90 ),
+			percentile( samples, nsamples, 99 ), samples[ 0 ],
+			(unsigned long) bytes_per_op );
+	fflush( stdout );
+}
+
+int main( int argc, char* argv[] ) {
+	int i;
+	bench_filters = calloc( argc, sizeof( char* ) );
+	for( i = 1; i < argc; ++i ) {
+		if( !strcmp( argv[ i ], "-t" ) && i + 1 < argc ) {
+			bench_seconds = atof( argv[ ++i ] );
+		} else if( argv[ i ][ 0 ] == '-' ) {
+			fprintf( stderr, "Usage: %s [-t seconds] [filter ...]\n", argv[ 0 ] );
+			return 1;
+		} else
+			bench_filters[ bench_filter_count++ ] = argv[ i ];
+	}
+
+	// Keep logging quiet and cheap
+	osrfLogSetLevel( OSRF_LOG_ERROR );
+
+	osrfBenchJSON();
+	osrfBenchHash();
+	osrfBenchBuffer();
+	osrfBenchMessage();
+	osrfBenchBig();
+	osrfBenchSocket();
+	osrfBenchTransport();
+	osrfBenchRouter();
+
+	free( bench_filters );
+	return 0;
+}
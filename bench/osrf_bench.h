@@ -0,0 +1,54 @@
+#ifndef OSRF_BENCH_H
+#define OSRF_BENCH_H
+
+/**
+	@file osrf_bench.h
+	@brief Minimal harness for the libopensrf microbenchmarks.
+
+	Each benchmark is a function that performs a given number of iterations of some
+	operation.  osrfBenchRun() calibrates a batch size, times a series of batches, and
+	prints one line of JSON summarizing the results:
+
+	- ns_per_op: mean time per iteration, over all batches;
+	- mb_per_s: throughput, if the benchmark declares how many bytes an iteration processes;
+	- allocs_per_op: calls to malloc(), calloc() and realloc() per iteration (glibc only;
+	  -1 elsewhere);
+	- p50_ns, p90_ns, p99_ns, min_ns: percentiles of the per-iteration time, taken over
+	  the batches.
+
+	Output from successive runs can be compared line by line to catch regressions.
+*/
+
+#include <stddef.h>
+
+/**
+	@brief A benchmark body: perform @a iters iterations of the operation under test.
+	@param ctx The context pointer passed to osrfBenchRun().
+	@param iters Number of iterations to perform.
+*/
+typedef void (*osrfBenchFunc)( void* ctx, unsigned long iters );
+
+int osrfBenchSelected( const char* name, const char* corpus );
+
+void osrfBenchRun( const char* name, const char* corpus, size_t bytes_per_op,
+	osrfBenchFunc func, void* ctx );
+
+/* Payload corpora (corpus.c).  Each returns a newly allocated string. */
+
+char* osrfBenchRequestJSON( void );
+char* osrfBenchFieldmapperJSON( int count );
+char* osrfBenchMarcText( void );
+char* osrfBenchConfigJSON( void );
+
+/* Benchmark groups, one per source file. */
+
+void osrfBenchJSON( void );
+void osrfBenchHash( void );
+void osrfBenchBuffer( void );
+void osrfBenchMessage( void );
+void osrfBenchBig( void );
+void osrfBenchSocket( void );
+void osrfBenchTransport( void );
+void osrfBenchRouter( void );
+
+#endif
@@ -139,6 +139,9 @@ int osrf_app_session_request_complete( const osrfAppSession* session, int reques
 osrfMessage* osrfAppSessionRequestRecv(
 		osrfAppSession* session, int request_id, int timeout );
 
+osrfMessage* osrfAppSessionRequestRecvMs(
+		osrfAppSession* session, int request_id, int timeout_ms );
+
 void osrf_app_session_request_finish( osrfAppSession* session, int request_id );
 
 int osrf_app_session_request_resend( osrfAppSession*, int request_id );
@@ -161,6 +164,8 @@ int osrf_app_session_disconnect( osrfAppSession* );
 
 int osrf_app_session_queue_wait( osrfAppSession*, int timeout, int* recvd );
 
+int osrf_app_session_queue_wait_ms( osrfAppSession*, int timeout_ms, int* recvd );
+
 void osrfAppSessionFree( osrfAppSession* );
 
 void osrf_app_session_request_reset_timeout( osrfAppSession* session, int req_id );
@@ -1,7 +1,13 @@
 #ifndef OSRF_BIG_HASH_H
 #define OSRF_BIG_HASH_H
 
-#include <Judy.h>
+/*
+	The storage behind an osrfBigHash is chosen when OpenSRF is configured: by default a
+	native open-addressed table (osrf_big_hash_native.c), or, with --with-judy, a JudySL
+	array (osrf_big_hash.c).  The interface is the same either way, except that only the
+	Judy backend returns keys in sorted order.
+*/
+
 #include <opensrf/utils.h>
 #include <opensrf/string_array.h>
 
@@ -12,15 +18,16 @@ extern "C" {
 #define OSRF_HASH_MAXKEY 256
 
 struct __osrfBigHashStruct {
-	Pvoid_t hash;							/* the hash */
+	void* hash;								/* the hash (backend-specific) */
 	void (*freeItem) (char* key, void* item);	/* callback for freeing stored items */
 };
 typedef struct __osrfBigHashStruct osrfBigHash;
 
 
 struct __osrfBigHashIteratorStruct {
-	char* current;
+	char* current;							/* last key returned */
 	osrfBigHash* hash;
+	unsigned long index;					/* next slot to examine (native backend) */
 };
 typedef struct __osrfBigHashIteratorStruct osrfBigHashIterator;
 
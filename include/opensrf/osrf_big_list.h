@@ -1,9 +1,14 @@
 #ifndef OSRF_BIG_LIST_H
 #define OSRF_BIG_LIST_H
 
+/*
+	The storage behind an osrfBigList is chosen when OpenSRF is configured: by default a
+	native array of fixed-size chunks (osrf_big_list_native.c), or, with --with-judy, a
+	JudyL array (osrf_big_list.c).  The interface is the same either way.
+*/
+
 #include <stdio.h>
 #include <opensrf/utils.h>
-#include <Judy.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,7 +21,7 @@ extern "C" {
   types in the list if you want magic freeing */
 
 struct __osrfBigListStruct {
-	Pvoid_t list;							/* the list */
+	void* list;								/* the list (backend-specific) */
 	int size;								/* how many items in the list including NULL items between non-NULL items */	
 	void (*freeItem) (void* item);	/* callback for freeing stored items */
 };
@@ -86,7 +91,8 @@ void* osrfBigListPop( osrfBigList* list );
   @param position The position to place the item in
   @return NULL in successfully inserting the new item and freeing
   any displaced items.  Returns the displaced item if no "freeItem"
-  callback is defined.
+  callback is defined.  A position of INT_MAX or more is out of range:
+  nothing is stored, and the return value is NULL.
 	*/
 void* osrfBigListSet( osrfBigList* list, void* item, unsigned long position );
 
@@ -31,6 +31,8 @@ osrfHash* osrfNewHash();
 
 void osrfHashSetCallback( osrfHash* hash, void (*callback) (char* key, void* item) );
 
+void osrfHashSetInternKeys( osrfHash* hash );
+
 void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... );
 
 void* osrfHashRemove( osrfHash* hash, const char* key, ... );
@@ -0,0 +1,51 @@
+#ifndef OSRF_INTERN_H
+#define OSRF_INTERN_H
+
+/**
+	@file osrf_intern.h
+	@brief Header for a process-wide table of interned strings.
+
+	Interning a string returns a pointer to a single shared copy of it.  Every caller that
+	interns an equal string gets the same pointer, so two interned strings are equal if and
+	only if their pointers are equal.  Each interned string also carries a precomputed hash
+	value and length.
+
+	Interned strings are reference-counted.  Each call to osrfIntern() or osrfInternRetain()
+	must be balanced by a call to osrfInternRelease(); when the last reference is released,
+	the shared copy is freed.  Never pass an interned string to free().
+
+	We use interned strings for values that repeat heavily but come from a limited
+	vocabulary, and that live in storage private to libopensrf: the keys of jsonObject
+	hashes, and the router's node ids.  Public struct members, such as the class name of a
+	jsonObject or the Jabber IDs of a transport_message, remain ordinary strings owned by
+	their structs.
+
+	The table is guarded by a mutex, so that threads may intern and release strings
+	concurrently.
+*/
+
+#include <opensrf/utils.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char* osrfIntern( const char* str );
+
+const char* osrfInternN( const char* str, size_t len );
+
+const char* osrfInternRetain( const char* istr );
+
+void osrfInternRelease( const char* istr );
+
+unsigned int osrfInternHash( const char* istr );
+
+size_t osrfInternLength( const char* istr );
+
+unsigned long osrfInternCount( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
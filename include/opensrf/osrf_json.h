@@ -196,6 +196,10 @@ unsigned long jsonObjectRemoveIndex(jsonObject* dest, unsigned long index);
 
 jsonObject* jsonObjectExtractIndex(jsonObject* dest, unsigned long index);
 
+unsigned long jsonObjectRemoveIndexShift(jsonObject* dest, unsigned long index);
+
+jsonObject* jsonObjectExtractIndexShift(jsonObject* dest, unsigned long index);
+
 unsigned long jsonObjectRemoveKey( jsonObject* dest, const char* key);
 
 const char* jsonObjectGetString(const jsonObject*);
@@ -12,7 +12,8 @@
 	directly to the freeItem member of the osrfList structure.
 
 	Unlike a typical vector class in, or example, C++, an osrfList does NOT shift items
-	around to fill in the gap when you remove an item.  Items stay put.
+	around to fill in the gap when you remove an item.  Items stay put.  If you want the
+	gap closed, use osrfListRemoveShift() or osrfListExtractShift() instead.
 
 	The use of void pointers involves the usual risk of type errors, so be careful.
 
@@ -95,6 +96,10 @@ void osrfListSwap( osrfList* one, osrfList* two );
 void* osrfListRemove( osrfList* list, unsigned int position );
 
 void* osrfListExtract( osrfList* list, unsigned int position );
+
+void* osrfListRemoveShift( osrfList* list, unsigned int position );
+
+void* osrfListExtractShift( osrfList* list, unsigned int position );
 		
 int osrfListFind( const osrfList* list, void* addr );
 
@@ -138,6 +138,20 @@ osrfList* osrfMessageDeserialize( const char* string, osrfList* list );
 
 int osrf_message_deserialize(const char* json, osrfMessage* msgs[], int count);
 
+/**
+	@brief The gist of an osrfMessage, as osrfMessageScan() finds it in JSON.
+*/
+typedef struct {
+	enum M_TYPE m_type;        /**< As for an osrfMessage. */
+	int thread_trace;          /**< As for an osrfMessage. */
+	int protocol;              /**< As for an osrfMessage. */
+	/** For a REQUEST: start of the method name, within the JSON (not nul-terminated). */
+	const char* method_name;
+	size_t method_len;         /**< Length of the method name. */
+} osrfMessageSummary;
+
+int osrfMessageScan( const char* string, osrfMessageSummary summaries[], int count );
+
 void osrf_message_set_params( osrfMessage* msg, const jsonObject* o );
 
 void osrf_message_set_method( osrfMessage* msg, const char* method_name );
@@ -0,0 +1,63 @@
+#ifndef OSRF_STRING_SET_H
+#define OSRF_STRING_SET_H
+
+/**
+	@file osrf_string_set.h
+	@brief Header for osrfStringSet and osrfPrefixMatcher.
+
+	An osrfStringSet answers exact membership questions ("is this domain trusted?") in
+	constant time, using an open-addressed hash table of private string copies.  It is
+	meant to replace osrfStringArrayContains() wherever a list of strings is loaded once
+	and then consulted on every message.
+
+	An osrfPrefixMatcher answers the question "does this string begin with any of these
+	prefixes?" with a binary search over a sorted, reduced table of prefixes, instead of
+	a strncmp() against every entry.
+*/
+
+#include <opensrf/utils.h>
+#include <opensrf/string_array.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct osrfStringSetStruct;
+typedef struct osrfStringSetStruct osrfStringSet;
+
+struct osrfPrefixMatcherStruct;
+typedef struct osrfPrefixMatcherStruct osrfPrefixMatcher;
+
+osrfStringSet* osrfNewStringSet( int size );
+
+osrfStringSet* osrfNewStringSetFromArray( const osrfStringArray* arr );
+
+int osrfStringSetAdd( osrfStringSet* set, const char* str );
+
+int osrfStringSetContains( const osrfStringSet* set, const char* str );
+
+int osrfStringSetContainsN( const osrfStringSet* set, const char* str, size_t len );
+
+int osrfStringSetRemove( osrfStringSet* set, const char* str );
+
+unsigned int osrfStringSetCount( const osrfStringSet* set );
+
+void osrfStringSetFree( osrfStringSet* set );
+
+osrfPrefixMatcher* osrfNewPrefixMatcher( void );
+
+osrfPrefixMatcher* osrfNewPrefixMatcherFromArray( const osrfStringArray* arr );
+
+void osrfPrefixMatcherAdd( osrfPrefixMatcher* pm, const char* prefix );
+
+int osrfPrefixMatcherMatch( const osrfPrefixMatcher* pm, const char* str );
+
+unsigned int osrfPrefixMatcherCount( const osrfPrefixMatcher* pm );
+
+void osrfPrefixMatcherFree( osrfPrefixMatcher* pm );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,32 +14,62 @@ extern "C" {
 #endif
 
 /**
-  Maintains a set of transport clients 
+  Maintains a pool of transport clients, spread over a set of domains.
+
+  Each domain (node) may have several connections, so that sends to it needn't wait on
+  one another.  A connection that fails is dropped; a domain with no connections left is
+  left alone for a while, and then reconnected.  Sends go to the domains in proportion
+  to how quickly each has been answering.  One epoll descriptor watches every
+  connection in the group for input.
   */
 
+/** Longest we wait before trying to reconnect to a failed domain, in seconds */
+#define OSRF_TG_MAX_RETRY 60
+
+struct __osrfTransportGroupNode;
+
+/** One connection in a domain's pool */
+struct __osrfTransportGroupConn {
+	transport_client* connection;		/* our connection to the network */
+	struct __osrfTransportGroupNode* node;	/* the domain it belongs to */
+	int active;								/* true if it's connected and usable */
+	long long awaiting;					/* when we sent the oldest unanswered message, in
+													milliseconds of the monotonic clock; 0 if none */
+};
+typedef struct __osrfTransportGroupConn osrfTransportGroupConn;
+
 struct __osrfTransportGroupStruct {
 	osrfHash* nodes;						/* our hash of nodes keyed by domain */
 	osrfHashIterator* itr;				/* points to the next node in the list */
+	int epoll_fd;							/* watches every active connection for input */
+	unsigned int next_recv;				/* where to start looking for queued input, for fairness */
 };
 typedef struct __osrfTransportGroupStruct osrfTransportGroup;
 
 
 struct __osrfTransportGroupNode {
-	transport_client* connection;		/* our connection to the network */
+	osrfTransportGroupConn* conns;	/* our connections to the network */
+	int conn_count;						/* how many connections are in the pool */
+	int next_conn;							/* the next connection to send on */
 	char* domain;							/* the domain we're connected to */
 	char* username;						/* username used to connect to the group of servers */
 	char* password;						/* password used to connect to the group of servers */
 	char* resource;						/* the login resource */
 	int port;								/* port used to connect to the group of servers */
 
-	int active;								/* true if we're able to send data on this connection */
+	int active;								/* how many of the connections are active */
 	time_t lastsent;						/* the last time we sent a message */
+	int failures;							/* times in a row that we've lost every connection */
+	time_t retry_at;						/* when to try to connect again, once we have */
+	double latency;						/* average time to an answer, in milliseconds; 0 until
+													we've seen one */
+	double current_weight;				/* running score for choosing among domains */
 };
 typedef struct __osrfTransportGroupNode osrfTransportGroupNode;
 
 
 /**
-  Creates a new group node
+  Creates a new group node with a single connection
   @param domain The domain we're connecting to
   @param port The port to connect on
   @param username The login name
@@ -47,21 +77,42 @@ typedef struct __osrfTransportGroupNode osrfTransportGroupNode;
   @param resource The login resource
   @return A new transport group node
   */
-osrfTransportGroupNode* osrfNewTransportGroupNode( 
+osrfTransportGroupNode* osrfNewTransportGroupNode(
 		char* domain, int port, char* username, char* password, char* resource );
 
+/**
+  Creates a new group node with a pool of connections.  Each connection after the first
+  logs in with the resource suffixed by its index ("resource_1", "resource_2"...), since
+  Jabber allows only one session per full Jabber ID.
+  @param domain The domain we're connecting to
+  @param port The port to connect on
+  @param username The login name
+  @param password The login password
+  @param resource The login resource
+  @param connections How many connections to keep to the domain
+  @return A new transport group node
+  */
+osrfTransportGroupNode* osrfNewTransportGroupPool( const char* domain, int port,
+		const char* username, const char* password, const char* resource, int connections );
+
 
 /**
-  Allocates and initializes a new transport group.
+  Allocates and initializes a new transport group, which takes ownership of the nodes.
   The first node in the array is the default node for client connections.
   @param nodes The nodes in the group.
   */
 osrfTransportGroup* osrfNewTransportGroup( osrfTransportGroupNode* nodes[], int count );
 
+/**
+  Disconnects and frees a transport group and all of its nodes.
+  @param grp The transport group
+  */
+void osrfTransportGroupFree( osrfTransportGroup* grp );
+
 /**
   Attempts to connect all of the nodes in this group.
   @param grp The transport group
-  @return The number of nodes successfully connected
+  @return The number of nodes with at least one connection
   */
 int osrfTransportGroupConnectAll( osrfTransportGroup* grp );
 
@@ -69,38 +120,36 @@ void osrfTransportGroupDisconnectAll( osrfTransportGroup* grp );
 
 
 /**
-  Sends a transport message by going to the next domain in the set.
-  if we have a connection for the recipient domain, then we consider it to be
-  a 'local' message.  Local messages have their recipient domains re-written to
-  match the domain of the next server in the set and they are sent directly to 
-  that server.  If we do not have a connection for the recipient domain, it is 
+  Sends a transport message to one of the domains in the set, favoring the ones that
+  have been answering fastest.  If we have a connection for the recipient domain, then
+  we consider it to be a 'local' message.  Local messages have their recipient domains
+  re-written to match the domain of the chosen server and they are sent directly to
+  that server.  If we do not have a connection for the recipient domain, it is
   considered a 'remote' message and the message is sent directly (unchanged)
-  to the next connection in the set.
+  to the chosen connection.  If the send fails, we try the domain's other connections,
+  and then the other domains.
 
   @param grp The transport group
-  @param msg The message to send 
-  @return 0 on normal successful send.  
-  Returns -1 if the message cannot be sent.  
+  @param msg The message to send
+  @return 0 on normal successful send.
+  Returns -1 if the message cannot be sent.
   */
 int osrfTransportGroupSend( osrfTransportGroup* grp, transport_message* msg );
 
 /**
-  Sends the message to the exact recipient.  No failover is attempted.
+  Sends the message to the exact recipient.  No failover to other domains is attempted,
+  though any of the domain's connections may carry it.
   @return 0 on success, -1 on error.
   */
 int osrfTransportGroupSendMatch( osrfTransportGroup* grp, transport_message* msg );
 
-
-int _osrfTGServerSend( osrfTransportGroup* grp, char* domain, transport_message* msg );
-int _osrfTGClientSend( osrfTransportGroup* grp, char* domain, transport_message* msg );
-
 /**
   Waits on all connections for inbound data.
   @param grp The transport group
-  @param timeout How long to wait for data.  0 means check for data
+  @param timeout How long to wait for data, in seconds.  0 means check for data
   but don't wait, a negative number means to wait indefinitely
-  @return The received message or NULL if the timeout occurred before a 
-  message was received 
+  @return The received message or NULL if the timeout occurred before a
+  message was received
  */
 transport_message* osrfTransportGroupRecvAll( osrfTransportGroup* grp, int timeout );
 
@@ -113,19 +162,13 @@ transport_message* osrfTransportGroupRecvAll( osrfTransportGroup* grp, int timeo
 transport_message* osrfTransportGroupRecv( osrfTransportGroup* grp, char* domain, int timeout );
 
 /**
-  Tells the group that a message to the given domain failed
-  domain did not make it through;
+  Tells the group that a message to the given domain did not make it through.  We drop
+  the domain's connections, and leave it alone for a while before reconnecting.
   @param grp The transport group
-  @param comain The failed domain
+  @param domain The failed domain
   */
 void osrfTransportGroupSetInactive( osrfTransportGroup* grp, char* domain );
 
-
-/**
-  Finds a node in our list of nodes 
-  */
-osrfTransportGroupNode* __osrfTransportGroupFindNode( osrfTransportGroup* grp, char* domain );
-
 #ifdef __cplusplus
 }
 #endif
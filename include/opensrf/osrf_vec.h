@@ -0,0 +1,102 @@
+/**
+	@file osrf_vec.h
+	@brief Header for osrfVec, a contiguous array of fixed-size elements.
+
+	An osrfVec stores its elements by value, one after another in a single block of
+	memory.  Each element occupies the number of bytes specified when the osrfVec is
+	created.  To store pointers, create an osrfVec with an element size of sizeof(void*),
+	and pass the address of each pointer.
+
+	Unlike an osrfList, an osrfVec has no holes.  When you remove an element, the elements
+	after it move down to fill the gap, so that the elements in use always occupy
+	subscripts 0 through size - 1.  When the array fills up, its capacity doubles, so that
+	appending n elements costs O(n) in all.
+
+	Optionally, the calling code may install a callback function as a destructor, by
+	assigning directly to the freeItem member.  The callback receives a pointer to the
+	element being discarded, not the element itself.
+*/
+
+#ifndef OSRF_VEC_H
+#define OSRF_VEC_H
+
+#include <opensrf/utils.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	@brief Macro to compute the address of an element, without bounds checking.
+	@param v A pointer to the osrfVec.
+	@param i The zero-based index of the element.
+*/
+#define OSRF_VEC_AT(v, i) ((void*) ((v)->data + (size_t) (i) * (v)->elem_size))
+
+/**
+	@brief Macro to fetch a pointer stored in an osrfVec of pointers.
+	@param v A pointer to an osrfVec whose elements are pointers.
+	@param i The zero-based index of the requested pointer.
+	@return The pointer stored at the specified position, or NULL if out of range.
+*/
+#define OSRF_VEC_GET_PTR(v, i) \
+	((!(v) || (size_t) (i) >= (v)->size) ? NULL : ((void**) (v)->data)[(i)])
+
+/**
+	@brief Structure for managing a contiguous array of fixed-size elements.
+*/
+struct _osrfVecStruct {
+	/** @brief Number of elements in use. */
+	size_t size;
+	/** @brief Number of elements for which space is allocated. */
+	size_t capacity;
+	/** @brief Size of each element, in bytes. */
+	size_t elem_size;
+	/** @brief Pointer to the elements. */
+	char* data;
+	/** @brief Callback function for freeing an element; receives its address. */
+	void (*freeItem) (void* elem);
+};
+typedef struct _osrfVecStruct osrfVec;
+
+osrfVec* osrfNewVec( size_t elem_size );
+
+osrfVec* osrfNewVecSize( size_t elem_size, size_t capacity );
+
+void osrfVecReserve( osrfVec* vec, size_t capacity );
+
+void* osrfVecPush( osrfVec* vec, const void* elem );
+
+void* osrfVecAppend( osrfVec* vec, const void* elems, size_t count );
+
+void* osrfVecInsert( osrfVec* vec, size_t index, const void* elem );
+
+void* osrfVecSet( osrfVec* vec, size_t index, const void* elem );
+
+void* osrfVecGet( const osrfVec* vec, size_t index );
+
+int osrfVecRemove( osrfVec* vec, size_t index );
+
+int osrfVecExtract( osrfVec* vec, size_t index, void* out );
+
+int osrfVecPop( osrfVec* vec, void* out );
+
+size_t osrfVecCount( const osrfVec* vec );
+
+void osrfVecClear( osrfVec* vec );
+
+void osrfVecFree( osrfVec* vec );
+
+void osrfVecSort( osrfVec* vec, int (*compare)( const void*, const void* ) );
+
+void* osrfVecBsearch( const osrfVec* vec, const void* key,
+	int (*compare)( const void*, const void* ) );
+
+long osrfVecFind( const osrfVec* vec, const void* elem,
+	int (*compare)( const void*, const void* ) );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -51,6 +51,15 @@ extern "C" {
 struct socket_node_struct;
 typedef struct socket_node_struct socket_node;
 
+/* private lookup table and event-polling state */
+struct socket_index_struct;
+
+/** @brief Default high-water mark for a socket's output queue, in bytes. */
+#define SOCKET_HIGH_WATER (1024 * 1024)
+
+/** @brief Corked output is sent as soon as this many bytes have piled up. */
+#define SOCKET_CORK_SIZE 65536
+
 
 /* Maintains the socket set */
 /**
@@ -62,14 +71,20 @@ struct socket_manager_struct {
 	- @em blob  Opaque pointer from the calling code.
 	- @em mgr Pointer to the socket_manager that manages the socket.
 	- @em sock_fd File descriptor of the socket that read the data.
-	- @em data Pointer to the data received.
+	- @em data Pointer to the data received.  It is followed by a terminal nul, for
+	  convenience, but may also contain embedded nuls.
+	- @em len Number of bytes received, not counting the terminal nul.
 	- @em parent_id (if > 0) listener socket from which the data socket was spawned.
+
+	The data buffer belongs to the socket_manager, and is valid only until the callback
+	returns.
 	*/
 	void (*data_received) (
 		void* blob,
 		struct socket_manager_struct* mgr,
 		int sock_fd,
 		char* data,
+		size_t len,
 		int parent_id
 	);
 
@@ -85,6 +100,12 @@ struct socket_manager_struct {
 
 	socket_node* socket;       /**< Linked list of managed sockets. */
 	void* blob;                /**< Opaque pointer from the calling code .*/
+	/** @brief Output queued for a socket beyond this many bytes calls for backpressure
+	(see socket_send_nowait()).  Zero means SOCKET_HIGH_WATER. */
+	size_t high_water;
+	/** @brief Sockets indexed by file descriptor, plus the epoll instance if any.
+	Private to socket_bundle.c; created on demand, so a zeroed socket_manager is valid. */
+	struct socket_index_struct* index;
 };
 typedef struct socket_manager_struct socket_manager;
 
@@ -106,12 +127,26 @@ int socket_send(int sock_fd, const char* data);
 
 int socket_send_timeout( int sock_fd, const char* data, int usecs );
 
+int socket_send_nowait( socket_manager* mgr, int sock_fd, const char* data, size_t len );
+
+int socket_send_corked( socket_manager* mgr, int sock_fd, const char* data, size_t len );
+
+int socket_flush( socket_manager* mgr, int sock_fd, int timeout );
+
+size_t socket_pending( socket_manager* mgr, int sock_fd );
+
+int socket_backpressure( socket_manager* mgr, int sock_fd );
+
 void socket_disconnect(socket_manager*, int sock_fd);
 
 int socket_wait(socket_manager* mgr, int timeout, int sock_fd);
 
+int socket_wait_ms(socket_manager* mgr, int timeout_ms, int sock_fd);
+
 int socket_wait_all(socket_manager* mgr, int timeout);
 
+int socket_wait_all_ms(socket_manager* mgr, int timeout_ms);
+
 void _socket_print_list(socket_manager* mgr);
 
 int socket_connected(int sock_fd);
@@ -11,6 +11,7 @@
 
 #include <time.h>
 #include <opensrf/transport_session.h>
+#include <opensrf/transport_local.h>
 #include <opensrf/utils.h>
 #include <opensrf/log.h>
 
@@ -33,6 +34,8 @@ struct transport_client_struct {
 	int error;                       /**< Boolean: true if an error has occurred */
 	char* host;                      /**< Domain name or IP address of the Jabber server */
 	char* xmpp_id;                   /**< Jabber ID used for outgoing messages */
+	transport_local* local;          /**< Direct connections to processes on this host,
+	                                      if enabled by client_open_local() */
 };
 typedef struct transport_client_struct transport_client;
 
@@ -50,10 +53,26 @@ int client_discard( transport_client* client );
 
 int client_send_message( transport_client* client, transport_message* msg );
 
+void client_set_nonblocking( transport_client* client, int nonblocking );
+
+void client_set_corked( transport_client* client, int corked );
+
+void client_set_compression( transport_client* client, int compress );
+
+int client_open_local( transport_client* client, const char* dir );
+
+int client_flush( transport_client* client, int timeout );
+
+size_t client_pending( transport_client* client );
+
+int client_backpressure( transport_client* client );
+
 int client_connected( const transport_client* client );
 
 transport_message* client_recv( transport_client* client, int timeout );
 
+transport_message* client_recv_ms( transport_client* client, int timeout_ms );
+
 int client_sock_fd( transport_client* client );
 
 #ifdef __cplusplus
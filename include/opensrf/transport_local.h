@@ -0,0 +1,73 @@
+#ifndef TRANSPORT_LOCAL_H
+#define TRANSPORT_LOCAL_H
+
+/**
+	@file transport_local.h
+	@brief Header for a brokerless transport between processes on the same host.
+
+	Each process listens on a UNIX domain socket in a shared directory, named for its Jabber
+	ID.  A message for a Jabber ID with a socket in the directory goes straight to that
+	socket, rather than through the Jabber server.  Messages for anybody else go through
+	Jabber as before.  Only processes running as our own effective user are peers, and the
+	directory must belong to that user and be writable by nobody else.
+*/
+
+#include <opensrf/transport_message.h>
+#include <opensrf/socket_bundle.h>
+#include <opensrf/osrf_hash.h>
+#include <opensrf/osrf_list.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Largest frame we accept from a local peer, in bytes. */
+#define LOCAL_MAX_FRAME ( 256 * 1024 * 1024 )
+
+/**
+	@brief How long, in seconds, a send waits for a local peer to take a message before
+	giving up on the connection.
+*/
+#define LOCAL_SEND_TIMEOUT 1
+
+/**
+	@brief A listening socket for local peers, and our connections to and from them.
+
+	The sockets belong to a socket_manager that we share with a transport_session, so that
+	one wait covers both.  We take over the socket_manager's callbacks, and pass along
+	whatever doesn't concern us to the ones that were there before.
+*/
+struct transport_local_struct {
+	socket_manager* sock_mgr;   /**< The socket_manager that we share (not owned). */
+	char* dir;                  /**< Directory where local peers have their sockets. */
+	char* path;                 /**< Pathname of our own socket. */
+	int listener;               /**< File descriptor of our own socket. */
+	osrfHash* peers;            /**< Connections to peers, keyed by Jabber ID. */
+	osrfList* conns;            /**< State of each connection, indexed by file descriptor. */
+
+	void* user_data;            /**< Opaque pointer from calling code. */
+	/** Callback from calling code, for when a complete message is received. */
+	void (*message_callback) ( void* user_data, transport_message* msg );
+
+	/* the socket_manager's callbacks, before we took them over */
+	void* next_blob;
+	void (*next_data_received) ( void* blob, socket_manager* mgr, int sock_fd,
+		char* data, size_t len, int parent_id );
+	void (*next_socket_closed) ( void* blob, int sock_fd );
+};
+typedef struct transport_local_struct transport_local;
+
+transport_local* local_init( socket_manager* mgr, const char* dir, const char* jid,
+	void* user_data, void (*message_callback) ( void* user_data, transport_message* msg ) );
+
+int local_send_msg( transport_local* local, transport_message* msg );
+
+void local_free( transport_local* local );
+
+void local_discard( transport_local* local );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
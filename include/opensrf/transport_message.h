@@ -37,7 +37,15 @@ extern "C" {
 	- router_command
 	- osrf_xid
 	- broadcast
+	- router_hops
 */
+
+/**
+	@brief The most router hops that a message can record; a message that claims more
+	has as many as that.
+*/
+#define MESSAGE_MAX_HOPS 1000
+
 struct transport_message_struct {
 	char* body;            /**< Text enclosed by the body element. */
 	char* subject;         /**< Text enclosed by the subject element. */
@@ -53,6 +61,8 @@ struct transport_message_struct {
 	char* error_type;      /**< Value of the "type" attribute of &lt;error&gt;. */
 	int error_code;        /**< Value of the "code" attribute of &lt;error&gt;. */
 	int broadcast;         /**< Value of the "broadcast" attribute in the message element. */
+	/** Value of the "router_hops" attribute: how many routers have passed it to a peer. */
+	int router_hops;
 	char* msg_xml;         /**< The entire message as XML, complete with entity encoding. */
 	struct transport_message_struct* next;
 };
@@ -69,8 +79,13 @@ void message_set_router_info( transport_message* msg, const char* router_from,
 
 void message_set_osrf_xid( transport_message* msg, const char* osrf_xid );
 
+void message_readdress( transport_message* msg, const char* recipient,
+		const char* router_from );
+
 int message_prepare_xml( transport_message* msg );
 
+int message_read_hops( const char* value, size_t len );
+
 int message_free( transport_message* msg );
 
 void jid_get_username( const char* jid, char buf[], int size );
@@ -79,6 +94,8 @@ void jid_get_resource( const char* jid, char buf[], int size );
 
 void jid_get_domain( const char* jid, char buf[], int size );
 
+const char* jid_find_domain( const char* jid, size_t* len );
+
 void set_msg_error( transport_message*, const char* error_type, int error_code);
 
 #ifdef __cplusplus
@@ -32,6 +32,9 @@
 extern "C" {
 #endif
 
+/* private stream compression state */
+struct session_zlib_struct;
+
 /** Note whether the login information should be sent as plaintext or as a hash digest. */
 enum TRANSPORT_AUTH_TYPE { AUTH_PLAIN, AUTH_DIGEST };
 
@@ -52,6 +55,13 @@ struct jabber_state_machine_struct {
 	int in_iq;
 	int in_presence;
 	int in_status;
+	int in_features;         /* inside <stream:features> */
+	int in_compression;      /* inside the <compression> feature */
+	int in_method;           /* inside a <method> of the <compression> feature */
+	int features_done;       /* seen the end of <stream:features> */
+	int compress_offered;    /* the server offers zlib compression */
+	int compress_reply;      /* 1 while we await the reply to <compress>; then
+	                            2 if the server said <compressed/>, -1 if <failure/> */
 };
 typedef struct jabber_state_machine_struct jabber_machine;
 
@@ -78,6 +88,7 @@ struct transport_session_struct {
 	growing_buffer* status_buffer;        /**< Text of &lt;status&gt; of message stanza. */
 	growing_buffer* message_error_type;   /**< "type" attribute of &lt;error&gt;. */
 	growing_buffer* session_id;           /**< "id" attribute of stream header. */
+	growing_buffer* method_buffer;        /**< Text of &lt;method&gt; of stream features. */
 	int message_error_code;               /**< "code" attribute of &lt;error&gt;. */
 
 	/* for OILS extensions */
@@ -87,6 +98,7 @@ struct transport_session_struct {
 	growing_buffer* router_command_buffer; /**< "router_command" attribute of &lt;message&gt;. */
 	growing_buffer* osrf_xid_buffer;      /**< "osrf_xid" attribute of &lt;message&gt;. */
 	int router_broadcast;                 /**< "broadcast" attribute of &lt;message&gt;. */
+	int router_hops;                      /**< "router_hops" attribute of &lt;message&gt;. */
 
 	void* user_data;                      /**< Opaque pointer from calling code. */
 
@@ -96,6 +108,14 @@ struct transport_session_struct {
 	int sock_id;                          /**< File descriptor of socket to Jabber. */
 
 	int component;                        /**< Boolean; true if we're a Jabber component. */
+	int nonblocking;                      /**< Boolean; true if outgoing messages may be
+	                                           queued rather than sent right away. */
+	int corked;                           /**< Boolean; true if outgoing messages are
+	                                           held back to be sent in batches. */
+	int compress;                         /**< Boolean; true if we should ask Jabber to
+	                                           compress the stream (XEP-0138). */
+	struct session_zlib_struct* zlib;     /**< Compression state, once the stream
+	                                           is compressed; NULL until then. */
 
 	/** Callback from calling code, for when a complete message stanza is received. */
 	void (*message_callback) ( void* user_data, transport_message* msg );
@@ -108,8 +128,16 @@ transport_session* init_transport( const char* server, int port,
 
 int session_wait( transport_session* session, int timeout );
 
+int session_wait_ms( transport_session* session, int timeout_ms );
+
 int session_send_msg( transport_session* session, transport_message* msg );
 
+int session_flush( transport_session* session, int timeout );
+
+int session_backpressure( transport_session* session );
+
+int session_compressed( transport_session* session );
+
 int session_connected( transport_session* session );
 
 int session_free( transport_session* session );
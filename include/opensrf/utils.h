@@ -358,6 +358,10 @@ int clr_fl( int fd, int flags );
 // Utility method
 double get_timestamp_millis( void );
 
+long long get_monotonic_millis( void );
+
+int timeout_to_millis( int timeout );
+
 
 /* returns true if the whole string is a number */
 int stringisnum(const char* s);
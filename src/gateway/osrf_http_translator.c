@@ -278,18 +278,9 @@ static char* osrfHttpTranslatorParseRequest(osrfHttpTranslator* trans) {
                 const jsonObject* obj = NULL;
                 int i = 0;
                 const char* str;
-                int redactParams = 0;
-                while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-                    //osrfLogInternal(OSRF_LOG_MARK, "Checking for log protection [%s]", str);
-                    if(!strncmp(method, str, strlen(str))) {
-                        redactParams = 1;
-                        break;
-                    }
-                }
-                if(redactParams) {
+                if(osrfPrefixMatcherMatch(log_protect_matcher, method)) {
                     OSRF_BUFFER_ADD(act, " **PARAMS REDACTED**");
                 } else {
-                    i = 0;
                     while((obj = jsonObjectGetIndex(params, i++))) {
                         str = jsonObjectToJSON(obj);
                         if( i == 1 )
@@ -302,18 +302,9 @@ static int osrf_json_gateway_method_handler (request_rec *r) {
 #endif
 
 		const char* str; int i = 0;
-		int redact_params = 0;
-		while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-			//osrfLogInternal(OSRF_LOG_MARK, "Checking for log protection [%s]", str);
-			if(!strncmp(method, str, strlen(str))) {
-				redact_params = 1;
-				break;
-			}
-		}
-		if(redact_params) {
+		if(osrfPrefixMatcherMatch(log_protect_matcher, method)) {
 			OSRF_BUFFER_ADD(act, " **PARAMS REDACTED**");
 		} else {
-			i = 0;
 			while( (str = osrfStringArrayGetString(mparams, i++)) ) {
 				if( i == 1 ) {
 					OSRF_BUFFER_ADD(act, " ");
@@ -292,13 +292,14 @@ void osrf_app_session_request_reset_timeout( osrfAppSession* session, int req_id
 /**
 	@brief Fetch the next response message to a given previous request, subject to a timeout.
 	@param req Pointer to the osrfAppRequest representing the request.
-	@param timeout Maxmimum time to wait, in seconds.
+	@param timeout_ms Maxmimum time to wait, in milliseconds.  A negative value is treated
+		as zero.
 
 	@return Pointer to the next osrfMessage for this request, if one is available, or if it
 	becomes available before the end of the timeout; otherwise NULL;
 
 	If there is already a message available in the input queue for this request, dequeue and
-	return it immediately.  Otherwise wait up to timeout seconds until you either get an
+	return it immediately.  Otherwise wait up to timeout_ms milliseconds until you either get an
 	input message for the specified request, run out of time, or encounter an error.
 
 	If the only message we receive for this request is a STATUS message with a status code
@@ -309,7 +310,7 @@ void osrf_app_session_request_reset_timeout( osrfAppSession* session, int req_id
 	messages will be wholly or partially processed behind the scenes while you wait for the
 	one you want.
 */
-static osrfMessage* _osrf_app_request_recv( osrfAppRequest* req, int timeout ) {
+static osrfMessage* _osrf_app_request_recv( osrfAppRequest* req, int timeout_ms ) {
 
 	if(req == NULL) return NULL;
 
@@ -320,21 +321,26 @@ static osrfMessage* _osrf_app_request_recv( osrfAppRequest* req, int timeout ) {
 		return tmp_msg;
 	}
 
-	time_t start = time(NULL);
-	time_t remaining = (time_t) timeout;
+	if( timeout_ms < 0 )
+		timeout_ms = 0;
+
+	// Measure against a monotonic clock, so that the timeout is as long as requested
+	// (not rounded to whole seconds), and setting the system clock can't disturb it.
+	long long deadline = get_monotonic_millis() + timeout_ms;
+	long long remaining = timeout_ms;
 
 	// Wait repeatedly for input messages until you either receive one for the request
 	// you're interested in, run out of time, or encounter an error.
 	// Wait repeatedly because you may also receive messages for other requests, or for
 	// other sessions, and process them behind the scenes. These are not the messages
 	// you're looking for.
-	while( remaining >= 0 ) {
+	for( ;; ) {
 		/* tell the session to wait for stuff */
-		osrfLogDebug( OSRF_LOG_MARK,  "In app_request receive with remaining time [%d]",
-				(int) remaining );
+		osrfLogDebug( OSRF_LOG_MARK,  "In app_request receive with remaining time [%lld ms]",
+				remaining );
 
 
-		osrf_app_session_queue_wait( req->session, 0, NULL );
+		osrf_app_session_queue_wait_ms( req->session, 0, NULL );
 		if(req->session->transport_error) {
 			osrfLogError(OSRF_LOG_MARK, "Transport error in recv()");
 			return NULL;
@@ -354,7 +360,7 @@ static osrfMessage* _osrf_app_request_recv( osrfAppRequest* req, int timeout ) {
 		if( req->complete )
 			return NULL;
 
-		osrf_app_session_queue_wait( req->session, (int) remaining, NULL );
+		osrf_app_session_queue_wait_ms( req->session, (int) remaining, NULL );
 
 		if(req->session->transport_error) {
 			osrfLogError(OSRF_LOG_MARK, "Transport error in recv()");
@@ -380,17 +386,15 @@ static osrfMessage* _osrf_app_request_recv( osrfAppRequest* req, int timeout ) {
 			// We got a reprieve.  This happens when a client receives a STATUS message
 			// with a status code OSRF_STATUS_CONTINUE.  We restart the timer from the
 			// beginning -- but only once.  We reset reset_timeout to zero. so that a
-			// second attempted reprieve will allow, at most, only one more second.
-			remaining = (time_t) timeout;
+			// second attempted reprieve won't extend the deadline.
+			deadline = get_monotonic_millis() + timeout_ms;
 			req->reset_timeout = 0;
 			osrfLogDebug( OSRF_LOG_MARK, "Received a timeout reset");
-		} else {
-			// Subtract the amount of time taken during this loop 
-			// iteration, not the combined time of all iterations.
-			time_t tmp = time(NULL);
-			remaining -= (int) (tmp - start);
-			start = tmp;
 		}
+
+		remaining = deadline - get_monotonic_millis();
+		if( remaining <= 0 )
+			break;
 	}
 
 	// Timeout exhausted; no messages for the request in question
@@ -948,18 +952,18 @@ int osrfAppSessionConnect( osrfAppSession* session ) {
 	if(ret)
 		return 0;
 
-	time_t start = time(NULL);
-	time_t remaining = (time_t) timeout;
+	long long deadline = get_monotonic_millis() + timeout_to_millis( timeout );
+	long long remaining = deadline - get_monotonic_millis();
 
 	// Wait for the acknowledgement.  We look for it repeatedly because, under the covers,
 	// we may receive and process messages other than the one we're looking for.
-	while( session->state != OSRF_SESSION_CONNECTED && remaining >= 0 ) {
-		osrf_app_session_queue_wait( session, remaining, NULL );
+	while( session->state != OSRF_SESSION_CONNECTED && remaining > 0 ) {
+		osrf_app_session_queue_wait_ms( session, (int) remaining, NULL );
 		if(session->transport_error) {
 			osrfLogError(OSRF_LOG_MARK, "cannot communicate with %s", session->remote_service);
 			return 0;
 		}
-		remaining -= (int) (time(NULL) - start);
+		remaining = deadline - get_monotonic_millis();
 	}
 
 	if(session->state == OSRF_SESSION_CONNECTED)
@@ -1078,7 +1082,9 @@ static int osrfAppSessionSendBatch( osrfAppSession* session, osrfMessage* msgs[]
 
 	// Send the JSON as the payload of a transport_message
 	if( string ) {
-		retval = osrfSendTransportPayload( session, string );
+		// A backed-up transport is not a failure; the message is queued
+		if( osrfSendTransportPayload( session, string ) < 0 )
+			retval = -1;
 		free(string);
 	}
 
@@ -1162,10 +1168,13 @@ int osrfSendChunkedResult(
 	@brief Wrap a given string in a transport message and send it.
 	@param session Pointer to the osrfAppSession responsible for sending the message(s).
 	@param payload A string to be sent via Jabber.
-	@return 0 upon success, or -1 upon failure.
+	@return 0 upon success, or 1 upon success if the transport_client is nonblocking and
+		backed up (see client_send_message()).
 
 	In practice the payload is normally a JSON string, but this function assumes nothing
 	about it.
+
+	If the message can't be sent at all, we exit.
 */
 int osrfSendTransportPayload( osrfAppSession* session, const char* payload ) {
 	transport_message* t_msg = message_init(
@@ -1173,7 +1182,7 @@ int osrfSendTransportPayload( osrfAppSession* session, const char* payload ) {
 	message_set_osrf_xid( t_msg, osrfLogGetXid() );
 
 	int retval = client_send_message( session->transport_handle, t_msg );
-	if( retval ) {
+	if( retval < 0 ) {
 		osrfLogError( OSRF_LOG_MARK, "client_send_message failed, exit()ing immediately" );
 		exit(99);
 	}
@@ -1212,7 +1221,22 @@ static int _osrf_app_session_send( osrfAppSession* session, osrfMessage* msg ){
 	to true; otherwise set it to false.
 	@return 0 upon success (even if a timeout occurs), or -1 upon failure.
 
-	A thin wrapper for osrf_stack_process().  The timeout applies only to the first
+	The same as osrf_app_session_queue_wait_ms(), but with the timeout in seconds.
+*/
+int osrf_app_session_queue_wait( osrfAppSession* session, int timeout, int* recvd ){
+	return osrf_app_session_queue_wait_ms( session, timeout_to_millis( timeout ), recvd );
+}
+
+/**
+	@brief Wait for any input messages to arrive, and process them as needed.
+	@param session Pointer to the osrfAppSession whose transport_session we will use.
+	@param timeout_ms How many milliseconds to wait for the first input message (negative
+	to wait indefinitely).
+	@param recvd Pointer to an boolean int.  If you receive at least one message, set the boolean
+	to true; otherwise set it to false.
+	@return 0 upon success (even if a timeout occurs), or -1 upon failure.
+
+	A thin wrapper for osrf_stack_process_ms().  The timeout applies only to the first
 	message; process subsequent messages if they are available, but don't wait for them.
 
 	The first parameter identifies an osrfApp session, but all we really use it for is to
@@ -1229,10 +1253,10 @@ static int _osrf_app_session_send( osrfAppSession* session, osrfMessage* msg ){
 	relevant request.  A server session receiving a REQUEST message may execute the
 	requested method.  And so forth.
 */
-int osrf_app_session_queue_wait( osrfAppSession* session, int timeout, int* recvd ){
+int osrf_app_session_queue_wait_ms( osrfAppSession* session, int timeout_ms, int* recvd ){
 	if(session == NULL) return 0;
-	osrfLogDebug(OSRF_LOG_MARK, "AppSession in queue_wait with timeout %d", timeout );
-	return osrf_stack_process(session->transport_handle, timeout, recvd);
+	osrfLogDebug(OSRF_LOG_MARK, "AppSession in queue_wait with timeout %d ms", timeout_ms );
+	return osrf_stack_process_ms(session->transport_handle, timeout_ms, recvd);
 }
 
 /**
@@ -1304,15 +1328,30 @@ void osrfAppSessionFree( osrfAppSession* session ){
 	@param timeout How many seconds to wait.
 	@return A pointer to the received osrfMessage if one arrives; otherwise NULL.
 
-	A thin wrapper.  Given a session and a request ID, look up the corresponding request
-	and pass it to _osrf_app_request_recv().
+	The same as osrfAppSessionRequestRecvMs(), but with the timeout in seconds.
 */
 osrfMessage* osrfAppSessionRequestRecv(
 		osrfAppSession* session, int req_id, int timeout ) {
+	return osrfAppSessionRequestRecvMs( session, req_id,
+		timeout < 0 ? 0 : timeout_to_millis( timeout ) );
+}
+
+/**
+	@brief Wait for a response to a given request, subject to a timeout.
+	@param session Pointer to the osrfAppSession that owns the request.
+	@param req_id Request ID for the request.
+	@param timeout_ms How many milliseconds to wait.
+	@return A pointer to the received osrfMessage if one arrives; otherwise NULL.
+
+	A thin wrapper.  Given a session and a request ID, look up the corresponding request
+	and pass it to _osrf_app_request_recv().
+*/
+osrfMessage* osrfAppSessionRequestRecvMs(
+		osrfAppSession* session, int req_id, int timeout_ms ) {
 	if(req_id < 0 || session == NULL)
 		return NULL;
 	osrfAppRequest* req = find_app_request( session, req_id );
-	return _osrf_app_request_recv( req, timeout );
+	return _osrf_app_request_recv( req, timeout_ms );
 }
 
 /**
@@ -671,7 +671,7 @@ static int flush_responses( osrfAppSession* ses, growing_buffer* outbuf ) {
 	int rc = 0;
 	if( buffer_length( outbuf ) > 0 ) {    // If there's anything to send...
 		buffer_add_char( outbuf, ']' );    // Close the JSON array
-		if( osrfSendTransportPayload( ses, OSRF_BUFFER_C_STR( ses->outbuf ))) {
+		if( osrfSendTransportPayload( ses, OSRF_BUFFER_C_STR( ses->outbuf )) < 0 ) {
 			osrfLogError( OSRF_LOG_MARK, "Unable to flush response buffer" );
 			rc = -1;
 		}
@@ -1052,20 +1052,8 @@ int osrfMethodVerifyContext( osrfMethodContext* ctx )
 	char* params_str = jsonObjectToJSON( ctx->params );
 	if( params_str ) {
 		// params_str will at minimum be "[]"
-		int i = 0;
-		const char* str;
-		char* method = ctx->method->name;
-		int redact_params = 0;
-		while( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-			//osrfLogInternal(OSRF_LOG_MARK, "Checking for log protection [%s]", str);
-			if(!strncmp(method, str, strlen(str))) {
-				redact_params = 1;
-				break;
-			}
-		}
-
 		char* params_logged;
-		if(redact_params) {
+		if( osrfPrefixMatcherMatch( log_protect_matcher, ctx->method->name ) ) {
 			params_logged = strdup("**PARAMS REDACTED**");
 		} else {
 			params_str[strlen(params_str) - 1] = '\0'; // drop the trailing ']'
@@ -1,3 +1,4 @@
+#include <Judy.h>
 #include <opensrf/osrf_big_hash.h>
 
 osrfBigHash* osrfNewBigHash() {
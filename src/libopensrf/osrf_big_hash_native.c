@@ -0,0 +1,389 @@
+/**
+	@file osrf_big_hash_native.c
+	@brief Native backend for osrfBigHash, without libJudy.
+
+	The table follows the "Swiss table" design.  Besides an array of slots, each holding a
+	key and an item, we keep a parallel array of one-byte control codes.  A control code
+	says whether its slot is empty, deleted, or full; for a full slot it also holds seven
+	bits of the key's hash value.
+
+	A lookup examines the control codes eight at a time, packed into a 64-bit word, and
+	compares a key only where those seven bits match.  Most probes therefore touch a single
+	word of control codes and at most one key.  Control codes for the first eight slots are
+	mirrored past the end of the array, so that a group starting near the end can be read
+	with a single load.
+
+	Keys are copied once, when they are added, and are not copied for lookups.
+
+	Unlike the JudySL backend, this one does not keep the keys in sorted order.  Iteration
+	and osrfBigHashKeys() visit the entries in an arbitrary order.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stdint.h>
+#include <opensrf/osrf_big_hash.h>
+
+/** @brief Number of control codes examined at once. */
+#define BIG_HASH_GROUP 8
+/** @brief Initial number of slots; a power of 2, no smaller than BIG_HASH_GROUP. */
+#define BIG_HASH_INITIAL_SIZE 16
+
+#define CTRL_EMPTY   ((unsigned char) 0x80)  /**< Slot never used. */
+#define CTRL_DELETED ((unsigned char) 0xFE)  /**< Slot whose entry was removed. */
+
+#define LSBS 0x0101010101010101ULL   /**< Low bit of every byte. */
+#define MSBS 0x8080808080808080ULL   /**< High bit of every byte. */
+
+/**
+	@brief A key, its hash value, and its associated item.
+*/
+typedef struct {
+	char* key;
+	void* item;
+	uint64_t hash;
+} BigHashSlot;
+
+/**
+	@brief The table hanging from the hash member of an osrfBigHash.
+*/
+typedef struct {
+	unsigned char* ctrl;     /**< Control codes: capacity + BIG_HASH_GROUP of them. */
+	BigHashSlot* slots;      /**< Array of slots. */
+	size_t capacity;         /**< Number of slots; a power of 2. */
+	size_t count;            /**< Number of full slots. */
+	size_t deleted;          /**< Number of deleted slots. */
+} BigHashTable;
+
+/**
+	@brief Compute a 64-bit hash value for a key.
+	@param key The key, nul-terminated.
+	@return The hash value (FNV-1a, with a final mix so that the high bits are usable).
+*/
+static uint64_t big_hash_key( const char* key ) {
+	uint64_t h = 14695981039346656037ULL;
+	const unsigned char* p = (const unsigned char*) key;
+	while( *p ) {
+		h ^= *p++;
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+	@brief Load a group of control codes, so that byte @em i of the group is byte @em i of
+	the result, counting from the low-order end.
+*/
+static inline uint64_t load_group( const unsigned char* ctrl ) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t g;
+	memcpy( &g, ctrl, sizeof( g ) );
+	return g;
+#else
+	uint64_t g = 0;
+	int i;
+	for( i = BIG_HASH_GROUP - 1; i >= 0; --i )
+		g = ( g << 8 ) | ctrl[ i ];
+	return g;
+#endif
+}
+
+/** @brief Flag the bytes of a group equal to a given full control code (may over-report). */
+static inline uint64_t match_h2( uint64_t group, unsigned char h2 ) {
+	uint64_t x = group ^ ( LSBS * h2 );
+	return ( x - LSBS ) & ~x & MSBS;
+}
+
+/** @brief Flag the bytes of a group that are CTRL_EMPTY. */
+static inline uint64_t match_empty( uint64_t group ) {
+	return group & ~( group << 6 ) & MSBS;
+}
+
+/** @brief Flag the bytes of a group that are CTRL_EMPTY or CTRL_DELETED. */
+static inline uint64_t match_free( uint64_t group ) {
+	return group & ~( group << 7 ) & MSBS;
+}
+
+/** @brief Return the index, within its group, of the lowest flagged byte. */
+static inline unsigned int first_match( uint64_t mask ) {
+	return __builtin_ctzll( mask ) >> 3;
+}
+
+/**
+	@brief Store a control code, along with its mirror image if it has one.
+*/
+static inline void set_ctrl( BigHashTable* t, size_t i, unsigned char c ) {
+	t->ctrl[ i ] = c;
+	if( i < BIG_HASH_GROUP )
+		t->ctrl[ t->capacity + i ] = c;
+}
+
+/**
+	@brief Allocate the arrays of a table with a given capacity.
+*/
+static void big_table_alloc( BigHashTable* t, size_t capacity ) {
+	t->capacity = capacity;
+	t->count = 0;
+	t->deleted = 0;
+	t->ctrl = safe_malloc( capacity + BIG_HASH_GROUP );
+	memset( t->ctrl, CTRL_EMPTY, capacity + BIG_HASH_GROUP );
+	OSRF_MALLOC( t->slots, capacity * sizeof( BigHashSlot ) );
+}
+
+/**
+	@brief Find the first free slot in the probe sequence for a given hash value.
+	@return Index of the slot.
+*/
+static size_t find_free( const BigHashTable* t, uint64_t hash ) {
+	size_t mask = t->capacity - 1;
+	size_t pos = ( hash >> 7 ) & mask;
+	size_t step = 0;
+	for( ;; ) {
+		uint64_t m = match_free( load_group( t->ctrl + pos ) );
+		if( m )
+			return ( pos + first_match( m ) ) & mask;
+		step += BIG_HASH_GROUP;
+		pos = ( pos + step ) & mask;
+	}
+}
+
+/**
+	@brief Find the slot holding a given key.
+	@return Index of the slot, or -1 if the key isn't present.
+*/
+static long find_key( const BigHashTable* t, const char* key, uint64_t hash ) {
+	size_t mask = t->capacity - 1;
+	size_t pos = ( hash >> 7 ) & mask;
+	size_t step = 0;
+	unsigned char h2 = hash & 0x7F;
+	for( ;; ) {
+		uint64_t group = load_group( t->ctrl + pos );
+		uint64_t m = match_h2( group, h2 );
+		while( m ) {
+			size_t i = ( pos + first_match( m ) ) & mask;
+			if( t->ctrl[ i ] == h2 && t->slots[ i ].hash == hash
+					&& !strcmp( t->slots[ i ].key, key ) )
+				return (long) i;
+			m &= m - 1;
+		}
+		if( match_empty( group ) )
+			return -1;
+		step += BIG_HASH_GROUP;
+		pos = ( pos + step ) & mask;
+	}
+}
+
+/**
+	@brief Rebuild a table to make room for more entries.
+
+	If more than half of the used slots are merely deleted, we rebuild at the same size to
+	reclaim them.  Otherwise we double the capacity.
+*/
+static void big_table_resize( BigHashTable* t ) {
+	unsigned char* old_ctrl = t->ctrl;
+	BigHashSlot* old_slots = t->slots;
+	size_t old_capacity = t->capacity;
+
+	size_t newcap = ( t->deleted > t->count ) ? old_capacity : old_capacity * 2;
+	big_table_alloc( t, newcap );
+
+	size_t i;
+	for( i = 0; i < old_capacity; ++i ) {
+		if( old_ctrl[ i ] & 0x80 )
+			continue;
+		uint64_t hash = old_slots[ i ].hash;
+		size_t j = find_free( t, hash );
+		set_ctrl( t, j, hash & 0x7F );
+		t->slots[ j ] = old_slots[ i ];
+		++t->count;
+	}
+
+	free( old_ctrl );
+	free( old_slots );
+}
+
+/**
+	@brief Empty a slot, freeing its key.
+*/
+static void big_table_erase( BigHashTable* t, size_t i ) {
+	free( t->slots[ i ].key );
+	t->slots[ i ].key = NULL;
+	t->slots[ i ].item = NULL;
+	set_ctrl( t, i, CTRL_DELETED );
+	--t->count;
+	++t->deleted;
+}
+
+osrfBigHash* osrfNewBigHash() {
+	osrfBigHash* hash = safe_malloc(sizeof(osrfBigHash));
+	BigHashTable* t = safe_malloc( sizeof( BigHashTable ) );
+	big_table_alloc( t, BIG_HASH_INITIAL_SIZE );
+	hash->hash = t;
+	hash->freeItem = NULL;
+	return hash;
+}
+
+void* osrfBigHashSet( osrfBigHash* hash, void* item, const char* key, ... ) {
+	if(!(hash && item && key )) return NULL;
+
+	VA_LIST_TO_STRING(key);
+	BigHashTable* t = hash->hash;
+
+	uint64_t h = big_hash_key( VA_BUF );
+	long i = find_key( t, VA_BUF, h );
+
+	if( i >= 0 ) {
+		void* olditem = t->slots[ i ].item;
+		if( hash->freeItem ) {
+			hash->freeItem( t->slots[ i ].key, olditem );
+			olditem = NULL;
+		}
+		t->slots[ i ].item = item;
+		return olditem;
+	}
+
+	// Keep the table at most 7/8 full, counting deleted slots
+	if( ( t->count + t->deleted + 1 ) * 8 > t->capacity * 7 )
+		big_table_resize( t );
+
+	size_t j = find_free( t, h );
+	if( t->ctrl[ j ] == CTRL_DELETED )
+		--t->deleted;
+	set_ctrl( t, j, h & 0x7F );
+	t->slots[ j ].key = strdup( VA_BUF );
+	t->slots[ j ].item = item;
+	t->slots[ j ].hash = h;
+	++t->count;
+	return NULL;
+}
+
+void* osrfBigHashRemove( osrfBigHash* hash, const char* key, ... ) {
+	if(!(hash && key )) return NULL;
+
+	VA_LIST_TO_STRING(key);
+	BigHashTable* t = hash->hash;
+
+	uint64_t h = big_hash_key( VA_BUF );
+	long i = find_key( t, VA_BUF, h );
+	if( i < 0 )
+		return NULL;
+
+	void* item = t->slots[ i ].item;
+	if( item && hash->freeItem ) {
+		hash->freeItem( t->slots[ i ].key, item );
+		item = NULL;
+	}
+
+	big_table_erase( t, i );
+	return item;
+}
+
+void* osrfBigHashGet( osrfBigHash* hash, const char* key, ... ) {
+	if(!(hash && key )) return NULL;
+
+	VA_LIST_TO_STRING(key);
+	const BigHashTable* t = hash->hash;
+
+	uint64_t h = big_hash_key( VA_BUF );
+	long i = find_key( t, VA_BUF, h );
+	return ( i >= 0 ) ? t->slots[ i ].item : NULL;
+}
+
+osrfStringArray* osrfBigHashKeys( osrfBigHash* hash ) {
+	if(!hash) return NULL;
+
+	const BigHashTable* t = hash->hash;
+	osrfStringArray* strings = osrfNewStringArray( t->count ? t->count : 8 );
+
+	size_t i;
+	for( i = 0; i < t->capacity; ++i ) {
+		if( !( t->ctrl[ i ] & 0x80 ) )
+			osrfStringArrayAdd( strings, t->slots[ i ].key );
+	}
+
+	return strings;
+}
+
+unsigned long osrfBigHashGetCount( osrfBigHash* hash ) {
+	if(!hash) return -1;
+	return ((const BigHashTable*) hash->hash)->count;
+}
+
+void osrfBigHashFree( osrfBigHash* hash ) {
+	if(!hash) return;
+
+	BigHashTable* t = hash->hash;
+	size_t i;
+	for( i = 0; i < t->capacity; ++i ) {
+		if( t->ctrl[ i ] & 0x80 )
+			continue;
+		if( hash->freeItem && t->slots[ i ].item )
+			hash->freeItem( t->slots[ i ].key, t->slots[ i ].item );
+		free( t->slots[ i ].key );
+	}
+
+	free( t->ctrl );
+	free( t->slots );
+	free( t );
+	free( hash );
+}
+
+/*
+	An iterator simply walks the slots in order.  Removing the entry most recently returned
+	is safe; adding entries during a traversal may rebuild the table, after which the
+	iterator may skip or repeat entries.
+
+	As with the Judy backend, current holds a copy of the key most recently returned, so
+	that it outlives the removal of its entry.
+*/
+
+osrfBigHashIterator* osrfNewBigHashIterator( osrfBigHash* hash ) {
+	if(!hash) return NULL;
+	osrfBigHashIterator* itr = safe_malloc(sizeof(osrfBigHashIterator));
+	itr->hash = hash;
+	itr->current = NULL;
+	itr->index = 0;
+	return itr;
+}
+
+void* osrfBigHashIteratorNext( osrfBigHashIterator* itr ) {
+	if(!(itr && itr->hash)) return NULL;
+
+	const BigHashTable* t = itr->hash->hash;
+	while( itr->index < t->capacity ) {
+		size_t i = itr->index++;
+		if( !( t->ctrl[ i ] & 0x80 ) ) {
+			free(itr->current);
+			itr->current = strdup( t->slots[ i ].key );
+			return t->slots[ i ].item;
+		}
+	}
+
+	return NULL;
+}
+
+void osrfBigHashIteratorFree( osrfBigHashIterator* itr ) {
+	if(!itr) return;
+	free(itr->current);
+	free(itr);
+}
+
+void osrfBigHashIteratorReset( osrfBigHashIterator* itr ) {
+	if(!itr) return;
+	free(itr->current);
+	itr->current = NULL;
+	itr->index = 0;
+}
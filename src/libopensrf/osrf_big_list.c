@@ -1,4 +1,7 @@
+#include <limits.h>
+#include <Judy.h>
 #include <opensrf/osrf_big_list.h>
+#include <opensrf/log.h>
 
 
 osrfBigList* osrfNewBigList() {
@@ -23,6 +26,13 @@ int osrfBigListPush( osrfBigList* list, void* item ) {
 void* osrfBigListSet( osrfBigList* list, void* item, unsigned long position ) {
 	if(!list || position < 0) return NULL;
 
+	// Same range as the native backend: the size of a list is an int.
+	if( position >= (unsigned long) INT_MAX ) {
+		osrfLogError( OSRF_LOG_MARK,
+			"osrfBigListSet(): position %lu is out of range", position );
+		return NULL;
+	}
+
 	Word_t* value;
 	void* olditem = osrfBigListRemove( list, position );
 
@@ -0,0 +1,285 @@
+/**
+	@file osrf_big_list_native.c
+	@brief Native backend for osrfBigList, without libJudy.
+
+	The items live in fixed-size chunks, reached through a directory of chunk pointers.
+	A chunk is allocated only when something is stored in it, and freed when it empties
+	again, so that a list with a few widely scattered items costs one directory entry per
+	chunk-sized stretch of positions, rather than one pointer per position.  The directory
+	grows geometrically as higher positions are used.
+
+	Since chunks never move, growing the directory doesn't copy any items, and a traversal
+	walks memory in order.
+
+	As with the Judy backend, a NULL item is treated as an empty position.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <limits.h>
+#include <opensrf/osrf_big_list.h>
+#include <opensrf/log.h>
+
+/** @brief log2 of the number of items in a chunk. */
+#define BIG_LIST_CHUNK_BITS 10
+/** @brief Number of items in a chunk. */
+#define BIG_LIST_CHUNK_SIZE ( 1UL << BIG_LIST_CHUNK_BITS )
+/** @brief Mask to extract the position of an item within its chunk. */
+#define BIG_LIST_CHUNK_MASK ( BIG_LIST_CHUNK_SIZE - 1 )
+
+/**
+	@brief A chunk of consecutive positions.
+*/
+typedef struct {
+	unsigned long used;                    /**< Number of non-NULL items in the chunk. */
+	void* items[ BIG_LIST_CHUNK_SIZE ];    /**< The items. */
+} BigListChunk;
+
+/**
+	@brief The storage hanging from the list member of an osrfBigList.
+*/
+typedef struct {
+	BigListChunk** chunks;   /**< Directory of chunks; NULL for an unused chunk. */
+	unsigned long nchunks;   /**< Number of entries in the directory. */
+	unsigned long count;     /**< Number of non-NULL items in the list. */
+} BigListStore;
+
+/**
+	@brief Fetch the item at a given position, or NULL.
+*/
+static inline void* big_list_get( const BigListStore* s, unsigned long position ) {
+	unsigned long c = position >> BIG_LIST_CHUNK_BITS;
+	if( c >= s->nchunks || !s->chunks[ c ] )
+		return NULL;
+	return s->chunks[ c ]->items[ position & BIG_LIST_CHUNK_MASK ];
+}
+
+/**
+	@brief Recompute the size member: one more than the highest occupied position.
+	@param list The list.
+	@param from The size to start searching down from.
+*/
+static void big_list_shrink( osrfBigList* list, unsigned long from ) {
+	const BigListStore* s = list->list;
+	unsigned long pos = from;
+	while( pos > 0 ) {
+		unsigned long c = ( pos - 1 ) >> BIG_LIST_CHUNK_BITS;
+		const BigListChunk* chunk = s->chunks[ c ];
+		if( !chunk ) {
+			pos = c << BIG_LIST_CHUNK_BITS;   // skip the whole empty chunk
+			continue;
+		}
+		if( chunk->items[ ( pos - 1 ) & BIG_LIST_CHUNK_MASK ] )
+			break;
+		--pos;
+	}
+	list->size = pos;
+}
+
+osrfBigList* osrfNewBigList() {
+	osrfBigList* list = safe_malloc(sizeof(osrfBigList));
+	list->list = safe_malloc( sizeof( BigListStore ) );
+	list->size = 0;
+	list->freeItem = NULL;
+	return list;
+}
+
+int osrfBigListPush( osrfBigList* list, void* item ) {
+	if(!(list && item)) return -1;
+	osrfBigListSet( list, item, list->size );
+	return 0;
+}
+
+void* osrfBigListSet( osrfBigList* list, void* item, unsigned long position ) {
+	if(!list) return NULL;
+
+	// The size of a list is an int, so positions stop short of INT_MAX.  That also keeps
+	// the directory, and its doubling below, far from overflowing.
+	if( position >= (unsigned long) INT_MAX ) {
+		osrfLogError( OSRF_LOG_MARK,
+			"osrfBigListSet(): position %lu is out of range", position );
+		return NULL;
+	}
+
+	void* olditem = osrfBigListRemove( list, (int) position );
+	if( !item )
+		return olditem;
+
+	BigListStore* s = list->list;
+	unsigned long c = position >> BIG_LIST_CHUNK_BITS;
+
+	if( c >= s->nchunks ) {
+		// Grow the directory geometrically
+		unsigned long n = s->nchunks ? s->nchunks * 2 : 4;
+		while( n <= c )
+			n *= 2;
+		BigListChunk** newdir;
+		OSRF_MALLOC( newdir, n * sizeof( BigListChunk* ) );
+		if( s->chunks )
+			memcpy( newdir, s->chunks, s->nchunks * sizeof( BigListChunk* ) );
+		free( s->chunks );
+		s->chunks = newdir;
+		s->nchunks = n;
+	}
+
+	if( !s->chunks[ c ] )
+		OSRF_MALLOC( s->chunks[ c ], sizeof( BigListChunk ) );
+
+	s->chunks[ c ]->items[ position & BIG_LIST_CHUNK_MASK ] = item;
+	++s->chunks[ c ]->used;
+	++s->count;
+	if( position >= list->size )
+		list->size = position + 1;
+
+	return olditem;
+}
+
+void* osrfBigListGetIndex( osrfBigList* list, unsigned long position ) {
+	if(!list) return NULL;
+	return big_list_get( list->list, position );
+}
+
+void osrfBigListFree( osrfBigList* list ) {
+	if(!list) return;
+
+	BigListStore* s = list->list;
+	unsigned long c = s->nchunks;
+
+	// Free the items from last to first, as the Judy backend does
+	while( c > 0 ) {
+		BigListChunk* chunk = s->chunks[ --c ];
+		if( !chunk )
+			continue;
+		if( list->freeItem ) {
+			unsigned long i = BIG_LIST_CHUNK_SIZE;
+			while( i > 0 ) {
+				void* item = chunk->items[ --i ];
+				if( item )
+					list->freeItem( item );
+			}
+		}
+		free( chunk );
+	}
+
+	free( s->chunks );
+	free( s );
+	free(list);
+}
+
+void* osrfBigListRemove( osrfBigList* list, int position ) {
+	if(!list || position < 0) return NULL;
+
+	BigListStore* s = list->list;
+	unsigned long c = (unsigned long) position >> BIG_LIST_CHUNK_BITS;
+	if( c >= s->nchunks || !s->chunks[ c ] )
+		return NULL;
+
+	BigListChunk* chunk = s->chunks[ c ];
+	void** slot = &chunk->items[ position & BIG_LIST_CHUNK_MASK ];
+	void* olditem = *slot;
+	if( !olditem )
+		return NULL;
+
+	*slot = NULL;
+	--s->count;
+	if( --chunk->used == 0 ) {
+		free( chunk );
+		s->chunks[ c ] = NULL;
+	}
+
+	if( list->freeItem ) {
+		list->freeItem( olditem );
+		olditem = NULL;
+	}
+
+	if( (unsigned long) position + 1 == list->size )
+		big_list_shrink( list, position );
+
+	return olditem;
+}
+
+int osrfBigListFind( osrfBigList* list, void* addr ) {
+	if(!(list && addr)) return -1;
+
+	// Search from the end, as the Judy backend does
+	const BigListStore* s = list->list;
+	unsigned long pos = list->size;
+	while( pos > 0 ) {
+		--pos;
+		if( big_list_get( s, pos ) == addr )
+			return pos;
+	}
+
+	return -1;
+}
+
+void __osrfBigListSetSize( osrfBigList* list ) {
+	if(!list) return;
+	big_list_shrink( list, list->size );
+}
+
+unsigned long osrfBigListGetCount( osrfBigList* list ) {
+	if(!list) return -1;
+	return ((const BigListStore*) list->list)->count;
+}
+
+void* osrfBigListPop( osrfBigList* list ) {
+	if(!list) return NULL;
+	return osrfBigListRemove( list, list->size - 1 );
+}
+
+osrfBigBigListIterator* osrfNewBigListIterator( osrfBigList* list ) {
+	if(!list) return NULL;
+	osrfBigBigListIterator* itr = safe_malloc(sizeof(osrfBigBigListIterator));
+	itr->list = list;
+	itr->current = 0;
+	return itr;
+}
+
+void* osrfBigBigListIteratorNext( osrfBigBigListIterator* itr ) {
+	if(!(itr && itr->list)) return NULL;
+
+	const BigListStore* s = itr->list->list;
+	while( itr->current < itr->list->size ) {
+		unsigned long c = itr->current >> BIG_LIST_CHUNK_BITS;
+		const BigListChunk* chunk = s->chunks[ c ];
+		if( !chunk ) {
+			itr->current = ( c + 1 ) << BIG_LIST_CHUNK_BITS;
+			continue;
+		}
+		void* item = chunk->items[ itr->current++ & BIG_LIST_CHUNK_MASK ];
+		if( item )
+			return item;
+	}
+
+	return NULL;
+}
+
+void osrfBigBigListIteratorFree( osrfBigBigListIterator* itr ) {
+	if(!itr) return;
+	free(itr);
+}
+
+void osrfBigBigListIteratorReset( osrfBigBigListIterator* itr ) {
+	if(!itr) return;
+	itr->current = 0;
+}
+
+void osrfBigListVanillaFree( void* item ) {
+	free(item);
+}
+
+void osrfBigListSetDefaultFree( osrfBigList* list ) {
+	if(!list) return;
+	list->freeItem = osrfBigListVanillaFree;
+}
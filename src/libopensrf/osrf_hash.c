@@ -19,6 +19,8 @@ GNU General Public License for more details.
 */
 
 #include <opensrf/osrf_hash.h>
+#include <opensrf/osrf_intern.h>
+#include <opensrf/osrf_vec.h>
 
 /**
 	@brief A node storing a single item within an osrfHash.
@@ -35,6 +37,19 @@ struct _osrfHashNodeStruct {
 };
 typedef struct _osrfHashNodeStruct osrfHashNode;
 
+/**
+	@brief An entry in a bucket of the hash table.
+
+	Keeping the whole hash value beside the node pointer lets a search skip most of the
+	other keys in a bucket without following the pointer or comparing strings.
+*/
+typedef struct {
+	/** @brief Hash value of the node's key, before reduction to a bucket index */
+	unsigned int hash;
+	/** @brief Pointer to the node */
+	osrfHashNode* node;
+} osrfHashSlot;
+
 /**
 	@brief osrfHash structure
 
@@ -42,8 +57,9 @@ typedef struct _osrfHashNodeStruct osrfHashNode;
 	structure implemented as a linked list.
 
 	The hash table is an array of pointers, managed by an osrfList.  Each pointer in that array
-	points to another layer of osrfList, which stores pointers to osrfHashNodes for keys that
-	hash to the same value.
+	points to an osrfVec of osrfHashSlots, one for each osrfHashNode whose key hashes to that
+	bucket.  The slots lie contiguously, so searching a bucket walks a single block of
+	memory.
 
 	Besides residing in this hash table structure, each osrfHashNode resides in a doubly
 	linked list that includes all the osrfHashNodes in the osrfHash (except for any nodes
@@ -65,6 +81,8 @@ struct _osrfHashStruct {
 	osrfHashNode* first_key;
 	/** @brief Pointer to the last node in the linked list */
 	osrfHashNode* last_key;
+	/** @brief Boolean; if true, keys are interned strings rather than private copies */
+	int intern_keys;
 };
 
 /**
@@ -87,6 +105,17 @@ struct _osrfHashIteratorStruct {
 #define OSRF_HASH_LIST_SIZE 0x10  /* size of the main hash list */
 
 
+/**
+	@brief Free the key of an osrfHashNode, according to how the osrfHash stores keys.
+	@param h Pointer to the osrfHash
+	@param k Pointer to the key
+*/
+#define OSRF_HASH_KEY_FREE(h, k) \
+	do { \
+		if( (h)->intern_keys ) osrfInternRelease(k); \
+		else free(k); \
+	} while(0)
+
 /* used internally */
 /**
 	@brief Free an osrfHashNode, and its cargo, from within a given osrfHash.
@@ -100,7 +129,7 @@ struct _osrfHashIteratorStruct {
 #define OSRF_HASH_NODE_FREE(h, n) \
 	if(h && n) { \
 		if(h->freeItem && n->key) h->freeItem(n->key, n->item);\
-		free(n->key); free(n); \
+		OSRF_HASH_KEY_FREE(h, n->key); free(n); \
 }
 
 /**
@@ -118,7 +147,7 @@ osrfHash* osrfNewHash() {
 	return hash;
 }
 
-static osrfHashNode* osrfNewHashNode(char* key, void* item);
+static osrfHashNode* osrfNewHashNode(const osrfHash* hash, const char* key, void* item);
 
 /*
 static unsigned int osrfHashMakeKey(char* str) {
@@ -136,7 +165,8 @@ static unsigned int osrfHashMakeKey(char* str) {
 /**
 	@brief Hashing algorithm: derive a mangled number from a string.
 	@param str Pointer to the string to be hashed.
-	@param num A numeric variable to receive the resulting value.
+	@param num A numeric variable to receive the resulting value.  Mask it with
+		OSRF_HASH_LIST_SIZE - 1 to get the index of a bucket.
 
 	This macro implements an algorithm proposed by Donald E. Knuth
 	in The Art of Computer Programming Volume 3 (more or less..)
@@ -149,7 +179,7 @@ static unsigned int osrfHashMakeKey(char* str) {
       unsigned int i__ = 0;\
       for(i__ = 0; i__ < len__; k__++, i__++)\
          h__ = ((h__ << 5) ^ (h__ >> 27)) ^ (*k__);\
-      num = (h__ & (OSRF_HASH_LIST_SIZE-1));\
+      num = h__;\
    } while(0)
 
 /**
@@ -166,52 +196,70 @@ void osrfHashSetCallback( osrfHash* hash, void (*callback) (char* key, void* ite
 	if( hash ) hash->freeItem = callback;
 }
 
+/**
+	@brief Make an osrfHash store its keys as interned strings.
+	@param hash Pointer to the osrfHash.
+
+	By default an osrfHash stores a private copy of each key.  For hashes whose keys are
+	drawn from a small, heavily repeated vocabulary -- such as the field names of
+	fieldmapper objects -- it is cheaper to share a single interned copy of each key
+	(see osrf_intern.h).
+
+	This setting must be applied while the osrfHash is still empty; otherwise it is
+	ignored.
+*/
+void osrfHashSetInternKeys( osrfHash* hash )
+{
+	if( hash && 0 == hash->size && NULL == hash->first_key )
+		hash->intern_keys = 1;
+}
+
 /* Returns a pointer to the item's node if found; otherwise returns NULL. */
 /**
 	@brief Search for a given key in an osrfHash.
 	@param hash Pointer to the osrfHash.
 	@param key The key to be sought.
-	@param bucketkey Pointer through which we can report which slot the item belongs in.
+	@param hashval Pointer through which we can report the hash value of the key.
 	@return A pointer to the osrfHashNode where the item resides; or NULL, if it isn't there.
 
-	If the bucketkey parameter is not NULL, we update the index of the hash bucket where the
-	item belongs (whether or not we actually found it).  In some cases this feedback enables the
-	calling function to avoid hashing the same key twice.
+	If the hashval parameter is not NULL, we report the hash value of the key, and hence the
+	bucket where the item belongs (whether or not we actually found it).  In some cases this
+	feedback enables the calling function to avoid hashing the same key twice.
 */
 static osrfHashNode* find_item( const osrfHash* hash,
-		const char* key, unsigned int* bucketkey ) {
+		const char* key, unsigned int* hashval ) {
 
 	// Find the sub-list in the hash table
 
-	if( hash->size < 6 && !bucketkey )
+	if( hash->size < 6 && !hashval )
 	{
 		// For only a few entries, when we don't need to identify
 		// the hash bucket, it's probably faster to search the
 		// linked list instead of hashing
 
 		osrfHashNode* currnode = hash->first_key;
-		while( currnode && strcmp( currnode->key, key ) )
+		while( currnode && currnode->key != key && strcmp( currnode->key, key ) )
 			 currnode = currnode->next;
 
 		return currnode;
 	}
 
-	unsigned int i = 0;
-	OSRF_HASH_MAKE_KEY(key,i);
+	unsigned int h = 0;
+	OSRF_HASH_MAKE_KEY(key,h);
 
-	// If asked, report which slot the key hashes to
-	if( bucketkey ) *bucketkey = i;
+	// If asked, report what the key hashes to
+	if( hashval ) *hashval = h;
 
-	osrfList* list = OSRF_LIST_GET_INDEX( hash->hash, i );
-	if( !list ) { return NULL; }
+	const osrfVec* bucket = OSRF_LIST_GET_INDEX( hash->hash, h & (OSRF_HASH_LIST_SIZE-1) );
+	if( !bucket ) { return NULL; }
 
-	// Search the sub-list
+	// Search the bucket, comparing keys only when their hash values match
 
-	int k;
-	osrfHashNode* node = NULL;
-	for( k = 0; k < list->size; k++ ) {
-		node = OSRF_LIST_GET_INDEX(list, k);
-		if( node && node->key && !strcmp(node->key, key) )
+	const osrfHashSlot* slot = (const osrfHashSlot*) bucket->data;
+	const osrfHashSlot* end = slot + bucket->size;
+	for( ; slot < end; slot++ ) {
+		osrfHashNode* node = slot->node;
+		if( slot->hash == h && node->key && ( node->key == key || !strcmp(node->key, key) ) )
 			return node;
 	}
 
@@ -220,15 +268,22 @@ static osrfHashNode* find_item( const osrfHash* hash,
 
 /**
 	@brief Create and populate a new osrfHashNode.
+	@param hash Pointer to the osrfHash that will own the node.
 	@param key The key string.
 	@param item A pointer to the item associated with the key.
 	@return A pointer to the newly created node.
+
+	The node stores either a private copy of the key or an interned one, depending on
+	whether osrfHashSetInternKeys() has been called for the osrfHash.
 */
-static osrfHashNode* osrfNewHashNode(char* key, void* item) {
+static osrfHashNode* osrfNewHashNode(const osrfHash* hash, const char* key, void* item) {
 	if(!(key && item)) return NULL;
 	osrfHashNode* n;
 	OSRF_MALLOC(n, sizeof(osrfHashNode));
-	n->key = strdup(key);
+	if( hash->intern_keys )
+		n->key = (char*) osrfIntern(key);
+	else
+		n->key = strdup(key);
 	n->item = item;
 	n->prev = NULL;
 	n->prev = NULL;
@@ -256,10 +311,10 @@ static osrfHashNode* osrfNewHashNode(char* key, void* item) {
 void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... ) {
 	if(!(hash && item && key )) return NULL;
 
-	unsigned int bucketkey;
+	unsigned int hashval;
 
 	VA_LIST_TO_STRING(key);
-	osrfHashNode* node = find_item( hash, VA_BUF, &bucketkey );
+	osrfHashNode* node = find_item( hash, VA_BUF, &hashval );
 	if( node ) {
 
 		// We already have an item for this key.  Update it in place.
@@ -276,14 +331,16 @@ void* osrfHashSet( osrfHash* hash, void* item, const char* key, ... ) {
 	}
 
 	// There is no entry for this key.  Create a new one.
-	osrfList* bucket;
+	unsigned int bucketkey = hashval & (OSRF_HASH_LIST_SIZE-1);
+	osrfVec* bucket;
 	if( !(bucket = OSRF_LIST_GET_INDEX(hash->hash, bucketkey)) ) {
-		bucket = osrfNewList();
+		bucket = osrfNewVecSize( sizeof( osrfHashSlot ), 4 );
 		osrfListSet( hash->hash, bucket, bucketkey );
 	}
 
-	node = osrfNewHashNode(VA_BUF, item);
-	osrfListPushFirst( bucket, node );
+	node = osrfNewHashNode(hash, VA_BUF, item);
+	osrfHashSlot slot = { hashval, node };
+	osrfVecPush( bucket, &slot );
 
 	hash->size++;
 
@@ -341,7 +398,7 @@ void* osrfHashRemove( osrfHash* hash, const char* key, ... ) {
 
 	// Mark the node as logically deleted
 
-	free(node->key);
+	OSRF_HASH_KEY_FREE(hash, node->key);
 	node->key = NULL;
 	node->item = NULL;
 
@@ -388,7 +445,7 @@ void* osrfHashExtract( osrfHash* hash, const char* key, ... ) {
 	void* item = node->item;  // to be returned
 
 	// Mark the node as logically deleted
-	free(node->key);
+	OSRF_HASH_KEY_FREE(hash, node->key);
 	node->key = NULL;
 	node->item = NULL;
 
@@ -492,18 +549,18 @@ unsigned long osrfHashGetCount( osrfHash* hash ) {
 void osrfHashFree( osrfHash* hash ) {
 	if(!hash) return;
 
-	int i, j;
-	osrfList* list;
+	int i;
+	size_t j;
+	osrfVec* bucket;
 	osrfHashNode* node;
 
 	for( i = 0; i != hash->hash->size; i++ ) {
-		if( ( list = OSRF_LIST_GET_INDEX( hash->hash, i )) ) {
-			for( j = 0; j != list->size; j++ ) {
-				if( (node = OSRF_LIST_GET_INDEX( list, j )) ) {
-					OSRF_HASH_NODE_FREE(hash, node);
-				}
+		if( ( bucket = OSRF_LIST_GET_INDEX( hash->hash, i )) ) {
+			for( j = 0; j != bucket->size; j++ ) {
+				node = ((osrfHashSlot*) bucket->data)[ j ].node;
+				OSRF_HASH_NODE_FREE(hash, node);
 			}
-			osrfListFree(list);
+			osrfVecFree(bucket);
 		}
 	}
 
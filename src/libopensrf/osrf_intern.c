@@ -0,0 +1,259 @@
+/**
+	@file osrf_intern.c
+	@brief A process-wide table of reference-counted, interned strings.
+
+	Each interned string lives in an osrfInternEntry, a single allocation holding a reference
+	count, a hash value, a length, and the characters themselves.  The pointer handed out to
+	callers points at the characters; we get back to the header by subtracting the offset of
+	the string within the entry.  As a result, osrfInternRetain(), osrfInternHash() and
+	osrfInternLength() cost no lookup at all.
+
+	The entries are indexed by an open-addressed hash table with linear probing, kept no more
+	than half full.  When an entry's last reference goes away, we remove it from the table by
+	shifting later entries back, so that no tombstones accumulate.
+
+	A single mutex guards the table and the reference counts.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <stddef.h>
+#include <pthread.h>
+#include <opensrf/osrf_intern.h>
+
+/**
+	@brief An interned string, with its bookkeeping.
+*/
+typedef struct {
+	unsigned long refs;   /**< Number of outstanding references. */
+	unsigned int hash;    /**< Hash value of the string. */
+	size_t len;           /**< Length of the string. */
+	char str[];           /**< The string itself, nul-terminated. */
+} osrfInternEntry;
+
+/** @brief Initial number of slots in the table; must be a power of 2. */
+#define OSRF_INTERN_INITIAL_SIZE 256
+
+/** @brief Recover the osrfInternEntry from a pointer to its string. */
+#define INTERN_ENTRY(istr) \
+	((osrfInternEntry*) ((char*) (istr) - offsetof( osrfInternEntry, str )))
+
+static osrfInternEntry** intern_slots = NULL;  /**< The hash table. */
+static unsigned int intern_capacity = 0;       /**< Number of slots. */
+static unsigned long intern_count = 0;         /**< Number of distinct strings. */
+/** @brief Guards the table, and the reference count of every entry. */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+	@brief Compute a hash value for a string of known length.
+	@param str Pointer to the string (need not be nul-terminated).
+	@param len Number of characters to hash.
+	@return The hash value (FNV-1a).
+*/
+static unsigned int intern_hash( const char* str, size_t len ) {
+	unsigned int h = 2166136261u;
+	size_t i;
+	for( i = 0; i < len; ++i ) {
+		h ^= (unsigned char) str[ i ];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+	@brief Find the slot holding a given string, or the empty slot where it would go.
+	@param str Pointer to the string sought (need not be nul-terminated).
+	@param len Length of the string sought.
+	@param hash Hash value of the string sought.
+	@return Index of the matching slot, or of the first empty slot in its probe sequence.
+*/
+static unsigned int intern_probe( const char* str, size_t len, unsigned int hash ) {
+	unsigned int mask = intern_capacity - 1;
+	unsigned int i = hash & mask;
+	for( ;; ) {
+		const osrfInternEntry* entry = intern_slots[ i ];
+		if( NULL == entry )
+			return i;
+		if( entry->hash == hash && entry->len == len && !memcmp( entry->str, str, len ) )
+			return i;
+		i = ( i + 1 ) & mask;
+	}
+}
+
+/**
+	@brief Allocate the table, or double its size and rehash its contents.
+*/
+static void intern_grow( void ) {
+	osrfInternEntry** old_slots = intern_slots;
+	unsigned int old_capacity = intern_capacity;
+
+	intern_capacity = old_capacity ? old_capacity * 2 : OSRF_INTERN_INITIAL_SIZE;
+	OSRF_MALLOC( intern_slots, intern_capacity * sizeof( osrfInternEntry* ) );
+
+	unsigned int i;
+	for( i = 0; i < old_capacity; ++i ) {
+		osrfInternEntry* entry = old_slots[ i ];
+		if( entry )
+			intern_slots[ intern_probe( entry->str, entry->len, entry->hash ) ] = entry;
+	}
+
+	free( old_slots );
+}
+
+/**
+	@brief Intern a nul-terminated string.
+	@param str Pointer to the string to be interned.
+	@return Pointer to the shared copy of the string, or NULL if @a str is NULL.
+
+	The calling code owns one reference to the returned string, and must eventually give
+	it up by calling osrfInternRelease().
+*/
+const char* osrfIntern( const char* str ) {
+	if( !str )
+		return NULL;
+	return osrfInternN( str, strlen( str ) );
+}
+
+/**
+	@brief Intern a string of a specified length.
+	@param str Pointer to the first character of the string (need not be nul-terminated).
+	@param len Number of characters in the string.
+	@return Pointer to the shared, nul-terminated copy of the string, or NULL if @a str
+		is NULL.
+
+	The calling code owns one reference to the returned string, and must eventually give
+	it up by calling osrfInternRelease().
+*/
+const char* osrfInternN( const char* str, size_t len ) {
+	if( !str )
+		return NULL;
+
+	unsigned int hash = intern_hash( str, len );
+	pthread_mutex_lock( &intern_lock );
+
+	if( ( intern_count + 1 ) * 2 > intern_capacity )
+		intern_grow();
+
+	unsigned int i = intern_probe( str, len, hash );
+	osrfInternEntry* entry = intern_slots[ i ];
+
+	if( entry )
+		++entry->refs;
+	else {
+		entry = safe_malloc( sizeof( osrfInternEntry ) + len + 1 );
+		entry->refs = 1;
+		entry->hash = hash;
+		entry->len = len;
+		memcpy( entry->str, str, len );
+		entry->str[ len ] = '\0';
+
+		intern_slots[ i ] = entry;
+		++intern_count;
+	}
+
+	pthread_mutex_unlock( &intern_lock );
+	return entry->str;
+}
+
+/**
+	@brief Acquire another reference to an already interned string.
+	@param istr Pointer to an interned string (as returned by osrfIntern()), or NULL.
+	@return The same pointer.
+
+	This is much cheaper than interning the string again, since it doesn't hash the
+	string or search the table.
+*/
+const char* osrfInternRetain( const char* istr ) {
+	if( istr ) {
+		pthread_mutex_lock( &intern_lock );
+		++INTERN_ENTRY( istr )->refs;
+		pthread_mutex_unlock( &intern_lock );
+	}
+	return istr;
+}
+
+/**
+	@brief Give up a reference to an interned string.
+	@param istr Pointer to an interned string (as returned by osrfIntern()), or NULL.
+
+	When the last reference is released, the string is removed from the table and freed.
+*/
+void osrfInternRelease( const char* istr ) {
+	if( !istr )
+		return;
+
+	osrfInternEntry* entry = INTERN_ENTRY( istr );
+	pthread_mutex_lock( &intern_lock );
+	if( --entry->refs > 0 ) {
+		pthread_mutex_unlock( &intern_lock );
+		return;
+	}
+
+	// Find the slot that points to this entry
+	unsigned int mask = intern_capacity - 1;
+	unsigned int i = entry->hash & mask;
+	while( intern_slots[ i ] != entry )
+		i = ( i + 1 ) & mask;
+
+	intern_slots[ i ] = NULL;
+	--intern_count;
+	free( entry );
+
+	// Shift any displaced entries that follow back toward their home slots,
+	// so that no probe sequence is broken by the hole we just made.
+	unsigned int j = i;
+	for( ;; ) {
+		j = ( j + 1 ) & mask;
+		osrfInternEntry* next = intern_slots[ j ];
+		if( NULL == next )
+			break;
+		unsigned int home = next->hash & mask;
+		if( ( j > i && ( home <= i || home > j ) ) ||
+			( j < i && ( home <= i && home > j ) ) ) {
+			intern_slots[ i ] = next;
+			intern_slots[ j ] = NULL;
+			i = j;
+		}
+	}
+
+	pthread_mutex_unlock( &intern_lock );
+}
+
+/**
+	@brief Return the precomputed hash value of an interned string.
+	@param istr Pointer to an interned string.
+	@return The hash value, or zero if @a istr is NULL.
+*/
+unsigned int osrfInternHash( const char* istr ) {
+	return istr ? INTERN_ENTRY( istr )->hash : 0;
+}
+
+/**
+	@brief Return the length of an interned string.
+	@param istr Pointer to an interned string.
+	@return The length, or zero if @a istr is NULL.
+*/
+size_t osrfInternLength( const char* istr ) {
+	return istr ? INTERN_ENTRY( istr )->len : 0;
+}
+
+/**
+	@brief Return the number of distinct strings currently interned.
+	@return The number of entries in the table.
+*/
+unsigned long osrfInternCount( void ) {
+	pthread_mutex_lock( &intern_lock );
+	unsigned long count = intern_count;
+	pthread_mutex_unlock( &intern_lock );
+	return count;
+}
@@ -64,6 +64,7 @@ GNU General Public License for more details.
 	if( newtype == JSON_HASH && _obj_->value.h == NULL ) {	\
 		_obj_->value.h = osrfNewHash();		\
 		osrfHashSetCallback( _obj_->value.h, _jsonFreeHashItem ); \
+		osrfHashSetInternKeys( _obj_->value.h ); \
 	} else if( newtype == JSON_ARRAY && _obj_->value.l == NULL ) {	\
 		_obj_->value.l = osrfNewList();		\
 		_obj_->value.l->freeItem = _jsonFreeListItem;\
@@ -543,11 +544,13 @@ static void add_json_to_buffer( const jsonObject* obj,
 		case JSON_ARRAY: {
 			OSRF_BUFFER_ADD_CHAR(buf, '[');
 			if( obj->value.l ) {
-				int i;
-				for( i = 0; i != obj->value.l->size; i++ ) {
-					if(i > 0) OSRF_BUFFER_ADD(buf, ",");
-					add_json_to_buffer(
-						OSRF_LIST_GET_INDEX(obj->value.l, i), buf, do_classname, second_pass );
+				// Walk the array of pointers directly; holes serialize as null
+				jsonObject** items = (jsonObject**) obj->value.l->arrlist;
+				unsigned int count = obj->value.l->size;
+				unsigned int i;
+				for( i = 0; i < count; i++ ) {
+					if(i > 0) OSRF_BUFFER_ADD_CHAR(buf, ',');
+					add_json_to_buffer( items[i], buf, do_classname, second_pass );
 				}
 			}
 			OSRF_BUFFER_ADD_CHAR(buf, ']');
@@ -733,10 +736,32 @@ jsonObject* jsonObjectGetIndex( const jsonObject* obj, unsigned long index ) {
 	The return value is -1 if @a dest is NULL, or if it points to a jsonObject not of type
 	JSON_ARRAY.  Otherwise it reflects the number of elements remaining in the top level of
 	the outer jsonObject, not counting any at lower levels.
+
+	The elements after the one removed stay where they are, leaving a hole; see
+	jsonObjectRemoveIndexShift() for a version that closes it up.
 */
 unsigned long jsonObjectRemoveIndex(jsonObject* dest, unsigned long index) {
 	if( dest && dest->type == JSON_ARRAY ) {
 		osrfListRemove(dest->value.l, index);
+		dest->size = dest->value.l->size;
+		return dest->value.l->size;
+	}
+	return -1;
+}
+
+/**
+	@brief Remove a specified element from a jsonObject of type JSON_ARRAY, closing the gap.
+	@param dest Pointer to the jsonObject from which the element is to be removed.
+	@param index A zero-based index identifying the element to be removed.
+	@return The number of elements remaining at the top level, or -1 upon error.
+
+	This function is like jsonObjectRemoveIndex(), except that the elements after the one
+	removed move down by one, so that the array has no hole.
+*/
+unsigned long jsonObjectRemoveIndexShift(jsonObject* dest, unsigned long index) {
+	if( dest && dest->type == JSON_ARRAY ) {
+		osrfListRemoveShift(dest->value.l, index);
+		dest->size = dest->value.l->size;
 		return dest->value.l->size;
 	}
 	return -1;
@@ -761,6 +786,27 @@ unsigned long jsonObjectRemoveIndex(jsonObject* dest, unsigned long index) {
 jsonObject* jsonObjectExtractIndex(jsonObject* dest, unsigned long index) {
 	if( dest && dest->type == JSON_ARRAY ) {
 		jsonObject* obj = osrfListExtract(dest->value.l, index);
+		dest->size = dest->value.l->size;
+		if( obj )
+			obj->parent = NULL;
+		return obj;
+	} else
+		return NULL;
+}
+
+/**
+	@brief Extract a specified element from a jsonObject of type JSON_ARRAY, closing the gap.
+	@param dest Pointer to the jsonObject from which the element is to be extracted.
+	@param index A zero-based index identifying the element to be extracted.
+	@return A pointer to the extracted element, if successful; otherwise NULL.
+
+	This function is like jsonObjectExtractIndex(), except that the elements after the one
+	extracted move down by one, so that the array has no hole.
+*/
+jsonObject* jsonObjectExtractIndexShift(jsonObject* dest, unsigned long index) {
+	if( dest && dest->type == JSON_ARRAY ) {
+		jsonObject* obj = osrfListExtractShift(dest->value.l, index);
+		dest->size = dest->value.l->size;
 		if( obj )
 			obj->parent = NULL;
 		return obj;
@@ -969,6 +1015,9 @@ jsonObject* jsonObjectClone( const jsonObject* o ) {
         case JSON_ARRAY:
             arr = jsonNewObject(NULL);
             arr->type = JSON_ARRAY;
+            // Allocate the whole array up front, rather than growing it as we go
+            arr->value.l = osrfNewListSize(o->size);
+            arr->value.l->freeItem = _jsonFreeListItem;
             for(i=0; i < o->size; i++) 
                 jsonObjectPush(arr, jsonObjectClone(jsonObjectGetIndex(o, i)));
             result = arr;
@@ -6,7 +6,7 @@
 #include <opensrf/osrf_list.h>
 /** @brief The initial size of the array when none is specified */
 #define OSRF_LIST_DEFAULT_SIZE 48 /* most opensrf lists are small... */
-/** @brief How many slots to add at a time when the array grows */
+/** @brief How many slots to add at a time when the array grows, at least */
 #define OSRF_LIST_INC_SIZE 256
 //#define OSRF_LIST_MAX_SIZE 10240
 
@@ -100,28 +100,26 @@ int osrfListPushFirst( osrfList* list, void* item ) {
 
 	If the specified position is beyond the physical bounds of the array, we replace the
 	existing array with one that's big enough.  This replacement is transparent to the
-	calling code.
+	calling code.  Past OSRF_LIST_INC_SIZE slots, the array at least doubles each time, so
+	that filling a long list by pushing costs linear time.
 */
 void* osrfListSet( osrfList* list, void* item, unsigned int position ) {
 	if(!list) return NULL;
 
-	int newsize = list->arrsize;
+	size_t newsize = list->arrsize;
 
 	while( position >= newsize )
-		newsize += OSRF_LIST_INC_SIZE;
+		newsize += newsize > OSRF_LIST_INC_SIZE ? newsize : OSRF_LIST_INC_SIZE;
 
 	if( newsize > list->arrsize ) { /* expand the list if necessary */
-		void** newarr;
-		OSRF_MALLOC(newarr, newsize * sizeof(void*));
-
-		// Copy the old pointers, and nullify the new ones
+		void** newarr = realloc( list->arrlist, newsize * sizeof(void*) );
+		if( !newarr ) {
+			perror( "osrfListSet(): Out of Memory" );
+			exit( 99 );
+		}
 
-		int i;
-		for( i = 0; i < list->arrsize; i++ )
-			newarr[i] = list->arrlist[i];
-		for( ; i < newsize; i++ )
-			newarr[i] = NULL;
-		free(list->arrlist);
+		// Nullify the new pointers
+		memset( newarr + list->arrsize, 0, ( newsize - list->arrsize ) * sizeof(void*) );
 		list->arrlist = newarr;
 		list->arrsize = newsize;
 	}
@@ -259,6 +257,44 @@ void* osrfListExtract( osrfList* list, unsigned int position ) {
 }
 
 
+/**
+	@brief Remove a pointer from a specified position, and close up the gap.
+	@param list A pointer to the osrfList.
+	@param position A zero-based subscript identifying the pointer to be removed.
+	@return A copy of the pointer removed, or NULL if the item was freed.
+
+	This function is like osrfListRemove(), except that the pointers after the one removed
+	move down by one position, and the list shrinks by one.
+*/
+void* osrfListRemoveShift( osrfList* list, unsigned int position ) {
+	void* olditem = osrfListExtractShift( list, position );
+	if( olditem && list->freeItem ) {
+		list->freeItem(olditem);
+		olditem = NULL;
+	}
+	return olditem;
+}
+
+/**
+	@brief Extract a pointer from a specified position, and close up the gap.
+	@param list A pointer to the osrfList.
+	@param position A zero-based subscript identifying the pointer to be extracted.
+	@return The pointer at the specified position.
+
+	This function is like osrfListExtract(), except that the pointers after the one
+	extracted move down by one position, and the list shrinks by one.
+*/
+void* osrfListExtractShift( osrfList* list, unsigned int position ) {
+	if(!list || position >= list->size) return NULL;
+
+	void* olditem = list->arrlist[position];
+	memmove( list->arrlist + position, list->arrlist + position + 1,
+		( list->size - position - 1 ) * sizeof(void*) );
+	list->size--;
+	list->arrlist[list->size] = NULL;
+	return olditem;
+}
+
 /**
 	@brief Find the position where a given pointer is stored.
 	@param list A pointer to the osrfList.
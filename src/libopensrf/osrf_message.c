@@ -10,11 +10,45 @@
 #include <libxml/xpathInternals.h>
 #include <libxml/tree.h>
 
+#include <ctype.h>
 #include <opensrf/osrf_message.h>
 #include "opensrf/osrf_stack.h"
 
 static osrfMessage* deserialize_one_message( const jsonObject* message );
 
+/** @brief Deepest nesting of arrays and objects that osrfMessageScan() will skip over. */
+#define SCAN_MAX_DEPTH 512
+
+/* What osrfMessageScan() looks for in an object, according to where the object is */
+enum scan_level { SCAN_SKIP, SCAN_ELEMENT, SCAN_MESSAGE, SCAN_PAYLOAD, SCAN_PAYLOAD_DATA };
+
+/**
+	@brief A JSON value, as much of it as osrfMessageScan() needs to know.
+*/
+typedef struct {
+	char kind;          /**< '"', '{', '[', 'n', 't', 'f', or '0' for a number. */
+	const char* text;   /**< For a string, its contents; for a number, its digits. */
+	size_t len;         /**< Length of @a text. */
+	int plain;          /**< Boolean: true for a string with no escapes. */
+} ScanValue;
+
+/**
+	@brief What osrfMessageScan() has found in an object.
+*/
+typedef struct {
+	unsigned int seen;        /**< Bit mask of the members we've looked at. */
+	int is_message;           /**< Boolean: true if "__c" is "osrfMessage". */
+	int data_is_object;       /**< Boolean: true if "__p" is an object. */
+	const char* method;       /**< Contents of "method", or NULL. */
+	size_t method_len;
+	const char* data_method;  /**< Contents of "method" within "__p", or NULL. */
+	size_t data_method_len;
+	osrfMessageSummary* summary;  /**< Where what an osrfMessage says goes. */
+} ScanObject;
+
+static const char* scan_value( const char* p, int depth, enum scan_level level,
+		ScanObject* obj, ScanValue* value );
+
 static char default_locale[17] = "en-US\0\0\0\0\0\0\0\0\0\0\0\0";
 static char* current_locale = NULL;
 
@@ -619,6 +653,331 @@ int osrf_message_deserialize(const char* string, osrfMessage* msgs[], int count)
 }
 
 
+static const char* scan_space( const char* p ) {
+	while( isspace( (unsigned char) *p ) )
+		++p;
+	return p;
+}
+
+/**
+	@brief Skip over a JSON string.
+	@param p Pointer to the opening quotation mark.
+	@param value Pointer to a ScanValue in which to describe the string.
+	@return Pointer past the closing quotation mark, or NULL if jsonParse() would reject it.
+*/
+static const char* scan_string( const char* p, ScanValue* value ) {
+	value->kind = '"';
+	value->text = ++p;
+	value->plain = 1;
+	for( ;; ) {
+		p += strcspn( p, "\"\\" );
+		if( '"' == *p )
+			break;
+		else if( '\0' == *p )
+			return NULL;
+
+		value->plain = 0;
+		if( 'u' == p[ 1 ] ) {
+			// Four hex digits, not encoding a nul
+			int i;
+			int zero = 1;
+			for( i = 2; i < 6; ++i ) {
+				if( !isxdigit( (unsigned char) p[ i ] ) )
+					return NULL;
+				if( p[ i ] != '0' )
+					zero = 0;
+			}
+			if( zero )
+				return NULL;
+			p += 6;
+		} else if( '\0' == p[ 1 ] )
+			return NULL;
+		else
+			p += 2;
+	}
+	value->len = p - value->text;
+	return p + 1;
+}
+
+/**
+	@brief Skip over a JSON number.
+	@param p Pointer to the first character of the number.
+	@param value Pointer to a ScanValue in which to describe the number.
+	@return Pointer past the number, or NULL if it isn't strictly numeric.
+
+	jsonParse() massages some numbers that aren't into ones that are; we leave those to it.
+*/
+static const char* scan_number( const char* p, ScanValue* value ) {
+	size_t len = strspn( p, "0123456789.+-eE" );
+	char buf[ 64 ];
+	if( len >= sizeof( buf ) )
+		return NULL;
+	memcpy( buf, p, len );
+	buf[ len ] = '\0';
+	if( !jsonIsNumeric( buf ) )
+		return NULL;
+
+	value->kind = '0';
+	value->text = p;
+	value->len = len;
+	return p + len;
+}
+
+/**
+	@brief Skip over a JSON object, noting whatever osrfMessageScan() is looking for in it.
+	@param p Pointer to the opening brace.
+	@param depth How deeply the object is nested.
+	@param level What to look for, according to where the object is.
+	@param obj Pointer to a ScanObject to receive what we find (unused for SCAN_SKIP).
+	@return Pointer past the closing brace, or NULL if we can't vouch for the object.
+
+	Where we look, we want the object to read the same way to us as to jsonParse(): no
+	escaped keys, no class hints where deserialize_one_message() doesn't expect them, and
+	no duplicate keys.
+*/
+static const char* scan_object( const char* p, int depth, enum scan_level level,
+		ScanObject* obj ) {
+	static const char* const names[] =
+		{ "__c", "__p", "type", "threadTrace", "api_level", "payload", "method" };
+	const int name_count = sizeof( names ) / sizeof( names[0] );
+
+	p = scan_space( p + 1 );
+	if( '}' == *p )
+		return p + 1;
+
+	for( ;; ) {
+		if( '"' != *p )
+			return NULL;
+		ScanValue key;
+		p = scan_string( p, &key );
+		if( !p )
+			return NULL;
+		p = scan_space( p );
+		if( ':' != *p )
+			return NULL;
+		p = scan_space( p + 1 );
+
+		ScanValue value;
+		if( SCAN_SKIP == level ) {
+			p = scan_value( p, depth, SCAN_SKIP, NULL, &value );
+			if( !p )
+				return NULL;
+		} else {
+			if( !key.plain )
+				return NULL;
+			int name = 0;
+			while( name < name_count && !( strlen( names[ name ] ) == key.len
+					&& !strncmp( names[ name ], key.text, key.len ) ) )
+				++name;
+			if( name < name_count ) {
+				if( obj->seen & ( 1u << name ) )
+					return NULL;
+				obj->seen |= 1u << name;
+			}
+
+			// The objects that we look inside of
+			enum scan_level child_level = SCAN_SKIP;
+			if( 1 == name && SCAN_ELEMENT == level )
+				child_level = SCAN_MESSAGE;
+			else if( 1 == name && SCAN_PAYLOAD == level )
+				child_level = SCAN_PAYLOAD_DATA;
+			else if( 5 == name && SCAN_MESSAGE == level )
+				child_level = SCAN_PAYLOAD;
+
+			ScanObject child;
+			memset( &child, 0, sizeof( child ) );
+			child.summary = obj->summary;
+			p = scan_value( p, depth, child_level, &child, &value );
+			if( !p )
+				return NULL;
+
+			int scalar = '"' == value.kind || '0' == value.kind;
+			if( name < name_count && ( !value.plain
+					|| ( '{' == value.kind && SCAN_SKIP == child_level ) ) )
+				return NULL;    // escaped, or maybe a scalar behind a class hint
+
+			if( 0 == name ) {
+				// A class hint belongs only around a message and its payload
+				if( !( SCAN_ELEMENT == level || SCAN_PAYLOAD == level ) || '"' != value.kind )
+					return NULL;
+				obj->is_message = 11 == value.len && !strncmp( value.text, "osrfMessage", 11 );
+			} else if( 1 == name && SCAN_SKIP != child_level ) {
+				obj->data_is_object = '{' == value.kind;
+				obj->data_method = child.method;
+				obj->data_method_len = child.method_len;
+			} else if( SCAN_MESSAGE == level && scalar ) {
+				osrfMessageSummary* summary = obj->summary;
+				if( 2 == name ) {
+					if( '"' == value.kind ) {
+						if( 7 == value.len && !strncmp( value.text, "REQUEST", 7 ) )
+							summary->m_type = REQUEST;
+						else if( 6 == value.len && !strncmp( value.text, "STATUS", 6 ) )
+							summary->m_type = STATUS;
+						else if( 6 == value.len && !strncmp( value.text, "RESULT", 6 ) )
+							summary->m_type = RESULT;
+						else if( 10 == value.len && !strncmp( value.text, "DISCONNECT", 10 ) )
+							summary->m_type = DISCONNECT;
+					}
+				} else if( 3 == name )
+					summary->thread_trace = atoi( value.text );
+				else if( 4 == name )
+					summary->protocol = atoi( value.text );
+			} else if( SCAN_MESSAGE == level && 5 == name && '{' == value.kind ) {
+				// With a class hint, the payload is what's inside it
+				osrfMessageSummary* summary = obj->summary;
+				if( child.seen & 1u ) {
+					summary->method_name = child.data_is_object ? child.data_method : NULL;
+					summary->method_len = child.data_method_len;
+				} else {
+					summary->method_name = child.method;
+					summary->method_len = child.method_len;
+				}
+			} else if( 6 == name && ( SCAN_PAYLOAD == level || SCAN_PAYLOAD_DATA == level ) ) {
+				if( '0' == value.kind )
+					return NULL;    // a number for a name; leave it to jsonParse()
+				if( '"' == value.kind ) {
+					obj->method = value.text;
+					obj->method_len = value.len;
+				}
+			}
+		}
+
+		p = scan_space( p );
+		if( '}' == *p )
+			return p + 1;
+		else if( ',' != *p )
+			return NULL;
+		p = scan_space( p + 1 );
+	}
+}
+
+/**
+	@brief Skip over a JSON value of any kind.
+	@param p Pointer to the first character of the value.
+	@param depth How deeply the value is nested.
+	@param level What to look for, if the value is an object (see scan_object()).
+	@param obj Pointer to a ScanObject to receive what we find in an object.
+	@param value Pointer to a ScanValue in which to describe the value.
+	@return Pointer past the value, or NULL if we can't vouch for it.
+*/
+static const char* scan_value( const char* p, int depth, enum scan_level level,
+		ScanObject* obj, ScanValue* value ) {
+	if( depth > SCAN_MAX_DEPTH )
+		return NULL;
+
+	value->kind = *p;
+	value->text = NULL;
+	value->len = 0;
+	value->plain = 1;
+
+	switch( *p ) {
+		case '"' :
+			return scan_string( p, value );
+		case '{' :
+			return scan_object( p, depth + 1, level, obj );
+		case '[' :
+			p = scan_space( p + 1 );
+			if( ']' == *p )
+				return p + 1;
+			for( ;; ) {
+				ScanValue element;
+				p = scan_value( p, depth + 1, SCAN_SKIP, NULL, &element );
+				if( !p )
+					return NULL;
+				p = scan_space( p );
+				if( ']' == *p )
+					return p + 1;
+				else if( ',' != *p )
+					return NULL;
+				p = scan_space( p + 1 );
+			}
+		case 'n' :
+			return strncmp( p, "null", 4 ) || isalnum( (unsigned char) p[ 4 ] ) ? NULL : p + 4;
+		case 't' :
+			return strncmp( p, "true", 4 ) || isalnum( (unsigned char) p[ 4 ] ) ? NULL : p + 4;
+		case 'f' :
+			return strncmp( p, "false", 5 ) || isalnum( (unsigned char) p[ 5 ] ) ? NULL : p + 5;
+		default :
+			return scan_number( p, value );
+	}
+}
+
+/**
+	@brief Find out what the osrfMessages in a JSON array are, without parsing it.
+	@param string The JSON string, as for osrfMessageDeserialize().
+	@param summaries Pointer to an array of osrfMessageSummary, to receive the results.
+	@param count How many slots are available in the @a summaries array.
+	@return How many osrfMessages osrfMessageDeserialize() would find, or -1 if we can't
+		tell without parsing the JSON after all.
+
+	We pick out the type, thread trace, protocol, and method name of each message, and skip
+	over everything else, such as the parameters of a REQUEST, without copying or
+	allocating anything.  The method name points into @a string.
+
+	If the array holds more messages than @a summaries has room for, we count them all, but
+	describe only as many as fit.
+
+	We give up, returning -1, on anything that we aren't sure would read the same to
+	jsonParse(): an escape in a string that we need, a class hint where we don't expect
+	one, a number in anything but the strictest form, or anything malformed.  Then the
+	calling code should use osrfMessageDeserialize(), which will read it or complain about
+	it.  Outside of the members that we look at, we don't check for duplicate keys, which
+	would make jsonParse() reject the whole string.
+*/
+int osrfMessageScan( const char* string, osrfMessageSummary summaries[], int count ) {
+
+	if( !string || !*string )
+		return 0;
+
+	const char* p = scan_space( string );
+	if( '[' != *p )
+		return -1;
+
+	int found = 0;
+	p = scan_space( p + 1 );
+	if( ']' == *p )
+		++p;
+	else {
+		for( ;; ) {
+			osrfMessageSummary summary;
+			summary.m_type = CONNECT;      // the default, if there's no type
+			summary.thread_trace = 0;
+			summary.protocol = 0;
+			summary.method_name = NULL;
+			summary.method_len = 0;
+
+			ScanObject obj;
+			memset( &obj, 0, sizeof( obj ) );
+			obj.summary = &summary;
+			ScanValue value;
+			p = scan_value( p, 1, SCAN_ELEMENT, &obj, &value );
+			if( !p )
+				return -1;
+
+			// A message is a class hint of "osrfMessage" around an object
+			if( '{' == value.kind && obj.is_message && ( obj.seen & 2u ) ) {
+				if( !obj.data_is_object )
+					return -1;
+				if( found < count )
+					summaries[ found ] = summary;
+				++found;
+			}
+
+			p = scan_space( p );
+			if( ']' == *p ) {
+				++p;
+				break;
+			} else if( ',' != *p )
+				return -1;
+			p = scan_space( p + 1 );
+		}
+	}
+
+	if( *scan_space( p ) )
+		return -1;       // extra material, which jsonParse() rejects
+	return found;
+}
+
 /**
 	@brief Translate a jsonObject into a single osrfMessage.
 	@param obj Pointer to the jsonObject to be translated.
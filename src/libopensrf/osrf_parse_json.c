@@ -555,6 +555,7 @@ static jsonObject* get_decoded_hash( Parser* parser ) {
 			// Throw away what we have and return a JSON_NULL.
 			jsonObjectFree( hash );
 			hash = jsonNewObjectType( JSON_NULL );
+			free( class_name );
 		}
 
 	} else {
@@ -44,6 +44,9 @@
 #define READ_BUFSIZE 1024
 #define ABS_MAX_CHILDREN 256
 
+/** @brief Least time between load hints to the routers, in seconds. */
+#define LOAD_HINT_INTERVAL 1
+
 typedef struct {
 	int max_requests;     /**< How many requests a child processes before terminating. */
 	int min_children;     /**< Minimum number of children to maintain. */
@@ -66,6 +69,8 @@ typedef struct {
 	struct prefork_child_struct* free_list;
     struct prefork_child_struct* sighup_pending_list;
 	transport_client* connection;  /**< Connection to Jabber. */
+	int reported_load;    /**< The load we last reported to the routers. */
+	time_t load_reported_at;    /**< When we reported it. */
 } prefork_simple;
 
 struct prefork_child_struct {
@@ -105,7 +110,8 @@ static prefork_child* prefork_child_init( prefork_simple* forker,
 static void prefork_child_wait( prefork_child* child );
 static void prefork_clear( prefork_simple*, bool graceful);
 static void prefork_child_free( prefork_simple* forker, prefork_child* );
-static void osrf_prefork_register_routers( const char* appname, bool unregister );
+static void osrf_prefork_register_routers( const char* appname, const char* command );
+static void osrf_prefork_report_load( prefork_simple* forker, int backlog );
 static void osrf_prefork_child_exit( prefork_child* );
 
 static void sigchld_handler( int sig );
@@ -211,7 +217,7 @@ int osrf_prefork_run( const char* appname ) {
 	prefork_launch_children( &forker );
 
 	// Tell the router that you're open for business.
-	osrf_prefork_register_routers( appname, false );
+	osrf_prefork_register_routers( appname, "register" );
 
 	signal( SIGUSR1, sigusr1_handler);
 	signal( SIGUSR2, sigusr2_handler);
@@ -234,14 +240,20 @@ int osrf_prefork_run( const char* appname ) {
 	@param appname Name of the application.
 	@param routerName Name of the router.
 	@param routerDomain Domain of the router.
+	@param command "register", "unregister", or "load".
 
 	Tell the router that you're open for business so that it can route requests to you.
 
+	A "register" or "load" command carries hints for routers that pick listeners by load:
+	how many requests we can work on at once, and how many we're working on or have queued.
+	Routers that don't use the hints ignore them, and routers that don't know the "load"
+	command ignore it altogether.
+
 	Called only by the parent process.
 */
 static void osrf_prefork_send_router_registration(
 		const char* appname, const char* routerName, 
-            const char* routerDomain, bool unregister ) {
+            const char* routerDomain, const char* command ) {
 
 	// Get a pointer to the global transport_client
 	transport_client* client = osrfSystemGetTransportClient();
@@ -251,18 +263,25 @@ static void osrf_prefork_send_router_registration(
 
 	// Create the registration message, and send it
 	transport_message* msg;
-    if (unregister) {
+    if( !strcmp( command, "unregister" ) ) {
 
 	    osrfLogInfo( OSRF_LOG_MARK, "%s un-registering with router %s", appname, jid );
 	    msg = message_init( "unregistering", NULL, NULL, jid, NULL );
-	    message_set_router_info( msg, NULL, NULL, appname, "unregister", 0 );
 
     } else {
 
-	    osrfLogInfo( OSRF_LOG_MARK, "%s registering with router %s", appname, jid );
-	    msg = message_init( "registering", NULL, NULL, jid, NULL );
-	    message_set_router_info( msg, NULL, NULL, appname, "register", 0 );
+	    if( !strcmp( command, "register" ) )
+		    osrfLogInfo( OSRF_LOG_MARK, "%s registering with router %s", appname, jid );
+	    else
+		    osrfLogDebug( OSRF_LOG_MARK, "%s reporting load %d to router %s",
+			    appname, global_forker->reported_load, jid );
+
+	    char hints[ 64 ];
+	    snprintf( hints, sizeof( hints ), "{\"capacity\":%d,\"load\":%d}",
+		    global_forker->max_children, global_forker->reported_load );
+	    msg = message_init( hints, NULL, NULL, jid, NULL );
     }
+	message_set_router_info( msg, NULL, NULL, appname, command, 0 );
 
 	client_send_message( client, msg );
 
@@ -275,6 +294,7 @@ static void osrf_prefork_send_router_registration(
 	@brief Register with a router, or not, according to some config settings.
 	@param appname Name of the application
 	@param RouterChunk A representation of part of the config file.
+	@param command "register", "unregister", or "load".
 
 	Parse a "complex" router configuration chunk.
 
@@ -285,7 +305,7 @@ static void osrf_prefork_send_router_registration(
 	Called only by the parent process.
 */
 static void osrf_prefork_parse_router_chunk( 
-    const char* appname, const jsonObject* routerChunk, bool unregister ) {
+    const char* appname, const jsonObject* routerChunk, const char* command ) {
 
 	const char* routerName = jsonObjectGetString( jsonObjectGetKeyConst( routerChunk, "name" ));
 	const char* domain = jsonObjectGetString( jsonObjectGetKeyConst( routerChunk, "domain" ));
@@ -305,29 +325,30 @@ static void osrf_prefork_parse_router_chunk(
 			for( j = 0; j < service_obj->size; j++ ) {
 				const char* service = jsonObjectGetString( jsonObjectGetIndex( service_obj, j ));
 				if( service && !strcmp( appname, service ))
-					osrf_prefork_send_router_registration( appname, routerName, domain, unregister );
+					osrf_prefork_send_router_registration( appname, routerName, domain, command );
 			}
 		}
 		else if( JSON_STRING == service_obj->type ) {
 			// There's only one service listed.  Register with this router
 			// if and only if this service is the one listed.
 			if( !strcmp( appname, jsonObjectGetString( service_obj )) )
-				osrf_prefork_send_router_registration( appname, routerName, domain, unregister );
+				osrf_prefork_send_router_registration( appname, routerName, domain, command );
 		}
 	} else {
 		// This router is not restricted to any set of services,
 		// so go ahead and register with it.
-		osrf_prefork_send_router_registration( appname, routerName, domain, unregister );
+		osrf_prefork_send_router_registration( appname, routerName, domain, command );
 	}
 }
 
 /**
 	@brief Register the application with one or more routers, according to the configuration.
 	@param appname Name of the application.
+	@param command "register", "unregister", or "load".
 
 	Called only by the parent process.
 */
-static void osrf_prefork_register_routers( const char* appname, bool unregister ) {
+static void osrf_prefork_register_routers( const char* appname, const char* command ) {
 
 	jsonObject* routerInfo = osrfConfigGetValueObject( NULL, "/routers/router" );
 
@@ -341,18 +362,49 @@ static void osrf_prefork_register_routers( const char* appname, bool unregister
 			char* domain = osrfConfigGetValue( NULL, "/routers/router" );
 			osrfLogDebug( OSRF_LOG_MARK, "found simple router settings with router name %s",
 				routerName );
-			osrf_prefork_send_router_registration( appname, routerName, domain, unregister );
+			osrf_prefork_send_router_registration( appname, routerName, domain, command );
 
 			free( routerName );
 			free( domain );
 		} else {
-			osrf_prefork_parse_router_chunk( appname, routerChunk, unregister );
+			osrf_prefork_parse_router_chunk( appname, routerChunk, command );
 		}
 	}
 
 	jsonObjectFree( routerInfo );
 }
 
+/**
+	@brief Tell the routers how busy we are, if that has changed.
+	@param forker Pointer to the prefork_simple.
+	@param backlog How many requests are waiting for a child to become available.
+
+	Our load is the number of requests that our children are working on, plus the backlog.
+	We report it at most once every LOAD_HINT_INTERVAL seconds, so that a busy listener
+	doesn't send the routers a message for every request.
+
+	Called only by the parent process.
+*/
+static void osrf_prefork_report_load( prefork_simple* forker, int backlog ) {
+
+	int load = backlog;
+	prefork_child* child = forker->first_child;
+	if( child ) {
+		do {
+			++load;
+			child = child->next;
+		} while( child != forker->first_child );
+	}
+
+	time_t now = time( NULL );
+	if( load == forker->reported_load || now - forker->load_reported_at < LOAD_HINT_INTERVAL )
+		return;
+
+	forker->reported_load = load;
+	forker->load_reported_at = now;
+	osrf_prefork_register_routers( forker->appname, "load" );
+}
+
 /**
 	@brief Initialize a child process.
 	@param child Pointer to the prefork_child representing the new child process.
@@ -433,6 +485,9 @@ static int prefork_child_process_request( prefork_child* child, char* data ) {
 		}
 	}
 
+	// Batch up our responses; prefork_child_wait() flushes them when we're done.
+	client_set_corked( osrfSystemGetTransportClient(), 1 );
+
 	// Construct the message from the xml.
 	transport_message* msg = new_message_from_xml( data );
 
@@ -568,6 +623,8 @@ static int prefork_simple_init( prefork_simple* prefork, transport_client* clien
 	prefork->free_list    = NULL;
 	prefork->connection   = client;
 	prefork->sighup_pending_list = NULL;
+	prefork->reported_load = 0;
+	prefork->load_reported_at = 0;
 
 	return 0;
 }
@@ -706,7 +763,7 @@ static void sigchld_handler( int sig ) {
 */
 static void sigusr1_handler( int sig ) {
 	if (!global_forker) return;
-	osrf_prefork_register_routers(global_forker->appname, true);
+	osrf_prefork_register_routers(global_forker->appname, "unregister");
 	signal( SIGUSR1, sigusr1_handler );
 }
 
@@ -718,7 +775,7 @@ static void sigusr1_handler( int sig ) {
 */
 static void sigusr2_handler( int sig ) {
 	if (!global_forker) return;
-	osrf_prefork_register_routers(global_forker->appname, false);
+	osrf_prefork_register_routers(global_forker->appname, "register");
 	signal( SIGUSR2, sigusr2_handler );
 }
 
@@ -880,9 +937,11 @@ static void prefork_run( prefork_simple* forker ) {
 
 		int received_from_network = 0;
 		if ( backlog_queue_size == 0 ) {
-			// Wait indefinitely for an input message
+			// Wait for an input message -- indefinitely, unless the routers think that
+			// we're busy.  Then we wake up to tell them when our children are done.
 			osrfLogDebug( OSRF_LOG_MARK, "Forker going into wait for data..." );
-			cur_msg = client_recv( forker->connection, -1 );
+			cur_msg = client_recv( forker->connection,
+				forker->reported_load ? LOAD_HINT_INTERVAL : -1 );
 			received_from_network = 1;
 		} else {
 			// See if any messages are immediately available
@@ -897,6 +956,10 @@ static void prefork_run( prefork_simple* forker ) {
 				// deceased children and try again.
 				if(child_dead)
 					reap_children(forker);
+
+				// or we timed out, waiting to report a lighter load
+				if( forker->reported_load && check_children( forker, 0 ) >= 0 )
+					osrf_prefork_report_load( forker, 0 );
 				continue;
 			}
 
@@ -1072,6 +1135,8 @@ static void prefork_run( prefork_simple* forker ) {
 			message_free( cur_msg );
 		}
 
+		osrf_prefork_report_load( forker, backlog_queue_size );
+
 	} /* end top level listen loop */
 }
 
@@ -1288,6 +1353,9 @@ static void prefork_child_wait( prefork_child* child ) {
 			osrfLogDebug( OSRF_LOG_MARK, "Prefork child got a request.. processing.." );
 			terminate_now = prefork_child_process_request( child, gbuf->buf );
 			buffer_reset( gbuf );
+
+			// Send any responses still held back, before we report that we're free
+			client_flush( osrfSystemGetTransportClient(), -1 );
 		}
 
 		if( terminate_now ) {
@@ -1454,7 +1522,7 @@ static void prefork_clear( prefork_simple* prefork, bool graceful ) {
 
 	// always de-register routers before killing child processes (or waiting
 	// for them to complete) so that new requests are directed elsewhere.
-	osrf_prefork_register_routers(global_forker->appname, true);
+	osrf_prefork_register_routers(global_forker->appname, "unregister");
 
 	while( prefork->first_child ) {
 
@@ -20,6 +20,20 @@ static void _do_server( osrfAppSession*, osrfMessage* );
 	@param msg_received A pointer through which to report whether a message was received.
 	@return 0 upon success (even if a timeout occurs), or -1 upon failure.
 
+	The same as osrf_stack_process_ms(), but with the timeout in seconds.
+*/
+int osrf_stack_process( transport_client* client, int timeout, int* msg_received ) {
+	return osrf_stack_process_ms( client, timeout_to_millis( timeout ), msg_received );
+}
+
+/**
+	@brief Read and process available transport_messages for a transport_client.
+	@param client Pointer to the transport_client whose socket is to be read.
+	@param timeout_ms How many milliseconds to wait for the first message (negative to wait
+		indefinitely).
+	@param msg_received A pointer through which to report whether a message was received.
+	@return 0 upon success (even if a timeout occurs), or -1 upon failure.
+
 	Read and process all available transport_messages from the socket of the specified
 	transport_client.  Pass each one through osrf_stack_transport().
 
@@ -33,17 +47,17 @@ static void _do_server( osrfAppSession*, osrfMessage* );
 	if you don't.  A timeout is not treated as an error; it just means you must set that
 	boolean to false.
 */
-int osrf_stack_process( transport_client* client, int timeout, int* msg_received ) {
+int osrf_stack_process_ms( transport_client* client, int timeout_ms, int* msg_received ) {
 	if( !client ) return -1;
 	transport_message* msg = NULL;
 	if(msg_received) *msg_received = 0;
 
 	// Loop through the available input messages
-	while( (msg = client_recv( client, timeout )) ) {
+	while( (msg = client_recv_ms( client, timeout_ms )) ) {
 		if(msg_received) *msg_received = 1;
 		osrfLogDebug( OSRF_LOG_MARK, "Received message from transport code from %s", msg->sender );
 		osrf_stack_transport_handler( msg, NULL );
-		timeout = 0;
+		timeout_ms = 0;
 	}
 
 	if( client->error ) {
@@ -0,0 +1,469 @@
+/**
+	@file osrf_string_set.c
+	@brief Implement osrfStringSet and osrfPrefixMatcher.
+
+	An osrfStringSet is a hash table with linear probing.  Each slot holds a private copy
+	of a string, its length, and its full hash value, so that most mismatches are rejected
+	without touching the string itself.  The table is kept no more than half full, and
+	deletions shift later entries back into the vacated slot rather than leaving
+	tombstones behind.
+
+	An osrfPrefixMatcher keeps its prefixes sorted, and never stores a prefix that is
+	itself an extension of another stored prefix (if "open-ils.auth" is present, then
+	"open-ils.auth.authenticate" adds nothing).  With that invariant, the only stored
+	prefix that can possibly match a given string is the greatest one that sorts at or
+	before it, which we find with a binary search.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <opensrf/osrf_string_set.h>
+
+/**
+	@brief A single slot in an osrfStringSet.
+*/
+typedef struct {
+	char* str;            /**< Private copy of the string, or NULL if the slot is empty. */
+	size_t len;           /**< Length of the string. */
+	unsigned int hash;    /**< Full hash value of the string. */
+} osrfStringSetSlot;
+
+/**
+	@brief Structure of an osrfStringSet.
+*/
+struct osrfStringSetStruct {
+	osrfStringSetSlot* slots;  /**< Array of slots. */
+	unsigned int capacity;     /**< Number of slots; always a power of 2. */
+	unsigned int count;        /**< Number of strings stored. */
+};
+
+/**
+	@brief Structure of an osrfPrefixMatcher.
+*/
+struct osrfPrefixMatcherStruct {
+	char** prefixes;      /**< Sorted array of prefixes, none a prefix of another. */
+	size_t* lens;         /**< Length of each prefix. */
+	unsigned int size;    /**< Number of prefixes stored. */
+	unsigned int arrsize; /**< Number of prefixes allocated for. */
+	int match_all;        /**< Boolean: an empty prefix was added. */
+};
+
+/** @brief Smallest number of slots in an osrfStringSet. */
+#define OSRF_STRING_SET_MIN_SIZE 16
+
+/**
+	@brief Compute a hash value for a string of known length.
+	@param str Pointer to the string (need not be nul-terminated).
+	@param len Number of characters to hash.
+	@return The hash value.
+
+	This is FNV-1a, which is cheap and spreads short, similar strings such as domain
+	names well enough for linear probing.
+*/
+static unsigned int string_set_hash( const char* str, size_t len ) {
+	unsigned int h = 2166136261u;
+	size_t i;
+	for( i = 0; i < len; ++i ) {
+		h ^= (unsigned char) str[ i ];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+	@brief Find the slot holding a given string, or the empty slot where it would go.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string sought (need not be nul-terminated).
+	@param len Length of the string sought.
+	@param hash Hash value of the string sought.
+	@return Index of the matching slot, or of the first empty slot in its probe sequence.
+*/
+static unsigned int string_set_probe( const osrfStringSet* set, const char* str,
+		size_t len, unsigned int hash ) {
+	unsigned int mask = set->capacity - 1;
+	unsigned int i = hash & mask;
+	for( ;; ) {
+		const osrfStringSetSlot* slot = set->slots + i;
+		if( NULL == slot->str )
+			return i;
+		if( slot->hash == hash && slot->len == len && !memcmp( slot->str, str, len ) )
+			return i;
+		i = ( i + 1 ) & mask;
+	}
+}
+
+/**
+	@brief Double the number of slots in an osrfStringSet, and rehash its contents.
+	@param set Pointer to the osrfStringSet.
+*/
+static void string_set_grow( osrfStringSet* set ) {
+	osrfStringSetSlot* old_slots = set->slots;
+	unsigned int old_capacity = set->capacity;
+
+	set->capacity = old_capacity * 2;
+	OSRF_MALLOC( set->slots, set->capacity * sizeof( osrfStringSetSlot ) );
+
+	unsigned int i;
+	for( i = 0; i < old_capacity; ++i ) {
+		if( old_slots[ i ].str ) {
+			unsigned int j = string_set_probe( set, old_slots[ i ].str,
+				old_slots[ i ].len, old_slots[ i ].hash );
+			set->slots[ j ] = old_slots[ i ];
+		}
+	}
+
+	free( old_slots );
+}
+
+/**
+	@brief Create and initialize an empty osrfStringSet.
+	@param size How many strings to allow space for initially.
+	@return Pointer to the newly created osrfStringSet.
+
+	If @a size is zero or negative, osrfNewStringSet uses a default value.  The set grows
+	as needed.
+
+	The calling code is responsible for freeing the osrfStringSet by calling
+	osrfStringSetFree().
+*/
+osrfStringSet* osrfNewStringSet( int size ) {
+	osrfStringSet* set;
+	OSRF_MALLOC( set, sizeof( osrfStringSet ) );
+
+	// Allow for a load factor of no more than one half
+	unsigned int capacity = OSRF_STRING_SET_MIN_SIZE;
+	while( size > 0 && capacity < (unsigned int) size * 2 )
+		capacity *= 2;
+
+	set->capacity = capacity;
+	set->count = 0;
+	OSRF_MALLOC( set->slots, capacity * sizeof( osrfStringSetSlot ) );
+	return set;
+}
+
+/**
+	@brief Create an osrfStringSet holding the contents of an osrfStringArray.
+	@param arr Pointer to the osrfStringArray to be loaded.
+	@return Pointer to the newly created osrfStringSet.
+
+	Duplicate strings in the array are stored only once.  The array itself is unchanged.
+
+	The calling code is responsible for freeing the osrfStringSet by calling
+	osrfStringSetFree().
+*/
+osrfStringSet* osrfNewStringSetFromArray( const osrfStringArray* arr ) {
+	osrfStringSet* set = osrfNewStringSet( arr ? arr->size : 0 );
+	if( arr ) {
+		int i;
+		for( i = 0; i < arr->size; ++i )
+			osrfStringSetAdd( set, osrfStringArrayGetString( arr, i ) );
+	}
+	return set;
+}
+
+/**
+	@brief Add a string to an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string to be added.
+	@return 1 if the string was added, or 0 if it was already present (or if either
+		parameter is NULL).
+
+	The string stored is a copy; the original is not affected.
+*/
+int osrfStringSetAdd( osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return 0;
+
+	size_t len = strlen( str );
+	unsigned int hash = string_set_hash( str, len );
+	unsigned int i = string_set_probe( set, str, len, hash );
+	if( set->slots[ i ].str )
+		return 0;      // Already there
+
+	if( ( set->count + 1 ) * 2 > set->capacity ) {
+		string_set_grow( set );
+		i = string_set_probe( set, str, len, hash );
+	}
+
+	osrfStringSetSlot* slot = set->slots + i;
+	slot->str = strdup( str );
+	slot->len = len;
+	slot->hash = hash;
+	++set->count;
+	return 1;
+}
+
+/**
+	@brief Determine whether an osrfStringSet contains a specified string.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the nul-terminated string to be sought.
+	@return 1 if the string is present, or 0 if it isn't.
+
+	The search is case-sensitive.
+*/
+int osrfStringSetContains( const osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return 0;
+	return osrfStringSetContainsN( set, str, strlen( str ) );
+}
+
+/**
+	@brief Determine whether an osrfStringSet contains a specified substring.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the first character of the string to be sought.
+	@param len Number of characters in the string to be sought.
+	@return 1 if the string is present, or 0 if it isn't.
+
+	The string sought need not be nul-terminated, so the caller can look up a piece of a
+	larger string (such as the domain of a Jabber ID) without copying it first.
+*/
+int osrfStringSetContainsN( const osrfStringSet* set, const char* str, size_t len ) {
+	if( !( set && str ) || 0 == set->count )
+		return 0;
+	unsigned int i = string_set_probe( set, str, len, string_set_hash( str, len ) );
+	return set->slots[ i ].str ? 1 : 0;
+}
+
+/**
+	@brief Remove a string from an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@param str Pointer to the string to be removed.
+	@return 1 if the string was removed, or 0 if it wasn't there.
+*/
+int osrfStringSetRemove( osrfStringSet* set, const char* str ) {
+	if( !( set && str ) )
+		return 0;
+
+	size_t len = strlen( str );
+	unsigned int mask = set->capacity - 1;
+	unsigned int i = string_set_probe( set, str, len, string_set_hash( str, len ) );
+	if( NULL == set->slots[ i ].str )
+		return 0;
+
+	free( set->slots[ i ].str );
+	set->slots[ i ].str = NULL;
+	--set->count;
+
+	// Shift any displaced entries that follow back toward their home slots,
+	// so that no probe sequence is broken by the hole we just made.
+	unsigned int j = i;
+	for( ;; ) {
+		j = ( j + 1 ) & mask;
+		if( NULL == set->slots[ j ].str )
+			break;
+		unsigned int home = set->slots[ j ].hash & mask;
+		// Move the entry at j into the hole at i if i lies
+		// cyclically within [home, j).
+		if( ( j > i && ( home <= i || home > j ) ) ||
+			( j < i && ( home <= i && home > j ) ) ) {
+			set->slots[ i ] = set->slots[ j ];
+			set->slots[ j ].str = NULL;
+			i = j;
+		}
+	}
+
+	return 1;
+}
+
+/**
+	@brief Return the number of strings in an osrfStringSet.
+	@param set Pointer to the osrfStringSet.
+	@return The number of strings stored.
+*/
+unsigned int osrfStringSetCount( const osrfStringSet* set ) {
+	return set ? set->count : 0;
+}
+
+/**
+	@brief Free an osrfStringSet, and all the strings inside it.
+	@param set Pointer to the osrfStringSet to be freed.
+*/
+void osrfStringSetFree( osrfStringSet* set ) {
+	if( !set )
+		return;
+	unsigned int i;
+	for( i = 0; i < set->capacity; ++i )
+		free( set->slots[ i ].str );
+	free( set->slots );
+	free( set );
+}
+
+/**
+	@brief Create and initialize an empty osrfPrefixMatcher.
+	@return Pointer to the newly created osrfPrefixMatcher.
+
+	The calling code is responsible for freeing the osrfPrefixMatcher by calling
+	osrfPrefixMatcherFree().
+*/
+osrfPrefixMatcher* osrfNewPrefixMatcher( void ) {
+	osrfPrefixMatcher* pm;
+	OSRF_MALLOC( pm, sizeof( osrfPrefixMatcher ) );
+	pm->arrsize = 8;
+	pm->size = 0;
+	pm->match_all = 0;
+	OSRF_MALLOC( pm->prefixes, pm->arrsize * sizeof( char* ) );
+	OSRF_MALLOC( pm->lens, pm->arrsize * sizeof( size_t ) );
+	return pm;
+}
+
+/**
+	@brief Create an osrfPrefixMatcher loaded with the contents of an osrfStringArray.
+	@param arr Pointer to an osrfStringArray of prefixes.
+	@return Pointer to the newly created osrfPrefixMatcher.
+
+	The calling code is responsible for freeing the osrfPrefixMatcher by calling
+	osrfPrefixMatcherFree().
+*/
+osrfPrefixMatcher* osrfNewPrefixMatcherFromArray( const osrfStringArray* arr ) {
+	osrfPrefixMatcher* pm = osrfNewPrefixMatcher();
+	if( arr ) {
+		int i;
+		for( i = 0; i < arr->size; ++i )
+			osrfPrefixMatcherAdd( pm, osrfStringArrayGetString( arr, i ) );
+	}
+	return pm;
+}
+
+/**
+	@brief Find the greatest stored prefix that sorts at or before a given string.
+	@param pm Pointer to the osrfPrefixMatcher.
+	@param str Pointer to the string.
+	@return Index of that prefix, or -1 if every stored prefix sorts after @a str.
+*/
+static int prefix_floor( const osrfPrefixMatcher* pm, const char* str ) {
+	int low = 0;
+	int high = (int) pm->size - 1;
+	int found = -1;
+	while( low <= high ) {
+		int mid = low + ( high - low ) / 2;
+		if( strcmp( pm->prefixes[ mid ], str ) <= 0 ) {
+			found = mid;
+			low = mid + 1;
+		} else
+			high = mid - 1;
+	}
+	return found;
+}
+
+/**
+	@brief Double the space allocated for prefixes in an osrfPrefixMatcher.
+	@param pm Pointer to the osrfPrefixMatcher.
+*/
+static void prefix_matcher_grow( osrfPrefixMatcher* pm ) {
+	char** prefixes;
+	size_t* lens;
+	OSRF_MALLOC( prefixes, pm->arrsize * 2 * sizeof( char* ) );
+	OSRF_MALLOC( lens, pm->arrsize * 2 * sizeof( size_t ) );
+	memcpy( prefixes, pm->prefixes, pm->size * sizeof( char* ) );
+	memcpy( lens, pm->lens, pm->size * sizeof( size_t ) );
+	free( pm->prefixes );
+	free( pm->lens );
+	pm->prefixes = prefixes;
+	pm->lens = lens;
+	pm->arrsize *= 2;
+}
+
+/**
+	@brief Add a prefix to an osrfPrefixMatcher.
+	@param pm Pointer to the osrfPrefixMatcher.
+	@param prefix Pointer to the prefix to be added.
+
+	If the new prefix is already covered by a shorter stored prefix, it is ignored.  Any
+	stored prefixes that the new one covers are discarded.  The string stored is a copy.
+*/
+void osrfPrefixMatcherAdd( osrfPrefixMatcher* pm, const char* prefix ) {
+	if( !( pm && prefix ) )
+		return;
+
+	if( '\0' == *prefix ) {
+		pm->match_all = 1;
+		return;
+	}
+
+	if( osrfPrefixMatcherMatch( pm, prefix ) )
+		return;       // Already covered
+
+	size_t len = strlen( prefix );
+
+	// Everything that the new prefix covers sorts immediately after it
+	unsigned int pos = (unsigned int) ( prefix_floor( pm, prefix ) + 1 );
+	unsigned int end = pos;
+	while( end < pm->size && !strncmp( pm->prefixes[ end ], prefix, len ) ) {
+		free( pm->prefixes[ end ] );
+		++end;
+	}
+
+	if( end == pos ) {
+		// Nothing covered; open up a gap
+		if( pm->size == pm->arrsize )
+			prefix_matcher_grow( pm );
+		memmove( pm->prefixes + pos + 1, pm->prefixes + pos,
+			( pm->size - pos ) * sizeof( char* ) );
+		memmove( pm->lens + pos + 1, pm->lens + pos,
+			( pm->size - pos ) * sizeof( size_t ) );
+		++pm->size;
+	} else if( end > pos + 1 ) {
+		// Close up the space left by the covered prefixes, all but one
+		memmove( pm->prefixes + pos + 1, pm->prefixes + end,
+			( pm->size - end ) * sizeof( char* ) );
+		memmove( pm->lens + pos + 1, pm->lens + end,
+			( pm->size - end ) * sizeof( size_t ) );
+		pm->size -= end - pos - 1;
+	}
+
+	pm->prefixes[ pos ] = strdup( prefix );
+	pm->lens[ pos ] = len;
+}
+
+/**
+	@brief Determine whether a string begins with any prefix in an osrfPrefixMatcher.
+	@param pm Pointer to the osrfPrefixMatcher.
+	@param str Pointer to the string to be tested.
+	@return 1 if some stored prefix matches, or 0 if none does.
+*/
+int osrfPrefixMatcherMatch( const osrfPrefixMatcher* pm, const char* str ) {
+	if( !( pm && str ) )
+		return 0;
+	if( pm->match_all )
+		return 1;
+	int i = prefix_floor( pm, str );
+	if( i < 0 )
+		return 0;
+	return strncmp( pm->prefixes[ i ], str, pm->lens[ i ] ) ? 0 : 1;
+}
+
+/**
+	@brief Return the number of distinct prefixes in an osrfPrefixMatcher.
+	@param pm Pointer to the osrfPrefixMatcher.
+	@return The number of prefixes stored, after discarding redundant ones.
+*/
+unsigned int osrfPrefixMatcherCount( const osrfPrefixMatcher* pm ) {
+	if( !pm )
+		return 0;
+	return pm->size + ( pm->match_all ? 1 : 0 );
+}
+
+/**
+	@brief Free an osrfPrefixMatcher, and all the prefixes inside it.
+	@param pm Pointer to the osrfPrefixMatcher to be freed.
+*/
+void osrfPrefixMatcherFree( osrfPrefixMatcher* pm ) {
+	if( !pm )
+		return;
+	unsigned int i;
+	for( i = 0; i < pm->size; ++i )
+		free( pm->prefixes[ i ] );
+	free( pm->prefixes );
+	free( pm->lens );
+	free( pm );
+}
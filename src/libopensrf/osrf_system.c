@@ -25,6 +25,9 @@
 
 osrfStringArray* log_protect_arr = NULL;
 
+/** Method name prefixes from log_protect_arr, whose params must not be logged. */
+osrfPrefixMatcher* log_protect_matcher = NULL;
+
 /** Pointer to the global transport_client; i.e. our connection to Jabber. */
 static transport_client* osrfGlobalTransportClient = NULL;
 
@@ -362,6 +365,7 @@ int osrfSystemBootstrapClientResc( const char* config_file,
 		log_protect_arr = osrfNewStringArray(8);
 		osrfConfig* cfg_shared = osrfConfigInit(config_file, "shared");
 		osrfConfigGetValueList( cfg_shared, log_protect_arr, "/log_protect/match_string" );
+		log_protect_matcher = osrfNewPrefixMatcherFromArray( log_protect_arr );
 	}
 
 	char* log_file      = osrfConfigGetValue( NULL, "/logfile");
@@ -454,6 +458,12 @@ int osrfSystemBootstrapClientResc( const char* config_file,
 		domain, iport, unixpath ? unixpath : "(none)" );
 	transport_client* client = client_init( domain, iport, unixpath, 0 );
 
+	/* ask the Jabber server to compress the stream, if so configured */
+	char* compress = osrfConfigGetValue( NULL, "/compress" );
+	if( compress && !strcasecmp( compress, "true" ) )
+		client_set_compression( client, 1 );
+	free( compress );
+
 	char host[HOST_NAME_MAX + 1] = "";
 	gethostname(host, sizeof(host) );
 	host[HOST_NAME_MAX] = '\0';
@@ -471,6 +481,13 @@ int osrfSystemBootstrapClientResc( const char* config_file,
 
 	if(client_connect( client, username, password, buf, 10, AUTH_DIGEST )) {
 		osrfGlobalTransportClient = client;
+
+		/* talk to processes on this host directly, if so configured */
+		char* local_dir = osrfConfigGetValue( NULL, "/local_transport_dir" );
+		if( local_dir && client_open_local( client, local_dir ) )
+			osrfLogWarning( OSRF_LOG_MARK, "Unable to open local transport in %s; "
+				"using Jabber only", local_dir );
+		free( local_dir );
 	}
 
 	osrfStringArrayFree(arr);
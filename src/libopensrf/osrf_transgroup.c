@@ -1,22 +1,56 @@
 #include <opensrf/osrf_transgroup.h>
-#include <sys/select.h>
-
-
-osrfTransportGroupNode* osrfNewTransportGroupNode( 
+#include <poll.h>
+#include <sys/epoll.h>
+
+/** Greatest number of readiness events we take from epoll at once */
+#define OSRF_TG_MAX_EVENTS 64
+
+static int osrfTGConnect( osrfTransportGroup* grp, osrfTransportGroupConn* conn );
+static void osrfTGDrop( osrfTransportGroup* grp, osrfTransportGroupConn* conn, int failed );
+static void osrfTGBackOff( osrfTransportGroupNode* node, time_t now );
+static int osrfTGHealthy( osrfTransportGroup* grp, osrfTransportGroupNode* node, time_t now );
+static osrfTransportGroupNode* osrfTGPick( osrfTransportGroup* grp, time_t now );
+static int osrfTGNodeSend( osrfTransportGroup* grp, osrfTransportGroupNode* node,
+		transport_message* msg );
+static transport_message* osrfTGConnRecv( osrfTransportGroup* grp,
+		osrfTransportGroupConn* conn );
+static osrfTransportGroupNode* osrfTGFindNode( osrfTransportGroup* grp, const char* jid );
+static void osrfTGNodeFree( char* domain, void* node );
+
+
+osrfTransportGroupNode* osrfNewTransportGroupNode(
 		char* domain, int port, char* username, char* password, char* resource ) {
+	return osrfNewTransportGroupPool( domain, port, username, password, resource, 1 );
+}
+
+osrfTransportGroupNode* osrfNewTransportGroupPool( const char* domain, int port,
+		const char* username, const char* password, const char* resource, int connections ) {
 
-	if(!(domain && port && username && password && resource)) return NULL;
+	if(!(domain && port && username && password && resource && connections > 0)) return NULL;
 
 	osrfTransportGroupNode* node = safe_malloc(sizeof(osrfTransportGroupNode));
 	node->domain	= strdup(domain);
 	node->port		= port;
 	node->username = strdup(username);
 	node->password = strdup(password);
-	node->domain	= strdup(domain);
 	node->resource	= strdup(resource);
 	node->active	= 0;
 	node->lastsent	= 0;
-	node->connection = client_init( domain, port, NULL, 0 );
+	node->failures	= 0;
+	node->retry_at	= 0;
+	node->latency	= 0.0;
+	node->current_weight = 0.0;
+
+	node->conn_count = connections;
+	node->next_conn = 0;
+	node->conns = safe_malloc( connections * sizeof(osrfTransportGroupConn) );
+	int i;
+	for( i = 0; i < connections; i++ ) {
+		node->conns[i].connection = client_init( domain, port, NULL, 0 );
+		node->conns[i].node = node;
+		node->conns[i].active = 0;
+		node->conns[i].awaiting = 0;
+	}
 
 	return node;
 }
@@ -25,13 +59,25 @@ osrfTransportGroupNode* osrfNewTransportGroupNode(
 osrfTransportGroup* osrfNewTransportGroup( osrfTransportGroupNode* nodes[], int count ) {
 	if(!nodes || count < 1) return NULL;
 
+	int i;
+	for( i = 0; i != count; i++ )
+		if(!(nodes[i] && nodes[i]->domain) ) return NULL;
+
+	int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if( epoll_fd < 0 ) {
+		osrfLogError( OSRF_LOG_MARK, "Unable to create epoll descriptor for TransportGroup: %s",
+			strerror( errno ) );
+		return NULL;
+	}
+
 	osrfTransportGroup* grp = safe_malloc(sizeof(osrfTransportGroup));
 	grp->nodes					= osrfNewHash();
+	osrfHashSetCallback( grp->nodes, &osrfTGNodeFree );
 	grp->itr						= osrfNewHashIterator(grp->nodes);
+	grp->epoll_fd				= epoll_fd;
+	grp->next_recv				= 0;
 
-	int i;
 	for( i = 0; i != count; i++ ) {
-		if(!(nodes[i] && nodes[i]->domain) ) return NULL;
 		osrfHashSet( grp->nodes, nodes[i], nodes[i]->domain );
 		osrfLogDebug( OSRF_LOG_MARK, "Adding domain %s to TransportGroup", nodes[i]->domain);
 	}
@@ -39,6 +85,102 @@ osrfTransportGroup* osrfNewTransportGroup( osrfTransportGroupNode* nodes[], int
 	return grp;
 }
 
+void osrfTransportGroupFree( osrfTransportGroup* grp ) {
+	if(!grp) return;
+	osrfTransportGroupDisconnectAll( grp );
+	osrfHashIteratorFree( grp->itr );
+	osrfHashFree( grp->nodes );
+	close( grp->epoll_fd );
+	free( grp );
+}
+
+static void osrfTGNodeFree( char* domain, void* item ) {
+	osrfTransportGroupNode* node = item;
+	int i;
+	for( i = 0; i < node->conn_count; i++ )
+		client_free( node->conns[i].connection );
+	free( node->conns );
+	free( node->domain );
+	free( node->username );
+	free( node->password );
+	free( node->resource );
+	free( node );
+}
+
+
+/**
+	Log in one connection of a pool, and start watching it for input.
+	@return 0 if successful, or -1 if not.
+*/
+static int osrfTGConnect( osrfTransportGroup* grp, osrfTransportGroupConn* conn ) {
+	osrfTransportGroupNode* node = conn->node;
+	int index = conn - node->conns;
+
+	char* resource = index ? va_list_to_string( "%s_%d", node->resource, index )
+		: strdup( node->resource );
+	int ok = client_connect( conn->connection, node->username, node->password,
+		resource, 10, AUTH_DIGEST );
+	free( resource );
+	if( !ok )
+		return -1;
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = conn;
+	if( epoll_ctl( grp->epoll_fd, EPOLL_CTL_ADD, client_sock_fd( conn->connection ),
+			&event ) < 0 ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Unable to watch connection to domain %s: %s",
+			node->domain, strerror( errno ) );
+		client_disconnect( conn->connection );
+		return -1;
+	}
+
+	conn->active = 1;
+	conn->awaiting = 0;
+	node->active++;
+	node->failures = 0;
+	return 0;
+}
+
+/**
+	Stop using a connection, and replace its client with a fresh one for reconnecting.
+	@param grp The transport group
+	@param conn The connection
+	@param failed True if the connection broke; false if we're closing it on purpose
+
+	When a domain loses the last of its connections to failure, we leave it alone for a
+	while (see osrfTGBackOff()).
+*/
+static void osrfTGDrop( osrfTransportGroup* grp, osrfTransportGroupConn* conn, int failed ) {
+	if( !conn->active ) return;
+	osrfTransportGroupNode* node = conn->node;
+
+	epoll_ctl( grp->epoll_fd, EPOLL_CTL_DEL, client_sock_fd( conn->connection ), NULL );
+	client_free( conn->connection );
+	conn->connection = client_init( node->domain, node->port, NULL, 0 );
+	conn->active = 0;
+	conn->awaiting = 0;
+	node->active--;
+
+	if( failed && !node->active ) {
+		osrfTGBackOff( node, time(NULL) );
+		osrfLogWarning( OSRF_LOG_MARK, "TransportGroup lost its connections to domain %s; "
+			"retrying in %d seconds", node->domain, (int) ( node->retry_at - time(NULL) ) );
+	}
+}
+
+/**
+	Put off reconnecting to a domain that has failed: for a second after the first
+	failure, then twice as long after each failure in a row, up to OSRF_TG_MAX_RETRY
+	seconds.
+*/
+static void osrfTGBackOff( osrfTransportGroupNode* node, time_t now ) {
+	int delay = node->failures < 6 ? 1 << node->failures : OSRF_TG_MAX_RETRY;
+	if( delay > OSRF_TG_MAX_RETRY )
+		delay = OSRF_TG_MAX_RETRY;
+	node->failures++;
+	node->retry_at = now + delay;
+}
 
 /* connect all of the nodes to their servers */
 int osrfTransportGroupConnectAll( osrfTransportGroup* grp ) {
@@ -49,18 +191,22 @@ int osrfTransportGroupConnectAll( osrfTransportGroup* grp ) {
 	osrfHashIteratorReset(grp->itr);
 
 	while( (node = osrfHashIteratorNext(grp->itr)) ) {
-		osrfLogInfo( OSRF_LOG_MARK, "TransportGroup attempting to connect to domain %s", 
-							 node->connection->session->server);
+		osrfLogInfo( OSRF_LOG_MARK, "TransportGroup attempting to connect to domain %s",
+							 node->domain);
+
+		int i;
+		for( i = 0; i < node->conn_count; i++ )
+			if( !node->conns[i].active )
+				osrfTGConnect( grp, &node->conns[i] );
 
-		if(client_connect( node->connection, node->username, 
-					node->password, node->resource, 10, AUTH_DIGEST )) {
-			node->active = 1;
+		if( node->active ) {
 			active++;
-			osrfLogInfo( OSRF_LOG_MARK, "TransportGroup successfully connected to domain %s", 
-							 node->connection->session->server);
+			osrfLogInfo( OSRF_LOG_MARK,
+				"TransportGroup connected to domain %s with %d of %d connections",
+				node->domain, node->active, node->conn_count );
 		} else {
-			osrfLogWarning( OSRF_LOG_MARK, "TransportGroup unable to connect to domain %s", 
-							 node->connection->session->server);
+			osrfLogWarning( OSRF_LOG_MARK, "TransportGroup unable to connect to domain %s",
+							 node->domain);
 		}
 	}
 
@@ -75,169 +221,328 @@ void osrfTransportGroupDisconnectAll( osrfTransportGroup* grp ) {
 	osrfHashIteratorReset(grp->itr);
 
 	while( (node = osrfHashIteratorNext(grp->itr)) ) {
-		osrfLogInfo( OSRF_LOG_MARK, "TransportGroup disconnecting from domain %s", 
-							 node->connection->session->server);
-		client_disconnect(node->connection);
-		node->active = 0;
+		osrfLogInfo( OSRF_LOG_MARK, "TransportGroup disconnecting from domain %s",
+							 node->domain);
+		int i;
+		for( i = 0; i < node->conn_count; i++ )
+			osrfTGDrop( grp, &node->conns[i], 0 );
 	}
 
 	osrfHashIteratorReset(grp->itr);
 }
 
 
-int osrfTransportGroupSendMatch( osrfTransportGroup* grp, transport_message* msg ) {
-	if(!(grp && msg)) return -1;
+/**
+	Determine whether a domain can take a message, reconnecting it if it's been down long
+	enough.
+	@return True if at least one of its connections is active.
+*/
+static int osrfTGHealthy( osrfTransportGroup* grp, osrfTransportGroupNode* node, time_t now ) {
+	if( node->active )
+		return 1;
+	if( now < node->retry_at )
+		return 0;
 
-	char domain[256];
-	domain[0] = '\0';
-	jid_get_domain( msg->recipient, domain, 255 );
+	int i;
+	for( i = 0; i < node->conn_count; i++ )
+		osrfTGConnect( grp, &node->conns[i] );
 
-	osrfTransportGroupNode* node = osrfHashGet(grp->nodes, domain);
-	if(node) {
-		if( (client_send_message( node->connection, msg )) == 0 )
-			return 0;
+	if( node->active ) {
+		osrfLogInfo( OSRF_LOG_MARK, "TransportGroup reconnected to domain %s", node->domain );
+		return 1;
 	}
 
-	osrfLogWarning( OSRF_LOG_MARK, "Error sending message to domain %s", domain );
-	return -1;
+	// Count it as another failure, and wait longer next time
+	osrfTGBackOff( node, now );
+	return 0;
 }
 
-int osrfTransportGroupSend( osrfTransportGroup* grp, transport_message* msg ) {
+/**
+	Choose the next domain to send to, from the healthy ones that haven't been tried yet.
+	@return The chosen node, or NULL if there is none.
+
+	This is a smooth weighted round robin: each domain's weight is the inverse of its
+	average time to an answer, so a domain that answers in half the time gets twice the
+	messages, interleaved with the others rather than in bursts.  A domain that hasn't
+	answered yet is weighted like the fastest one, so that it gets a chance to show how
+	fast it is.  A domain that has just failed to send has no connections left, and isn't
+	due to reconnect yet, so it's left out.
+*/
+static osrfTransportGroupNode* osrfTGPick( osrfTransportGroup* grp, time_t now ) {
+	double fastest = 0.0;
+	osrfTransportGroupNode* node;
+	osrfHashIteratorReset(grp->itr);
+	while( (node = osrfHashIteratorNext(grp->itr)) ) {
+		if( node->latency > 0.0 && ( fastest == 0.0 || node->latency < fastest ) )
+			fastest = node->latency;
+	}
 
-	if(!(grp && msg)) return -1;
-	int bufsize = 256;
+	osrfTransportGroupNode* best = NULL;
+	double total = 0.0;
+	osrfHashIteratorReset(grp->itr);
+	while( (node = osrfHashIteratorNext(grp->itr)) ) {
+		if( !osrfTGHealthy( grp, node, now ) )
+			continue;
+		double latency = node->latency > 0.0 ? node->latency : fastest;
+		double weight = 1.0 / ( latency + 1.0 );
+		node->current_weight += weight;
+		total += weight;
+		if( !best || node->current_weight > best->current_weight )
+			best = node;
+	}
+	osrfHashIteratorReset(grp->itr);
 
-	char domain[bufsize];
-	domain[0] = '\0';
-	jid_get_domain( msg->recipient, domain, bufsize - 1 );
+	if( best )
+		best->current_weight -= total;
+	return best;
+}
+
+/**
+	Send a message on one of a domain's connections, trying each of them in turn.
+	@return 0 if successful, or -1 if every connection failed.
+
+	A connection that fails to send is dropped.  Each try builds the message's XML afresh,
+	since client_send_message() gives it the sender of the connection at hand.
+*/
+static int osrfTGNodeSend( osrfTransportGroup* grp, osrfTransportGroupNode* node,
+		transport_message* msg ) {
+	int tries;
+	for( tries = 0; tries < node->conn_count && node->active; tries++ ) {
+		osrfTransportGroupConn* conn = &node->conns[ node->next_conn ];
+		node->next_conn = ( node->next_conn + 1 ) % node->conn_count;
+		if( !conn->active )
+			continue;
+
+		free( msg->msg_xml );
+		msg->msg_xml = NULL;
+		if( client_send_message( conn->connection, msg ) >= 0 ) {
+			if( !conn->awaiting )
+				conn->awaiting = get_monotonic_millis();
+			node->lastsent = time(NULL);
+			return 0;
+		}
 
-	char msgrecip[bufsize];
-	msgrecip[0] = '\0';
-	jid_get_username(msg->recipient, msgrecip, bufsize - 1);
+		osrfLogWarning( OSRF_LOG_MARK, "Error sending message to domain %s", node->domain );
+		osrfTGDrop( grp, conn, 1 );
+	}
+	return -1;
+}
 
-	char msgres[bufsize];
-	msgres[0] = '\0';
-	jid_get_resource(msg->recipient, msgres, bufsize - 1);
+/**
+	Find the node for the domain of a Jabber ID.
+	@return The node, or NULL if we have none for that domain.
+*/
+static osrfTransportGroupNode* osrfTGFindNode( osrfTransportGroup* grp, const char* jid ) {
+	size_t len;
+	const char* domain = jid ? jid_find_domain( jid, &len ) : NULL;
+	if( !domain )
+		return NULL;
+
+	char key[ len + 1 ];
+	memcpy( key, domain, len );
+	key[ len ] = '\0';
+	return osrfHashGet( grp->nodes, key );
+}
 
-	char* firstdomain = NULL;
-	char newrcp[1024];
+int osrfTransportGroupSendMatch( osrfTransportGroup* grp, transport_message* msg ) {
+	if(!(grp && msg)) return -1;
 
-	int updateRecip = 1;
-	/* if we don't host this domain, don't update the recipient but send it as is */
-	if(!osrfHashGet(grp->nodes, domain)) updateRecip = 0;
+	osrfTransportGroupNode* node = osrfTGFindNode( grp, msg->recipient );
+	if( node && osrfTGHealthy( grp, node, time(NULL) ) && osrfTGNodeSend( grp, node, msg ) == 0 )
+		return 0;
 
-	osrfTransportGroupNode* node;
+	osrfLogWarning( OSRF_LOG_MARK, "Error sending message to %s", msg->recipient );
+	return -1;
+}
 
-	do {
+int osrfTransportGroupSend( osrfTransportGroup* grp, transport_message* msg ) {
 
-		node = osrfHashIteratorNext(grp->itr);
-		if(!node) osrfHashIteratorReset(grp->itr);
+	if(!(grp && msg && msg->recipient)) return -1;
 
-		node = osrfHashIteratorNext(grp->itr);
-		if(!node) return -1;
+	/* if we don't host this domain, don't update the recipient but send it as is */
+	int updateRecip = osrfTGFindNode( grp, msg->recipient ) != NULL;
+	size_t domain_len = 0;
+	const char* domain = jid_find_domain( msg->recipient, &domain_len );
 
-		if(firstdomain == NULL) {
-			firstdomain = node->domain;
+	// Each domain that fails loses its connections, so osrfTGPick() passes over it next
+	time_t now = time(NULL);
+	int ret = -1;
 
-		} else {
-			if(!strcmp(firstdomain, node->domain)) { /* we've made a full loop */
-				osrfLogWarning( OSRF_LOG_MARK, "We've tried to send to all domains.. giving up");
-				return -1;
-			}
-		}
+	osrfTransportGroupNode* node;
+	while( (node = osrfTGPick( grp, now )) ) {
 
 		/* update the recipient domain if necessary */
-
 		if(updateRecip) {
-			snprintf(newrcp, sizeof(newrcp), "%s@%s/%s", msgrecip, node->domain, msgres);
+			size_t user_len = domain - msg->recipient;
+			char* newrcp = va_list_to_string( "%.*s%s%s", (int) user_len, msg->recipient,
+				node->domain, domain + domain_len );
 			free(msg->recipient);
-			msg->recipient = strdup(newrcp);
+			msg->recipient = newrcp;
+			domain = jid_find_domain( msg->recipient, &domain_len );
+			free( msg->msg_xml );
+			msg->msg_xml = NULL;
 		}
 
-		if( (client_send_message( node->connection, msg )) == 0 ) 
-			return 0;
-
-	} while(1);
+		if( osrfTGNodeSend( grp, node, msg ) == 0 ) {
+			ret = 0;
+			break;
+		}
+	}
 
-	return -1;
+	if( ret )
+		osrfLogWarning( OSRF_LOG_MARK, "We've tried to send to all domains.. giving up");
+	return ret;
 }
 
-static int __osrfTGWait( fd_set* fdset, int maxfd, int timeout ) {
-	if(!(fdset && maxfd)) return 0;
 
-	struct timeval tv;
-	tv.tv_sec = timeout;
-	tv.tv_usec = 0;
-	int retval = 0;
-
-	if( timeout < 0 ) {
-		if( (retval = select( maxfd + 1, fdset, NULL, NULL, NULL)) == -1 ) 
-			return 0;
-
-	} else {
-		if( (retval = select( maxfd + 1, fdset, NULL, NULL, &tv)) == -1 ) 
-			return 0;
+/**
+	Take a message from a connection that has one queued or waiting on its socket.
+	@return The message, or NULL if there was none after all.
+
+	A message that answers a send gives the domain another sample of how long it takes to
+	answer.  A connection whose socket has closed is dropped.
+*/
+static transport_message* osrfTGConnRecv( osrfTransportGroup* grp,
+		osrfTransportGroupConn* conn ) {
+	transport_message* msg = client_recv( conn->connection, 0 );
+
+	if( msg && conn->awaiting ) {
+		osrfTransportGroupNode* node = conn->node;
+		double sample = (double) ( get_monotonic_millis() - conn->awaiting );
+		node->latency = node->latency > 0.0 ? 0.8 * node->latency + 0.2 * sample : sample;
+		if( node->latency <= 0.0 )
+			node->latency = 0.001;   // answered within the clock's resolution
+		conn->awaiting = 0;
 	}
 
-	return retval;
+	if( !client_connected( conn->connection ) || conn->connection->error ) {
+		osrfLogWarning( OSRF_LOG_MARK, "TransportGroup lost a connection to domain %s",
+			conn->node->domain );
+		osrfTGDrop( grp, conn, 1 );
+	}
+	return msg;
 }
 
-
 transport_message* osrfTransportGroupRecvAll( osrfTransportGroup* grp, int timeout ) {
 	if(!grp) return NULL;
 
-	int maxfd = 0;
-	fd_set fdset;
-	FD_ZERO( &fdset );
-
+	// Messages already queued come first: from the first connection with any, at or
+	// after the one following the connection that we last took one from
+	unsigned int start = grp->next_recv;
+	unsigned int index = 0;
+	unsigned int queued_index = 0;
+	osrfTransportGroupConn* queued = NULL;
 	osrfTransportGroupNode* node;
-	osrfHashIterator* itr = osrfNewHashIterator(grp->nodes);
-
-	while( (node = osrfHashIteratorNext(itr)) ) {
-		if(node->active) {
-			int fd = node->connection->session->sock_id;
-			if( fd < maxfd ) maxfd = fd;
-			FD_SET( fd, &fdset );
+	osrfHashIteratorReset(grp->itr);
+	while( (node = osrfHashIteratorNext(grp->itr)) ) {
+		int i;
+		for( i = 0; i < node->conn_count; i++, index++ ) {
+			osrfTransportGroupConn* conn = &node->conns[i];
+			if( !( conn->active && conn->connection->msg_q_head ) )
+				continue;
+			if( !queued || ( queued_index < start && index >= start ) ) {
+				queued = conn;
+				queued_index = index;
+			}
 		}
 	}
-	osrfHashIteratorReset(itr);
+	osrfHashIteratorReset(grp->itr);
+	if( queued ) {
+		grp->next_recv = queued_index + 1;
+		return osrfTGConnRecv( grp, queued );
+	}
+	grp->next_recv = start + 1;
+
+	long long deadline = timeout > 0 ? get_monotonic_millis() + timeout * 1000LL : 0;
+	for( ;; ) {
+		int wait_ms = timeout < 0 ? -1 : 0;
+		if( timeout > 0 ) {
+			long long left = deadline - get_monotonic_millis();
+			wait_ms = left > 0 ? (int) left : 0;
+		}
 
-	if( __osrfTGWait( &fdset, maxfd, timeout ) ) {
-		while( (node = osrfHashIteratorNext(itr)) ) {
-			if(node->active) {
-				int fd = node->connection->session->sock_id;
-				if( FD_ISSET( fd, &fdset ) ) {
-					return client_recv( node->connection, 0 );
-				}
-			}
+		struct epoll_event events[ OSRF_TG_MAX_EVENTS ];
+		int count = epoll_wait( grp->epoll_fd, events, OSRF_TG_MAX_EVENTS, wait_ms );
+		if( count < 0 && errno != EINTR ) {
+			osrfLogWarning( OSRF_LOG_MARK, "TransportGroup unable to wait for input: %s",
+				strerror( errno ) );
+			return NULL;
 		}
-	}
 
-	osrfHashIteratorFree(itr);
-	return NULL;
+		// Take the first message; the others stay ready for the next call
+		int i;
+		for( i = 0; i < count; i++ ) {
+			osrfTransportGroupConn* conn = events[ ( start + i ) % count ].data.ptr;
+			if( !conn->active )
+				continue;   // dropped while handling an earlier event
+			transport_message* msg = osrfTGConnRecv( grp, conn );
+			if( msg )
+				return msg;
+		}
+
+		if( wait_ms == 0 )
+			return NULL;
+	}
 }
 
 transport_message* osrfTransportGroupRecv( osrfTransportGroup* grp, char* domain, int timeout ) {
 	if(!(grp && domain)) return NULL;
 
 	osrfTransportGroupNode* node = osrfHashGet(grp->nodes, domain);
-	if(!node && node->connection && node->connection->session) return NULL;
-	int fd = node->connection->session->sock_id;
+	if(!node) return NULL;
 
-	fd_set fdset;
-	FD_ZERO( &fdset );
-	FD_SET( fd, &fdset );
+	int i;
+	for( i = 0; i < node->conn_count; i++ )
+		if( node->conns[i].active && node->conns[i].connection->msg_q_head )
+			return osrfTGConnRecv( grp, &node->conns[i] );
+
+	// Just the one domain's connections; the group's epoll descriptor watches them all
+	long long deadline = timeout > 0 ? get_monotonic_millis() + timeout * 1000LL : 0;
+	for( ;; ) {
+		struct pollfd fds[ node->conn_count ];
+		osrfTransportGroupConn* conns[ node->conn_count ];
+		int nfds = 0;
+		for( i = 0; i < node->conn_count; i++ ) {
+			if( node->conns[i].active ) {
+				conns[ nfds ] = &node->conns[i];
+				fds[ nfds ].fd = client_sock_fd( node->conns[i].connection );
+				fds[ nfds ].events = POLLIN;
+				nfds++;
+			}
+		}
+		if( !nfds )
+			return NULL;
 
-	int active = __osrfTGWait( &fdset, fd, timeout );
-	if(active) return client_recv( node->connection, 0 );
-	
-	return NULL;
+		int wait_ms = timeout < 0 ? -1 : 0;
+		if( timeout > 0 ) {
+			long long left = deadline - get_monotonic_millis();
+			wait_ms = left > 0 ? (int) left : 0;
+		}
+
+		int count = poll( fds, nfds, wait_ms );
+		if( count < 0 && errno != EINTR )
+			return NULL;
+
+		for( i = 0; i < nfds && count > 0; i++ ) {
+			if( fds[i].revents ) {
+				transport_message* msg = osrfTGConnRecv( grp, conns[i] );
+				if( msg )
+					return msg;
+			}
+		}
+
+		if( wait_ms == 0 )
+			return NULL;
+	}
 }
 
 void osrfTransportGroupSetInactive( osrfTransportGroup* grp, char* domain ) {
 	if(!(grp && domain)) return;
 	osrfTransportGroupNode* node = osrfHashGet(grp->nodes, domain );
-	if(node) node->active = 0;
-}
+	if(!node) return;
 
+	int i;
+	for( i = 0; i < node->conn_count; i++ )
+		osrfTGDrop( grp, &node->conns[i], 1 );
+}
 
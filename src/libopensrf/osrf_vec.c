@@ -0,0 +1,353 @@
+/**
+	@file osrf_vec.c
+	@brief Implementation of osrfVec, a contiguous array of fixed-size elements.
+
+	The elements live in a single block of memory.  When more room is needed, we allocate
+	a block twice as big (or big enough, if that's bigger) and copy the elements over, so
+	that the cost of growth is amortized over the elements added.
+
+	Unused space beyond the last element is always zeroed.
+*/
+
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+*/
+
+#include <opensrf/osrf_vec.h>
+
+/** @brief Default initial capacity of an osrfVec, in elements. */
+#define OSRF_VEC_DEFAULT_SIZE 8
+
+/**
+	@brief Create a new osrfVec with the default initial capacity.
+	@param elem_size Size of each element, in bytes.
+	@return A pointer to the new osrfVec.
+
+	The calling code is responsible for freeing the osrfVec by calling osrfVecFree().
+*/
+osrfVec* osrfNewVec( size_t elem_size ) {
+	return osrfNewVecSize( elem_size, OSRF_VEC_DEFAULT_SIZE );
+}
+
+/**
+	@brief Create a new osrfVec with a specified initial capacity.
+	@param elem_size Size of each element, in bytes.  If zero, it defaults to sizeof(void*).
+	@param capacity How many elements to allocate space for initially.
+	@return A pointer to the new osrfVec.
+
+	The calling code is responsible for freeing the osrfVec by calling osrfVecFree().
+*/
+osrfVec* osrfNewVecSize( size_t elem_size, size_t capacity ) {
+	osrfVec* vec;
+	OSRF_MALLOC( vec, sizeof( osrfVec ) );
+
+	vec->size = 0;
+	vec->elem_size = elem_size ? elem_size : sizeof( void* );
+	vec->capacity = capacity ? capacity : 1;
+	vec->freeItem = NULL;
+	OSRF_MALLOC( vec->data, vec->capacity * vec->elem_size );
+
+	return vec;
+}
+
+/**
+	@brief Make sure an osrfVec has room for a specified number of elements.
+	@param vec Pointer to the osrfVec.
+	@param capacity The number of elements to make room for.
+
+	If the osrfVec already has at least the specified capacity, nothing happens.  Otherwise
+	we replace the array with a bigger one: twice the current capacity, or the requested
+	capacity, whichever is larger.
+
+	Reserving space in advance avoids repeated copying when the calling code knows how many
+	elements it will add.
+*/
+void osrfVecReserve( osrfVec* vec, size_t capacity ) {
+	if( !vec || capacity <= vec->capacity )
+		return;
+
+	size_t newcap = vec->capacity * 2;
+	if( newcap < capacity )
+		newcap = capacity;
+
+	char* newdata;
+	OSRF_MALLOC( newdata, newcap * vec->elem_size );
+	memcpy( newdata, vec->data, vec->size * vec->elem_size );
+	free( vec->data );
+	vec->data = newdata;
+	vec->capacity = newcap;
+}
+
+/**
+	@brief Append a copy of an element to the end of an osrfVec.
+	@param vec Pointer to the osrfVec.
+	@param elem Pointer to the element to be copied.  If NULL, append a zeroed element.
+	@return A pointer to the new element within the osrfVec, or NULL if @a vec is NULL.
+
+	The returned pointer is valid only until the next operation that changes the size of
+	the osrfVec.
+*/
+void* osrfVecPush( osrfVec* vec, const void* elem ) {
+	if( !vec )
+		return NULL;
+	if( vec->size == vec->capacity )
+		osrfVecReserve( vec, vec->size + 1 );
+
+	void* slot = OSRF_VEC_AT( vec, vec->size );
+	if( elem )
+		memcpy( slot, elem, vec->elem_size );
+	++vec->size;
+	return slot;
+}
+
+/**
+	@brief Append copies of multiple elements to the end of an osrfVec.
+	@param vec Pointer to the osrfVec.
+	@param elems Pointer to the first of the elements to be copied, stored contiguously.
+		If NULL, append zeroed elements.
+	@param count Number of elements to append.
+	@return A pointer to the first new element within the osrfVec, or NULL if @a vec is NULL.
+
+	This function grows the array at most once, and copies all the elements with a single
+	memcpy().
+*/
+void* osrfVecAppend( osrfVec* vec, const void* elems, size_t count ) {
+	if( !vec )
+		return NULL;
+	osrfVecReserve( vec, vec->size + count );
+
+	void* slot = OSRF_VEC_AT( vec, vec->size );
+	if( elems && count )
+		memcpy( slot, elems, count * vec->elem_size );
+	vec->size += count;
+	return slot;
+}
+
+/**
+	@brief Insert a copy of an element at a specified position.
+	@param vec Pointer to the osrfVec.
+	@param index Zero-based subscript where the new element is to go.
+	@param elem Pointer to the element to be copied.  If NULL, insert a zeroed element.
+	@return A pointer to the new element within the osrfVec, or NULL if @a vec is NULL.
+
+	Elements at and after the specified position move up by one.  If @a index is at or
+	beyond the end of the array, the behavior is the same as osrfVecSet().
+*/
+void* osrfVecInsert( osrfVec* vec, size_t index, const void* elem ) {
+	if( !vec )
+		return NULL;
+	if( index >= vec->size )
+		return osrfVecSet( vec, index, elem );
+
+	if( vec->size == vec->capacity )
+		osrfVecReserve( vec, vec->size + 1 );
+
+	void* slot = OSRF_VEC_AT( vec, index );
+	memmove( OSRF_VEC_AT( vec, index + 1 ), slot, ( vec->size - index ) * vec->elem_size );
+	if( elem )
+		memcpy( slot, elem, vec->elem_size );
+	else
+		memset( slot, 0, vec->elem_size );
+	++vec->size;
+	return slot;
+}
+
+/**
+	@brief Store a copy of an element at a specified position.
+	@param vec Pointer to the osrfVec.
+	@param index Zero-based subscript where the element is to go.
+	@param elem Pointer to the element to be copied.  If NULL, store a zeroed element.
+	@return A pointer to the stored element within the osrfVec, or NULL if @a vec is NULL.
+
+	If there is already an element at the specified position, and a freeItem callback is
+	installed, the callback is called for the old element before it is overwritten.
+
+	If the specified position is beyond the end of the array, the array grows to include
+	it, and any intervening new elements are zeroed.
+*/
+void* osrfVecSet( osrfVec* vec, size_t index, const void* elem ) {
+	if( !vec )
+		return NULL;
+
+	if( index >= vec->size ) {
+		osrfVecReserve( vec, index + 1 );
+		vec->size = index + 1;    // The new elements are already zeroed
+	} else if( vec->freeItem )
+		vec->freeItem( OSRF_VEC_AT( vec, index ) );
+
+	void* slot = OSRF_VEC_AT( vec, index );
+	if( elem )
+		memcpy( slot, elem, vec->elem_size );
+	else
+		memset( slot, 0, vec->elem_size );
+	return slot;
+}
+
+/**
+	@brief Fetch the address of the element at a specified position.
+	@param vec Pointer to the osrfVec.
+	@param index Zero-based subscript of the element.
+	@return A pointer to the element, or NULL if either parameter is invalid.
+
+	The returned pointer is valid only until the next operation that changes the size of
+	the osrfVec.
+*/
+void* osrfVecGet( const osrfVec* vec, size_t index ) {
+	if( !vec || index >= vec->size )
+		return NULL;
+	return OSRF_VEC_AT( vec, index );
+}
+
+/**
+	@brief Remove the element at a specified position, and close the gap.
+	@param vec Pointer to the osrfVec.
+	@param index Zero-based subscript of the element to be removed.
+	@return 0 if successful, or -1 if either parameter is invalid.
+
+	If a freeItem callback is installed, it is called for the element being removed.
+	Elements after the specified position move down by one.
+*/
+int osrfVecRemove( osrfVec* vec, size_t index ) {
+	if( !vec || index >= vec->size )
+		return -1;
+
+	if( vec->freeItem )
+		vec->freeItem( OSRF_VEC_AT( vec, index ) );
+	return osrfVecExtract( vec, index, NULL );
+}
+
+/**
+	@brief Remove the element at a specified position without freeing it.
+	@param vec Pointer to the osrfVec.
+	@param index Zero-based subscript of the element to be removed.
+	@param out Pointer to a buffer to receive a copy of the removed element, or NULL.
+	@return 0 if successful, or -1 if either parameter is invalid.
+
+	This function is identical to osrfVecRemove(), except that it never calls the freeItem
+	callback.  Instead it copies the element to @a out, if provided, leaving the calling code
+	responsible for whatever the element owns.
+*/
+int osrfVecExtract( osrfVec* vec, size_t index, void* out ) {
+	if( !vec || index >= vec->size )
+		return -1;
+
+	void* slot = OSRF_VEC_AT( vec, index );
+	if( out )
+		memcpy( out, slot, vec->elem_size );
+
+	--vec->size;
+	memmove( slot, OSRF_VEC_AT( vec, index + 1 ), ( vec->size - index ) * vec->elem_size );
+	memset( OSRF_VEC_AT( vec, vec->size ), 0, vec->elem_size );
+	return 0;
+}
+
+/**
+	@brief Remove the last element of an osrfVec without freeing it.
+	@param vec Pointer to the osrfVec.
+	@param out Pointer to a buffer to receive a copy of the removed element, or NULL.
+	@return 0 if successful, or -1 if the osrfVec is NULL or empty.
+*/
+int osrfVecPop( osrfVec* vec, void* out ) {
+	if( !vec || 0 == vec->size )
+		return -1;
+	return osrfVecExtract( vec, vec->size - 1, out );
+}
+
+/**
+	@brief Return the number of elements in an osrfVec.
+	@param vec Pointer to the osrfVec.
+	@return The number of elements, or zero if @a vec is NULL.
+*/
+size_t osrfVecCount( const osrfVec* vec ) {
+	return vec ? vec->size : 0;
+}
+
+/**
+	@brief Remove every element from an osrfVec.
+	@param vec Pointer to the osrfVec.
+
+	If a freeItem callback is installed, it is called for every element.  The allocated
+	capacity is retained, so that the osrfVec can be refilled without reallocating.
+*/
+void osrfVecClear( osrfVec* vec ) {
+	if( !vec )
+		return;
+
+	if( vec->freeItem ) {
+		size_t i;
+		for( i = 0; i < vec->size; ++i )
+			vec->freeItem( OSRF_VEC_AT( vec, i ) );
+	}
+
+	memset( vec->data, 0, vec->size * vec->elem_size );
+	vec->size = 0;
+}
+
+/**
+	@brief Free an osrfVec, and, optionally, everything in it.
+	@param vec Pointer to the osrfVec to be freed.
+
+	If a freeItem callback is installed, it is called for every element.
+*/
+void osrfVecFree( osrfVec* vec ) {
+	if( !vec )
+		return;
+
+	osrfVecClear( vec );
+	free( vec->data );
+	free( vec );
+}
+
+/**
+	@brief Sort the elements of an osrfVec in place.
+	@param vec Pointer to the osrfVec.
+	@param compare Comparison function, as for qsort(); it receives pointers to elements.
+*/
+void osrfVecSort( osrfVec* vec, int (*compare)( const void*, const void* ) ) {
+	if( vec && compare && vec->size > 1 )
+		qsort( vec->data, vec->size, vec->elem_size, compare );
+}
+
+/**
+	@brief Search a sorted osrfVec for a given key, by binary search.
+	@param vec Pointer to the osrfVec, sorted according to @a compare.
+	@param key Pointer to the key sought.
+	@param compare Comparison function, as for bsearch(); its first argument is @a key.
+	@return A pointer to a matching element, or NULL if none is found.
+*/
+void* osrfVecBsearch( const osrfVec* vec, const void* key,
+		int (*compare)( const void*, const void* ) ) {
+	if( !vec || !compare || 0 == vec->size )
+		return NULL;
+	return bsearch( key, vec->data, vec->size, vec->elem_size, compare );
+}
+
+/**
+	@brief Find the first element equal to a given one, by linear search.
+	@param vec Pointer to the osrfVec.
+	@param elem Pointer to the element sought.
+	@param compare Comparison function returning zero for equal elements, or NULL to
+		compare the elements byte by byte.
+	@return The zero-based subscript of the first matching element, or -1 if none is found.
+*/
+long osrfVecFind( const osrfVec* vec, const void* elem,
+		int (*compare)( const void*, const void* ) ) {
+	if( !vec || !elem )
+		return -1;
+
+	size_t i;
+	for( i = 0; i < vec->size; ++i ) {
+		const void* slot = OSRF_VEC_AT( vec, i );
+		if( compare ? !compare( elem, slot ) : !memcmp( elem, slot, vec->elem_size ) )
+			return (long) i;
+	}
+	return -1;
+}
@@ -1,9 +1,26 @@
 /**
 	@file socket_bundle.c
 	@brief Collection of socket-handling routines.
+
+	On Linux, socket_wait_all() waits on an epoll instance, so that the cost of a wakeup
+	depends on the number of active sockets rather than on the number of sockets managed.
+	Elsewhere, or if the code is compiled with OSRF_SOCKET_USE_SELECT defined, it falls
+	back to select(), which is limited to descriptors below FD_SETSIZE.
+
+	socket_send() blocks until the socket has taken all of the data.  socket_send_nowait()
+	instead queues whatever the socket won't take right away, and the wait functions send
+	it as the socket becomes writable.
 */
 
 #include <opensrf/socket_bundle.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+
+#if defined(__linux__) && !defined(OSRF_SOCKET_USE_SELECT)
+#define SOCKET_USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #define LISTENER_SOCKET   1
 #define DATA_SOCKET       2
@@ -26,16 +43,78 @@ struct socket_node_struct {
 	int parent_id;      /**< For a socket created by accept() for a listener socket,
 	                        this is the listener socket we spawned from. */
 	struct socket_node_struct* next;  /**< Linkage pointer for linked list. */
+	struct socket_node_struct* prev;  /**< Linkage pointer for linked list. */
+	char* rbuf;         /**< Receive buffer, allocated on first read. */
+	size_t rbuf_size;   /**< Capacity of rbuf, not counting room for a terminal nul. */
+	int rbuf_idle;      /**< Number of consecutive wakeups that used little of rbuf. */
+	char* obuf;         /**< Output queue: data accepted by socket_send_nowait() but not
+	                        yet taken by the socket. */
+	size_t obuf_size;   /**< Capacity of obuf. */
+	size_t obuf_head;   /**< Offset in obuf of the first byte not yet sent. */
+	size_t obuf_tail;   /**< Offset in obuf just past the last byte queued. */
+	int want_write;     /**< Boolean: true if we're waiting for the socket to be writable. */
+};
+
+/**
+	@brief Finds a socket_manager's sockets by file descriptor, and polls them.
+
+	The node table lets us find or remove a socket_node without searching the list.  The
+	epoll instance, if any, is created by the first call to socket_wait_all(); until then
+	(and for socket_managers that only ever call socket_wait()) it costs nothing.
+
+	An epoll instance is shared with any child process we fork, and removing a socket from it
+	in the child would remove it in the parent as well.  So we remember which process created
+	it, and a child quietly abandons the parent's instance and makes its own.
+*/
+struct socket_index_struct {
+	socket_node** nodes;    /**< Array of socket_node pointers, indexed by sock_fd. */
+	int size;               /**< Number of slots in the nodes array. */
+	int epoll_fd;           /**< epoll instance, or -1 if none. */
+	pid_t epoll_pid;        /**< Process that created epoll_fd. */
 };
+typedef struct socket_index_struct socket_index;
 
-/** @brief Size of buffer used to read from the sockets */
-#define RBUFSIZE 1024
+/**
+	@name Receive buffer sizes
+
+	Each data socket reads into a buffer of its own.  The buffer starts small, doubles
+	whenever a single read fills it, and halves after a run of wakeups that each left most
+	of it unused.  So a connection that carries large messages gets large reads -- and
+	passes large chunks to the callback -- while an idle connection costs little memory.
+*/
+/*@{*/
+#define RBUF_MIN          4096    /**< Initial size of a receive buffer. */
+#define RBUF_MAX          262144  /**< Largest size of a receive buffer. */
+#define RBUF_SHRINK_AFTER 16      /**< Number of small wakeups before shrinking. */
+/*@}*/
+
+/** @brief Initial size of an output queue. */
+#define OBUF_MIN  16384
+/** @brief Largest output queue buffer we keep around once it's empty. */
+#define OBUF_KEEP 65536
+
+/** @brief Initial number of slots in a socket_index. */
+#define SOCKET_INDEX_MIN 64
+
+/** @brief Maximum number of events to collect from one call to epoll_wait(). */
+#define SOCKET_MAX_EVENTS 64
 
 static socket_node* _socket_add_node(socket_manager* mgr,
 		int endpoint, int addr_type, int sock_fd, int parent_id );
 static socket_node* socket_find_node(socket_manager* mgr, int sock_fd);
 static void socket_remove_node(socket_manager*, int sock_fd);
-static int _socket_send(int sock_fd, const char* data, int flags);
+static socket_index* socket_get_index(socket_manager* mgr);
+static int socket_index_add(socket_manager* mgr, socket_node* node);
+#ifdef SOCKET_USE_EPOLL
+static int socket_epoll_init(socket_manager* mgr);
+static void socket_epoll_add(socket_index* index, const socket_node* node);
+static int socket_wait_all_epoll(socket_manager* mgr, int timeout_ms);
+static unsigned int socket_epoll_events(const socket_node* node);
+#endif
+static int _socket_send(int sock_fd, const char* data, size_t len, long usecs);
+static void _socket_queue_output(socket_node* node, const char* data, size_t len);
+static int _socket_flush_node(socket_manager* mgr, socket_node* node);
+static void socket_want_write(socket_manager* mgr, socket_node* node, int want);
 static int _socket_handle_new_client(socket_manager* mgr, socket_node* node);
 static int _socket_handle_client_data(socket_manager* mgr, socket_node* node);
 
@@ -46,7 +125,7 @@ static int _socket_handle_client_data(socket_manager* mgr, socket_node* node);
 /*
 int count = 0;
 void printme(void* blob, socket_manager* mgr,
-		int sock_fd, char* data, int parent_id) {
+		int sock_fd, char* data, size_t len, int parent_id) {
 
 	fprintf(stderr, "Got data from socket %d with parent %d => %s",
 			sock_fd, parent_id, data );
@@ -100,15 +179,85 @@ static socket_node* _socket_add_node(socket_manager* mgr,
 	new_node->addr_type	= addr_type;
 	new_node->sock_fd	= sock_fd;
 	new_node->next		= NULL;
+	new_node->prev		= NULL;
+	new_node->rbuf		= NULL;
+	new_node->rbuf_size	= 0;
+	new_node->rbuf_idle	= 0;
+	new_node->obuf		= NULL;
+	new_node->obuf_size	= 0;
+	new_node->obuf_head	= 0;
+	new_node->obuf_tail	= 0;
+	new_node->want_write	= 0;
 	new_node->parent_id = 0;
 	if(parent_id > 0)
 		new_node->parent_id = parent_id;
 
 	new_node->next			= mgr->socket;
+	if(mgr->socket)
+		mgr->socket->prev	= new_node;
 	mgr->socket				= new_node;
+
+	socket_index_add(mgr, new_node);
 	return new_node;
 }
 
+/**
+	@brief Return a socket_manager's index, creating an empty one if necessary.
+	@param mgr Pointer to the socket_manager.
+	@return Pointer to the socket_index.
+*/
+static socket_index* socket_get_index(socket_manager* mgr) {
+	if(mgr->index == NULL) {
+		socket_index* index = safe_malloc(sizeof(socket_index));
+		index->nodes = NULL;
+		index->size = 0;
+		index->epoll_fd = -1;
+		index->epoll_pid = 0;
+		mgr->index = index;
+	}
+	return mgr->index;
+}
+
+/**
+	@brief Enter a new socket_node into a socket_manager's index, and into its epoll set.
+	@param mgr Pointer to the socket_manager.
+	@param node Pointer to the socket_node, already in the socket_manager's list.
+	@return 0 if successful, or -1 if not.
+
+	Create the index if necessary, and expand it if it is too small for the new
+	file descriptor.
+*/
+static int socket_index_add(socket_manager* mgr, socket_node* node) {
+
+	if(node->sock_fd < 0)
+		return -1;
+
+	socket_index* index = socket_get_index(mgr);
+
+	if(node->sock_fd >= index->size) {
+		int new_size = index->size ? index->size : SOCKET_INDEX_MIN;
+		while(new_size <= node->sock_fd)
+			new_size *= 2;
+
+		socket_node** new_nodes = safe_malloc(new_size * sizeof(socket_node*));
+		if(index->nodes) {
+			memcpy(new_nodes, index->nodes, index->size * sizeof(socket_node*));
+			free(index->nodes);
+		}
+		index->nodes = new_nodes;
+		index->size = new_size;
+	}
+
+	index->nodes[node->sock_fd] = node;
+
+#ifdef SOCKET_USE_EPOLL
+	if(index->epoll_fd >= 0 && index->epoll_pid == getpid())
+		socket_epoll_add(index, node);
+#endif
+
+	return 0;
+}
+
 /**
 	@brief Create an TCP INET listener socket and add it to a socket_manager's list.
 	@param mgr Pointer to the socket manager that will own the socket.
@@ -453,17 +602,12 @@ int socket_open_unix_client(socket_manager* mgr, const char* sock_path) {
 	@param sock_fd The file descriptor to be sought.
 	@return A pointer to the socket_node if found; otherwise NULL.
 
-	Traverse a linked list owned by the socket_manager.
+	Look up the file descriptor in the socket_manager's index.
 */
 static socket_node* socket_find_node(socket_manager* mgr, int sock_fd) {
-	if(mgr == NULL) return NULL;
-	socket_node* node = mgr->socket;
-	while(node) {
-		if(node->sock_fd == sock_fd)
-			return node;
-		node = node->next;
-	}
-	return NULL;
+	if(mgr == NULL || mgr->index == NULL) return NULL;
+	if(sock_fd < 0 || sock_fd >= mgr->index->size) return NULL;
+	return mgr->index->nodes[sock_fd];
 }
 
 /* removes the node with the given sock_fd from the list and frees it */
@@ -477,33 +621,30 @@ static socket_node* socket_find_node(socket_manager* mgr, int sock_fd) {
 */
 static void socket_remove_node(socket_manager* mgr, int sock_fd) {
 
-	if(mgr == NULL) return;
+	socket_node* node = socket_find_node(mgr, sock_fd);
+	if(node == NULL) return;
 
 	osrfLogDebug( OSRF_LOG_MARK, "removing socket %d", sock_fd);
 
-	socket_node* head = mgr->socket;
-	socket_node* tail = head;
-	if(head == NULL) return;
-
-	/* if removing the first node in the list */
-	if(head->sock_fd == sock_fd) {
-		mgr->socket = head->next;
-		free(head);
-		return;
-	}
-
-	head = head->next;
-
-	/* if removing any other node */
-	while(head) {
-		if(head->sock_fd == sock_fd) {
-			tail->next = head->next;
-			free(head);
-			return;
-		}
-		tail = head;
-		head = head->next;
-	}
+	if(node->prev)
+		node->prev->next = node->next;
+	else
+		mgr->socket = node->next;
+	if(node->next)
+		node->next->prev = node->prev;
+
+	mgr->index->nodes[sock_fd] = NULL;
+
+#ifdef SOCKET_USE_EPOLL
+	/* fails harmlessly if the socket has already been closed */
+	socket_index* index = mgr->index;
+	if(index->epoll_fd >= 0 && index->epoll_pid == getpid())
+		epoll_ctl(index->epoll_fd, EPOLL_CTL_DEL, sock_fd, NULL);
+#endif
+
+	free(node->rbuf);
+	free(node->obuf);
+	free(node);
 }
 
 
@@ -533,46 +674,126 @@ void _socket_print_list(socket_manager* mgr) {
 	@param data Pointer to the string to be sent.
 	@return 0 if successful, -1 if not.
 
-	This function is a thin wrapper for _socket_send().
+	Block until the socket has accepted all of the data.  This function is a thin wrapper
+	for _socket_send().
 */
 int socket_send(int sock_fd, const char* data) {
-	return _socket_send( sock_fd, data, 0);
+	return _socket_send( sock_fd, data, strlen( data ), -1 );
 }
 
 /**
-	@brief Send a nul-terminated string over a socket.
+	@brief Write as much of a buffer to a socket as it will take without blocking.
 	@param sock_fd The file descriptor for the socket.
-	@param data Pointer to the string to be sent.
-	@param flags A set of bitflags to be passed to send().
-	@return 0 if successful, -1 if not.
-
-	This function is the final common pathway for all outgoing socket traffic.
+	@param data Pointer to the data to be sent.
+	@param len Number of bytes to send.
+	@return The number of bytes sent (0 if the socket would block), or -1 upon error.
 */
-static int _socket_send(int sock_fd, const char* data, int flags) {
+static ssize_t _socket_write(int sock_fd, const char* data, size_t len) {
 
-	signal(SIGPIPE, SIG_IGN); /* in case a unix socket was closed */
+	static int sigpipe_ignored = 0;
+	if( !sigpipe_ignored ) {
+		signal(SIGPIPE, SIG_IGN); /* in case a unix socket was closed */
+		sigpipe_ignored = 1;
+	}
 
-	errno = 0;
-	size_t r = send( sock_fd, data, strlen(data), flags );
-	int local_errno = errno;
+	ssize_t r;
+	do {
+		errno = 0;
+		r = send( sock_fd, data, len, MSG_DONTWAIT );
+	} while( r < 0 && EINTR == errno );
 
-	if( r == -1 ) {
-		osrfLogWarning( OSRF_LOG_MARK, "_socket_send(): Error sending data with return %d", r );
-		osrfLogWarning( OSRF_LOG_MARK, "Last Sys Error: %s", strerror(local_errno));
+	if( r < 0 ) {
+		if( EAGAIN == errno || EWOULDBLOCK == errno )
+			return 0;
+		osrfLogWarning( OSRF_LOG_MARK, "_socket_write(): Error sending data on socket %d: %s",
+			sock_fd, strerror( errno ) );
 		return -1;
 	}
 
-	return 0;
+	return r;
+}
+
+/**
+	@brief Return a monotonic timestamp in microseconds, for measuring timeouts.
+*/
+static long long socket_now_usecs(void) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+	@brief Wait until a socket is ready to be written to, or until time runs out.
+	@param sock_fd The file descriptor for the socket.
+	@param deadline Monotonic time by which to give up, in microseconds; or -1 for never.
+	@return 1 if the socket is writable, 0 if we timed out, or -1 upon error.
+*/
+static int _socket_wait_writable(int sock_fd, long long deadline) {
+	struct pollfd pfd;
+	pfd.fd = sock_fd;
+	pfd.events = POLLOUT;
+
+	for( ;; ) {
+		int wait_ms = -1;
+		if( deadline >= 0 ) {
+			long long remaining = deadline - socket_now_usecs();
+			if( remaining <= 0 )
+				return 0;
+			wait_ms = remaining > INT_MAX * 1000LL ? INT_MAX : (int) ( ( remaining + 999 ) / 1000 );
+		}
+
+		pfd.revents = 0;
+		errno = 0;
+		int ret = poll( &pfd, 1, wait_ms );
+		if( ret > 0 )
+			return 1;
+		else if( ret < 0 && EINTR != errno )
+			return -1;
+	}
 }
 
+/**
+	@brief Send a buffer over a socket, waiting as necessary for the socket to take it all.
+	@param sock_fd The file descriptor for the socket.
+	@param data Pointer to the data to be sent.
+	@param len Number of bytes to send.
+	@param usecs How long to wait, in microseconds, before timing out; or -1 to wait as long
+		as it takes.
+	@return 0 if successful, -1 if not.
+
+	A single send() may accept only part of the data, if the socket buffer is full or the
+	call is interrupted by a signal.  We keep going until all of it has been sent.
+
+	This function is the final common pathway for outgoing socket traffic that doesn't go
+	through an output queue.
+*/
+static int _socket_send(int sock_fd, const char* data, size_t len, long usecs) {
+
+	long long deadline = usecs < 0 ? -1 : socket_now_usecs() + usecs;
+	size_t sent = 0;
+
+	while( sent < len ) {
+		ssize_t r = _socket_write( sock_fd, data + sent, len - sent );
+		if( r < 0 )
+			return -1;
+		sent += r;
+
+		if( sent < len ) {
+			int ret = _socket_wait_writable( sock_fd, deadline );
+			if( 0 == ret ) {
+				osrfLogError( OSRF_LOG_MARK, "_socket_send(): timed out after sending %lu of "
+					"%lu bytes on socket %d", (unsigned long) sent, (unsigned long) len, sock_fd );
+				return -1;
+			} else if( ret < 0 ) {
+				osrfLogError( OSRF_LOG_MARK, "_socket_send(): error waiting to send on "
+					"socket %d: %s", sock_fd, strerror( errno ) );
+				return -1;
+			}
+		}
+	}
 
-/* sends the given data to the given socket.
- * sets the send flag MSG_DONTWAIT which will allow the
- * process to continue even if the socket buffer is full
- * returns 0 on success, -1 otherwise */
-//int socket_send_nowait( int sock_fd, const char* data) {
-//	return _socket_send( sock_fd, data, MSG_DONTWAIT);
-//}
+	return 0;
+}
 
 
 /**
@@ -582,31 +803,230 @@ static int _socket_send(int sock_fd, const char* data, int flags) {
 	@param usecs How long to wait, in microseconds, before timing out.
 	@return 0 if successful, -1 if not.
 
-	The socket may not accept all the data we want to give it.
+	The timeout applies to the whole string, not just to the first part of it that the socket
+	is willing to accept.
 */
 int socket_send_timeout( int sock_fd, const char* data, int usecs ) {
+	return _socket_send( sock_fd, data, strlen( data ), usecs < 0 ? 0 : usecs );
+}
 
-	fd_set write_set;
-	FD_ZERO( &write_set );
-	FD_SET( sock_fd, &write_set );
 
-	const int mil = 1000000;
-	int secs = (int) usecs / mil;
-	usecs = usecs - (secs * mil);
+/**
+	@brief Send data over a socket without blocking; queue whatever the socket won't take.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param sock_fd File descriptor of the socket.
+	@param data Pointer to the data to be sent.
+	@param len Number of bytes to send.
+	@return 0 if successful, 1 if successful but the output queue is above the high-water
+		mark, or -1 upon error.
+
+	If nothing is already queued for the socket, send as much as the socket will take
+	immediately.  Append the rest to the socket's output queue, to be sent by
+	socket_wait(), socket_wait_all() or socket_flush() as the socket becomes writable.
+
+	A return of 1 is a request for backpressure: the data has been accepted, but the peer
+	isn't keeping up, and the caller should stop generating output for this socket until
+	socket_backpressure() says otherwise.
+*/
+int socket_send_nowait( socket_manager* mgr, int sock_fd, const char* data, size_t len ) {
+
+	socket_node* node = socket_find_node( mgr, sock_fd );
+	if( NULL == node ) {
+		osrfLogWarning( OSRF_LOG_MARK, "socket_send_nowait(): no such socket: %d", sock_fd );
+		return -1;
+	}
 
-	struct timeval tv;
-	tv.tv_sec = secs;
-	tv.tv_usec = usecs;
+	if( node->obuf_head == node->obuf_tail ) {
+		ssize_t r = _socket_write( sock_fd, data, len );
+		if( r < 0 )
+			return -1;
+		data += r;
+		len -= r;
+	}
 
-	errno = 0;
-	int ret = select( sock_fd + 1, NULL, &write_set, NULL, &tv);
-	if( ret > 0 ) return _socket_send( sock_fd, data, 0);
+	if( len > 0 ) {
+		_socket_queue_output( node, data, len );
+		socket_want_write( mgr, node, 1 );
+	}
 
-	osrfLogError(OSRF_LOG_MARK, "socket_send_timeout(): "
-		"timed out on send for socket %d after %d secs, %d usecs: %s",
-		sock_fd, secs, usecs, strerror( errno ) );
+	return socket_backpressure( mgr, sock_fd );
+}
+
+/**
+	@brief Queue data for a socket, to be sent later along with whatever follows it.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param sock_fd File descriptor of the socket.
+	@param data Pointer to the data to be sent.
+	@param len Number of bytes to send.
+	@return 0 if successful, 1 if successful but the output queue is above the high-water
+		mark, or -1 upon error.
+
+	Unlike socket_send_nowait(), don't try to send anything yet, unless the queue has reached
+	SOCKET_CORK_SIZE bytes.  Many small messages thus go out in one send() -- and often in
+	one TCP segment -- instead of one apiece.  The queue is sent by socket_flush(), or by
+	socket_wait() or socket_wait_all() on their next pass, since a socket with queued output
+	is waited on for writability.
+
+	The return value means the same as for socket_send_nowait().
+*/
+int socket_send_corked( socket_manager* mgr, int sock_fd, const char* data, size_t len ) {
+
+	socket_node* node = socket_find_node( mgr, sock_fd );
+	if( NULL == node ) {
+		osrfLogWarning( OSRF_LOG_MARK, "socket_send_corked(): no such socket: %d", sock_fd );
+		return -1;
+	}
+
+	_socket_queue_output( node, data, len );
+	if( node->obuf_tail - node->obuf_head >= SOCKET_CORK_SIZE ) {
+		if( _socket_flush_node( mgr, node ) > 0 )
+			socket_want_write( mgr, node, 1 );
+	} else
+		socket_want_write( mgr, node, 1 );
+
+	return socket_backpressure( mgr, sock_fd );
+}
+
+/**
+	@brief Append data to a socket's output queue.
+	@param node Pointer to the socket_node.
+	@param data Pointer to the data to be queued.
+	@param len Number of bytes to queue.
+
+	Make room by discarding the part of the queue that has already been sent, or else by
+	moving the queue to a bigger buffer.
+*/
+static void _socket_queue_output(socket_node* node, const char* data, size_t len) {
+
+	if( node->obuf_tail + len > node->obuf_size ) {
+		size_t pending = node->obuf_tail - node->obuf_head;
+		if( pending + len <= node->obuf_size / 2 ) {
+			memmove( node->obuf, node->obuf + node->obuf_head, pending );
+		} else {
+			size_t new_size = node->obuf_size ? node->obuf_size : OBUF_MIN;
+			while( new_size < pending + len )
+				new_size *= 2;
+			char* new_buf = safe_malloc( new_size );
+			if( pending )
+				memcpy( new_buf, node->obuf + node->obuf_head, pending );
+			free( node->obuf );
+			node->obuf = new_buf;
+			node->obuf_size = new_size;
+		}
+		node->obuf_head = 0;
+		node->obuf_tail = pending;
+	}
+
+	memcpy( node->obuf + node->obuf_tail, data, len );
+	node->obuf_tail += len;
+}
+
+/**
+	@brief Send as much of a socket's output queue as the socket will take without blocking.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param node Pointer to the socket_node.
+	@return 0 if the queue is now empty, 1 if data remains queued, or -1 upon error.
+
+	If the send fails, discard the queue; the socket is presumably dead, and the failure
+	will come to light when we next try to read from it.
+*/
+static int _socket_flush_node(socket_manager* mgr, socket_node* node) {
+
+	while( node->obuf_head < node->obuf_tail ) {
+		ssize_t r = _socket_write( node->sock_fd, node->obuf + node->obuf_head,
+				node->obuf_tail - node->obuf_head );
+		if( r < 0 ) {
+			node->obuf_head = node->obuf_tail = 0;
+			socket_want_write( mgr, node, 0 );
+			return -1;
+		} else if( 0 == r )
+			return 1;
+		node->obuf_head += r;
+	}
 
-	return -1;
+	// The queue is empty.  Don't hang on to a large buffer.
+	node->obuf_head = node->obuf_tail = 0;
+	if( node->obuf_size > OBUF_KEEP ) {
+		free( node->obuf );
+		node->obuf = NULL;
+		node->obuf_size = 0;
+	}
+	socket_want_write( mgr, node, 0 );
+	return 0;
+}
+
+/**
+	@brief Send a socket's queued output, waiting if necessary.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param sock_fd File descriptor of the socket.
+	@param timeout How long to wait, in seconds: -1 to wait until all the data has been sent,
+		or 0 not to wait at all.
+	@return 0 if the queue is now empty, 1 if data remains queued, or -1 upon error.
+*/
+int socket_flush( socket_manager* mgr, int sock_fd, int timeout ) {
+
+	socket_node* node = socket_find_node( mgr, sock_fd );
+	if( NULL == node )
+		return -1;
+
+	long long deadline = timeout < 0 ? -1 : socket_now_usecs() + timeout * 1000000LL;
+	int ret;
+	while( ( ret = _socket_flush_node( mgr, node ) ) > 0 && timeout != 0 ) {
+		if( _socket_wait_writable( sock_fd, deadline ) <= 0 )
+			break;
+	}
+
+	return ret;
+}
+
+/**
+	@brief Report how much output is queued for a socket.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param sock_fd File descriptor of the socket.
+	@return The number of bytes queued but not yet sent.
+*/
+size_t socket_pending( socket_manager* mgr, int sock_fd ) {
+	socket_node* node = socket_find_node( mgr, sock_fd );
+	return node ? node->obuf_tail - node->obuf_head : 0;
+}
+
+/**
+	@brief Report whether a socket's output queue is above its high-water mark.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param sock_fd File descriptor of the socket.
+	@return 1 if the caller should hold off sending more data to the socket, or 0 if not.
+*/
+int socket_backpressure( socket_manager* mgr, int sock_fd ) {
+	if( NULL == mgr )
+		return 0;
+	size_t high_water = mgr->high_water ? mgr->high_water : SOCKET_HIGH_WATER;
+	return socket_pending( mgr, sock_fd ) > high_water;
+}
+
+/**
+	@brief Tell the event loop whether we want to hear about a socket becoming writable.
+	@param mgr Pointer to the socket_manager that owns the socket.
+	@param node Pointer to the socket_node.
+	@param want Boolean: true if there is output waiting to be sent.
+
+	socket_wait() and the select() flavor of socket_wait_all() look at the output queue
+	directly; an epoll instance has to be told.
+*/
+static void socket_want_write(socket_manager* mgr, socket_node* node, int want) {
+	if( node->want_write == want )
+		return;
+	node->want_write = want;
+
+#ifdef SOCKET_USE_EPOLL
+	socket_index* index = mgr->index;
+	if( index && index->epoll_fd >= 0 && index->epoll_pid == getpid() ) {
+		struct epoll_event ev;
+		memset( &ev, 0, sizeof( ev ) );
+		ev.events = socket_epoll_events( node );
+		ev.data.fd = node->sock_fd;
+		epoll_ctl( index->epoll_fd, EPOLL_CTL_MOD, node->sock_fd, &ev );
+	}
+#endif
 }
 
 
@@ -621,8 +1041,8 @@ int socket_send_timeout( int sock_fd, const char* data, int usecs ) {
 */
 void socket_disconnect(socket_manager* mgr, int sock_fd) {
 	osrfLogInternal( OSRF_LOG_MARK, "Closing socket %d", sock_fd);
-	close( sock_fd );
 	socket_remove_node(mgr, sock_fd);
+	close( sock_fd );
 }
 
 
@@ -631,26 +1051,28 @@ void socket_disconnect(socket_manager* mgr, int sock_fd) {
 	@param sock_fd File descriptor for the socket.
 	@return 1 if the socket is valid, or 0 if it isn't.
 
-	The test is based on a call to select().  If the socket is valid but is not ready to be
-	written to, we wait until it is ready, then return 1.
+	The test is based on a non-blocking call to poll().  The socket is invalid if the
+	descriptor isn't open, or if poll() reports an error or a hangup -- as it does if, for
+	example, the other end of a connection has closed the connection.
 
-	If the select() fails, it may be because it was interrupted by a signal.  In that case
-	we try again.  Otherwise we assume that the socket is no longer valid.  This can happen
-	if, for example, the other end of a connection has closed the connection.
-
-	The select() can also fail if it is unable to allocate enough memory for its own internal
-	use.  If that happens, we may erroneously report a valid socket as invalid, but we
-	probably wouldn't be able to use it anyway if we're that close to exhausting memory.
+	If the poll() is interrupted by a signal, we try again.  If it fails for some other reason
+	(such as being unable to allocate memory for its own use), we report the socket as
+	invalid; we probably wouldn't be able to use it anyway if we're that close to exhausting
+	memory.
 */
 int socket_connected(int sock_fd) {
-	fd_set read_set;
-	FD_ZERO( &read_set );
-	FD_SET( sock_fd, &read_set );
+	struct pollfd pfd;
+	pfd.fd = sock_fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
 	while( 1 ) {
-		if( select( sock_fd + 1, &read_set, NULL, NULL, NULL) == -1 )
+		errno = 0;
+		if( poll( &pfd, 1, 0 ) == -1 ) {
+			if( EINTR == errno )
+				continue;
+			return 0;
+		} else if( pfd.revents & ( POLLERR | POLLHUP | POLLNVAL ) )
 			return 0;
-		else if( EINTR == errno )
-			continue;
 		else
 			return 1;
 	}
@@ -666,8 +1088,25 @@ int socket_connected(int sock_fd) {
 
 	If @a timeout is -1, wait indefinitely for input activity to appear.  If @a timeout is
 	zero, don't wait at all.  If @a timeout is positive, wait that number of seconds
-	before timing out.  If @a timeout has a negative value other than -1, the results are not
-	well defined, but we'll probably get an EINVAL error from select().
+	before timing out.
+
+	The same as socket_wait_ms(), but with the timeout in seconds.
+*/
+int socket_wait( socket_manager* mgr, int timeout, int sock_fd ) {
+	return socket_wait_ms( mgr, timeout_to_millis( timeout ), sock_fd );
+}
+
+/**
+	@brief Look for input on a given socket.  If you find some, react to it.
+	@param mgr Pointer to the socket_manager that presumably owns the socket.
+	@param timeout_ms Timeout interval, in milliseconds (see notes).
+	@param sock_fd The file descriptor to look at.
+	@return 0 if successful, or -1 if a timeout or other error occurs, or if the sender
+		closes the connection.
+
+	If @a timeout_ms is negative, wait indefinitely for input activity to appear.  If
+	@a timeout_ms is zero, don't wait at all.  If @a timeout_ms is positive, wait that
+	many milliseconds before timing out.
 
 	If we detect activity, branch on the type of socket:
 
@@ -675,48 +1114,48 @@ int socket_connected(int sock_fd) {
 	socket_manager's list, without actually reading any data.
 	- Otherwise, read as much data as is available from the input socket, passing it a
 	buffer at a time to whatever callback function has been defined to the socket_manager.
+
+	If output is queued for the socket, we also wait for the socket to become writable, and
+	send as much of the queue as it will take.
 */
-int socket_wait( socket_manager* mgr, int timeout, int sock_fd ) {
+int socket_wait_ms( socket_manager* mgr, int timeout_ms, int sock_fd ) {
 
 	int retval = 0;
-	fd_set read_set;
-	FD_ZERO( &read_set );
-	FD_SET( sock_fd, &read_set );
+	socket_node* node = socket_find_node(mgr, sock_fd);
 
-	struct timeval tv;
-	tv.tv_sec = timeout;
-	tv.tv_usec = 0;
+	// Unlike select(), poll() doesn't care how big the file descriptor is
+	struct pollfd pfd;
+	pfd.fd = sock_fd;
+	pfd.events = POLLIN;
+	if( node && node->obuf_head < node->obuf_tail )
+		pfd.events |= POLLOUT;
+	pfd.revents = 0;
 	errno = 0;
 
-	if( timeout < 0 ) {
+	if( timeout_ms != 0 ) { /* timeout of 0 means don't block */
 
-		// If timeout is -1, we block indefinitely
-		if( (retval = select( sock_fd + 1, &read_set, NULL, NULL, NULL)) == -1 ) {
-			osrfLogDebug( OSRF_LOG_MARK, "Call to select() interrupted: Sys Error: %s",
-					strerror(errno));
-			return -1;
-		}
-
-	} else if( timeout > 0 ) { /* timeout of 0 means don't block */
-
-		if( (retval = select( sock_fd + 1, &read_set, NULL, NULL, &tv)) == -1 ) {
-			osrfLogDebug( OSRF_LOG_MARK, "Call to select() interrupted: Sys Error: %s",
+		// If timeout is negative, we block indefinitely
+		if( (retval = poll( &pfd, 1, timeout_ms < 0 ? -1 : timeout_ms )) == -1 ) {
+			osrfLogDebug( OSRF_LOG_MARK, "Call to poll() interrupted: Sys Error: %s",
 					strerror(errno));
 			return -1;
 		}
 	}
 
-	osrfLogInternal( OSRF_LOG_MARK, "%d active sockets after select()", retval);
+	osrfLogInternal( OSRF_LOG_MARK, "%d active sockets after poll()", retval);
 
-	socket_node* node = socket_find_node(mgr, sock_fd);
 	if( node ) {
+		if( pfd.revents & POLLOUT )
+			_socket_flush_node( mgr, node );
+
 		if( node->endpoint == LISTENER_SOCKET ) {
 			_socket_handle_new_client( mgr, node );  // accept new connection
 		} else {
 			int status = _socket_handle_client_data( mgr, node );   // read data
 			if( status == -1 ) {
-				close( sock_fd );
-				socket_remove_node( mgr, sock_fd );
+				/* the callback may already have closed the socket */
+				if( socket_find_node( mgr, sock_fd ) )
+					socket_disconnect( mgr, sock_fd );
 				return -1;
 			}
 		}
@@ -735,8 +1174,23 @@ int socket_wait( socket_manager* mgr, int timeout, int sock_fd ) {
 
 	If @a timeout is -1, wait indefinitely for input activity to appear.  If @a timeout is
 	zero, don't wait at all.  If @a timeout is positive, wait that number of seconds
-	before timing out.  If @a timeout has a negative value other than -1, the results are not
-	well defined, but we'll probably get an EINVAL error from select().
+	before timing out.
+
+	The same as socket_wait_all_ms(), but with the timeout in seconds.
+*/
+int socket_wait_all(socket_manager* mgr, int timeout) {
+	return socket_wait_all_ms( mgr, timeout_to_millis( timeout ) );
+}
+
+/**
+	@brief Wait for input on all of a socket_manager's sockets; react to any input found.
+	@param mgr Pointer to the socket_manager.
+	@param timeout_ms How many milliseconds to wait before timing out (see notes).
+	@return 0 if successful, or -1 if a timeout or other error occurs.
+
+	If @a timeout_ms is negative, wait indefinitely for input activity to appear.  If
+	@a timeout_ms is zero, don't wait at all.  If @a timeout_ms is positive, wait that
+	many milliseconds before timing out.
 
 	For each active socket found:
 
@@ -744,44 +1198,61 @@ int socket_wait( socket_manager* mgr, int timeout, int sock_fd ) {
 	socket_manager's list, without actually reading any data.
 	- Otherwise, read as much data as is available from the input socket, passing it a
 	buffer at a time to whatever callback function has been defined to the socket_manager.
+
+	Where epoll is available we use it, and fall back to select() only if it isn't.
 */
-int socket_wait_all(socket_manager* mgr, int timeout) {
+int socket_wait_all_ms(socket_manager* mgr, int timeout_ms) {
 
 	if(mgr == NULL) {
 		osrfLogWarning( OSRF_LOG_MARK,  "socket_wait_all(): null mgr" );
 		return -1;
 	}
 
+#ifdef SOCKET_USE_EPOLL
+	if( socket_epoll_init( mgr ) == 0 )
+		return socket_wait_all_epoll( mgr, timeout_ms );
+#endif
+
 	int num_active = 0;
 	fd_set read_set;
+	fd_set write_set;
 	FD_ZERO( &read_set );
+	FD_ZERO( &write_set );
 
 	socket_node* node = mgr->socket;
 	int max_fd = 0;
 	while(node) {
+		if( node->sock_fd >= FD_SETSIZE ) {
+			osrfLogWarning( OSRF_LOG_MARK, "Socket fd %d is too big for select(); ignoring it",
+				node->sock_fd );
+			node = node->next;
+			continue;
+		}
 		osrfLogInternal( OSRF_LOG_MARK, "Adding socket fd %d to select set",node->sock_fd);
 		FD_SET( node->sock_fd, &read_set );
+		if( node->obuf_head < node->obuf_tail )
+			FD_SET( node->sock_fd, &write_set );
 		if(node->sock_fd > max_fd) max_fd = node->sock_fd;
 		node = node->next;
 	}
 	max_fd += 1;
 
 	struct timeval tv;
-	tv.tv_sec = timeout;
-	tv.tv_usec = 0;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = ( timeout_ms % 1000 ) * 1000;
 	errno = 0;
 
-	if( timeout < 0 ) {
+	if( timeout_ms < 0 ) {
 
-		// If timeout is -1, there is no timeout passed to the call to select
-		if( (num_active = select( max_fd, &read_set, NULL, NULL, NULL)) == -1 ) {
+		// If timeout is negative, there is no timeout passed to the call to select
+		if( (num_active = select( max_fd, &read_set, &write_set, NULL, NULL)) == -1 ) {
 			osrfLogWarning( OSRF_LOG_MARK, "select() call aborted: %s", strerror(errno));
 			return -1;
 		}
 
-	} else if( timeout != 0 ) { /* timeout of 0 means don't block */
+	} else { /* timeout of 0 means don't block, but still look */
 
-		if( (num_active = select( max_fd, &read_set, NULL, NULL, &tv)) == -1 ) {
+		if( (num_active = select( max_fd, &read_set, &write_set, NULL, &tv)) == -1 ) {
 			osrfLogWarning( OSRF_LOG_MARK, "select() call aborted: %s", strerror(errno));
 			return -1;
 		}
@@ -794,11 +1265,19 @@ int socket_wait_all(socket_manager* mgr, int timeout) {
 
 	while(node && (handled < num_active)) {
 
-		socket_node* next_node = node->next;
+		/* a callback may close the next socket, so remember it by descriptor */
+		int next_fd = node->next ? node->next->sock_fd : -1;
 		int sock_fd = node->sock_fd;
 
+		/* is this socket ready to take queued output? */
+		if( sock_fd < FD_SETSIZE && FD_ISSET( sock_fd, &write_set ) ) {
+			handled++;
+			FD_CLR(sock_fd, &write_set);
+			_socket_flush_node(mgr, node);
+		}
+
 		/* does this socket have data? */
-		if( FD_ISSET( sock_fd, &read_set ) ) {
+		if( sock_fd < FD_SETSIZE && FD_ISSET( sock_fd, &read_set ) ) {
 
 			osrfLogInternal( OSRF_LOG_MARK, "Socket %d active", sock_fd);
 			handled++;
@@ -810,18 +1289,147 @@ int socket_wait_all(socket_manager* mgr, int timeout) {
 			else {
 				if( _socket_handle_client_data(mgr, node) == -1 ) {
 					/* someone may have yanked a socket_node out from under us */
-					close( sock_fd );
-					socket_remove_node( mgr, sock_fd );
+					if( socket_find_node( mgr, sock_fd ) )
+						socket_disconnect( mgr, sock_fd );
 				}
 			}
 		}
 
-		node = next_node;
+		node = next_fd < 0 ? NULL : socket_find_node( mgr, next_fd );
 	} // is_set
 
 	return 0;
 }
 
+#ifdef SOCKET_USE_EPOLL
+/**
+	@brief Make sure that a socket_manager has an epoll instance of its own.
+	@param mgr Pointer to the socket_manager.
+	@return 0 if the epoll instance is ready for use, or -1 if we can't use epoll.
+
+	Create the epoll instance if it doesn't exist yet, or if it was inherited from a
+	parent process, and register all of the socket_manager's sockets with it.  If we
+	can't create one, remember that, so that we don't try again on every call.
+*/
+static int socket_epoll_init(socket_manager* mgr) {
+
+	socket_index* index = socket_get_index(mgr);
+	pid_t pid = getpid();
+	if(index->epoll_pid == pid)
+		return index->epoll_fd >= 0 ? 0 : -1;
+
+	if(index->epoll_fd >= 0)
+		close(index->epoll_fd);   /* the parent process's instance; leave it alone */
+
+	index->epoll_pid = pid;
+	errno = 0;
+	index->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(index->epoll_fd < 0) {
+		osrfLogWarning( OSRF_LOG_MARK, "epoll_create1() failed; using select(): %s",
+			strerror(errno));
+		return -1;
+	}
+
+	socket_node* node = mgr->socket;
+	while(node) {
+		socket_epoll_add(index, node);
+		node = node->next;
+	}
+
+	return 0;
+}
+
+/**
+	@brief Register a socket with a socket_manager's epoll instance.
+	@param index Pointer to the socket_manager's index.
+	@param node Pointer to the socket_node for the socket.
+
+	Data sockets are edge-triggered: _socket_handle_client_data() reads until the socket
+	would block, so we only need to hear about new arrivals.  Listener sockets are
+	level-triggered, since we accept only one connection per wakeup.
+*/
+static void socket_epoll_add(socket_index* index, const socket_node* node) {
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = socket_epoll_events(node);
+	ev.data.fd = node->sock_fd;
+
+	errno = 0;
+	if(epoll_ctl(index->epoll_fd, EPOLL_CTL_ADD, node->sock_fd, &ev) < 0)
+		osrfLogWarning( OSRF_LOG_MARK, "Unable to add socket %d to epoll set: %s",
+			node->sock_fd, strerror(errno));
+}
+
+/**
+	@brief Compute the set of epoll events of interest for a socket.
+	@param node Pointer to the socket_node for the socket.
+	@return A bitmask for the events member of a struct epoll_event.
+
+	We ask about writability only while output is queued, since otherwise a writable socket
+	would wake us up for nothing.
+*/
+static unsigned int socket_epoll_events(const socket_node* node) {
+	unsigned int events = EPOLLIN;
+	if(node->endpoint == DATA_SOCKET)
+		events |= EPOLLET;
+	if(node->want_write)
+		events |= EPOLLOUT;
+	return events;
+}
+
+/**
+	@brief Wait on a socket_manager's epoll instance; react to any input found.
+	@param mgr Pointer to the socket_manager.
+	@param timeout_ms How many milliseconds to wait before timing out (negative to wait
+		indefinitely).
+	@return 0 if successful, or -1 if an error occurs.
+
+	The same as socket_wait_all_ms(), except for how we wait.
+*/
+static int socket_wait_all_epoll(socket_manager* mgr, int timeout_ms) {
+
+	struct epoll_event events[SOCKET_MAX_EVENTS];
+
+	errno = 0;
+	int num_active = epoll_wait(mgr->index->epoll_fd, events, SOCKET_MAX_EVENTS,
+			timeout_ms < 0 ? -1 : timeout_ms);
+	if(num_active == -1) {
+		osrfLogWarning( OSRF_LOG_MARK, "epoll_wait() call aborted: %s", strerror(errno));
+		return -1;
+	}
+
+	osrfLogDebug( OSRF_LOG_MARK, "%d active sockets after epoll_wait()", num_active);
+
+	int i;
+	for(i = 0; i < num_active; ++i) {
+
+		int sock_fd = events[i].data.fd;
+
+		/* a callback may have closed this socket while we handled an earlier one */
+		socket_node* node = socket_find_node(mgr, sock_fd);
+		if(node == NULL)
+			continue;
+
+		osrfLogInternal( OSRF_LOG_MARK, "Socket %d active", sock_fd);
+
+		if(events[i].events & EPOLLOUT) {
+			_socket_flush_node(mgr, node);
+			if(!(events[i].events & ~EPOLLOUT))
+				continue;    /* writable, but nothing to read */
+		}
+
+		if(node->endpoint == LISTENER_SOCKET)
+			_socket_handle_new_client(mgr, node);
+		else if( _socket_handle_client_data(mgr, node) == -1 ) {
+			if( socket_find_node( mgr, sock_fd ) )
+				socket_disconnect( mgr, sock_fd );
+		}
+	}
+
+	return 0;
+}
+#endif
+
 /**
 	@brief Accept a new socket from a listener, and add it to the socket_manager's list.
 	@param mgr Pointer to the socket_manager that will own the new socket.
@@ -862,8 +1470,8 @@ static int _socket_handle_new_client(socket_manager* mgr, socket_node* node) {
 	@return 0 if successful, or -1 upon failure.
 
 	Receive one or more buffers until no more bytes are available for receipt.  Add a
-	terminal nul to each buffer and pass it to a callback function previously defined by the
-	application to the socket_manager.
+	terminal nul to each buffer and pass it, with its length, to a callback function
+	previously defined by the application to the socket_manager.
 
 	If the sender closes the connection, call another callback function, if one has been
 	defined.
@@ -872,39 +1480,83 @@ static int _socket_handle_new_client(socket_manager* mgr, socket_node* node) {
 	there may be more data that hasn't arrived yet.  It is the responsibility of the
 	calling code to recognize message boundaries.
 
+	The callback may close the socket and free its socket_node, so while reading we hold the
+	receive buffer ourselves, and hand it back to the node only if the node survives.
+
 	Called only for a DATA_SOCKET.
 */
 static int _socket_handle_client_data(socket_manager* mgr, socket_node* node) {
 	if(mgr == NULL || node == NULL) return -1;
 
-	char buf[RBUFSIZE];
-	int read_bytes;
+	ssize_t read_bytes;
+	ssize_t most_bytes = 0;
 	int sock_fd = node->sock_fd;
-
-	set_fl(sock_fd, O_NONBLOCK);
+	int parent_id = node->parent_id;  /* the callback may free the node */
+
+	size_t buf_size = node->rbuf_size;
+	char* buf = node->rbuf;
+	node->rbuf = NULL;
+	if(buf == NULL) {
+		buf_size = RBUF_MIN;
+		buf = safe_malloc(buf_size + 1);
+	}
 
 	osrfLogInternal( OSRF_LOG_MARK, "%ld : Received data at %f\n",
 			(long) getpid(), get_timestamp_millis());
 
-	while( (read_bytes = recv(sock_fd, buf, RBUFSIZE-1, 0) ) > 0 ) {
-		buf[read_bytes] = '\0';
-		osrfLogInternal( OSRF_LOG_MARK, "Socket %d Read %d bytes and data: %s",
-				sock_fd, read_bytes, buf);
-		if(mgr->data_received)
-			mgr->data_received(mgr->blob, mgr, sock_fd, buf, node->parent_id);
+	/* MSG_DONTWAIT spares us toggling O_NONBLOCK with fcntl() around every read */
+	for( ;; ) {
+		read_bytes = recv(sock_fd, buf, buf_size, MSG_DONTWAIT);
+		if( read_bytes > 0 ) {
+			buf[read_bytes] = '\0';
+			if(read_bytes > most_bytes)
+				most_bytes = read_bytes;
+			osrfLogInternal( OSRF_LOG_MARK, "Socket %d Read %ld bytes and data: %s",
+					sock_fd, (long) read_bytes, buf);
+			if(mgr->data_received) {
+				mgr->data_received(mgr->blob, mgr, sock_fd, buf, read_bytes, parent_id);
+				if(socket_find_node(mgr, sock_fd) == NULL)
+					break;      /* the callback closed the socket */
+			}
+
+			/* a full buffer suggests that more is on the way; read it in bigger bites */
+			if((size_t) read_bytes == buf_size && buf_size < RBUF_MAX) {
+				free(buf);
+				buf_size *= 2;
+				buf = safe_malloc(buf_size + 1);
+			}
+		} else if( read_bytes < 0 && EINTR == errno )
+			continue;   /* an edge-triggered socket must be drained */
+		else
+			break;
 	}
 	int local_errno = errno; /* capture errno as set by recv() */
 
-	if(socket_find_node(mgr, sock_fd)) {  /* someone may have closed this socket */
-		clr_fl(sock_fd, O_NONBLOCK);
-		if(read_bytes < 0) {
-			// EAGAIN would have meant that no more data was available
-			if(local_errno != EAGAIN)   // but if that's not the case...
-				osrfLogWarning( OSRF_LOG_MARK, " * Error reading socket with error %s",
-					strerror(local_errno) );
-		}
+	node = socket_find_node(mgr, sock_fd);
+	if(node == NULL) {  /* someone may have closed this socket */
+		free(buf);
+		return -1;      /* inform the caller that this node has been tampered with */
+	}
 
-	} else { return -1; } /* inform the caller that this node has been tampered with */
+	/* give the buffer back, shrinking it if it has been mostly idle for a while */
+	if((size_t) most_bytes <= buf_size / 4 && buf_size > RBUF_MIN) {
+		if(++node->rbuf_idle >= RBUF_SHRINK_AFTER) {
+			free(buf);
+			buf_size /= 2;
+			buf = safe_malloc(buf_size + 1);
+			node->rbuf_idle = 0;
+		}
+	} else
+		node->rbuf_idle = 0;
+	node->rbuf = buf;
+	node->rbuf_size = buf_size;
+
+	if(read_bytes < 0) {
+		// EAGAIN would have meant that no more data was available
+		if(local_errno != EAGAIN)   // but if that's not the case...
+			osrfLogWarning( OSRF_LOG_MARK, " * Error reading socket with error %s",
+				strerror(local_errno) );
+	}
 
 	if(read_bytes == 0) {  /* socket closed by client */
 		if(mgr->on_socket_closed) {
@@ -930,6 +1582,12 @@ void socket_manager_free(socket_manager* mgr) {
 		socket_disconnect(mgr, mgr->socket->sock_fd);
 		mgr->socket = tmp;
 	}
+	if(mgr->index) {
+		if(mgr->index->epoll_fd >= 0)
+			close(mgr->index->epoll_fd);
+		free(mgr->index->nodes);
+		free(mgr->index);
+	}
 	free(mgr);
 
 }
@@ -2,7 +2,7 @@
 
 int count = 0;
 void printme(void* blob, socket_manager* mgr, 
-		int sock_fd, char* data, int parent_id) {
+		int sock_fd, char* data, size_t len, int parent_id) {
 
 	fprintf(stderr, "Got data from socket %d with parent %d => %s", 
 			sock_fd, parent_id, data );
@@ -8,9 +8,13 @@
 	two main purposes:
 	- They remember a Jabber ID to use when sending messages.
 	- They maintain a queue of input messages that the calling code can get one at a time.
+
+	Optionally they also exchange messages with other processes on the same host directly,
+	bypassing Jabber; see client_open_local().
 */
 
 static void client_message_handler( void* client, transport_message* msg );
+static int client_wait_ms( transport_client* client, int timeout_ms );
 
 //int main( int argc, char** argv );
 
@@ -88,6 +92,7 @@ transport_client* client_init( const char* server, int port, const char* unix_pa
 	client->error = 0;
 	client->host = strdup(server);
 	client->xmpp_id = NULL;
+	client->local = NULL;
 
 	return client;
 }
@@ -142,9 +147,35 @@ int client_connect( transport_client* client,
 */
 int client_disconnect( transport_client* client ) {
 	if( client == NULL ) { return 0; }
+	local_free( client->local );
+	client->local = NULL;
 	return session_disconnect( client->session );
 }
 
+/**
+	@brief Exchange messages with other processes on this host directly, bypassing Jabber.
+	@param client Pointer to a connected transport_client.
+	@param dir A directory, shared by the processes, where each has a socket.
+	@return 0 if successful, or -1 if not.
+
+	From now on, a message for a Jabber ID with a socket in @a dir goes straight to that
+	socket, and messages from local peers arrive through our own socket, to be received
+	by client_recv() like any other.  Messages for anybody else still go through Jabber.
+	See transport_local.c.
+
+	Since client_recv() then waits on all of the client's sockets, this doesn't suit a
+	client that the calling code waits on by itself, such as the router's.
+*/
+int client_open_local( transport_client* client, const char* dir ) {
+	if( client == NULL || client->xmpp_id == NULL || dir == NULL )
+		return -1;
+	if( client->local )
+		return 0;
+	client->local = local_init( client->session->sock_mgr, dir, client->xmpp_id,
+		client, client_message_handler );
+	return client->local ? 0 : -1;
+}
+
 /**
 	@brief Report whether a transport_client is connected.
 	@param client Pointer to the transport_client.
@@ -159,10 +190,14 @@ int client_connected( const transport_client* client ) {
 	@brief Send a transport message to the current destination.
 	@param client Pointer to a transport_client.
 	@param msg Pointer to the transport_message to be sent.
-	@return 0 if successful, or -1 if not.
+	@return 0 if successful, 1 if successful but a nonblocking client is backed up, or -1
+		if not.
 
 	Translate the transport_message into XML and send it to Jabber, using the previously
 	stored Jabber ID for the sender.
+
+	A client made nonblocking by client_set_nonblocking() may queue part of the message, to
+	be sent when the socket is writable; see session_send_msg().
 */
 int client_send_message( transport_client* client, transport_message* msg ) {
 	if( client == NULL || client->error )
@@ -170,26 +205,137 @@ int client_send_message( transport_client* client, transport_message* msg ) {
 	if( msg->sender )
 		free( msg->sender );
 	msg->sender = strdup(client->xmpp_id);
+	if( client->local && local_send_msg( client->local, msg ) == 0 )
+		return 0;
 	return session_send_msg( client->session, msg );
 }
 
+/**
+	@brief Choose whether client_send_message() may queue output instead of blocking.
+	@param client Pointer to a transport_client.
+	@param nonblocking Boolean: true to queue output, or false to block until it's sent.
+
+	A nonblocking client is for an event loop that waits on the client's socket -- for
+	example with socket_wait_all() or select() -- and calls client_flush() when the socket is
+	writable.  Any other code should leave the client blocking, or else call client_flush()
+	after sending.
+*/
+void client_set_nonblocking( transport_client* client, int nonblocking ) {
+	if( client && client->session )
+		client->session->nonblocking = nonblocking ? 1 : 0;
+}
+
+/**
+	@brief Choose whether client_send_message() holds messages back to send them in batches.
+	@param client Pointer to a transport_client.
+	@param corked Boolean: true to batch output, or false to send each message as it comes.
+
+	A corked client appends each outgoing message to the socket's output queue instead of
+	sending it.  The queue goes out in a single send() when it reaches SOCKET_CORK_SIZE
+	bytes, when client_flush() is called, or when the client next waits for input -- for
+	example in client_recv(), or in socket_wait_all() for an event loop.  This saves a
+	system call, and usually a TCP segment, per message when sending many small ones.
+
+	Code that corks a client must flush it before doing anything that depends on the peer
+	having received the output.  Uncorking a client flushes it, waiting if the client is
+	blocking.
+*/
+void client_set_corked( transport_client* client, int corked ) {
+	if( client == NULL || client->session == NULL )
+		return;
+	client->session->corked = corked ? 1 : 0;
+	if( !corked && client_pending( client ) )
+		session_flush( client->session, client->session->nonblocking ? 0 : -1 );
+}
+
+/**
+	@brief Choose whether to ask the Jabber server to compress the client's stream.
+	@param client Pointer to a transport_client.
+	@param compress Boolean: true to ask for zlib compression (XEP-0138), or false not to.
+
+	This must be set before client_connect().  A server that doesn't offer compression, or
+	refuses it, gets an uncompressed stream as before.  Compression trades some CPU for a
+	large cut in bandwidth when messages are big and repetitive, as fieldmapper objects are.
+*/
+void client_set_compression( transport_client* client, int compress ) {
+	if( client && client->session )
+		client->session->compress = compress ? 1 : 0;
+}
+
+/**
+	@brief Send any output queued for a transport_client.
+	@param client Pointer to a transport_client.
+	@param timeout How many seconds to wait for the socket to take the data: -1 to wait
+		as long as it takes, or 0 not to wait at all.
+	@return 0 if nothing remains queued, 1 if something does, or -1 upon error.
+*/
+int client_flush( transport_client* client, int timeout ) {
+	if( client == NULL )
+		return -1;
+	return session_flush( client->session, timeout );
+}
+
+/**
+	@brief Report how many bytes of output are queued for a transport_client.
+	@param client Pointer to a transport_client.
+	@return The number of bytes accepted by client_send_message() but not yet sent.
+*/
+size_t client_pending( transport_client* client ) {
+	if( client == NULL || client->session == NULL || client->session->sock_mgr == NULL )
+		return 0;
+	return socket_pending( client->session->sock_mgr, client->session->sock_id );
+}
+
+/**
+	@brief Report whether a nonblocking transport_client is backed up.
+	@param client Pointer to a transport_client.
+	@return 1 if its queued output exceeds the high-water mark, or 0 if not.
+
+	While this returns 1, the caller should avoid generating more traffic for the client --
+	for example by not reading requests that would produce more output for it.
+*/
+int client_backpressure( transport_client* client ) {
+	if( client == NULL )
+		return 0;
+	return session_backpressure( client->session );
+}
+
 /**
 	@brief Fetch an input message, if one is available.
 	@param client Pointer to a transport_client.
 	@param timeout How long to wait for a message to arrive, in seconds (see remarks).
 	@return A pointer to a transport_message if successful, or NULL if not.
 
-	If there is a message already in the queue, return it immediately.  Otherwise read any
-	available messages from the transport_session (subject to a timeout), and return the
-	first one.
-
 	If the value of @a timeout is -1, then there is no time limit -- wait indefinitely until a
 	message arrives (or we error out for other reasons).  If the value of @a timeout is zero,
 	don't wait at all.
 
+	The same as client_recv_ms(), but with the timeout in seconds.
+
 	The calling code is responsible for freeing the transport_message by calling message_free().
 */
 transport_message* client_recv( transport_client* client, int timeout ) {
+	return client_recv_ms( client, timeout_to_millis( timeout ) );
+}
+
+/**
+	@brief Fetch an input message, if one is available.
+	@param client Pointer to a transport_client.
+	@param timeout_ms How long to wait for a message to arrive, in milliseconds (see
+		remarks).
+	@return A pointer to a transport_message if successful, or NULL if not.
+
+	If there is a message already in the queue, return it immediately.  Otherwise read any
+	available messages from the transport_session (subject to a timeout), and return the
+	first one.
+
+	If the value of @a timeout_ms is negative, then there is no time limit -- wait
+	indefinitely until a message arrives (or we error out for other reasons).  If the value
+	of @a timeout_ms is zero, don't wait at all.
+
+	The calling code is responsible for freeing the transport_message by calling message_free().
+*/
+transport_message* client_recv_ms( transport_client* client, int timeout_ms ) {
 	if( client == NULL ) { return NULL; }
 
 	int error = 0;  /* boolean */
@@ -198,14 +344,14 @@ transport_message* client_recv( transport_client* client, int timeout ) {
 
 		// No message available on the queue?  Try to get a fresh one.
 
-		// When we call session_wait(), it reads a socket for new messages.  When it finds
+		// When we call client_wait_ms(), it reads a socket for new messages.  When it finds
 		// one, it enqueues it by calling the callback function client_message_handler(),
 		// which we installed in the transport_session when we created the transport_client.
 
-		// Since a single call to session_wait() may not result in the receipt of a complete
-		// message. we call it repeatedly until we get either a message or an error.
+		// Since a single call to client_wait_ms() may not result in the receipt of a
+		// complete message. we call it repeatedly until we get either a message or an error.
 
-		// Alternatively, a single call to session_wait() may result in the receipt of
+		// Alternatively, a single call to client_wait_ms() may result in the receipt of
 		// multiple messages.  That's why we have to enqueue them.
 
 		// The timeout applies to the receipt of a complete message.  For a sufficiently
@@ -215,35 +361,34 @@ transport_message* client_recv( transport_client* client, int timeout ) {
 		// Likewise we could time out while still receiving the second or subsequent message,
 		// return the first message, and resume receiving messages later.
 
-		if( timeout == -1 ) {  /* wait potentially forever for data to arrive */
+		if( timeout_ms < 0 ) {  /* wait potentially forever for data to arrive */
 
 			int x;
 			do {
-				if( (x = session_wait( client->session, -1 )) ) {
+				if( (x = client_wait_ms( client, -1 )) ) {
 					osrfLogDebug(OSRF_LOG_MARK, "session_wait returned failure code %d\n", x);
 					error = 1;
 					break;
 				}
 			} while( client->msg_q_head == NULL );
 
-		} else {    /* loop up to 'timeout' seconds waiting for data to arrive  */
-
-			/* This loop assumes that a time_t is denominated in seconds -- not */
-			/* guaranteed by Standard C, but a fair bet for Linux or UNIX       */
+		} else {    /* loop until the deadline, waiting for data to arrive  */
 
-			time_t start = time(NULL);
-			time_t remaining = (time_t) timeout;
+			// Measure against a monotonic clock, so that setting the system clock
+			// can't stretch or shrink the wait.
+			long long deadline = get_monotonic_millis() + timeout_ms;
+			long long remaining = timeout_ms;
 
 			int wait_ret;
 			do {
-				if( (wait_ret = session_wait( client->session, (int) remaining)) ) {
+				if( (wait_ret = client_wait_ms( client, (int) remaining )) ) {
 					error = 1;
 					osrfLogDebug(OSRF_LOG_MARK,
 						"session_wait returned failure code %d: setting error=1\n", wait_ret);
 					break;
 				}
 
-				remaining -= time(NULL) - start;
+				remaining = deadline - get_monotonic_millis();
 			} while( NULL == client->msg_q_head && remaining > 0 );
 		}
 	}
@@ -262,6 +407,24 @@ transport_message* client_recv( transport_client* client, int timeout ) {
 	return msg;
 }
 
+/**
+	@brief Wait for input, and process whatever arrives.
+	@param client Pointer to the transport_client.
+	@param timeout_ms How many milliseconds to wait; -1 to wait indefinitely.
+	@return 0 if successful, or -1 upon timeout or error.
+
+	Ordinarily we wait on the Jabber socket alone.  With local peers we wait on all of our
+	sockets, including any new connections from local peers.
+*/
+static int client_wait_ms( transport_client* client, int timeout_ms ) {
+	if( NULL == client->local )
+		return session_wait_ms( client->session, timeout_ms );
+
+	if( socket_wait_all_ms( client->session->sock_mgr, timeout_ms ) )
+		return -1;
+	return client->session->sock_id ? 0 : -1;   // Jabber may have hung up
+}
+
 /**
 	@brief Enqueue a newly received transport_message.
 	@param client A pointer to a transport_client, cast to a void pointer.
@@ -300,6 +463,8 @@ static void client_message_handler( void* client, transport_message* msg ){
 int client_free( transport_client* client ) {
 	if(client == NULL)
 		return 0;
+	local_free( client->local );
+	client->local = NULL;
 	session_free( client->session );
 	client->session = NULL;
 	return client_discard( client );
@@ -328,6 +493,7 @@ int client_discard( transport_client* client ) {
 		current = next;
 	}
 
+	local_discard( client->local );
 	free(client->host);
 	free(client->xmpp_id);
 	free( client );
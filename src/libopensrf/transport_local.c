@@ -0,0 +1,416 @@
+// For struct ucred, which glibc declares only on request
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <opensrf/transport_local.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/**
+	@file transport_local.c
+	@brief Brokerless transport between processes on the same host.
+
+	When several OpenSRF processes run on one host, a message from one to another
+	ordinarily makes two trips through the Jabber server.  If they share a directory of
+	sockets, they can skip it.  Each process listens on a UNIX domain socket in the
+	directory, named for an MD5 hash of its Jabber ID (Jabber IDs can be longer than a
+	socket's pathname may be).  To send a message, we look for the recipient's socket in
+	the directory; if it's there, we connect to it -- once, keeping the connection for
+	later messages -- and send the message as a frame: a four-byte length, in network
+	byte order, followed by the XML of the message stanza.  If it isn't, the calling code
+	sends the message through Jabber as usual.
+
+	A message that arrives by either route looks the same to the calling code.  The sender
+	receives replies to it on its own socket, by the same logic.
+
+	Only processes running as the same user talk to each other this way; anybody else, like
+	anybody on another host, goes through Jabber.  We insist on a directory that belongs to
+	our effective user and that nobody else can write to, so that nobody else can plant or
+	replace a socket there.  We create our socket under a umask of 077, so that it is never
+	open to anybody else, even briefly.  Before sending to a socket we check that it belongs
+	to our effective user, and on each connection, in both directions, we check the
+	credentials of the process at the other end with SO_PEERCRED.
+
+	A receiver believes the sender named in each stanza, just as it believes the Jabber
+	server.  That is safe because every peer runs as our own user, and could as well log in
+	to Jabber with the same credentials as we do.
+*/
+
+/**
+	@brief A connection to or from a local peer.
+*/
+typedef struct {
+	int sock_fd;            /**< File descriptor of the socket. */
+	char* peer;             /**< Jabber ID, for a connection that we opened; else NULL. */
+	growing_buffer* inbuf;  /**< Start of a frame that hasn't all arrived yet. */
+} local_conn;
+
+static void local_data_received( void* blob, socket_manager* mgr, int sock_fd,
+		char* data, size_t len, int parent_id );
+static void local_socket_closed( void* blob, int sock_fd );
+
+/**
+	@brief Build the pathname of the socket for a given Jabber ID.
+	@param dir The directory of sockets.
+	@param jid The Jabber ID.
+	@return A pathname, which the caller is responsible for freeing.
+*/
+static char* local_path( const char* dir, const char* jid ) {
+	char* hash = md5sum( jid );
+	char* path = va_list_to_string( "%s/%s.sock", dir, hash );
+	free( hash );
+	return path;
+}
+
+/**
+	@brief Determine whether the process at the other end of a socket runs as our user.
+	@param sock_fd File descriptor of a connected UNIX domain socket.
+	@return 1 if the peer's effective user ID is the same as ours; otherwise 0.
+*/
+static int local_peer_is_us( int sock_fd ) {
+	uid_t uid;
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof( cred );
+	if( getsockopt( sock_fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) < 0
+			|| len != sizeof( cred ) )
+		return 0;
+	uid = cred.uid;
+#else
+	gid_t gid;
+	if( getpeereid( sock_fd, &uid, &gid ) < 0 )
+		return 0;
+#endif
+	return uid == geteuid();
+}
+
+/**
+	@brief Determine whether a directory is fit to hold our sockets.
+	@param dir The directory.
+	@return 1 if it's a directory belonging to our effective user, and nobody else may
+		write to it; otherwise 0.
+*/
+static int local_dir_is_private( const char* dir ) {
+	struct stat st;
+	if( lstat( dir, &st ) < 0 ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Unable to use local socket directory %s: %s",
+			dir, strerror( errno ) );
+		return 0;
+	}
+	if( !S_ISDIR( st.st_mode ) || st.st_uid != geteuid()
+			|| ( st.st_mode & ( S_IWGRP | S_IWOTH ) ) ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Local socket directory %s must be a directory "
+			"owned by uid %ld and writable by nobody else", dir, (long) geteuid() );
+		return 0;
+	}
+	return 1;
+}
+
+/**
+	@brief Free a local_conn; installed as the freeing function of a transport_local's list.
+*/
+static void local_conn_free( void* item ) {
+	local_conn* conn = item;
+	if( conn ) {
+		free( conn->peer );
+		buffer_free( conn->inbuf );
+		free( conn );
+	}
+}
+
+static local_conn* local_conn_add( transport_local* local, int sock_fd, const char* peer ) {
+	local_conn* conn = safe_malloc( sizeof( local_conn ) );
+	conn->sock_fd = sock_fd;
+	conn->peer = peer ? strdup( peer ) : NULL;
+	conn->inbuf = buffer_init( 256 );
+	osrfListSet( local->conns, conn, sock_fd );
+	if( peer )
+		osrfHashSet( local->peers, conn, peer );
+	return conn;
+}
+
+/**
+	@brief Forget a connection, and close it if it's still open.
+	@param local Pointer to the transport_local.
+	@param conn Pointer to the local_conn, which will be freed.
+	@param close_it Boolean; true if the socket is to be closed, or false if the
+		socket_manager has closed it already.
+*/
+static void local_conn_remove( transport_local* local, local_conn* conn, int close_it ) {
+	int sock_fd = conn->sock_fd;
+	if( conn->peer )
+		osrfHashRemove( local->peers, conn->peer );
+	osrfListRemove( local->conns, sock_fd );
+	if( close_it )
+		socket_disconnect( local->sock_mgr, sock_fd );
+}
+
+/**
+	@brief Open a socket for local peers, sharing a socket_manager with other traffic.
+	@param mgr Pointer to the socket_manager, usually that of a transport_session.
+	@param dir The directory of sockets, which must exist, belong to our effective user,
+		and be writable by nobody else.
+	@param jid Our Jabber ID.
+	@param user_data An opaque pointer to pass to @a message_callback.
+	@param message_callback A function to call with each message received.
+	@return A pointer to a newly allocated transport_local, or NULL upon error.
+
+	If we leave a socket behind -- for example by crashing -- a process with the same Jabber
+	ID removes it.  Meanwhile peers fail to connect to it and fall back to Jabber.
+
+	The calling code is responsible for freeing the transport_local by calling local_free()
+	or local_discard().
+*/
+transport_local* local_init( socket_manager* mgr, const char* dir, const char* jid,
+		void* user_data, void (*message_callback) ( void* user_data, transport_message* msg ) ) {
+
+	if( !( mgr && dir && jid ) )
+		return NULL;
+	if( !local_dir_is_private( dir ) )
+		return NULL;
+
+	char* path = local_path( dir, jid );
+	unlink( path );
+	// The socket is born private, rather than made private after it's bound
+	mode_t old_mask = umask( 077 );
+	int listener = socket_open_unix_server( mgr, path );
+	umask( old_mask );
+	if( listener < 0 ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Unable to open local socket %s for %s", path, jid );
+		free( path );
+		return NULL;
+	}
+
+	transport_local* local = safe_malloc( sizeof( transport_local ) );
+	local->sock_mgr = mgr;
+	local->dir = strdup( dir );
+	local->path = path;
+	local->listener = listener;
+	local->peers = osrfNewHash();
+	local->conns = osrfNewList();
+	local->conns->freeItem = local_conn_free;
+	local->user_data = user_data;
+	local->message_callback = message_callback;
+
+	local->next_blob = mgr->blob;
+	local->next_data_received = mgr->data_received;
+	local->next_socket_closed = mgr->on_socket_closed;
+	mgr->blob = local;
+	mgr->data_received = local_data_received;
+	mgr->on_socket_closed = local_socket_closed;
+
+	osrfLogInfo( OSRF_LOG_MARK, "Listening for local peers of %s at %s", jid, path );
+	return local;
+}
+
+/**
+	@brief Send a message straight to a local peer, if the recipient is one.
+	@param local Pointer to the transport_local.
+	@param msg Pointer to the message, with its recipient filled in.
+	@return 0 if successful; or 1 if the recipient isn't a local peer, or we lost our
+		connection to it, so that the message should go through Jabber instead.
+
+	We wait until the socket has taken the whole message, but no longer than
+	LOCAL_SEND_TIMEOUT.  We don't read while we wait, so two peers sending big messages
+	to each other at once could otherwise wait on each other forever.  A peer that
+	isn't keeping up loses its connection, and the message goes through Jabber.
+*/
+int local_send_msg( transport_local* local, transport_message* msg ) {
+	if( !( local && msg && msg->recipient ) )
+		return 1;
+
+	local_conn* conn = osrfHashGet( local->peers, msg->recipient );
+	if( !conn ) {
+		// A failed stat() is much cheaper than a failed connect(), and it's the usual case
+		char* path = local_path( local->dir, msg->recipient );
+		struct stat st;
+		int sock_fd = -1;
+		if( lstat( path, &st ) == 0 && S_ISSOCK( st.st_mode ) && st.st_uid == geteuid() )
+			sock_fd = socket_open_unix_client( local->sock_mgr, path );
+		free( path );
+		if( sock_fd < 0 )
+			return 1;
+		if( !local_peer_is_us( sock_fd ) ) {
+			osrfLogWarning( OSRF_LOG_MARK,
+				"Local socket for %s belongs to another user; using Jabber", msg->recipient );
+			socket_disconnect( local->sock_mgr, sock_fd );
+			return 1;
+		}
+		conn = local_conn_add( local, sock_fd, msg->recipient );
+	}
+
+	message_prepare_xml( msg );
+	size_t len = strlen( msg->msg_xml );
+	uint32_t header = htonl( (uint32_t) len );
+
+	// Corked, the header and the stanza go out in one send()
+	if( socket_send_corked( local->sock_mgr, conn->sock_fd, (const char*) &header, 4 ) < 0
+			|| socket_send_corked( local->sock_mgr, conn->sock_fd, msg->msg_xml, len ) < 0 ) {
+		osrfLogInfo( OSRF_LOG_MARK, "Lost local connection to %s", msg->recipient );
+		local_conn_remove( local, conn, 1 );
+		return 1;
+	}
+
+	// Earlier messages were flushed whole, so only this one can be cut short.  The peer
+	// never sees a partial frame, since we close the connection.
+	int rc = socket_flush( local->sock_mgr, conn->sock_fd, LOCAL_SEND_TIMEOUT );
+	if( rc ) {
+		if( rc > 0 )
+			osrfLogWarning( OSRF_LOG_MARK,
+				"Local peer %s isn't taking messages; using Jabber", msg->recipient );
+		else
+			osrfLogInfo( OSRF_LOG_MARK, "Lost local connection to %s", msg->recipient );
+		local_conn_remove( local, conn, 1 );
+		return 1;
+	}
+	return 0;
+}
+
+/**
+	@brief Extract complete frames from received data, and pass their messages along.
+	@param local Pointer to the transport_local.
+	@param data Pointer to the data.  We may change it, but we restore it.
+	@param len Length of the data.
+	@return How many bytes we used, or -1 if a frame is impossibly large.
+*/
+static long local_parse_frames( transport_local* local, char* data, size_t len ) {
+	size_t used = 0;
+	while( len - used >= 4 ) {
+		uint32_t header;
+		memcpy( &header, data + used, 4 );
+		size_t frame_len = ntohl( header );
+		if( frame_len > LOCAL_MAX_FRAME )
+			return -1;
+		if( len - used - 4 < frame_len )
+			break;
+
+		// Terminate the stanza in place, rather than copy it
+		char* xml = data + used + 4;
+		char save = xml[ frame_len ];
+		xml[ frame_len ] = '\0';
+		transport_message* msg = new_message_from_xml( xml );
+		xml[ frame_len ] = save;
+		used += 4 + frame_len;
+
+		if( msg && local->message_callback )
+			local->message_callback( local->user_data, msg );
+		else
+			message_free( msg );
+	}
+	return used;
+}
+
+/**
+	@brief Callback function: handle data received by the socket_manager.
+	@param blob Pointer to the transport_local, cast to a void pointer.
+	@param mgr Pointer to the socket_manager.
+	@param sock_fd Socket file descriptor.
+	@param data Pointer to the data, which the socket_manager has nul-terminated.
+	@param len Length of the data.
+	@param parent_id File descriptor of the listener that accepted the socket, if any.
+
+	Data from a local peer is parsed into frames; anything else goes to the callback that
+	the socket_manager had before us.  Whole frames are parsed where they lie, and only a
+	partial frame at the end is copied, to be completed by later data.
+*/
+static void local_data_received( void* blob, socket_manager* mgr, int sock_fd,
+		char* data, size_t len, int parent_id ) {
+	transport_local* local = blob;
+
+	local_conn* conn = osrfListGetIndex( local->conns, sock_fd );
+	if( !conn ) {
+		if( parent_id != local->listener ) {
+			if( local->next_data_received )
+				local->next_data_received( local->next_blob, mgr, sock_fd, data, len,
+					parent_id );
+			return;
+		}
+		if( !local_peer_is_us( sock_fd ) ) {
+			osrfLogWarning( OSRF_LOG_MARK, "Refusing a local peer that runs as another user" );
+			socket_disconnect( mgr, sock_fd );
+			return;
+		}
+		conn = local_conn_add( local, sock_fd, NULL );
+	}
+
+	long used;
+	growing_buffer* inbuf = conn->inbuf;
+	if( 0 == inbuf->n_used ) {
+		used = local_parse_frames( local, data, len );
+		if( used >= 0 )
+			buffer_add_n( inbuf, data + used, len - used );
+	} else {
+		buffer_add_n( inbuf, data, len );
+		used = local_parse_frames( local, inbuf->buf, inbuf->n_used );
+		if( used > 0 ) {
+			inbuf->n_used -= used;
+			memmove( inbuf->buf, inbuf->buf + used, inbuf->n_used + 1 );
+		}
+	}
+
+	if( used < 0 ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Oversized frame from local peer; disconnecting" );
+		local_conn_remove( local, conn, 1 );
+	}
+}
+
+/**
+	@brief Callback function: forget a connection that a peer has closed.
+	@param blob Pointer to the transport_local, cast to a void pointer.
+	@param sock_fd File descriptor of the socket, which the socket_manager has closed.
+*/
+static void local_socket_closed( void* blob, int sock_fd ) {
+	transport_local* local = blob;
+	local_conn* conn = osrfListGetIndex( local->conns, sock_fd );
+	if( conn )
+		local_conn_remove( local, conn, 0 );
+	else if( local->next_socket_closed )
+		local->next_socket_closed( local->next_blob, sock_fd );
+}
+
+/**
+	@brief Close our socket and all connections to local peers, and free the transport_local.
+	@param local Pointer to the transport_local.
+
+	The socket_manager gets its old callbacks back.  Our socket disappears from the
+	directory, so peers send to us through Jabber again.
+*/
+void local_free( transport_local* local ) {
+	if( !local )
+		return;
+
+	unlink( local->path );
+	socket_disconnect( local->sock_mgr, local->listener );
+
+	unsigned int i;
+	for( i = 0; i < local->conns->size; ++i ) {
+		local_conn* conn = osrfListGetIndex( local->conns, i );
+		if( conn )
+			socket_disconnect( local->sock_mgr, conn->sock_fd );
+	}
+
+	local->sock_mgr->blob = local->next_blob;
+	local->sock_mgr->data_received = local->next_data_received;
+	local->sock_mgr->on_socket_closed = local->next_socket_closed;
+	local_discard( local );
+}
+
+/**
+	@brief Free a transport_local without touching its sockets.
+	@param local Pointer to the transport_local.
+
+	This is for a child process, which closes its parent's sockets by freeing the
+	socket_manager, and mustn't remove the parent's socket from the directory.
+*/
+void local_discard( transport_local* local ) {
+	if( !local )
+		return;
+	osrfHashFree( local->peers );
+	osrfListFree( local->conns );
+	free( local->dir );
+	free( local->path );
+	free( local );
+}
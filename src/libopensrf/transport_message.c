@@ -65,6 +65,7 @@ transport_message* message_init( const char* body, const char* subject,
 	msg->error_type     = NULL;
 	msg->error_code     = 0;
 	msg->broadcast      = 0;
+	msg->router_hops    = 0;
 	msg->msg_xml        = NULL;
 	msg->next           = NULL;
 
@@ -72,10 +73,414 @@ transport_message* message_init( const char* body, const char* subject,
 }
 
 
+/** @brief Most attributes we look at on any one element; any others are ignored. */
+#define XML_MAX_ATTRS 16
+/** @brief How deeply we'll follow elements nested in the stanza, for skipping them. */
+#define XML_MAX_DEPTH 32
+
+/**
+	@brief An attribute of an element in a stanza, pointing into the raw XML.
+*/
+typedef struct {
+	const char* name;      /**< Name of the attribute. */
+	size_t name_len;       /**< Length of the name. */
+	const char* value;     /**< Value of the attribute, still escaped. */
+	size_t value_len;      /**< Length of the value. */
+} xml_attr;
+
+/**
+	@brief A start tag in a stanza, pointing into the raw XML.
+*/
+typedef struct {
+	const char* name;               /**< Name of the element. */
+	size_t name_len;                /**< Length of the name. */
+	int empty;                      /**< Boolean: true if the tag closes itself. */
+	int attr_count;                 /**< Number of attributes recorded. */
+	xml_attr attrs[ XML_MAX_ATTRS ];
+} xml_tag;
+
+static int xml_is_space( char c ) {
+	return ' ' == c || '\t' == c || '\n' == c || '\r' == c;
+}
+
+static const char* xml_skip_space( const char* p ) {
+	while( xml_is_space( *p ) )
+		++p;
+	return p;
+}
+
+/**
+	@brief Return a pointer just past the next occurrence of a string, or NULL if none.
+*/
+static const char* xml_skip_past( const char* p, const char* terminator ) {
+	const char* end = strstr( p, terminator );
+	return end ? end + strlen( terminator ) : NULL;
+}
+
+static int xml_name_is( const char* name, size_t len, const char* literal ) {
+	return len == strlen( literal ) && ! memcmp( name, literal, len );
+}
+
+/**
+	@brief Encode a code point as UTF-8.
+	@param out Where to write the encoded bytes; there must be room for four.
+	@param cp The code point.
+	@return The number of bytes written.
+*/
+static size_t xml_put_utf8( char* out, unsigned long cp ) {
+	if( cp < 0x80 ) {
+		out[0] = (char) cp;
+		return 1;
+	} else if( cp < 0x800 ) {
+		out[0] = (char) ( 0xC0 | ( cp >> 6 ) );
+		out[1] = (char) ( 0x80 | ( cp & 0x3F ) );
+		return 2;
+	} else if( cp < 0x10000 ) {
+		out[0] = (char) ( 0xE0 | ( cp >> 12 ) );
+		out[1] = (char) ( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+		out[2] = (char) ( 0x80 | ( cp & 0x3F ) );
+		return 3;
+	} else {
+		out[0] = (char) ( 0xF0 | ( cp >> 18 ) );
+		out[1] = (char) ( 0x80 | ( ( cp >> 12 ) & 0x3F ) );
+		out[2] = (char) ( 0x80 | ( ( cp >> 6 ) & 0x3F ) );
+		out[3] = (char) ( 0x80 | ( cp & 0x3F ) );
+		return 4;
+	}
+}
+
+/**
+	@brief Decode an entity or character reference.
+	@param s Pointer to the ampersand.
+	@param end Pointer to the end of the text containing the reference.
+	@param out Where to write the UTF-8 for the character; there must be room for four bytes.
+	@param out_len Pointer through which to return the number of bytes written.
+	@return The length of the reference, including the ampersand and semicolon; or 0 if
+		it isn't one we recognize.
+*/
+static size_t xml_decode_ref( const char* s, const char* end, char* out, size_t* out_len ) {
+	const char* semi = memchr( s, ';', end - s < 12 ? end - s : 12 );
+	if( ! semi )
+		return 0;
+
+	const char* name = s + 1;
+	size_t len = semi - name;
+	unsigned long cp = 0;
+
+	if( xml_name_is( name, len, "lt" ) )
+		cp = '<';
+	else if( xml_name_is( name, len, "gt" ) )
+		cp = '>';
+	else if( xml_name_is( name, len, "amp" ) )
+		cp = '&';
+	else if( xml_name_is( name, len, "quot" ) )
+		cp = '"';
+	else if( xml_name_is( name, len, "apos" ) )
+		cp = '\'';
+	else if( len > 1 && '#' == name[0] ) {
+		const char* digits = name + 1;
+		int base = 10;
+		if( 'x' == *digits ) {
+			base = 16;
+			++digits;
+		}
+		if( digits == semi )
+			return 0;
+		for( ; digits < semi; ++digits ) {
+			int d;
+			if( *digits >= '0' && *digits <= '9' )
+				d = *digits - '0';
+			else if( 16 == base && *digits >= 'a' && *digits <= 'f' )
+				d = *digits - 'a' + 10;
+			else if( 16 == base && *digits >= 'A' && *digits <= 'F' )
+				d = *digits - 'A' + 10;
+			else
+				return 0;
+			cp = cp * base + d;
+			if( cp > 0x10FFFF )
+				return 0;
+		}
+		if( 0 == cp )
+			return 0;
+	} else
+		return 0;
+
+	*out_len = xml_put_utf8( out, cp );
+	return semi + 1 - s;
+}
+
+/**
+	@brief Unescape text or an attribute value from a stanza.
+	@param out Where to write the result.  There must be room for @a n bytes, since
+		unescaping never makes anything longer.
+	@param s Pointer to the raw text.
+	@param n Length of the raw text.
+	@param attr Boolean: true for an attribute value, false for text.
+	@return The length of the result.
+
+	Replace entity and character references with the characters they stand for, and
+	normalize line ends as an XML parser does.  In an attribute value, whitespace characters
+	also become spaces.  An unrecognized reference is kept as is.
+*/
+static size_t xml_unescape( char* out, const char* s, size_t n, int attr ) {
+	const char* end = s + n;
+	char* o = out;
+
+	if( ! attr && ! memchr( s, '\r', n ) ) {
+		// The usual case: only references need attention, so copy the runs between them
+		const char* amp;
+		while( ( amp = memchr( s, '&', end - s ) ) ) {
+			memcpy( o, s, amp - s );
+			o += amp - s;
+			size_t out_len;
+			size_t ref_len = xml_decode_ref( amp, end, o, &out_len );
+			if( ref_len ) {
+				s = amp + ref_len;
+				o += out_len;
+			} else {
+				*o++ = '&';
+				s = amp + 1;
+			}
+		}
+		memcpy( o, s, end - s );
+		return o + ( end - s ) - out;
+	}
+
+	while( s < end ) {
+		char c = *s;
+		if( '&' == c ) {
+			size_t out_len;
+			size_t ref_len = xml_decode_ref( s, end, o, &out_len );
+			if( ref_len ) {
+				s += ref_len;
+				o += out_len;
+				continue;
+			}
+		} else if( '\r' == c ) {
+			if( s + 1 < end && '\n' == s[1] )
+				++s;
+			c = attr ? ' ' : '\n';
+		} else if( attr && ( '\n' == c || '\t' == c ) )
+			c = ' ';
+		*o++ = c;
+		++s;
+	}
+
+	return o - out;
+}
+
+/**
+	@brief Make an unescaped, nul-terminated copy of an attribute value.
+	@param attr Pointer to the attribute.
+	@return A newly allocated string, which the caller is responsible for freeing.
+
+	Every attribute value is copied, whether or not it needs unescaping; none is interned,
+	since callers may free() or replace the string members of a transport_message.
+*/
+static char* xml_attr_dup( const xml_attr* attr ) {
+	char* value = safe_malloc( attr->value_len + 1 );
+	value[ xml_unescape( value, attr->value, attr->value_len, 1 ) ] = '\0';
+	return value;
+}
+
+/**
+	@brief Look up an attribute by name.
+	@return A pointer to the attribute, or NULL if the tag doesn't have it.
+*/
+static const xml_attr* xml_tag_attr( const xml_tag* tag, const char* name ) {
+	int i;
+	for( i = 0; i < tag->attr_count; ++i ) {
+		if( xml_name_is( tag->attrs[ i ].name, tag->attrs[ i ].name_len, name ) )
+			return tag->attrs + i;
+	}
+	return NULL;
+}
+
+/**
+	@brief Parse a start tag.
+	@param p Pointer to the opening angle bracket.
+	@param tag Pointer to an xml_tag to be filled in.
+	@return A pointer just past the closing angle bracket, or NULL if the tag is malformed.
+*/
+static const char* xml_parse_tag( const char* p, xml_tag* tag ) {
+	tag->name = ++p;
+	while( *p && ! xml_is_space( *p ) && '/' != *p && '>' != *p )
+		++p;
+	tag->name_len = p - tag->name;
+	tag->attr_count = 0;
+	if( 0 == tag->name_len )
+		return NULL;
+
+	for( ;; ) {
+		p = xml_skip_space( p );
+		if( '>' == *p ) {
+			tag->empty = 0;
+			return p + 1;
+		} else if( '/' == *p && '>' == p[1] ) {
+			tag->empty = 1;
+			return p + 2;
+		}
+
+		const char* name = p;
+		while( *p && ! xml_is_space( *p ) && '=' != *p && '/' != *p && '>' != *p )
+			++p;
+		size_t name_len = p - name;
+		p = xml_skip_space( p );
+		if( 0 == name_len || '=' != *p )
+			return NULL;
+		p = xml_skip_space( p + 1 );
+
+		char quote = *p;
+		if( '"' != quote && '\'' != quote )
+			return NULL;
+		const char* value = p + 1;
+		p = strchr( value, quote );
+		if( ! p )
+			return NULL;
+
+		if( tag->attr_count < XML_MAX_ATTRS ) {
+			xml_attr* attr = tag->attrs + tag->attr_count++;
+			attr->name = name;
+			attr->name_len = name_len;
+			attr->value = value;
+			attr->value_len = p - value;
+		}
+		++p;
+	}
+}
+
+/**
+	@brief Append a span of text to a string being accumulated.
+	@param text Pointer to the string, which may be NULL; it is replaced by a longer one.
+	@param len Pointer to the length of the string.
+	@param s Pointer to the text to be appended.
+	@param n Length of the text to be appended.
+	@param unescape Boolean: true for character data, false for a CDATA section.
+*/
+static void xml_append_text( char** text, size_t* len, const char* s, size_t n, int unescape ) {
+	char* new_text = safe_malloc( *len + n + 1 );
+	if( *text ) {
+		memcpy( new_text, *text, *len );
+		free( *text );
+	}
+	if( unescape )
+		*len += xml_unescape( new_text + *len, s, n, 0 );
+	else {
+		memcpy( new_text + *len, s, n );
+		*len += n;
+	}
+	new_text[ *len ] = '\0';
+	*text = new_text;
+}
+
+/**
+	@brief Parse the content of an element, optionally collecting its text.
+	@param p Pointer to the first character after the start tag.
+	@param text Pointer through which to return the text, or NULL if we don't want it.  The
+		text includes character data and CDATA sections directly within the element, but
+		not within elements nested inside it.  If there isn't any, *text is left alone.
+	@param depth How deeply the element is nested, to guard against runaway recursion.
+	@return A pointer just past the end tag, or NULL if the content is malformed.
+*/
+static const char* xml_parse_content( const char* p, char** text, int depth ) {
+	char* acc = NULL;
+	size_t acc_len = 0;
+
+	for( ;; ) {
+		const char* lt = strchr( p, '<' );
+		if( ! lt )
+			break;
+		if( text && lt > p )
+			xml_append_text( &acc, &acc_len, p, lt - p, 1 );
+		p = lt;
+
+		if( '/' == p[1] ) {                             // end tag
+			p = strchr( p, '>' );
+			if( ! p )
+				break;
+			if( text && acc ) {
+				free( *text );
+				*text = acc;
+			} else
+				free( acc );
+			return p + 1;
+		} else if( ! strncmp( p, "<!--", 4 ) ) {
+			p = xml_skip_past( p + 4, "-->" );
+		} else if( ! strncmp( p, "<![CDATA[", 9 ) ) {
+			const char* end = strstr( p + 9, "]]>" );
+			if( end && text )
+				xml_append_text( &acc, &acc_len, p + 9, end - p - 9, 0 );
+			p = end ? end + 3 : NULL;
+		} else if( '?' == p[1] ) {
+			p = xml_skip_past( p + 2, "?>" );
+		} else {                                        // a nested element: skip it
+			xml_tag tag;
+			p = xml_parse_tag( p, &tag );
+			if( p && ! tag.empty )
+				p = depth < XML_MAX_DEPTH ? xml_parse_content( p, NULL, depth + 1 ) : NULL;
+		}
+
+		if( ! p )
+			break;
+	}
+
+	free( acc );
+	return NULL;
+}
+
+/**
+	@brief Populate a transport_message from the attributes of an &lt;opensrf&gt; element.
+	@param msg Pointer to the transport_message.
+	@param tag Pointer to the parsed start tag.
+*/
+static void message_set_opensrf_attrs( transport_message* msg, const xml_tag* tag ) {
+	const xml_attr* attr;
+
+	if( ( attr = xml_tag_attr( tag, "osrf_xid" ) ) ) {
+		free( msg->osrf_xid );
+		msg->osrf_xid = xml_attr_dup( attr );
+	}
+
+	if( ( attr = xml_tag_attr( tag, "router_from" ) ) ) {
+		free( msg->router_from );
+		msg->router_from = xml_attr_dup( attr );
+
+		// Use the router value in place of any sender applied already -- unless it's
+		// empty, as it is in a message that didn't come through a router
+		if( attr->value_len ) {
+			free( msg->sender );
+			msg->sender = strdup( msg->router_from );
+		}
+	}
+
+	if( ( attr = xml_tag_attr( tag, "router_to" ) ) ) {
+		free( msg->router_to );
+		msg->router_to = xml_attr_dup( attr );
+	}
+
+	if( ( attr = xml_tag_attr( tag, "router_class" ) ) ) {
+		free( msg->router_class );
+		msg->router_class = xml_attr_dup( attr );
+	}
+
+	if( ( attr = xml_tag_attr( tag, "router_command" ) ) ) {
+		free( msg->router_command );
+		msg->router_command = xml_attr_dup( attr );
+	}
+
+	if( ( attr = xml_tag_attr( tag, "broadcast" ) ) ) {
+		if( ! xml_name_is( attr->value, attr->value_len, "0" ) )
+			msg->broadcast = 1;
+	}
+
+	if( ( attr = xml_tag_attr( tag, "router_hops" ) ) )
+		msg->router_hops = message_read_hops( attr->value, attr->value_len );
+}
+
 /**
 	@brief Translate an XML string into a transport_message.
 	@param msg_xml Pointer to a &lt;message&gt; element as passed by Jabber.
-	@return Pointer to a newly created transport_message.
+	@return Pointer to a newly created transport_message, or NULL if the XML is malformed.
 
 	Do @em not populate the following members:
 	- router_command
@@ -83,6 +488,12 @@ transport_message* message_init( const char* body, const char* subject,
 	- error_type
 	- error_code.
 
+	Rather than build a DOM, we scan the stanza directly, since its shape is fixed: a root
+	element whose "from", "to", "subject" and "thread" attributes we use, containing
+	&lt;thread&gt;, &lt;subject&gt;, &lt;body&gt; and &lt;opensrf&gt; elements.  Anything
+	else is skipped.  Each value is unescaped once, straight into the memory that the
+	transport_message keeps.
+
 	The calling code is responsible for freeing the transport_message by calling message_free().
 */
 transport_message* new_message_from_xml( const char* msg_xml ) {
@@ -106,115 +517,84 @@ transport_message* new_message_from_xml( const char* msg_xml ) {
 	new_msg->error_type     = NULL;
 	new_msg->error_code     = 0;
 	new_msg->broadcast      = 0;
+	new_msg->router_hops    = 0;
 	new_msg->msg_xml        = NULL;
 	new_msg->next           = NULL;
 
-	/* Parse the XML document and grab the root */
-	xmlKeepBlanksDefault(0);
-	xmlDocPtr msg_doc = xmlReadDoc( BAD_CAST msg_xml, NULL, NULL, 0 );
-	xmlNodePtr root = xmlDocGetRootElement(msg_doc);
-
-	/* Get various attributes of the root, */
-	/* and use them to populate the corresponding members */
-	xmlChar* sender         = xmlGetProp( root, BAD_CAST "from");
-	xmlChar* recipient      = xmlGetProp( root, BAD_CAST "to");
-	xmlChar* subject        = xmlGetProp( root, BAD_CAST "subject");
-	xmlChar* thread         = xmlGetProp( root, BAD_CAST "thread" );
-	xmlChar* router_from    = NULL;
-	xmlChar* router_to      = NULL;
-	xmlChar* router_class   = NULL;
-	xmlChar* router_command = NULL;
-	xmlChar* broadcast      = NULL;
-	xmlChar* osrf_xid       = NULL;
-
-	if( sender ) {
-		new_msg->sender = strdup((const char*)sender);
-		xmlFree(sender);
+	/* Skip over any XML declaration, comments, or whitespace ahead of the root */
+	const char* p = msg_xml;
+	for( ;; ) {
+		p = xml_skip_space( p );
+		if( ! strncmp( p, "<?", 2 ) )
+			p = xml_skip_past( p + 2, "?>" );
+		else if( ! strncmp( p, "<!--", 4 ) )
+			p = xml_skip_past( p + 4, "-->" );
+		else
+			break;
+		if( ! p ) break;
 	}
 
-	if( recipient ) {
-		new_msg->recipient  = strdup((const char*)recipient);
-		xmlFree(recipient);
-	}
-
-	if(subject){
-		new_msg->subject    = strdup((const char*)subject);
-		xmlFree(subject);
-	}
-
-	if(thread) {
-		new_msg->thread     = strdup((const char*)thread);
-		xmlFree(thread);
+	xml_tag tag;
+	if( p && '<' == *p )
+		p = xml_parse_tag( p, &tag );
+	else
+		p = NULL;
+
+	if( p ) {
+		/* Get various attributes of the root, */
+		/* and use them to populate the corresponding members */
+		const xml_attr* attr;
+		if( ( attr = xml_tag_attr( &tag, "from" ) ) )
+			new_msg->sender = xml_attr_dup( attr );
+		if( ( attr = xml_tag_attr( &tag, "to" ) ) )
+			new_msg->recipient = xml_attr_dup( attr );
+		if( ( attr = xml_tag_attr( &tag, "subject" ) ) )
+			new_msg->subject = xml_attr_dup( attr );
+		if( ( attr = xml_tag_attr( &tag, "thread" ) ) )
+			new_msg->thread = xml_attr_dup( attr );
 	}
 
-	/* Within the message element, find the child nodes for "thread", "subject" */
+	/* Within the message element, find the child elements for "thread", "subject" */
 	/* "body", and "opensrf".  Extract their textual content into the corresponding members. */
-	xmlNodePtr search_node = root->children;
-	while( search_node != NULL ) {
-
-		if( ! strcmp( (const char*) search_node->name, "thread" ) ) {
-			if( search_node->children && search_node->children->content )
-				new_msg->thread = strdup( (const char*) search_node->children->content );
-		}
-
-		if( ! strcmp( (const char*) search_node->name, "subject" ) ) {
-			if( search_node->children && search_node->children->content )
-				new_msg->subject = strdup( (const char*) search_node->children->content );
-		}
-
-		if( ! strcmp( (const char*) search_node->name, "opensrf" ) ) {
-			router_from    = xmlGetProp( search_node, BAD_CAST "router_from" );
-			router_to      = xmlGetProp( search_node, BAD_CAST "router_to" );
-			router_class   = xmlGetProp( search_node, BAD_CAST "router_class" );
-			router_command = xmlGetProp( search_node, BAD_CAST "router_command" );
-			broadcast      = xmlGetProp( search_node, BAD_CAST "broadcast" );
-			osrf_xid       = xmlGetProp( search_node, BAD_CAST "osrf_xid" );
-
-			if( osrf_xid ) {
-				message_set_osrf_xid( new_msg, (char*) osrf_xid);
-				xmlFree(osrf_xid);
-			}
-
-			if( router_from ) {
-				if (new_msg->sender) {
-					// Sender value applied above.  Clear it and
-					// use the router value instead.
-					free(new_msg->sender);
-				}
-
-				new_msg->sender = strdup((const char*)router_from);
-				new_msg->router_from = strdup((const char*)router_from);
-				xmlFree(router_from);
-			}
-
-			if(router_to) {
-				new_msg->router_to  = strdup((const char*)router_to);
-				xmlFree(router_to);
-			}
-
-			if(router_class) {
-				new_msg->router_class = strdup((const char*)router_class);
-				xmlFree(router_class);
-			}
-
-			if(router_command) {
-				new_msg->router_command = strdup((const char*)router_command);
-				xmlFree(router_command);
-			}
-
-			if(broadcast) {
-				if(strcmp((const char*) broadcast,"0") )
-					new_msg->broadcast = 1;
-				xmlFree(broadcast);
-			}
-		}
-
-		if( ! strcmp( (const char*) search_node->name, "body" ) ) {
-			if( search_node->children && search_node->children->content )
-				new_msg->body = strdup((const char*) search_node->children->content );
+	while( p && ! tag.empty ) {
+		p = strchr( p, '<' );
+		if( ! p )
+			break;
+
+		if( '/' == p[1] ) {                            // end of the stanza
+			break;
+		} else if( ! strncmp( p, "<!--", 4 ) ) {
+			p = xml_skip_past( p + 4, "-->" );
+		} else if( ! strncmp( p, "<![CDATA[", 9 ) ) {
+			p = xml_skip_past( p + 9, "]]>" );
+		} else if( '?' == p[1] ) {
+			p = xml_skip_past( p + 2, "?>" );
+		} else {
+			xml_tag child;
+			p = xml_parse_tag( p, &child );
+			if( ! p )
+				break;
+
+			char** text = NULL;
+			if( xml_name_is( child.name, child.name_len, "thread" ) )
+				text = &new_msg->thread;
+			else if( xml_name_is( child.name, child.name_len, "subject" ) )
+				text = &new_msg->subject;
+			else if( xml_name_is( child.name, child.name_len, "body" ) )
+				text = &new_msg->body;
+			else if( xml_name_is( child.name, child.name_len, "opensrf" ) )
+				message_set_opensrf_attrs( new_msg, &child );
+
+			if( ! child.empty )
+				p = xml_parse_content( p, text, 1 );
 		}
+	}
 
-		search_node = search_node->next;
+	if( ! p ) {
+		osrfLogWarning( OSRF_LOG_MARK, "new_message_from_xml(): malformed message: %s",
+			msg_xml );
+		message_free( new_msg );
+		return NULL;
 	}
 
 	if( new_msg->thread == NULL )
@@ -224,10 +604,8 @@ transport_message* new_message_from_xml( const char* msg_xml ) {
 	if( new_msg->body == NULL )
 		new_msg->body = strdup("");
 
-	/* Convert the XML document back into a string, and store it. */
-	new_msg->msg_xml = xmlDocToString(msg_doc, 0);
-	xmlFreeDoc(msg_doc);
-	xmlCleanupParser();
+	/* Keep the original XML, as if we had prepared it ourselves */
+	new_msg->msg_xml = strdup( msg_xml );
 
 	return new_msg;
 }
@@ -288,6 +666,75 @@ void message_set_router_info( transport_message* msg, const char* router_from,
 }
 
 
+/**
+	@brief Read the value of a "router_hops" attribute.
+	@param value The value, not necessarily nul-terminated.
+	@param len The length of the value.
+	@return The number of hops, from 0 to MESSAGE_MAX_HOPS.
+
+	Only digits count; anything else ends the number.  A number over MESSAGE_MAX_HOPS, or
+	a negative one, reads as MESSAGE_MAX_HOPS, so that no router passes the message on.
+	Whether a stanza is read by new_message_from_xml() or by a transport_session, its
+	hops read the same.
+*/
+int message_read_hops( const char* value, size_t len ) {
+	if( len && '-' == value[ 0 ] )
+		return MESSAGE_MAX_HOPS;
+
+	int hops = 0;
+	size_t i;
+	for( i = 0; i < len; ++i ) {
+		char c = value[ i ];
+		if( c < '0' || c > '9' )
+			break;
+		hops = hops * 10 + ( c - '0' );
+		if( hops >= MESSAGE_MAX_HOPS )
+			return MESSAGE_MAX_HOPS;
+	}
+	return hops;
+}
+
+/**
+	@brief Readdress a received message in place, to pass it along to somebody else.
+	@param msg Pointer to the transport_message.
+	@param recipient The new recipient.
+	@param router_from Value of "router_from" attribute, or NULL for an empty string.
+
+	The body, subject, thread, sender, transaction id and hop count stay as they are; the
+	other OSRF extensions are cleared, as is any error.  So a router can forward what it receives
+	without copying the body, which may be large, into a new message.
+*/
+void message_readdress( transport_message* msg, const char* recipient,
+		const char* router_from ) {
+	if( !msg )
+		return;
+
+	// Copy the new values before freeing the old ones, which may be the same strings
+	char* new_recipient = strdup( recipient ? recipient : "" );
+	char* new_router_from = strdup( router_from ? router_from : "" );
+	free( msg->recipient );
+	free( msg->router_from );
+	msg->recipient = new_recipient;
+	msg->router_from = new_router_from;
+
+	free( msg->router_to );
+	msg->router_to = NULL;
+	free( msg->router_class );
+	msg->router_class = NULL;
+	free( msg->router_command );
+	msg->router_command = NULL;
+	msg->broadcast = 0;
+
+	msg->is_error = 0;
+	free( msg->error_type );
+	msg->error_type = NULL;
+	msg->error_code = 0;
+
+	free( msg->msg_xml );
+	msg->msg_xml = NULL;
+}
+
+
 /**
 	@brief Free a transport_message and all the memory it owns.
 	@param msg Pointer to the transport_message to be destroyed.
@@ -313,6 +760,153 @@ int message_free( transport_message* msg ){
 }
 
 
+/** @brief Characters to be escaped in text.  */
+#define XML_TEXT_ESCAPES "<>&\r"
+
+/**
+	@brief ASCII characters to be escaped in attribute values.  We also escape every
+	non-ASCII character (see buffer_add_xml_escaped()).
+*/
+static const unsigned char xml_attr_escapes[ 128 ] = {
+	[ '<' ] = 1, [ '>' ] = 1, [ '&' ] = 1, [ '\r' ] = 1,
+	[ '"' ] = 1, [ '\n' ] = 1, [ '\t' ] = 1
+};
+
+/**
+	@brief Decode a UTF-8 sequence, for a character reference.
+	@param s Pointer to the first byte of the sequence, which is at least 0x80.
+	@param len Pointer to an int through which to return the length of the sequence.
+	@return The code point, or -1 if the sequence is malformed or doesn't encode an XML
+		character, in which case *len is 1.
+*/
+static long utf8_decode( const unsigned char* s, int* len ) {
+	long cp;
+	int n;
+	if( s[0] >= 0xF0 && s[0] < 0xF8 ) {
+		cp = s[0] & 0x07;
+		n = 4;
+	} else if( s[0] >= 0xE0 ) {
+		cp = s[0] & 0x0F;
+		n = 3;
+	} else if( s[0] >= 0xC0 ) {
+		cp = s[0] & 0x1F;
+		n = 2;
+	} else {
+		*len = 1;
+		return -1;
+	}
+
+	int i;
+	for( i = 1; i < n; ++i ) {
+		if( ( s[i] & 0xC0 ) != 0x80 ) {   // also catches the terminal nul
+			*len = 1;
+			return -1;
+		}
+		cp = ( cp << 6 ) | ( s[i] & 0x3F );
+	}
+
+	// Also reject anything that isn't an XML character
+	if( cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) || cp == 0xFFFE || cp == 0xFFFF ) {
+		*len = 1;
+		return -1;
+	}
+
+	*len = n;
+	return cp;
+}
+
+/**
+	@brief Append a string to a growing_buffer, escaped for XML.
+	@param buf Pointer to the growing_buffer.
+	@param str Pointer to the string to be escaped.  NULL is treated as an empty string.
+	@param attr Boolean: true if the string is an attribute value, or false if it's text.
+
+	The escapes reproduce what libxml2's serializer produced when it built our stanzas, so
+	that the output doesn't change: in text, escape the markup characters and carriage
+	returns; in attribute values, also escape quotes, newlines and tabs, and replace
+	non-ASCII characters with hexadecimal character references.  A malformed UTF-8
+	sequence in an attribute value comes out one byte at a time, as if it were Latin-1.
+
+	Characters that need no escaping are copied in runs, not one at a time.
+*/
+static void buffer_add_xml_escaped( growing_buffer* buf, const char* str, int attr ) {
+	if( ! str )
+		return;
+
+	const unsigned char* run = (const unsigned char*) str;
+	const unsigned char* s = run;
+
+	for( ;; ) {
+		unsigned char c;
+		if( attr ) {
+			while( ( c = *s ) && c < 0x80 && ! xml_attr_escapes[ c ] )
+				++s;
+		} else {
+			// Text is mostly long runs with nothing to escape, which strcspn() scans quickly
+			s += strcspn( (const char*) s, XML_TEXT_ESCAPES );
+			c = *s;
+		}
+
+		if( s > run )
+			OSRF_BUFFER_ADD_N( buf, (const char*) run, s - run );
+		if( ! c )
+			break;
+
+		int len = 1;
+		switch( c ) {
+			case '<'  : OSRF_BUFFER_ADD( buf, "&lt;" );   break;
+			case '>'  : OSRF_BUFFER_ADD( buf, "&gt;" );   break;
+			case '&'  : OSRF_BUFFER_ADD( buf, "&amp;" );  break;
+			case '"'  : OSRF_BUFFER_ADD( buf, "&quot;" ); break;
+			case '\r' : OSRF_BUFFER_ADD( buf, "&#13;" );  break;
+			case '\n' : OSRF_BUFFER_ADD( buf, "&#10;" );  break;
+			case '\t' : OSRF_BUFFER_ADD( buf, "&#9;" );   break;
+			default : {
+				char ref[ 16 ];
+				long cp = utf8_decode( s, &len );
+				snprintf( ref, sizeof( ref ), "&#x%lX;", cp < 0 ? (long) c : cp );
+				OSRF_BUFFER_ADD( buf, ref );
+				break;
+			}
+		}
+
+		s += len;
+		run = s;
+	}
+}
+
+/**
+	@brief Append an attribute, with a leading space, to a growing_buffer.
+	@param buf Pointer to the growing_buffer.
+	@param name Name of the attribute.
+	@param value Value of the attribute, unescaped; NULL is treated as an empty string.
+*/
+static void buffer_add_xml_attr( growing_buffer* buf, const char* name, const char* value ) {
+	OSRF_BUFFER_ADD_CHAR( buf, ' ' );
+	OSRF_BUFFER_ADD( buf, name );
+	OSRF_BUFFER_ADD( buf, "=\"" );
+	buffer_add_xml_escaped( buf, value, 1 );
+	OSRF_BUFFER_ADD_CHAR( buf, '"' );
+}
+
+/**
+	@brief Append a text-only element to a growing_buffer, unless the text is empty.
+	@param buf Pointer to the growing_buffer.
+	@param name Name of the element.
+	@param text Content of the element, unescaped.
+*/
+static void buffer_add_xml_element( growing_buffer* buf, const char* name, const char* text ) {
+	if( text && *text ) {
+		OSRF_BUFFER_ADD_CHAR( buf, '<' );
+		OSRF_BUFFER_ADD( buf, name );
+		OSRF_BUFFER_ADD_CHAR( buf, '>' );
+		buffer_add_xml_escaped( buf, text, 0 );
+		OSRF_BUFFER_ADD( buf, "</" );
+		OSRF_BUFFER_ADD( buf, name );
+		OSRF_BUFFER_ADD_CHAR( buf, '>' );
+	}
+}
+
 /**
 	@brief Build a &lt;message&gt; element and store it as a string in the msg_xml member.
 	@param msg Pointer to a transport_message.
@@ -323,92 +917,67 @@ int message_free( transport_message* msg ){
 	The contents of the &lt;message&gt; element come from various members of the
 	transport_message.  Store the resulting string as the msg_xml member.
 
-	To build the XML we first build a DOM structure, and then export it to a string.  That
-	way we can let the XML library worry about replacing certain characters with
-	character entity references -- not a trivial task when UTF-8 characters may be present.
+	We write the XML directly into a buffer sized for the unescaped content, rather than
+	building a DOM and exporting it.  Escaping seldom makes the stanza much longer, so
+	usually the buffer never has to grow.  The output is the same, byte for byte, as what
+	libxml2 used to produce for us.
 */
 int message_prepare_xml( transport_message* msg ) {
 
 	if( !msg ) return 0;
 	if( msg->msg_xml ) return 1;   /* already done */
 
-	xmlNodePtr  message_node;
-	xmlNodePtr  body_node;
-	xmlNodePtr  thread_node;
-	xmlNodePtr  opensrf_node;
-	xmlNodePtr  subject_node;
-	xmlNodePtr  error_node;
-
-	xmlDocPtr   doc;
+	size_t size = 256;   // for the markup
+	const char* fields[] = { msg->recipient, msg->sender, msg->router_from, msg->router_to,
+		msg->router_class, msg->router_command, msg->osrf_xid, msg->error_type,
+		msg->thread, msg->subject, msg->body };
+	int i;
+	for( i = 0; i < sizeof( fields ) / sizeof( fields[0] ); ++i ) {
+		if( fields[ i ] )
+			size += strlen( fields[ i ] );
+	}
+	size += size / 16;   // a little room for escapes
 
-	xmlKeepBlanksDefault(0);
+	growing_buffer* buf = buffer_init( size );
 
-	doc = xmlReadDoc( BAD_CAST "<message/>", NULL, NULL, XML_PARSE_NSCLEAN );
-	message_node = xmlDocGetRootElement(doc);
+	OSRF_BUFFER_ADD( buf, "<message" );
+	buffer_add_xml_attr( buf, "to", msg->recipient );
+	buffer_add_xml_attr( buf, "from", msg->sender );
+	OSRF_BUFFER_ADD_CHAR( buf, '>' );
 
 	if( msg->is_error ) {
-		error_node = xmlNewChild(message_node, NULL, BAD_CAST "error" , NULL );
-		xmlAddChild( message_node, error_node );
-		xmlNewProp( error_node, BAD_CAST "type", BAD_CAST msg->error_type );
-		char code_buf[16];
-		osrf_clearbuf( code_buf, sizeof(code_buf));
-		sprintf(code_buf, "%d", msg->error_code );
-		xmlNewProp( error_node, BAD_CAST "code", BAD_CAST code_buf  );
+		char code_buf[ 16 ];
+		snprintf( code_buf, sizeof( code_buf ), "%d", msg->error_code );
+		OSRF_BUFFER_ADD( buf, "<error" );
+		buffer_add_xml_attr( buf, "type", msg->error_type );
+		buffer_add_xml_attr( buf, "code", code_buf );
+		OSRF_BUFFER_ADD( buf, "/>" );
 	}
 
-	/* set from and to */
-	xmlNewProp( message_node, BAD_CAST "to", BAD_CAST msg->recipient );
-	xmlNewProp( message_node, BAD_CAST "from", BAD_CAST msg->sender );
-
 	/* set from and to on a new node, also */
-	opensrf_node = xmlNewChild(message_node, NULL, (xmlChar*) "opensrf", NULL );
-	xmlNewProp( opensrf_node, BAD_CAST "router_from", BAD_CAST msg->router_from );
-	xmlNewProp( opensrf_node, BAD_CAST "router_to", BAD_CAST msg->router_to );
-	xmlNewProp( opensrf_node, BAD_CAST "router_class", BAD_CAST msg->router_class );
-	xmlNewProp( opensrf_node, BAD_CAST "router_command", BAD_CAST msg->router_command );
-	xmlNewProp( opensrf_node, BAD_CAST "osrf_xid", BAD_CAST msg->osrf_xid );
-
-	xmlAddChild(message_node, opensrf_node);
-
-	if( msg->broadcast ) {
-		xmlNewProp( opensrf_node, BAD_CAST "broadcast", BAD_CAST "1" );
+	OSRF_BUFFER_ADD( buf, "<opensrf" );
+	buffer_add_xml_attr( buf, "router_from", msg->router_from );
+	buffer_add_xml_attr( buf, "router_to", msg->router_to );
+	buffer_add_xml_attr( buf, "router_class", msg->router_class );
+	buffer_add_xml_attr( buf, "router_command", msg->router_command );
+	buffer_add_xml_attr( buf, "osrf_xid", msg->osrf_xid );
+	if( msg->broadcast )
+		buffer_add_xml_attr( buf, "broadcast", "1" );
+	if( msg->router_hops > 0 ) {
+		char hops_buf[ 16 ];
+		snprintf( hops_buf, sizeof( hops_buf ), "%d", msg->router_hops );
+		buffer_add_xml_attr( buf, "router_hops", hops_buf );
 	}
+	OSRF_BUFFER_ADD( buf, "/>" );
 
 	/* Now add nodes where appropriate */
-	char* body      = msg->body;
-	char* subject   = msg->subject;
-	char* thread    = msg->thread;
-
-	if( thread && *thread ) {
-		thread_node = xmlNewChild(message_node, NULL, (xmlChar*) "thread", NULL );
-		xmlNodePtr txt = xmlNewText((xmlChar*) thread);
-		xmlAddChild(thread_node, txt);
-		xmlAddChild(message_node, thread_node);
-	}
+	buffer_add_xml_element( buf, "thread", msg->thread );
+	buffer_add_xml_element( buf, "subject", msg->subject );
+	buffer_add_xml_element( buf, "body", msg->body );
 
-	if( subject && *subject ) {
-		subject_node = xmlNewChild(message_node, NULL, (xmlChar*) "subject", NULL );
-		xmlNodePtr txt = xmlNewText((xmlChar*) subject);
-		xmlAddChild(subject_node, txt);
-		xmlAddChild( message_node, subject_node );
-	}
-
-	if( body && *body ) {
-		body_node = xmlNewChild(message_node, NULL, (xmlChar*) "body", NULL);
-		xmlNodePtr txt = xmlNewText((xmlChar*) body);
-		xmlAddChild(body_node, txt);
-		xmlAddChild( message_node, body_node );
-	}
-
-	// Export the xmlDoc to a string
-	xmlBufferPtr xmlbuf = xmlBufferCreate();
-	xmlNodeDump( xmlbuf, doc, xmlDocGetRootElement(doc), 0, 0);
-	msg->msg_xml = strdup((const char*) (xmlBufferContent(xmlbuf)));
-
-	xmlBufferFree(xmlbuf);
-	xmlFreeDoc( doc );
-	xmlCleanupParser();
+	OSRF_BUFFER_ADD( buf, "</message>" );
 
+	msg->msg_xml = buffer_release( buf );
 	return 1;
 }
 
@@ -506,6 +1075,40 @@ void jid_get_domain( const char* jid, char buf[], int size ) {
 		buf[ 0 ] = '\0';
 }
 
+/**
+	@brief Locate the domain within a Jabber ID, without copying it.
+	@param jid Pointer to the Jabber ID.
+	@param len Pointer through which to report the length of the domain.
+	@return Pointer to the first character of the domain, or NULL if there isn't one.
+
+	This function applies the same rules as jid_get_domain(), but points into the Jabber
+	ID instead of copying the domain into a buffer.  The domain is not nul-terminated;
+	use the length reported through @a len.
+*/
+const char* jid_find_domain( const char* jid, size_t* len ) {
+
+	if( jid == NULL || len == NULL ) return NULL;
+
+	const char* start = NULL;
+	const char* end = NULL;
+	const char* p;
+
+	for( p = jid; *p; ++p ) {
+		if( *p == '@' )
+			start = p + 1;
+		else if( *p == '/' && start )
+			end = p;
+	}
+
+	if( start && end && end > start ) {
+		*len = end - start;
+		return start;
+	}
+
+	*len = 0;
+	return NULL;
+}
+
 /**
 	@brief Turn a transport_message into an error message.
 	@param msg Pointer to the transport_message.
@@ -1,4 +1,6 @@
 #include <opensrf/transport_session.h>
+#include <limits.h>
+#include <zlib.h>
 
 /**
 	@file transport_session.c
@@ -17,6 +19,27 @@
 #define JABBER_THREAD_BUFSIZE    64  /**< buffer size for message thread */
 #define JABBER_JID_BUFSIZE       64  /**< buffer size for various ids */
 #define JABBER_STATUS_BUFSIZE    16  /**< buffer size for status code */
+#define SESSION_FLUSH_TIMEOUT     5  /**< seconds to spend draining output on disconnect */
+#define SESSION_ZLIB_CHUNK    65536  /**< bytes of XML to inflate at a time */
+#define SESSION_ZLIB_LEVEL        1  /**< zlib compression level for what we send */
+
+/** XEP-0138 request to compress the stream. */
+#define SESSION_COMPRESS_REQUEST \
+	"<compress xmlns='http://jabber.org/protocol/compress'><method>zlib</method></compress>"
+
+/**
+	@brief State of a compressed stream (XEP-0138).
+
+	Once Jabber accepts our request for compression, everything after that in either
+	direction is one long zlib stream.
+*/
+struct session_zlib_struct {
+	z_stream in;         /**< Inflates what Jabber sends us. */
+	z_stream out;        /**< Deflates what we send to Jabber. */
+	char* in_buf;        /**< Inflated XML, on its way to the parser. */
+	char* out_buf;       /**< Deflated XML, on its way to the socket. */
+	size_t out_size;     /**< Capacity of out_buf. */
+};
 
 // ---------------------------------------------------------------------------------
 // Callback for handling the startElement event.  Much of the jabber logic occurs
@@ -89,9 +112,16 @@ static const xmlSAXHandlerPtr SAXHandler = &SAXHandlerStruct;
 #define HOST_NAME_MAX 256
 #endif
 
-static void grab_incoming(void* blob, socket_manager* mgr, int sockid, char* data, int parent);
+static void grab_incoming(void* blob, socket_manager* mgr, int sockid, char* data,
+		size_t len, int parent);
+static void session_socket_closed( void* blob, int sock_fd );
 static void reset_session_buffers( transport_session* session );
 static const char* get_xml_attr( const xmlChar** atts, const char* attr_name );
+static int session_send_data( transport_session* session, const char* data, size_t len,
+		int may_queue );
+static int session_negotiate_compression( transport_session* session, const char* header,
+		int connect_timeout );
+static void session_zlib_free( transport_session* session );
 
 /**
 	@brief Allocate and initialize a transport_session.
@@ -124,6 +154,9 @@ transport_session* init_transport( const char* server,
 	session->user_data = user_data;
 
 	session->component = component;
+	session->nonblocking = 0;
+	session->compress = 0;
+	session->zlib = NULL;
 
 	/* initialize the data buffers */
 	session->body_buffer        = buffer_init( JABBER_BODY_BUFSIZE );
@@ -134,6 +167,7 @@ transport_session* init_transport( const char* server,
 	session->recipient_buffer   = buffer_init( JABBER_JID_BUFSIZE );
 	session->message_error_type = buffer_init( JABBER_JID_BUFSIZE );
 	session->session_id         = buffer_init( 64 );
+	session->method_buffer      = buffer_init( JABBER_STATUS_BUFSIZE );
 
 	session->message_error_code = 0;
 
@@ -145,6 +179,7 @@ transport_session* init_transport( const char* server,
 	session->router_command_buffer  = buffer_init( JABBER_JID_BUFSIZE );
 
 	session->router_broadcast   = 0;
+	session->router_hops        = 0;
 
 	/* initialize the jabber state machine */
 	session->state_machine = (jabber_machine*) safe_malloc( sizeof(jabber_machine) );
@@ -159,6 +194,12 @@ transport_session* init_transport( const char* server,
 	session->state_machine->in_iq            = 0;
 	session->state_machine->in_presence      = 0;
 	session->state_machine->in_status        = 0;
+	session->state_machine->in_features      = 0;
+	session->state_machine->in_compression   = 0;
+	session->state_machine->in_method        = 0;
+	session->state_machine->features_done    = 0;
+	session->state_machine->compress_offered = 0;
+	session->state_machine->compress_reply   = 0;
 
 	/* initialize the sax push parser */
 	session->parser_ctxt = xmlCreatePushParserCtxt(SAXHandler, session, "", 0, NULL);
@@ -167,7 +208,7 @@ transport_session* init_transport( const char* server,
 	session->sock_mgr = (socket_manager*) safe_malloc( sizeof(socket_manager) );
 
 	session->sock_mgr->data_received = &grab_incoming;
-	session->sock_mgr->on_socket_closed = NULL;
+	session->sock_mgr->on_socket_closed = &session_socket_closed;
 	session->sock_mgr->socket = NULL;
 	session->sock_mgr->blob = session;
 
@@ -217,6 +258,8 @@ int session_discard( transport_session* session ) {
 	if(session->sock_mgr)
 		socket_manager_free(session->sock_mgr);
 
+	session_zlib_free( session );
+
 	if( session->state_machine ) free( session->state_machine );
 	if( session->parser_ctxt) {
 		xmlFreeDoc( session->parser_ctxt->myDoc );
@@ -240,6 +283,7 @@ int session_discard( transport_session* session ) {
 	buffer_free(session->router_class_buffer);
 	buffer_free(session->router_command_buffer);
 	buffer_free(session->session_id);
+	buffer_free(session->method_buffer);
 
 	free(session->server);
 	free(session->unix_path);
@@ -266,8 +310,24 @@ int session_connected( transport_session* session ) {
 
 	If @a timeout is -1, wait indefinitely for input activity to appear.  If @a timeout is
 	zero, don't wait at all.  If @a timeout is positive, wait that number of seconds
-	before timing out.  If @a timeout has a negative value other than -1, the results are not
-	well defined.
+	before timing out.
+
+	The same as session_wait_ms(), but with the timeout in seconds.
+*/
+int session_wait( transport_session* session, int timeout ) {
+	return session_wait_ms( session, timeout_to_millis( timeout ) );
+}
+
+/**
+	@brief Wait on the client socket connected to Jabber, and process any resulting input.
+	@param session Pointer to the transport_session.
+	@param timeout_ms How many milliseconds to wait before timing out (see notes).
+	@return 0 if successful, or -1 if a timeout or other error occurs, or if the server
+		closes the connection at the other end.
+
+	If @a timeout_ms is negative, wait indefinitely for input activity to appear.  If
+	@a timeout_ms is zero, don't wait at all.  If @a timeout_ms is positive, wait that
+	many milliseconds before timing out.
 
 	Read all available input from the socket and pass it through grab_incoming() (a
 	callback function previously installed in the socket_manager).
@@ -276,12 +336,12 @@ int session_connected( transport_session* session ) {
 	result, the calling code should call this function in a loop until it gets a complete
 	message, or until an error occurs.
 */
-int session_wait( transport_session* session, int timeout ) {
+int session_wait_ms( transport_session* session, int timeout_ms ) {
 	if( ! session || ! session->sock_mgr ) {
 		return 0;
 	}
 
-	int ret =  socket_wait( session->sock_mgr, timeout, session->sock_id );
+	int ret =  socket_wait_ms( session->sock_mgr, timeout_ms, session->sock_id );
 
 	if( ret ) {
 		osrfLogDebug(OSRF_LOG_MARK, "socket_wait returned error code %d", ret);
@@ -293,7 +353,19 @@ int session_wait( transport_session* session, int timeout ) {
 	@brief Convert a transport_message to XML and send it to Jabber.
 	@param session Pointer to the transport_session.
 	@param msg Pointer to a transport_message enclosing the message.
-	@return 0 if successful, or -1 upon error.
+	@return 0 if successful, 1 if successful but the session is backed up (see notes), or
+		-1 upon error.
+
+	Ordinarily we block until the socket has accepted the whole message.  If the session
+	has been made nonblocking, we send what the socket will take and queue the rest, to be
+	sent as the socket drains; a return of 1 then means that the queue has grown past its
+	high-water mark, and the caller should stop sending for a while (see
+	session_backpressure()).
+
+	If the session is corked, we just queue the message, to go out with the ones after it
+	when the caller flushes the session or waits on it, or when the queue reaches
+	SOCKET_CORK_SIZE.  A blocking session then waits for a full batch to be sent before
+	returning.
 */
 int session_send_msg(
 		transport_session* session, transport_message* msg ) {
@@ -306,8 +378,146 @@ int session_send_msg(
 	}
 
 	message_prepare_xml( msg );
-	return socket_send( session->sock_id, msg->msg_xml );
 
+	return session_send_data( session, msg->msg_xml, strlen( msg->msg_xml ), 1 );
+}
+
+/**
+	@brief Deflate some outgoing XML, for a compressed stream.
+	@param session Pointer to the transport_session, whose stream is compressed.
+	@param data Pointer to the XML.
+	@param len Pointer to the length of the XML; on return, the length of the result.
+	@return Pointer to the compressed data, or NULL upon error.
+
+	Each call ends with a sync flush, so that Jabber can inflate and parse the XML as
+	soon as it arrives.  The result is in a buffer owned by the session, and is valid
+	until the next call.
+*/
+static const char* session_deflate( transport_session* session, const char* data,
+		size_t* len ) {
+	struct session_zlib_struct* zlib = session->zlib;
+	z_stream* z = &zlib->out;
+
+	size_t bound = deflateBound( z, *len ) + 16;
+	if( zlib->out_size < bound ) {
+		free( zlib->out_buf );
+		zlib->out_size = bound < SESSION_ZLIB_CHUNK ? SESSION_ZLIB_CHUNK : bound;
+		zlib->out_buf = safe_malloc( zlib->out_size );
+	}
+
+	z->next_in = (Bytef*) data;
+	z->avail_in = *len;
+	size_t used = 0;
+	for( ;; ) {
+		z->next_out = (Bytef*) zlib->out_buf + used;
+		z->avail_out = zlib->out_size - used;
+		if( deflate( z, Z_SYNC_FLUSH ) == Z_STREAM_ERROR ) {
+			osrfLogError( OSRF_LOG_MARK, "Unable to compress data for Jabber" );
+			return NULL;
+		}
+		used = zlib->out_size - z->avail_out;
+		if( z->avail_out > 0 )
+			break;
+
+		// Rare, since the buffer starts out at the bound; but room for more won't hurt
+		zlib->out_size *= 2;
+		zlib->out_buf = realloc( zlib->out_buf, zlib->out_size );
+		if( ! zlib->out_buf ) {
+			osrfLogError( OSRF_LOG_MARK, "Out of memory compressing data for Jabber" );
+			exit( 99 );
+		}
+	}
+
+	*len = used;
+	return zlib->out_buf;
+}
+
+/**
+	@brief Send some XML to Jabber, compressing it if the stream is compressed.
+	@param session Pointer to the transport_session.
+	@param data Pointer to the XML, which must be nul-terminated.
+	@param len Length of the XML.
+	@param may_queue Boolean; true if the XML may wait in the output queue, if the
+		session is nonblocking or corked.
+	@return The same as session_send_msg().
+
+	The connect and disconnect stanzas are sent with @a may_queue off, so that they go
+	out right away; but they still go out after anything already queued.
+*/
+static int session_send_data( transport_session* session, const char* data, size_t len,
+		int may_queue ) {
+
+	int compressed = 0;
+	if( session->zlib ) {
+		data = session_deflate( session, data, &len );
+		if( ! data )
+			return -1;
+		compressed = 1;
+	}
+
+	if( may_queue && session->corked ) {
+		int ret = socket_send_corked( session->sock_mgr, session->sock_id, data, len );
+		if( ret < 0 || session->nonblocking )
+			return ret;
+		if( socket_pending( session->sock_mgr, session->sock_id ) >= SOCKET_CORK_SIZE
+				&& socket_flush( session->sock_mgr, session->sock_id, -1 ) )
+			return -1;
+		return 0;
+	}
+
+	if( may_queue && session->nonblocking )
+		return socket_send_nowait( session->sock_mgr, session->sock_id, data, len );
+
+	// Don't let this message jump ahead of anything already queued
+	if( socket_pending( session->sock_mgr, session->sock_id )
+			&& socket_flush( session->sock_mgr, session->sock_id, -1 ) )
+		return -1;
+	if( ! compressed )
+		return socket_send( session->sock_id, data );
+
+	// Compressed data may contain nul bytes, so socket_send() won't do
+	if( socket_send_nowait( session->sock_mgr, session->sock_id, data, len ) < 0 )
+		return -1;
+	return socket_flush( session->sock_mgr, session->sock_id, -1 ) ? -1 : 0;
+}
+
+/**
+	@brief Send any output queued for a nonblocking or corked transport_session.
+	@param session Pointer to the transport_session.
+	@param timeout How many seconds to wait for the socket to take the data: -1 to wait
+		as long as it takes, or 0 not to wait at all.
+	@return 0 if nothing remains queued, 1 if something does, or -1 upon error.
+*/
+int session_flush( transport_session* session, int timeout ) {
+	if( ! session || ! session->sock_mgr || ! session->sock_id )
+		return -1;
+	if( ! socket_pending( session->sock_mgr, session->sock_id ) )
+		return 0;
+	return socket_flush( session->sock_mgr, session->sock_id, timeout );
+}
+
+/**
+	@brief Determine whether a nonblocking transport_session is backed up.
+	@param session Pointer to the transport_session.
+	@return 1 if the output queued for the session exceeds its high-water mark, or 0 if not.
+*/
+int session_backpressure( transport_session* session ) {
+	if( ! session || ! session->sock_mgr )
+		return 0;
+	return socket_backpressure( session->sock_mgr, session->sock_id );
+
+}
+
+/**
+	@brief Determine whether a transport_session's stream is compressed.
+	@param session Pointer to the transport_session.
+	@return 1 if Jabber agreed to compress the stream, or 0 if not.
+
+	Compression is requested by setting the session's @em compress member before calling
+	session_connect().  If Jabber doesn't offer it, the stream is simply left uncompressed.
+*/
+int session_compressed( transport_session* session ) {
+	return session && session->zlib ? 1 : 0;
 }
 
 
@@ -327,7 +537,8 @@ int session_send_msg(
 	than -1, the results are not well defined.
 
 	The value of @a connect_timeout applies to each of two stages in the logon procedure.
-	Hence the logon may take up to twice the amount of time indicated.
+	Hence the logon may take up to twice the amount of time indicated.  Negotiating
+	compression, if the session asks for it, is a third such stage.
 
 	If we connect as a Jabber component, we send the password as an SHA1 hash.  Otherwise
 	we look at the @a auth_type.  If it's AUTH_PLAIN, we send the password as plaintext; if
@@ -351,6 +562,13 @@ int session_connect( transport_session* session,
 		return 0;
 	}
 
+	// A new connection starts out uncompressed
+	session_zlib_free( session );
+	jabber_machine* machine = session->state_machine;
+	machine->features_done = 0;
+	machine->compress_offered = 0;
+	machine->compress_reply = 0;
+
 	// Open a client socket connecting to the Jabber server
 	if(session->port > 0) {   // use TCP
 		session->sock_id = socket_open_tcp_client(
@@ -392,9 +610,16 @@ int session_connect( transport_session* session,
 
 	If authentication fails, the Jabber server returns a <stream:error> (if we used a <handshake>
 	or an <iq> of type "error" (if we used an <iq>).
+
+	If the session asks for compression, and we're not a component, then between the two
+	stages we ask Jabber to compress the stream, as described in XEP-0138.
 	*/
 	if( session->component ) {
 
+		if( session->compress )
+			osrfLogInfo( OSRF_LOG_MARK,
+				"Stream compression isn't available to components; not compressing" );
+
 		/* the first Jabber connect stanza */
 		char our_hostname[HOST_NAME_MAX + 1] = "";
 		gethostname(our_hostname, sizeof(our_hostname) );
@@ -443,12 +668,12 @@ int session_connect( transport_session* session,
 	} else { /* we're not a component */
 
 		/* the first Jabber connect stanza */
-		size1 = 100 + strlen( server );
+		size1 = 120 + strlen( server );
 		char stanza1[ size1 ];
 		snprintf( stanza1, sizeof(stanza1),
 				"<stream:stream to='%s' xmlns='jabber:client' "
-				"xmlns:stream='http://etherx.jabber.org/streams'>",
-			server );
+				"xmlns:stream='http://etherx.jabber.org/streams'%s>",
+			server, session->compress ? " version='1.0'" : "" );
 
 		/* send the first stanze */
 		session->state_machine->connecting = CONNECTING_1;
@@ -463,6 +688,13 @@ int session_connect( transport_session* session,
 		/* wait for reply */
 		socket_wait( session->sock_mgr, connect_timeout, session->sock_id ); /* make the timeout smarter XXX */
 
+		if( session->compress && session->state_machine->connecting == CONNECTING_2
+				&& session_negotiate_compression( session, stanza1, connect_timeout ) ) {
+			socket_disconnect( session->sock_mgr, session->sock_id );
+			session->sock_id = 0;
+			return 0;
+		}
+
 		if( auth_type == AUTH_PLAIN ) {
 
 			/* the second jabber connect stanza including login info*/
@@ -475,7 +707,7 @@ int session_connect( transport_session* session,
 
 			/* server acknowledges our existence, now see if we can login */
 			if( session->state_machine->connecting == CONNECTING_2 ) {
-				if( socket_send( session->sock_id, stanza2 )  ) {
+				if( session_send_data( session, stanza2, strlen( stanza2 ), 0 ) ) {
 					osrfLogWarning(OSRF_LOG_MARK, "error sending");
 					socket_disconnect( session->sock_mgr, session->sock_id );
 					session->sock_id = 0;
@@ -501,7 +733,7 @@ int session_connect( transport_session* session,
 
 			/* server acknowledges our existence, now see if we can login */
 			if( session->state_machine->connecting == CONNECTING_2 ) {
-				if( socket_send( session->sock_id, stanza2 )  ) {
+				if( session_send_data( session, stanza2, strlen( stanza2 ), 0 ) ) {
 					osrfLogWarning(OSRF_LOG_MARK, "error sending");
 					socket_disconnect( session->sock_mgr, session->sock_id );
 					session->sock_id = 0;
@@ -538,17 +770,203 @@ int session_connect( transport_session* session,
 	@param blob Void pointer pointing to the transport_session.
 	@param mgr Pointer to the socket_manager (not used).
 	@param sockid Socket file descriptor (not used)
-	@param data Pointer to a buffer of received data, as a nul-terminated string.
+	@param data Pointer to a buffer of received data.
+	@param len Length of the data, in bytes.
 	@param parent Not applicable.
 
 	The socket_manager calls this function when it reads a buffer's worth of data from
 	the Jabber socket.  The XML parser calls other callback functions when it sees various
 	features of the XML.
+
+	If the stream is compressed, we inflate the data first, and feed the XML to the parser
+	a chunk at a time.  If the data won't inflate, there's no way to find our place in the
+	stream again, so we drop the connection.
 */
-static void grab_incoming(void* blob, socket_manager* mgr, int sockid, char* data, int parent) {
+static void grab_incoming(void* blob, socket_manager* mgr, int sockid, char* data,
+		size_t len, int parent) {
 	transport_session* ses = (transport_session*) blob;
 	if( ! ses ) { return; }
-	xmlParseChunk(ses->parser_ctxt, data, strlen(data), 0);
+
+	if( ! ses->zlib ) {
+		xmlParseChunk(ses->parser_ctxt, data, len, 0);
+		return;
+	}
+
+	z_stream* z = &ses->zlib->in;
+	z->next_in = (Bytef*) data;
+	z->avail_in = len;
+	int ret;
+	do {
+		z->next_out = (Bytef*) ses->zlib->in_buf;
+		z->avail_out = SESSION_ZLIB_CHUNK;
+		ret = inflate( z, Z_SYNC_FLUSH );
+		if( ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR ) {
+			osrfLogError( OSRF_LOG_MARK, "Unable to inflate data from Jabber: %s",
+				z->msg ? z->msg : "unknown error" );
+			socket_disconnect( mgr, sockid );
+			ses->sock_id = 0;
+			ses->state_machine->connected = 0;
+			return;
+		}
+
+		size_t n = SESSION_ZLIB_CHUNK - z->avail_out;
+		if( n > 0 )
+			xmlParseChunk( ses->parser_ctxt, ses->zlib->in_buf, n, 0 );
+	} while( ret == Z_OK && ( z->avail_in > 0 || z->avail_out == 0 ) );
+}
+
+/**
+	@brief Callback function: note that Jabber has closed the connection.
+	@param blob Pointer to the transport_session, cast to a void pointer.
+	@param sock_fd File descriptor of the socket, which the socket_manager has closed.
+
+	Ordinarily socket_wait() reports this by returning -1.  But when the socket_manager
+	has other sockets too, and waits on them all, this is how we find out.
+*/
+static void session_socket_closed( void* blob, int sock_fd ) {
+	transport_session* ses = (transport_session*) blob;
+	if( ses && sock_fd == ses->sock_id ) {
+		osrfLogWarning( OSRF_LOG_MARK, "Jabber server closed the connection" );
+		ses->sock_id = 0;
+		ses->state_machine->connected = 0;
+	}
+}
+
+/**
+	@brief Start compressing a transport_session's stream, in both directions.
+	@param session Pointer to the transport_session.
+	@return 0 if successful, or -1 if zlib won't cooperate.
+*/
+static int session_zlib_init( transport_session* session ) {
+	struct session_zlib_struct* zlib = safe_malloc( sizeof( struct session_zlib_struct ) );
+
+	if( deflateInit( &zlib->out, SESSION_ZLIB_LEVEL ) != Z_OK ) {
+		osrfLogError( OSRF_LOG_MARK, "Unable to initialize zlib compression" );
+		free( zlib );
+		return -1;
+	}
+	if( inflateInit( &zlib->in ) != Z_OK ) {
+		osrfLogError( OSRF_LOG_MARK, "Unable to initialize zlib decompression" );
+		deflateEnd( &zlib->out );
+		free( zlib );
+		return -1;
+	}
+
+	zlib->in_buf = safe_malloc( SESSION_ZLIB_CHUNK );
+	session->zlib = zlib;
+	return 0;
+}
+
+/**
+	@brief Discard a transport_session's compression state, if any.
+	@param session Pointer to the transport_session.
+*/
+static void session_zlib_free( transport_session* session ) {
+	struct session_zlib_struct* zlib = session->zlib;
+	if( zlib ) {
+		inflateEnd( &zlib->in );
+		deflateEnd( &zlib->out );
+		free( zlib->in_buf );
+		free( zlib->out_buf );
+		free( zlib );
+		session->zlib = NULL;
+	}
+}
+
+/**
+	@brief Wait on the Jabber socket until a flag in the state machine changes.
+	@param session Pointer to the transport_session.
+	@param flag Pointer to the flag, in the session's jabber_machine.
+	@param value The value of the flag that we're waiting to see change.
+	@param deadline When to give up, as from get_monotonic_millis(); or -1 for never.
+	@return 0 if the flag changed, or -1 if it didn't.
+*/
+static int session_wait_for( transport_session* session, const int* flag, int value,
+		long long deadline ) {
+	while( *flag == value ) {
+		int remaining = -1;
+		if( deadline >= 0 ) {
+			long long left = deadline - get_monotonic_millis();
+			if( left <= 0 )
+				return -1;
+			remaining = left > INT_MAX ? INT_MAX : (int) left;
+		}
+		if( socket_wait_ms( session->sock_mgr, remaining, session->sock_id ) )
+			return *flag == value ? -1 : 0;
+	}
+	return 0;
+}
+
+/**
+	@brief Ask Jabber to compress the stream, if it offers to (XEP-0138).
+	@param session Pointer to the transport_session, which has just opened its stream.
+	@param header The stream header that opened the stream, to open it again once it's
+		compressed.
+	@param connect_timeout How long to wait for each reply, as for session_connect().
+	@return 0 if we may go on to log in, with or without compression; or -1 if the
+		connection has failed.
+
+	The server lists what it offers in &lt;stream:features&gt;, after its stream header.
+	If zlib is among the compression methods, we send &lt;compress&gt;.  If the server
+	says &lt;compressed/&gt;, both sides start a new stream, compressed from its first
+	byte; that means a new parser, and a new stream header and session id.  If the server
+	says &lt;failure/&gt; instead, we carry on without compression.
+*/
+static int session_negotiate_compression( transport_session* session, const char* header,
+		int connect_timeout ) {
+
+	jabber_machine* machine = session->state_machine;
+	long long deadline = -1;
+	if( connect_timeout >= 0 )
+		deadline = get_monotonic_millis() + timeout_to_millis( connect_timeout );
+
+	session_wait_for( session, &machine->features_done, 0, deadline );
+	if( ! machine->compress_offered ) {
+		osrfLogInfo( OSRF_LOG_MARK,
+			"Jabber server doesn't offer zlib compression; not compressing" );
+		return 0;
+	}
+
+	machine->compress_reply = 1;
+	if( session_send_data( session, SESSION_COMPRESS_REQUEST,
+			strlen( SESSION_COMPRESS_REQUEST ), 0 ) ) {
+		osrfLogWarning( OSRF_LOG_MARK, "error sending" );
+		return -1;
+	}
+
+	if( session_wait_for( session, &machine->compress_reply, 1, deadline ) ) {
+		osrfLogWarning( OSRF_LOG_MARK, "No reply from Jabber to request for compression" );
+		return -1;
+	}
+
+	if( machine->compress_reply < 0 ) {
+		osrfLogWarning( OSRF_LOG_MARK,
+			"Jabber server refused to compress the stream; not compressing" );
+		return 0;
+	}
+
+	// Start over with a new stream, and a parser that hasn't seen the old one
+	if( session_zlib_init( session ) )
+		return -1;
+
+	xmlFreeDoc( session->parser_ctxt->myDoc );
+	xmlFreeParserCtxt( session->parser_ctxt );
+	session->parser_ctxt = xmlCreatePushParserCtxt( SAXHandler, session, "", 0, NULL );
+	buffer_reset( session->session_id );
+	machine->connecting = CONNECTING_1;
+
+	if( session_send_data( session, header, strlen( header ), 0 ) ) {
+		osrfLogWarning( OSRF_LOG_MARK, "error sending" );
+		return -1;
+	}
+
+	if( session_wait_for( session, &machine->connecting, CONNECTING_1, deadline ) ) {
+		osrfLogWarning( OSRF_LOG_MARK, "No compressed stream header from Jabber" );
+		return -1;
+	}
+
+	osrfLogInfo( OSRF_LOG_MARK, "Jabber stream is compressed" );
+	return 0;
 }
 
 
@@ -588,6 +1006,9 @@ static void startElementHandler(
 			const char* broadcast = get_xml_attr( atts, "broadcast" );
 			if( broadcast )
 				ses->router_broadcast = atoi( broadcast );
+			const char* hops = get_xml_attr( atts, "router_hops" );
+			if( hops )
+				ses->router_hops = message_read_hops( hops, strlen( hops ) );
 
 			return;
 		}
@@ -622,6 +1043,39 @@ static void startElementHandler(
 	}
 
 
+	if( strcmp( (char*) name, "stream:features" ) == 0 ) {
+		ses->state_machine->in_features = 1;
+		return;
+	}
+
+	if( ses->state_machine->in_features ) {
+
+		if( strcmp( (char*) name, "compression" ) == 0 ) {
+			ses->state_machine->in_compression = 1;
+			return;
+		}
+
+		if( ses->state_machine->in_compression && strcmp( (char*) name, "method" ) == 0 ) {
+			ses->state_machine->in_method = 1;
+			buffer_reset( ses->method_buffer );
+			return;
+		}
+
+		return;
+	}
+
+	/* reply to a request for compression */
+	if( 1 == ses->state_machine->compress_reply ) {
+		if( strcmp( (char*) name, "compressed" ) == 0 ) {
+			ses->state_machine->compress_reply = 2;
+			return;
+		}
+		if( strcmp( (char*) name, "failure" ) == 0 ) {
+			ses->state_machine->compress_reply = -1;
+			return;
+		}
+	}
+
 	if( strcmp( (char*) name, "stream:error" ) == 0 ) {
 		ses->state_machine->in_error = 1;
 		ses->state_machine->connected = 0;
@@ -718,13 +1172,27 @@ static void endElementHandler( void *session, const xmlChar *name) {
 		/* pass off the message info the callback */
 		if( ses->message_callback ) {
 
+			// A large body goes to the message as is, rather than being copied; the
+			// session gets a fresh buffer for the next one.
+			char* body = NULL;
+			if( ses->body_buffer->n_used > JABBER_BODY_BUFSIZE ) {
+				body = buffer_release( ses->body_buffer );
+				ses->body_buffer = buffer_init( JABBER_BODY_BUFSIZE );
+			}
+
 			transport_message* msg =  message_init(
-				OSRF_BUFFER_C_STR( ses->body_buffer ),
+				body ? "" : OSRF_BUFFER_C_STR( ses->body_buffer ),
 				OSRF_BUFFER_C_STR( ses->subject_buffer ),
 				OSRF_BUFFER_C_STR( ses->thread_buffer ),
 				OSRF_BUFFER_C_STR( ses->recipient_buffer ),
 				OSRF_BUFFER_C_STR( ses->from_buffer ) );
 
+			if( msg && body ) {
+				free( msg->body );
+				msg->body = body;
+			} else
+				free( body );
+
 			message_set_router_info( msg,
 				ses->router_from_buffer->buf,
 				ses->router_to_buffer->buf,
@@ -733,6 +1201,8 @@ static void endElementHandler( void *session, const xmlChar *name) {
 				ses->router_broadcast );
 
 			message_set_osrf_xid( msg, ses->osrf_xid_buffer->buf );
+			if( msg )
+				msg->router_hops = ses->router_hops;
 
 			if( ses->message_error_type->n_used > 0 ) {
 				set_msg_error( msg, ses->message_error_type->buf, ses->message_error_code );
@@ -800,26 +1270,58 @@ static void endElementHandler( void *session, const xmlChar *name) {
 		machine->in_error = 0;
 		return;
 	}
+
+	if( machine->in_method && strcmp( (const char*) name, "method" ) == 0 ) {
+		machine->in_method = 0;
+		if( strcmp( OSRF_BUFFER_C_STR( ses->method_buffer ), "zlib" ) == 0 )
+			machine->compress_offered = 1;
+		return;
+	}
+
+	if( machine->in_compression && strcmp( (const char*) name, "compression" ) == 0 ) {
+		machine->in_compression = 0;
+		return;
+	}
+
+	if( machine->in_features && strcmp( (const char*) name, "stream:features" ) == 0 ) {
+		machine->in_features = 0;
+		machine->features_done = 1;
+		return;
+	}
 }
 
+/**
+	@brief Empty a growing_buffer in constant time.
+
+	Every way of adding to a growing_buffer keeps it nul-terminated, so unlike
+	OSRF_BUFFER_RESET we needn't clear the whole allocation -- which, after a large message,
+	could be megabytes.
+*/
+#define SESSION_BUFFER_CLEAR(gb) \
+	do {\
+		(gb)->n_used = 0;\
+		(gb)->buf[0] = '\0';\
+	} while(0)
+
 /**
 	@brief Clear all the buffers of a transport_session.
 	@param ses Pointer to the transport_session whose buffers are to be cleared.
 */
 static void reset_session_buffers( transport_session* ses ) {
-	OSRF_BUFFER_RESET( ses->body_buffer );
-	OSRF_BUFFER_RESET( ses->subject_buffer );
-	OSRF_BUFFER_RESET( ses->thread_buffer );
-	OSRF_BUFFER_RESET( ses->from_buffer );
-	OSRF_BUFFER_RESET( ses->recipient_buffer );
-	OSRF_BUFFER_RESET( ses->router_from_buffer );
-	OSRF_BUFFER_RESET( ses->osrf_xid_buffer );
-	OSRF_BUFFER_RESET( ses->router_to_buffer );
-	OSRF_BUFFER_RESET( ses->router_class_buffer );
-	OSRF_BUFFER_RESET( ses->router_command_buffer );
-	OSRF_BUFFER_RESET( ses->message_error_type );
-	OSRF_BUFFER_RESET( ses->session_id );
-	OSRF_BUFFER_RESET( ses->status_buffer );
+	SESSION_BUFFER_CLEAR( ses->body_buffer );
+	SESSION_BUFFER_CLEAR( ses->subject_buffer );
+	SESSION_BUFFER_CLEAR( ses->thread_buffer );
+	SESSION_BUFFER_CLEAR( ses->from_buffer );
+	SESSION_BUFFER_CLEAR( ses->recipient_buffer );
+	SESSION_BUFFER_CLEAR( ses->router_from_buffer );
+	SESSION_BUFFER_CLEAR( ses->osrf_xid_buffer );
+	SESSION_BUFFER_CLEAR( ses->router_to_buffer );
+	SESSION_BUFFER_CLEAR( ses->router_class_buffer );
+	SESSION_BUFFER_CLEAR( ses->router_command_buffer );
+	SESSION_BUFFER_CLEAR( ses->message_error_type );
+	SESSION_BUFFER_CLEAR( ses->session_id );
+	SESSION_BUFFER_CLEAR( ses->status_buffer );
+	ses->router_hops = 0;
 }
 
 // ------------------------------------------------------------------
@@ -867,6 +1369,11 @@ static void characterHandler(
 		buffer_add_n( ses->status_buffer, p, len );
 	}
 
+	/* note the compression methods on offer */
+	if( machine->in_method ) {
+		buffer_add_n( ses->method_buffer, p, len );
+	}
+
 	if( machine->in_error ) {
 		char msg[ len + 1 ];
 		strncpy( msg, p, len );
@@ -909,9 +1416,12 @@ static void  parseErrorHandler( void *session, const char* msg, ... ){
 */
 int session_disconnect( transport_session* session ) {
 	if( session && session->sock_id != 0 ) {
-		socket_send(session->sock_id, "</stream:stream>");
+		session_flush( session, SESSION_FLUSH_TIMEOUT );
+		const char* end = "</stream:stream>";
+		session_send_data( session, end, strlen( end ), 0 );
 		socket_disconnect(session->sock_mgr, session->sock_id);
 		session->sock_id = 0;
+		session_zlib_free( session );
 	}
 	return 0;
 }
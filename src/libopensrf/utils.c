@@ -24,6 +24,8 @@ GNU General Public License for more details.
 #include <opensrf/utils.h>
 #include <opensrf/log.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
 
 /**
 	@brief A thin wrapper for malloc().
@@ -151,6 +153,36 @@ double get_timestamp_millis( void ) {
 }
 
 
+/**
+	@brief Read a monotonic clock, for measuring timeouts.
+	@return Milliseconds since some unspecified starting point.
+
+	Unlike time() or gettimeofday(), the result doesn't jump when the system clock is set,
+	so the difference between two readings is a reliable measure of elapsed time.
+*/
+long long get_monotonic_millis( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+	@brief Translate a timeout in seconds into milliseconds.
+	@param timeout Timeout in seconds, or -1 to wait indefinitely.
+	@return Timeout in milliseconds, or -1 to wait indefinitely.
+
+	Any negative timeout means to wait indefinitely.  A timeout too long to express in
+	milliseconds is clamped to INT_MAX.
+*/
+int timeout_to_millis( int timeout ) {
+	if( timeout < 0 )
+		return -1;
+	else if( timeout > INT_MAX / 1000 )
+		return INT_MAX;
+	else
+		return timeout * 1000;
+}
+
 /**
 	@brief Set designated file status flags for an open file descriptor.
 	@param fd The file descriptor to be tweaked.
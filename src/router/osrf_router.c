@@ -1,9 +1,16 @@
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <stdint.h>
 #include <signal.h>
 #include "opensrf/utils.h"
 #include "opensrf/log.h"
 #include "opensrf/osrf_list.h"
 #include "opensrf/string_array.h"
+#include "opensrf/osrf_string_set.h"
+#include "opensrf/osrf_intern.h"
 #include "opensrf/osrf_hash.h"
 #include "osrf_router.h"
 #include "opensrf/transport_client.h"
@@ -20,7 +27,83 @@
 
 	For each server class there may be multiple server nodes.  Each node corresponds to a
 	listener process for a service.
+
+	The main loop waits on an epoll instance holding the sockets of all those sessions, and
+	maps each socket that fires straight to its class.  So the cost of routing a message
+	doesn't grow with the number of classes, and there's no limit on the number of sockets
+	such as select() would impose.
+
+	One process can route only as fast as one CPU allows.  So the router can also shard its
+	classes across several worker processes, by a hash of the class name.  Each worker opens
+	and serves the Jabber sessions of its own classes, with its own main loop.  The original
+	process keeps the router's own session: it passes each command to the worker that owns
+	the class, and answers requests for information by asking the workers and merging what
+	they say.  It talks to each worker over a socket pair, in frames: a four-byte length, in
+	network byte order, followed by the XML of a message (or, in a worker's reply, JSON).
+
+	We use processes rather than threads because much of libopensrf keeps its state in
+	globals, and because that's how OpenSRF spreads work across CPUs elsewhere.
+*/
+
+struct _osrfRouterClassStruct;
+typedef struct _osrfRouterClassStruct osrfRouterClass;
+struct _osrfRouterNodeStruct;
+typedef struct _osrfRouterNodeStruct osrfRouterNode;
+
+/** @brief Number of buckets in a latency histogram; see osrfRouterLatencyBucket(). */
+#define ROUTER_LATENCY_BUCKETS 304
+
+/**
+	@brief A rate of messages per second, as an exponentially weighted moving average.
+
+	We count the messages in each second, and fold each second's count into the average
+	when the next one starts, or when somebody asks.
+*/
+typedef struct {
+	double rate;              /**< Messages per second, as of the end of @a second. */
+	long long second;         /**< The second now being counted, by the monotonic clock. */
+	unsigned long count;      /**< How many messages we've counted in that second. */
+} osrfRouterRate;
+
+/**
+	@brief Limits on the requests admitted for a class, or from a sending domain.
+*/
+typedef struct {
+	double rate;              /**< Requests per second to admit, on average (0: no limit). */
+	double burst;             /**< How many requests to admit at once, above the rate. */
+	int max_in_flight;        /**< How many requests may be unacknowledged (0: no limit). */
+} osrfRouterLimit;
+
+/**
+	@brief Where a class, or a sending domain, stands against its osrfRouterLimit.
+
+	The token bucket fills at the limit's rate, up to its burst; each request admitted
+	takes a token.
+*/
+typedef struct {
+	double tokens;            /**< Requests we can admit now. */
+	long long filled;         /**< When we last added tokens, in monotonic nanoseconds. */
+	int in_flight;            /**< Requests sent to hinting nodes, not yet acknowledged. */
+} osrfRouterBucket;
+
+/**
+	@brief A histogram of latencies, in nanoseconds, with a relative precision of 1/8.
+*/
+typedef struct {
+	unsigned long buckets[ ROUTER_LATENCY_BUCKETS ];
+	unsigned long count;      /**< How many latencies we've recorded. */
+	long long max;            /**< The greatest of them. */
+} osrfRouterLatency;
+
+/**
+	@brief A ring of messages that we've routed, oldest first, kept in case they bounce.
 */
+typedef struct {
+	transport_message** msgs;
+	int size;                 /**< How many messages the ring can hold. */
+	int first;                /**< Index of the oldest message. */
+	int count;                /**< How many messages are in the ring. */
+} osrfRouterRing;
 
 /**
 	@brief Collection of server classes, with connection parameters for Jabber.
@@ -34,22 +117,50 @@ struct osrfRouterStruct {
 		osrfRouterClass.
 	*/
 	osrfHash* classes;
-	osrfHashIterator* class_itr;  /**< For traversing the list of classes. */
+	/** The same osrfRouterClasses, indexed by the file descriptors of their sockets. */
+	osrfList* fd_classes;
+	int epoll_fd;         /**< epoll instance for the main loop, or -1 if not running. */
+	unsigned int events;  /**< epoll events we're waiting for on the router's own socket. */
 	char* domain;         /**< Domain name of Jabber server. */
 	char* name;           /**< Router's username for the Jabber logon. */
 	char* resource;       /**< Router's resource name for the Jabber logon. */
 	char* password;       /**< Router's password for the Jabber logon. */
 	int port;             /**< Jabber's port number. */
+	int compress;         /**< Boolean; true if our Jabber streams should be compressed. */
 	volatile sig_atomic_t stop; /**< To be set by signal handler to interrupt main loop. */
 
-	/** Array of client domains that we allow to send requests through us. */
-	osrfStringArray* trustedClients;
-	/** Array of server domains that we allow to register, etc. with us. */
-	osrfStringArray* trustedServers;
+	/** Set of client domains that we allow to send requests through us. */
+	osrfStringSet* trustedClients;
+	/** Set of server domains that we allow to register, etc. with us. */
+	osrfStringSet* trustedServers;
 	/** List of osrfMessages to be returned from osrfMessageDeserialize() */
 	osrfList* message_list;
 
 	transport_client* connection;
+
+	/** Routing policy: picks a node of a class to send a message to. */
+	osrfRouterNode* (*pick_node)( osrfRouter* router, osrfRouterClass* rclass );
+	unsigned int seed;    /**< Random number state, for policies that need it. */
+	int retry_depth;      /**< How many unacknowledged messages to keep for each node. */
+	int stats_interval;   /**< Seconds between summaries in the log (0: none). */
+	osrfRouterLimit class_limit;   /**< Limits for each class not in class_limits. */
+	osrfHash* class_limits;        /**< Limits for particular classes, by class name. */
+	osrfRouterLimit domain_limit;  /**< Limits for each sending domain. */
+	/** osrfRouterBuckets for sending domains, by domain name; NULL if they have no limits. */
+	osrfHash* domains;
+	/** Domains of peer routers, to pass requests to when our nodes can't take them. */
+	osrfStringArray* peers;
+	int next_peer;        /**< Index of the next peer to pass a request to. */
+	long long next_stats; /**< When the next summary is due, in monotonic milliseconds. */
+
+	int worker_count;     /**< How many worker processes to shard classes across (0: none). */
+	int* workers;         /**< In the control process: a socket to each worker. */
+	pid_t* worker_pids;   /**< In the control process: the process ID of each worker. */
+	/** In the control process: what each worker has sent that we haven't used yet. */
+	growing_buffer** worker_in;
+	unsigned long query_seq;  /**< In the control process: number of the latest query. */
+	int control_fd;       /**< In a worker: socket to the control process; otherwise -1. */
+	growing_buffer* control_in; /**< In a worker: the part of a frame not yet handled. */
 };
 
 /**
@@ -57,6 +168,9 @@ struct osrfRouterStruct {
 */
 struct _osrfRouterClassStruct {
 	osrfRouter* router;         /**< The osrfRouter that owns this osrfRouterClass. */
+	char* name;                 /**< Class name. */
+	int sock_fd;                /**< File descriptor of the class's socket. */
+	unsigned int events;        /**< epoll events we're waiting for on that socket. */
 	osrfHashIterator* itr;      /**< Iterator for set of osrfRouterNodes. */
 	/**
 		@brief Hash store of server nodes.
@@ -67,24 +181,81 @@ struct _osrfRouterClassStruct {
 	osrfHash* nodes;
 	/** The transport_client used for communicating with this server. */
 	transport_client* connection;
+
+	unsigned long messages;     /**< How many messages we've routed to the class's nodes. */
+	unsigned long long bytes;   /**< How many bytes of stanzas those came to. */
+	unsigned long bounces;      /**< How many of them have bounced. */
+	unsigned long rerouted;     /**< How many we've sent again after their nodes died. */
+	unsigned long rejected;     /**< How many requests we've turned away, over the limits. */
+	unsigned long forwarded;    /**< How many requests we've passed to peer routers. */
+	osrfRouterRate rate;        /**< Messages routed per second. */
+	osrfRouterLimit limit;      /**< Limits on the requests we admit for the class. */
+	osrfRouterBucket bucket;    /**< Where the class stands against them. */
+	osrfRouterLatency latency;  /**< How long we took to route each message. */
+	/** Messages that removed nodes hadn't acknowledged, until they bounce too. */
+	osrfRouterRing stranded;
 };
-typedef struct _osrfRouterClassStruct osrfRouterClass;
 
 /**
 	@brief Represents a link to a single server's inbound connection.
 */
 struct _osrfRouterNodeStruct {
-	char* remoteId;     /**< Send message to me via this login. */
+	osrfRouterClass* rclass;  /**< The class that the node belongs to. */
+	char* remoteId;     /**< Send message to me via this login (interned). */
 	int count;          /**< How many message have been sent to this node. */
-	transport_message* lastMessage;
+	/** The messages most recently sent to this node, until it acknowledges them. */
+	osrfRouterRing sent;
+	int capacity;       /**< How many requests the node can work on at once, as it says. */
+	int load;           /**< How many requests the node last said it was working on. */
+	int unreported;     /**< How many we've sent it since then. */
+	long long aged;     /**< When we last aged @a unreported, in monotonic nanoseconds. */
+	int hinted;         /**< Boolean: true once the node has reported its load. */
+	unsigned long long bytes;  /**< How many bytes of stanzas we've sent it. */
+	osrfRouterRate rate;       /**< Messages sent to it per second. */
 };
-typedef struct _osrfRouterNodeStruct osrfRouterNode;
 
 static osrfRouterClass* osrfRouterAddClass( osrfRouter* router, const char* classname );
-static void osrfRouterClassAddNode( osrfRouterClass* rclass, const char* remoteId );
+static osrfRouterNode* osrfRouterClassAddNode( osrfRouterClass* rclass,
+		const char* remoteId );
+static void osrfRouterNodeSetLoad( osrfRouterNode* node, const char* hints );
+static void osrfRouterNodeAge( osrfRouterNode* node, long long now );
+static void osrfRouterRingInit( osrfRouterRing* ring, int size );
+static void osrfRouterRingPush( osrfRouterRing* ring, transport_message* msg );
+static transport_message* osrfRouterRingShift( osrfRouterRing* ring );
+static transport_message* osrfRouterRingTake( osrfRouterRing* ring,
+		const transport_message* bounce );
+static void osrfRouterRingClear( osrfRouterRing* ring );
+static int osrfRouterIsBounceOf( const transport_message* bounce,
+		const transport_message* sent );
+static void osrfRouterNodeRemember( osrfRouterNode* node, transport_message* msg );
+static transport_message* osrfRouterNodeTakeOldest( osrfRouterNode* node );
+static transport_message* osrfRouterNodeTake( osrfRouterNode* node,
+		const transport_message* bounce );
+static void osrfRouterNodeForget( osrfRouterNode* node, int keep );
+static void osrfRouterCountInFlight( osrfRouterClass* rclass, const transport_message* msg,
+		int delta );
+static osrfRouterBucket* osrfRouterFindDomain( osrfRouter* router, const char* jid,
+		int create );
+static void osrfRouterBucketFill( osrfRouterBucket* bucket, const osrfRouterLimit* limit,
+		long long now );
+static int osrfRouterBucketFull( const osrfRouterBucket* bucket,
+		const osrfRouterLimit* limit );
+static int osrfRouterAdmit( osrfRouter* router, osrfRouterClass* rclass,
+		const transport_message* msg );
+static void osrfRouterReject( osrfRouterClass* rclass, const transport_message* msg );
+static int osrfRouterClassFull( const osrfRouter* router, osrfRouterClass* rclass );
+static int osrfRouterForwardToPeer( osrfRouter* router, osrfRouterClass* rclass,
+		transport_message* msg );
+static void osrfRouterCancel( osrfRouterClass* rclass, const transport_message* lost );
+static int osrfRouterFromPeer( const osrfRouter* router, const transport_message* msg );
+static osrfRouterNode* osrfRouterPickRoundRobin( osrfRouter* router, osrfRouterClass* rclass );
+static osrfRouterNode* osrfRouterPickLeastLoaded( osrfRouter* router,
+		osrfRouterClass* rclass );
+static osrfRouterNode* osrfRouterPickTwoChoices( osrfRouter* router,
+		osrfRouterClass* rclass );
 static void osrfRouterHandleCommand( osrfRouter* router, const transport_message* msg );
 static void osrfRouterClassHandleMessage( osrfRouter* router,
-		osrfRouterClass* rclass, const transport_message* msg );
+		osrfRouterClass* rclass, transport_message* msg );
 static void osrfRouterRemoveClass( osrfRouter* router, const char* classname );
 static void osrfRouterClassRemoveNode( osrfRouter* router, const char* classname,
 		const char* remoteId );
@@ -93,30 +264,106 @@ static void osrfRouterNodeFree( char* remoteId, void* node );
 static osrfRouterClass* osrfRouterFindClass( osrfRouter* router, const char* classname );
 static osrfRouterNode* osrfRouterClassFindNode( osrfRouterClass* rclass,
 		const char* remoteId );
-static int _osrfRouterFillFDSet( osrfRouter* router, fd_set* set );
+static void osrfRouterWatch( osrfRouter* router, int sock_fd, unsigned int* current,
+		unsigned int events );
+static unsigned int osrfRouterClassEvents( osrfRouterClass* rclass );
+static void osrfRouterFlush( osrfRouter* router, const struct epoll_event* events,
+		int count );
 static void osrfRouterHandleIncoming( osrfRouter* router );
 static void osrfRouterClassHandleIncoming( osrfRouter* router,
 		const char* classname,  osrfRouterClass* class );
-static transport_message* osrfRouterClassHandleBounce( osrfRouter* router,
+static void osrfRouterClassHandleBounce( osrfRouter* router,
 		const char* classname, osrfRouterClass* rclass, const transport_message* msg );
 static void osrfRouterHandleAppRequest( osrfRouter* router, const transport_message* msg );
 static void osrfRouterRespondConnect( osrfRouter* router, const transport_message* msg,
-		const osrfMessage* omsg );
+		int thread_trace, int protocol );
 static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_message* msg,
 		const osrfMessage* omsg );
 static void osrfRouterSendAppResponse( osrfRouter* router, const transport_message* msg,
 		const osrfMessage* omsg, const jsonObject* response );
 static void osrfRouterHandleMethodNFound( osrfRouter* router,
-		const transport_message* msg, const osrfMessage* omsg );
+		const transport_message* msg, int thread_trace );
+static int osrfRouterInfo( osrfRouter* router, const char* method,
+		const jsonObject* params, jsonObject** result );
+static int osrfRouterSpawnWorkers( osrfRouter* router );
+static void osrfRouterBecomeWorker( osrfRouter* router, int index, int control_fd );
+static void osrfRouterStopWorkers( osrfRouter* router );
+static int osrfRouterShard( const osrfRouter* router, const char* classname );
+static int osrfRouterWriteFrame( int fd, const char* data );
+static int osrfRouterWorkerIndex( const osrfRouter* router, int fd );
+static int osrfRouterReadWorker( osrfRouter* router, int index );
+static char* osrfRouterTakeAnswer( osrfRouter* router, int index, unsigned long seq );
+static void osrfRouterForwardCommand( osrfRouter* router, transport_message* msg );
+static void osrfRouterHandleControl( osrfRouter* router );
+static void osrfRouterAnswerQuery( osrfRouter* router, const transport_message* msg );
+static void osrfRouterGatherInfo( osrfRouter* router, const char* method,
+		const jsonObject* params, jsonObject* result );
+static void osrfRouterMergeInfo( jsonObject* into, const jsonObject* part );
+static long long osrfRouterClockNanos( void );
+static void osrfRouterRateInit( osrfRouterRate* rate );
+static void osrfRouterRateCount( osrfRouterRate* rate, long long now );
+static double osrfRouterRateGet( osrfRouterRate* rate, long long now );
+static int osrfRouterLatencyBucket( long long ns );
+static void osrfRouterLatencyAdd( osrfRouterLatency* latency, long long ns );
+static double osrfRouterLatencyPercentile( const osrfRouterLatency* latency, double fraction );
+static jsonObject* osrfRouterStatNumber( double num );
+static jsonObject* osrfRouterClassStats( osrfRouterClass* rclass, int with_nodes );
+static void osrfRouterLogStats( osrfRouter* router );
+
+/** @brief How many unacknowledged messages to keep for each node, by default. */
+#define ROUTER_RETRY_DEPTH 16
+
+/**
+	@brief How long to wait for the workers to answer a request for information, in
+	milliseconds.
+*/
+#define ROUTER_WORKER_TIMEOUT 1000
+
+/**
+	@brief How long it takes to forget half of what we've sent a node that doesn't report its
+	load, in nanoseconds.
+*/
+#define ROUTER_UNREPORTED_HALF_LIFE 1000000000LL
+
+/**
+	@brief How many times a request may be passed from one router to a peer.
+
+	With one, a router never passes on a request that came from a peer, so no request can
+	go round in circles, or bounce back and forth between routers that are both short of
+	nodes.
+*/
+#define ROUTER_MAX_HOPS 1
+
+/** @brief Maximum number of events to collect from one call to epoll_wait(). */
+#define ROUTER_MAX_EVENTS 64
+
+/**
+	@brief Weight of the old average in a message rate, after one second: exp(-1/60).
+
+	So each rate is averaged over roughly the last minute.
+*/
+#define ROUTER_RATE_DECAY 0.98347145382161748
 
 #define ROUTER_REGISTER "register"
 #define ROUTER_UNREGISTER "unregister"
+#define ROUTER_LOAD "load"
 
 #define ROUTER_REQUEST_CLASS_LIST "opensrf.router.info.class.list"
 #define ROUTER_REQUEST_STATS_NODE_FULL "opensrf.router.info.stats.class.node.all"
 #define ROUTER_REQUEST_STATS_CLASS_FULL "opensrf.router.info.stats.class.all"
 #define ROUTER_REQUEST_STATS_CLASS "opensrf.router.info.stats.class"
 #define ROUTER_REQUEST_STATS_CLASS_SUMMARY "opensrf.router.info.stats.class.summary"
+#define ROUTER_REQUEST_STATS "opensrf.router.info.stats"
+
+/** @brief What the names of all of the above have in common. */
+#define ROUTER_REQUEST_PREFIX "opensrf.router.info."
+
+/**
+	@brief How many messages in one body the router handles from a scan of the JSON.
+
+	Bodies with more are parsed; there are seldom more than one or two.
+*/
+#define ROUTER_SCAN_MESSAGES 8
 
 /**
 	@brief Stop the otherwise endless main loop of the router.
@@ -144,6 +391,9 @@ void router_stop( osrfRouter* router )
 
 	Don't connect to Jabber yet.  We'll do that later, upon a call to osrfRouterConnect().
 
+	The router takes ownership of the trusted domain arrays.  It loads them into hashed
+	sets, which it consults on every message, and frees the arrays.
+
 	The calling code is responsible for freeing the osrfRouter by calling osrfRouterFree().
 */
 osrfRouter* osrfNewRouter(
@@ -160,16 +410,39 @@ osrfRouter* osrfNewRouter(
 	router->password       = strdup(password);
 	router->resource       = strdup(resource);
 	router->port           = port;
+	router->compress       = 0;
 	router->stop           = 0;
-
-	router->trustedClients = trustedClients;
-	router->trustedServers = trustedServers;
+	router->pick_node      = osrfRouterPickRoundRobin;
+	router->seed           = (unsigned int) time( NULL ) ^ (unsigned int) getpid();
+	router->retry_depth    = ROUTER_RETRY_DEPTH;
+	router->stats_interval = 0;
+	router->next_stats     = 0;
+	memset( &router->class_limit, 0, sizeof( router->class_limit ) );
+	memset( &router->domain_limit, 0, sizeof( router->domain_limit ) );
+	router->class_limits   = NULL;
+	router->domains        = NULL;
+	router->peers          = NULL;
+	router->next_peer      = 0;
+
+	router->trustedClients = osrfNewStringSetFromArray( trustedClients );
+	router->trustedServers = osrfNewStringSetFromArray( trustedServers );
+	osrfStringArrayFree( trustedClients );
+	osrfStringArrayFree( trustedServers );
 
 
 	router->classes = osrfNewHash();
 	osrfHashSetCallback(router->classes, &osrfRouterClassFree);
-	router->class_itr = osrfNewHashIterator( router->classes );
+	router->fd_classes = osrfNewList();
+	router->epoll_fd = -1;
+	router->events = 0;
 	router->message_list = NULL;   // We'll allocate one later
+	router->worker_count = 0;
+	router->workers = NULL;
+	router->worker_pids = NULL;
+	router->worker_in = NULL;
+	router->query_seq = 0;
+	router->control_fd = -1;
+	router->control_in = NULL;
 
 	// Prepare to connect to Jabber, as a non-component, over TCP (not UNIX domain).
 	router->connection = client_init( domain, port, NULL, 0 );
@@ -191,9 +464,230 @@ int osrfRouterConnect( osrfRouter* router ) {
 	int ret = client_connect( router->connection, router->name,
 			router->password, router->resource, 10, AUTH_DIGEST );
 	if( ret == 0 ) return -1;
+
+	// The main loop flushes output as the socket drains, so don't wait for it; and
+	// sends each pass's output in one batch
+	client_set_nonblocking( router->connection, 1 );
+	client_set_corked( router->connection, 1 );
+	return 0;
+}
+
+/**
+	@brief Choose whether to ask Jabber to compress the router's streams.
+	@param router Pointer to the osrfRouter.
+	@param compress Boolean: true to ask for compression, or false not to.
+
+	This applies to the router's own connection, which must not be connected yet, and to
+	the connections of the classes registered after that.
+*/
+void osrfRouterSetCompression( osrfRouter* router, int compress ) {
+	if( !router ) return;
+	router->compress = compress ? 1 : 0;
+	client_set_compression( router->connection, router->compress );
+}
+
+/**
+	@brief Choose how the router picks a node for each message routed to a class.
+	@param router Pointer to the osrfRouter.
+	@param policy Name of the policy:
+	- "round_robin" -- each node in turn, ignoring load (the default);
+	- "least_loaded" -- the node with the fewest requests in hand, relative to its capacity;
+	- "two_choices" -- the less loaded of two nodes picked at random.
+	@return 0 if successful, or -1 if the policy is unknown (in which case we leave the
+		policy unchanged).
+
+	The load-aware policies rely on the hints that listeners include when they register,
+	and send again as their load changes: how many requests they can work on at once, and
+	how many they are working on.  To those we add the messages that we've routed to a node
+	since its last hint.  A node that sends no hints counts as having a capacity of 1, and
+	since it never tells us what it has finished, we forget half of what we've sent it
+	every second; otherwise it would look ever busier, and never be picked.
+
+	Since the hints are always somewhat stale, "least_loaded" tends to send a burst of
+	messages to the same node until the next hint arrives; "two_choices" spreads the burst
+	more evenly, at a small cost in precision.
+*/
+int osrfRouterSetPolicy( osrfRouter* router, const char* policy ) {
+	if( !( router && policy ) )
+		return -1;
+
+	if( !strcmp( policy, "round_robin" ) )
+		router->pick_node = osrfRouterPickRoundRobin;
+	else if( !strcmp( policy, "least_loaded" ) )
+		router->pick_node = osrfRouterPickLeastLoaded;
+	else if( !strcmp( policy, "two_choices" ) )
+		router->pick_node = osrfRouterPickTwoChoices;
+	else
+		return -1;
+
 	return 0;
 }
 
+/**
+	@brief Choose how many messages to keep for each node, to send elsewhere if it dies.
+	@param router Pointer to the osrfRouter.
+	@param depth How many messages to keep; at least 1.
+
+	We keep the messages most recently sent to each node that reports its load, up to this
+	many, until the node acknowledges them by reporting its load: a node with a load of 3
+	can still be working on the last 3 messages we sent it, but not on any before them.
+	If one of those bounces, because the node has died, it goes to another node of the
+	same class.  Nothing that the node has acknowledged, or that doesn't bounce, is sent
+	again, since it may have been answered already.
+
+	A node that doesn't report its load acknowledges nothing, so for it we keep only the
+	last message, as we always have.
+
+	This applies to nodes registered after the call.
+*/
+void osrfRouterSetRetryDepth( osrfRouter* router, int depth ) {
+	if( router )
+		router->retry_depth = depth > 1 ? depth : 1;
+}
+
+/**
+	@brief Choose how many worker processes to shard the router's classes across.
+	@param router Pointer to the osrfRouter, which must not be running yet.
+	@param count How many workers to run.  With fewer than 2 we route everything in one
+		process, as usual.
+
+	With several workers, each class belongs to one of them, by a hash of its name.  A
+	worker routes the messages for its classes on its own, so the router can use as many
+	CPUs as it has workers.  The original process keeps the router's own session, for
+	commands and requests for information, which are comparatively rare.
+*/
+void osrfRouterSetWorkers( osrfRouter* router, int count ) {
+	if( router )
+		router->worker_count = count > 1 ? count : 0;
+}
+
+/**
+	@brief Free an osrfRouterLimit or an osrfRouterBucket, as a callback for an osrfHash.
+	@param key The name of the class or domain (not used).
+	@param item Pointer to the item, cast to a void pointer.
+*/
+static void osrfRouterFreeLimit( char* key, void* item ) {
+	free( item );
+}
+
+/**
+	@brief Fill in an osrfRouterLimit, with sensible values for what's left out.
+*/
+static void osrfRouterLimitInit( osrfRouterLimit* limit, double rate, double burst,
+		int max_in_flight ) {
+	limit->rate = rate > 0 ? rate : 0;
+	limit->burst = burst >= 1 ? burst : ( limit->rate > 1 ? limit->rate : 1 );
+	limit->max_in_flight = max_in_flight > 0 ? max_in_flight : 0;
+}
+
+/**
+	@brief Limit the requests that the router admits for a class.
+	@param router Pointer to the osrfRouter.
+	@param classname Name of the class; or NULL for every class without limits of its own.
+	@param rate How many requests per second to admit, on average; 0 for no limit.
+	@param burst How many requests to admit at once, above the rate; 0 for one second's
+		worth.
+	@param max_in_flight How many requests may be unacknowledged at once; 0 for no limit.
+
+	We admit a request only if the class is within both limits, and the sending domain
+	within its own (see osrfRouterSetDomainLimit()).  Anything else we turn away at once,
+	with a "service unavailable" status, as a listener does when its backlog is full --
+	but without troubling the listener, or letting one client's flood delay everybody
+	else's requests.
+
+	A request is in flight from when we send it to a node until the node acknowledges it
+	by reporting its load (see osrfRouterSetRetryDepth()).  We count no more than the
+	retry depth for each node.  A node that doesn't report its load, such as a Perl or
+	Python listener, never acknowledges anything, so we don't count what we send it at
+	all: @a max_in_flight limits only the nodes that report their load, and a class with
+	none is limited by @a rate alone.
+
+	This applies to classes registered after the call.  With workers, each class belongs to
+	one worker, so its limits hold exactly.
+*/
+void osrfRouterSetClassLimit( osrfRouter* router, const char* classname, double rate,
+		double burst, int max_in_flight ) {
+	if( !router )
+		return;
+
+	if( !classname ) {
+		osrfRouterLimitInit( &router->class_limit, rate, burst, max_in_flight );
+		return;
+	}
+
+	if( !router->class_limits ) {
+		router->class_limits = osrfNewHash();
+		osrfHashSetCallback( router->class_limits, &osrfRouterFreeLimit );
+	}
+	osrfRouterLimit* limit = safe_malloc( sizeof( osrfRouterLimit ) );
+	osrfRouterLimitInit( limit, rate, burst, max_in_flight );
+	osrfHashSet( router->class_limits, limit, classname );
+}
+
+/**
+	@brief Limit the requests that the router admits from each sending domain.
+	@param router Pointer to the osrfRouter.
+	@param rate How many requests per second to admit from a domain, on average; 0 for no
+		limit.
+	@param burst How many requests to admit at once, above the rate; 0 for one second's
+		worth.
+	@param max_in_flight How many requests from a domain may be unacknowledged at once; 0
+		for no limit.
+
+	Each trusted client domain has its own limits, across all classes; see
+	osrfRouterSetClassLimit().  With workers, each worker applies them to its own classes,
+	so a domain may get that many times as much in all.
+*/
+void osrfRouterSetDomainLimit( osrfRouter* router, double rate, double burst,
+		int max_in_flight ) {
+	if( !router )
+		return;
+
+	osrfRouterLimitInit( &router->domain_limit, rate, burst, max_in_flight );
+	if( !router->domains && ( router->domain_limit.rate || router->domain_limit.max_in_flight ) ) {
+		router->domains = osrfNewHash();
+		osrfHashSetCallback( router->domains, &osrfRouterFreeLimit );
+	}
+}
+
+/**
+	@brief Add a peer router, to take requests that the router's own nodes can't.
+	@param router Pointer to the osrfRouter.
+	@param domain The domain of the peer router, which must log in to Jabber with the
+		same name as this one.
+
+	We pass a request to a peer, in turn, when the class's last node has died with the
+	request in hand, or when every node of the class is working to its capacity as it
+	last reported, or when the request is over the class's limits or its domain's (see
+	osrfRouterSetClassLimit()).  The peer routes it as if the client had sent it there,
+	except that it won't pass it on again (see ROUTER_MAX_HOPS); and its listener answers
+	the client directly.  So the peer has to trust our client domains, and vice versa.
+
+	If the peer doesn't serve the class, the request bounces back to us, and we tell the
+	client that it failed, as we would if we had no peers.
+*/
+void osrfRouterAddPeer( osrfRouter* router, const char* domain ) {
+	if( !( router && domain && *domain ) )
+		return;
+	if( !router->peers )
+		router->peers = osrfNewStringArray( 4 );
+	osrfStringArrayAdd( router->peers, domain );
+}
+
+/**
+	@brief Choose how often to log a summary of the router's statistics.
+	@param router Pointer to the osrfRouter.
+	@param seconds Seconds between summaries, or 0 for none (the default).
+
+	Each summary is a line of JSON at INFO level, giving for each class what
+	"opensrf.router.info.stats" does, less the details of each node.  With workers, each
+	worker logs a summary of its own classes.
+*/
+void osrfRouterSetStatsInterval( osrfRouter* router, int seconds ) {
+	if( router )
+		router->stats_interval = seconds > 0 ? seconds : 0;
+}
+
 /**
 	@brief Enter endless loop to receive and respond to input.
 	@param router Pointer to the osrfRouter that's looping.
@@ -202,22 +696,80 @@ int osrfRouterConnect( osrfRouter* router ) {
 	either the top level socket belonging to the router or any of the lower level sockets
 	belonging to the classes.  React to the incoming activity as needed.
 
+	Our connections are nonblocking, so a slow reader doesn't stall the whole router.  We
+	also wait for sockets with queued output to become writable, and send what we can.
+	They are also corked: the messages we route on one pass are sent together at the end
+	of it, rather than with a system call apiece.
+	While a class's output is backed up past the high-water mark, we stop reading its
+	socket, so that its clients feel the backpressure instead of our memory.
+
+	Each pass touches only the sockets that epoll reports as active, so it costs the same
+	whether we have three classes or three hundred.
+
+	If the router has workers, we spawn them first.  Each worker runs the same loop, but in
+	place of the router's own socket it reads commands and queries from the control process;
+	the control process runs it with no classes of its own.  A worker returns when the
+	control process goes away, and the control process returns, having stopped the
+	workers, when any of them does.
+
 	We don't exit the loop until we receive a signal to stop, or until we encounter an error.
 */
 void osrfRouterRun( osrfRouter* router ) {
 	if(!(router && router->classes)) return;
 
-	int routerfd = client_sock_fd( router->connection );
-	int selectret = 0;
+	if( router->worker_count && osrfRouterSpawnWorkers( router ) )
+		return;
+
+	router->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if( router->epoll_fd < 0 ) {
+		osrfLogError( OSRF_LOG_MARK, "Unable to create an epoll instance: %s",
+				strerror( errno ) );
+		osrfRouterStopWorkers( router );
+		return;
+	}
+
+	int routerfd = router->control_fd >= 0 ?
+			router->control_fd : client_sock_fd( router->connection );
+	router->events = 0;
+	osrfRouterWatch( router, routerfd, &router->events, EPOLLIN );
+
+	// In the control process, hearing from a worker out of turn means it has gone away
+	int i;
+	for( i = 0; router->workers && i < router->worker_count; ++i ) {
+		unsigned int watched = 0;
+		osrfRouterWatch( router, router->workers[ i ], &watched, EPOLLIN );
+	}
+
+	// Register any classes that we acquired before we started running
+	osrfRouterClass* class;
+	osrfHashIterator* itr = osrfNewHashIterator( router->classes );
+	while( (class = osrfHashIteratorNext( itr )) ) {
+		class->events = 0;
+		osrfRouterWatch( router, class->sock_fd, &class->events,
+				osrfRouterClassEvents( class ) );
+	}
+	osrfHashIteratorFree( itr );
+
+	struct epoll_event events[ ROUTER_MAX_EVENTS ];
+	if( router->stats_interval )
+		router->next_stats = get_monotonic_millis() + router->stats_interval * 1000LL;
 
 	// Loop until a signal handler sets router->stop
 	while( ! router->stop ) {
 
-		fd_set set;
-		int maxfd = _osrfRouterFillFDSet( router, &set );
+		// Wait for an incoming message, or until the next summary is due
+		int timeout = -1;
+		if( router->stats_interval ) {
+			long long now = get_monotonic_millis();
+			if( now >= router->next_stats ) {
+				osrfRouterLogStats( router );
+				router->next_stats = now + router->stats_interval * 1000LL;
+			}
+			timeout = (int) ( router->next_stats - now );
+		}
 
-		// Wait indefinitely for an incoming message
-		if( (selectret = select(maxfd + 1, &set, NULL, NULL, NULL)) < 0 ) {
+		int count = epoll_wait( router->epoll_fd, events, ROUTER_MAX_EVENTS, timeout );
+		if( count < 0 ) {
 			if( EINTR == errno ) {
 				if( router->stop ) {
 					osrfLogInfo(OSRF_LOG_MARK, "Router shutting down");
@@ -226,39 +778,639 @@ void osrfRouterRun( osrfRouter* router ) {
 				else
 					continue;    // Irrelevant signal; ignore it
 			} else {
-				osrfLogWarning( OSRF_LOG_MARK, "Top level select call failed with errno %d: %s",
-						errno, strerror( errno ) );
+				osrfLogWarning( OSRF_LOG_MARK, "Top level epoll_wait call failed with "
+						"errno %d: %s", errno, strerror( errno ) );
 				break;
 			}
 		}
 
-		/* see if there is a top level router message */
-		if( FD_ISSET(routerfd, &set) ) {
-			osrfLogDebug( OSRF_LOG_MARK, "Top router socket is active: %d", routerfd );
-			osrfRouterHandleIncoming( router );
-		}
+		for( i = 0; i < count; ++i ) {
+			int sockfd = events[ i ].data.fd;
+			unsigned int fired = events[ i ].events;
 
-		/* Check each of the connected classes and see if they have data to route */
-		osrfRouterClass* class;
-		osrfHashIterator* itr = router->class_itr;  // remove a layer of indirection
-		osrfHashIteratorReset( itr );
+			if( sockfd == routerfd && router->control_fd >= 0 ) {
+				osrfRouterHandleControl( router );
+				continue;
+			}
 
-		while( (class = osrfHashIteratorNext(itr)) ) {   // for each class
+			if( sockfd == routerfd ) {
 
-			const char* classname = osrfHashIteratorKey(itr);
+				/* send whatever queued output the router socket will now take */
+				if( fired & EPOLLOUT )
+					client_flush( router->connection, 0 );
 
-			if( classname ) {
+				/* see if there is a top level router message */
+				if( fired & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) {
+					osrfLogDebug( OSRF_LOG_MARK, "Top router socket is active: %d", routerfd );
+					osrfRouterHandleIncoming( router );
+				}
+				continue;
+			}
 
-				osrfLogDebug( OSRF_LOG_MARK, "Checking %s for activity...", classname );
+			/* a worker, with an answer that came too late, or gone away */
+			int worker = osrfRouterWorkerIndex( router, sockfd );
+			if( worker >= 0 ) {
+				if( osrfRouterReadWorker( router, worker ) ) {
+					if( !router->stop ) {
+						osrfLogError( OSRF_LOG_MARK, "Router worker lost; shutting down" );
+						router->stop = 1;
+					}
+				} else
+					free( osrfRouterTakeAnswer( router, worker, 0 ) );
+				continue;
+			}
 
-				int sockfd = client_sock_fd( class->connection );
-				if(FD_ISSET( sockfd, &set )) {
-					osrfLogDebug( OSRF_LOG_MARK, "Socket is active: %d", sockfd );
-					osrfRouterClassHandleIncoming( router, classname, class );
+			/* a class with data to route, or room for more output */
+			class = osrfListGetIndex( router->fd_classes, sockfd );
+			if( !class )
+				continue;    // removed while we handled an earlier socket
+
+			if( fired & EPOLLOUT )
+				client_flush( class->connection, 0 );
+			if( fired & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) {
+				osrfLogDebug( OSRF_LOG_MARK, "Socket is active: %d", sockfd );
+				osrfRouterClassHandleIncoming( router, class->name, class );
+
+				// If Jabber dropped the connection, the class is no use to anybody
+				class = osrfListGetIndex( router->fd_classes, sockfd );
+				if( class && !client_connected( class->connection ) ) {
+					osrfLogWarning( OSRF_LOG_MARK, "Removing router class '%s' because "
+							"its connection to Jabber was lost", class->name );
+					osrfRouterRemoveClass( router, class->name );
 				}
 			}
-		} // end while
+		}
+
+		if( router->control_fd >= 0 ) {
+			if( !router->control_in ) {
+				osrfLogInfo( OSRF_LOG_MARK, "Router worker shutting down" );
+				break;
+			}
+		} else if( !client_connected( router->connection ) ) {
+			osrfLogError( OSRF_LOG_MARK, "Router lost its connection to Jabber" );
+			break;
+		}
+
+		osrfRouterFlush( router, events, count );
 	} // end while
+
+	close( router->epoll_fd );
+	router->epoll_fd = -1;
+	osrfRouterStopWorkers( router );
+}
+
+/**
+	@brief In the control process: start the worker processes.
+	@param router Pointer to the osrfRouter.
+	@return 0 if successful (in the control process and in each worker alike), or -1 if
+		we couldn't start them all (in which case we stop any that we did start).
+
+	We start the workers before we have any classes, so that they share nothing but the
+	router's own connection, which each worker closes.
+*/
+static int osrfRouterSpawnWorkers( osrfRouter* router ) {
+	router->workers = safe_malloc( router->worker_count * sizeof( int ) );
+	router->worker_pids = safe_malloc( router->worker_count * sizeof( pid_t ) );
+	router->worker_in = safe_malloc( router->worker_count * sizeof( growing_buffer* ) );
+
+	int i;
+	for( i = 0; i < router->worker_count; ++i ) {
+		router->workers[ i ] = -1;
+		router->worker_in[ i ] = buffer_init( 4096 );
+	}
+
+	for( i = 0; i < router->worker_count; ++i ) {
+		int pair[ 2 ];
+		if( socketpair( AF_UNIX, SOCK_STREAM, 0, pair ) < 0 ) {
+			osrfLogError( OSRF_LOG_MARK, "Unable to make a socket pair for a router worker: %s",
+					strerror( errno ) );
+			osrfRouterStopWorkers( router );
+			return -1;
+		}
+
+		pid_t pid = fork();
+		if( pid < 0 ) {
+			osrfLogError( OSRF_LOG_MARK, "Unable to fork a router worker: %s",
+					strerror( errno ) );
+			close( pair[ 0 ] );
+			close( pair[ 1 ] );
+			osrfRouterStopWorkers( router );
+			return -1;
+		} else if( 0 == pid ) {
+			close( pair[ 0 ] );
+			osrfRouterBecomeWorker( router, i, pair[ 1 ] );
+			return 0;
+		}
+
+		close( pair[ 1 ] );
+		router->workers[ i ] = pair[ 0 ];
+		router->worker_pids[ i ] = pid;
+	}
+
+	osrfLogInfo( OSRF_LOG_MARK, "Router sharding classes across %d workers",
+			router->worker_count );
+	return 0;
+}
+
+/**
+	@brief In a newly forked worker: let go of what belongs to the control process.
+	@param router Pointer to the osrfRouter.
+	@param index Which worker this is.
+	@param control_fd Our end of the socket pair to the control process.
+
+	We close the router's own connection without disconnecting it, since it still serves
+	the control process, and our copies of the sockets to the workers forked before us.
+*/
+static void osrfRouterBecomeWorker( osrfRouter* router, int index, int control_fd ) {
+	int i;
+	for( i = 0; i < index; ++i )
+		close( router->workers[ i ] );
+	for( i = 0; i < router->worker_count; ++i )
+		buffer_free( router->worker_in[ i ] );
+	free( router->workers );
+	free( router->worker_pids );
+	free( router->worker_in );
+	router->workers = NULL;
+	router->worker_pids = NULL;
+	router->worker_in = NULL;
+
+	close( client_sock_fd( router->connection ) );
+	client_discard( router->connection );
+	router->connection = NULL;
+
+	router->control_fd = control_fd;
+	router->control_in = buffer_init( 4096 );
+	osrfLogInfo( OSRF_LOG_MARK, "Router worker %d of %d started", index + 1,
+			router->worker_count );
+}
+
+/**
+	@brief Stop the worker processes, if we have any, or stop being one.
+	@param router Pointer to the osrfRouter.
+
+	In the control process, close the socket to each worker, which tells it to stop, and
+	wait for it to do so.  Each worker disconnects its classes from Jabber on the way out.
+*/
+static void osrfRouterStopWorkers( osrfRouter* router ) {
+	if( router->control_fd >= 0 ) {
+		close( router->control_fd );
+		router->control_fd = -1;
+		buffer_free( router->control_in );
+		router->control_in = NULL;
+	}
+
+	if( !router->workers )
+		return;
+
+	int i;
+	for( i = 0; i < router->worker_count; ++i ) {
+		if( router->workers[ i ] >= 0 )
+			close( router->workers[ i ] );
+	}
+	for( i = 0; i < router->worker_count; ++i ) {
+		if( router->workers[ i ] >= 0 )
+			waitpid( router->worker_pids[ i ], NULL, 0 );
+		buffer_free( router->worker_in[ i ] );
+	}
+
+	free( router->workers );
+	free( router->worker_pids );
+	free( router->worker_in );
+	router->workers = NULL;
+	router->worker_pids = NULL;
+	router->worker_in = NULL;
+}
+
+/**
+	@brief Determine which worker a class belongs to.
+	@param router Pointer to the osrfRouter, which has workers.
+	@param classname Name of the class.
+	@return Index of the worker.
+*/
+static int osrfRouterShard( const osrfRouter* router, const char* classname ) {
+	unsigned long hash = 5381;
+	const unsigned char* p;
+	for( p = (const unsigned char*) classname; *p; ++p )
+		hash = hash * 33 + *p;
+	return (int) ( hash % (unsigned long) router->worker_count );
+}
+
+/**
+	@brief Send a frame to the other end of a socket pair, waiting until it's all sent.
+	@param fd File descriptor of our end.
+	@param data The contents of the frame: a nul-terminated string.
+	@return 0 if successful, or -1 if the other end has gone away.
+*/
+static int osrfRouterWriteFrame( int fd, const char* data ) {
+	size_t len = strlen( data );
+	uint32_t header = htonl( (uint32_t) len );
+	char* frame = safe_malloc( len + 4 );
+	memcpy( frame, &header, 4 );
+	memcpy( frame + 4, data, len );
+
+	size_t sent = 0;
+	while( sent < len + 4 ) {
+		ssize_t n = send( fd, frame + sent, len + 4 - sent, MSG_NOSIGNAL );
+		if( n < 0 && EINTR == errno )
+			continue;
+		if( n <= 0 )
+			break;
+		sent += n;
+	}
+	free( frame );
+
+	if( sent < len + 4 ) {
+		osrfLogError( OSRF_LOG_MARK, "Unable to send a frame to the other end of socket %d",
+				fd );
+		return -1;
+	}
+	return 0;
+}
+
+/**
+	@brief In the control process: find which worker is at the other end of a socket.
+	@param router Pointer to the osrfRouter.
+	@param fd File descriptor of a socket.
+	@return Index of the worker, or -1 if the socket isn't one of ours to a worker.
+*/
+static int osrfRouterWorkerIndex( const osrfRouter* router, int fd ) {
+	int i;
+	for( i = 0; router->workers && i < router->worker_count; ++i ) {
+		if( router->workers[ i ] == fd )
+			return i;
+	}
+	return -1;
+}
+
+/**
+	@brief In the control process: read whatever a worker has sent, without waiting.
+	@param router Pointer to the osrfRouter.
+	@param index Index of the worker.
+	@return 0 if successful, even if there was nothing to read; or -1 if the worker has gone
+		away.
+*/
+static int osrfRouterReadWorker( osrfRouter* router, int index ) {
+	char buf[ 65536 ];
+	for( ;; ) {
+		ssize_t n = recv( router->workers[ index ], buf, sizeof( buf ), MSG_DONTWAIT );
+		if( n > 0 )
+			buffer_add_n( router->worker_in[ index ], buf, n );
+		else if( n < 0 && EINTR == errno )
+			continue;
+		else if( n < 0 && ( EAGAIN == errno || EWOULDBLOCK == errno ) )
+			return 0;
+		else
+			return -1;
+	}
+}
+
+/**
+	@brief In the control process: take a worker's answer to a given query, if it's here.
+	@param router Pointer to the osrfRouter.
+	@param index Index of the worker.
+	@param seq Number of the query.
+	@return The answer, which the caller is responsible for freeing; or NULL if it hasn't
+		arrived yet.
+
+	Each answer is a frame: the number of the query, a space, and the answer in JSON.  An
+	answer to an earlier query came too late to be used, after we gave up waiting for it,
+	so we throw it away.
+*/
+static char* osrfRouterTakeAnswer( osrfRouter* router, int index, unsigned long seq ) {
+	growing_buffer* in = router->worker_in[ index ];
+	char* answer = NULL;
+	size_t used = 0;
+	while( !answer && in->n_used - used >= 4 ) {
+		uint32_t header;
+		memcpy( &header, in->buf + used, 4 );
+		size_t len = ntohl( header );
+		if( in->n_used - used - 4 < len )
+			break;
+
+		char* frame = in->buf + used + 4;
+		char* json = NULL;
+		unsigned long frame_seq = strtoul( frame, &json, 10 );
+		if( frame_seq == seq && json < frame + len && ' ' == *json )
+			answer = strndup( json + 1, frame + len - json - 1 );
+		else
+			osrfLogInfo( OSRF_LOG_MARK, "Discarding a late answer from router worker %d",
+					index + 1 );
+		used += 4 + len;
+	}
+
+	if( used ) {
+		in->n_used -= used;
+		memmove( in->buf, in->buf + used, in->n_used + 1 );
+	}
+	return answer;
+}
+
+/**
+	@brief In the control process: pass a command to the worker that owns its class.
+	@param router Pointer to the osrfRouter.
+	@param msg Pointer to the message bearing the command.
+*/
+static void osrfRouterForwardCommand( osrfRouter* router, transport_message* msg ) {
+	if( !( msg->router_class && *msg->router_class ) )
+		return;
+
+	int shard = osrfRouterShard( router, msg->router_class );
+	osrfLogDebug( OSRF_LOG_MARK, "Passing %s for class %s to router worker %d",
+			msg->router_command, msg->router_class, shard + 1 );
+	message_prepare_xml( msg );
+	osrfRouterWriteFrame( router->workers[ shard ], msg->msg_xml );
+}
+
+/**
+	@brief In a worker: handle what the control process has sent us.
+	@param router Pointer to the osrfRouter.
+
+	Read what's available, and handle every whole frame: a message with a router command,
+	which we obey as if it had come to us directly, or a query for information, which we
+	answer.  Keep any partial frame for next time.
+
+	If the control process has gone away, free the input buffer, which tells the main loop
+	to stop.
+*/
+static void osrfRouterHandleControl( osrfRouter* router ) {
+	char buf[ 65536 ];
+	ssize_t n = read( router->control_fd, buf, sizeof( buf ) );
+	if( n < 0 && ( EINTR == errno || EAGAIN == errno ) )
+		return;
+	if( n <= 0 ) {
+		buffer_free( router->control_in );
+		router->control_in = NULL;
+		return;
+	}
+
+	growing_buffer* in = router->control_in;
+	buffer_add_n( in, buf, n );
+
+	size_t used = 0;
+	while( in->n_used - used >= 4 ) {
+		uint32_t header;
+		memcpy( &header, in->buf + used, 4 );
+		size_t len = ntohl( header );
+		if( in->n_used - used - 4 < len )
+			break;
+
+		// Terminate the frame in place, rather than copy it
+		char* xml = in->buf + used + 4;
+		char save = xml[ len ];
+		xml[ len ] = '\0';
+		transport_message* msg = new_message_from_xml( xml );
+		xml[ len ] = save;
+		used += 4 + len;
+
+		if( msg ) {
+			if( msg->router_command && *msg->router_command )
+				osrfRouterHandleCommand( router, msg );
+			else
+				osrfRouterAnswerQuery( router, msg );
+			message_free( msg );
+		}
+	}
+
+	if( used ) {
+		in->n_used -= used;
+		memmove( in->buf, in->buf + used, in->n_used + 1 );
+	}
+}
+
+/**
+	@brief In a worker: answer a query from the control process for information.
+	@param router Pointer to the osrfRouter.
+	@param msg Pointer to the query, whose body is a JSON array: the name of the request,
+		and its parameters; and whose thread is the number of the query.
+
+	We reply with the number of the query, a space, and the answer for our own classes, in
+	JSON, or "null" if there isn't one.
+*/
+static void osrfRouterAnswerQuery( osrfRouter* router, const transport_message* msg ) {
+	jsonObject* query = jsonParse( msg->body );
+	jsonObject* result = NULL;
+	osrfRouterInfo( router, jsonObjectGetString( jsonObjectGetIndex( query, 0 ) ),
+			jsonObjectGetIndex( query, 1 ), &result );
+	jsonObjectFree( query );
+
+	char* json = result ? jsonObjectToJSON( result ) : strdup( "null" );
+	jsonObjectFree( result );
+	char* answer = va_list_to_string( "%s %s", msg->thread ? msg->thread : "0", json );
+	free( json );
+	osrfRouterWriteFrame( router->control_fd, answer );
+	free( answer );
+}
+
+/**
+	@brief In the control process: add the workers' answers to a request for information.
+	@param router Pointer to the osrfRouter.
+	@param method Name of the request.
+	@param params Parameters of the request.
+	@param result Pointer to our own answer, for no classes, to which we add theirs.
+
+	A request about one class goes only to the worker that owns it; any other goes to all
+	of them, at once.  We wait up to ROUTER_WORKER_TIMEOUT milliseconds for the answers,
+	since meanwhile we route nothing, and leave out the classes of any worker that doesn't
+	answer by then.  Its answer, if it comes later, is thrown away.
+*/
+static void osrfRouterGatherInfo( osrfRouter* router, const char* method,
+		const jsonObject* params, jsonObject* result ) {
+	if( !result )
+		return;
+
+	int first = 0;
+	int last = router->worker_count - 1;
+	const char* classname = jsonObjectGetString( jsonObjectGetIndex( params, 0 ) );
+	if( !strcmp( method, ROUTER_REQUEST_STATS_CLASS )
+			|| !strcmp( method, ROUTER_REQUEST_STATS_CLASS_SUMMARY )
+			|| ( !strcmp( method, ROUTER_REQUEST_STATS ) && classname ) ) {
+		first = last = osrfRouterShard( router, classname );
+	}
+
+	jsonObject* query = jsonNewObjectType( JSON_ARRAY );
+	jsonObjectPush( query, jsonNewObject( method ) );
+	jsonObjectPush( query, params ? jsonObjectClone( params ) : jsonNewObject( NULL ) );
+	char* body = jsonObjectToJSON( query );
+	jsonObjectFree( query );
+
+	unsigned long seq = ++router->query_seq;
+	char thread[ 32 ];
+	snprintf( thread, sizeof( thread ), "%lu", seq );
+	transport_message* msg = message_init( body, NULL, thread, NULL, NULL );
+	free( body );
+	message_prepare_xml( msg );
+
+	int count = last - first + 1;
+	struct pollfd* waiting = safe_malloc( count * sizeof( struct pollfd ) );
+	int i;
+	for( i = 0; i < count; ++i ) {
+		waiting[ i ].fd = router->workers[ first + i ];
+		waiting[ i ].events = POLLIN;
+		if( osrfRouterWriteFrame( waiting[ i ].fd, msg->msg_xml ) ) {
+			osrfLogError( OSRF_LOG_MARK, "No answer from router worker %d", first + i + 1 );
+			waiting[ i ].fd = -1;    // poll() ignores it
+		}
+	}
+	message_free( msg );
+
+	long long deadline = get_monotonic_millis() + ROUTER_WORKER_TIMEOUT;
+	int left = count;
+	for( i = 0; i < count; ++i )
+		if( waiting[ i ].fd < 0 )
+			left--;
+
+	while( left > 0 ) {
+		long long now = get_monotonic_millis();
+		if( now >= deadline )
+			break;
+		int ready = poll( waiting, count, (int) ( deadline - now ) );
+		if( ready < 0 && EINTR == errno )
+			continue;
+		if( ready <= 0 )
+			break;
+
+		for( i = 0; i < count; ++i ) {
+			if( waiting[ i ].fd < 0 || !waiting[ i ].revents )
+				continue;
+			int index = first + i;
+			char* answer = NULL;
+			if( osrfRouterReadWorker( router, index ) == 0 ) {
+				answer = osrfRouterTakeAnswer( router, index, seq );
+				if( !answer )
+					continue;    // not all here yet
+			} else
+				osrfLogError( OSRF_LOG_MARK, "No answer from router worker %d", index + 1 );
+
+			// The main loop notices a lost worker, once we return
+			waiting[ i ].fd = -1;
+			left--;
+			jsonObject* part = jsonParse( answer );
+			free( answer );
+			osrfRouterMergeInfo( result, part );
+			jsonObjectFree( part );
+		}
+	}
+
+	for( i = 0; i < count; ++i ) {
+		if( waiting[ i ].fd >= 0 )
+			osrfLogWarning( OSRF_LOG_MARK, "Router worker %d didn't answer within %d ms; "
+					"leaving out its classes", first + i + 1, ROUTER_WORKER_TIMEOUT );
+	}
+	free( waiting );
+}
+
+/**
+	@brief Merge one worker's answer to a request for information into another's.
+	@param into Pointer to the answer so far.
+	@param part Pointer to the worker's answer.
+
+	Each worker has different classes, so we can append arrays, take the union of hashes,
+	and add numbers.
+*/
+static void osrfRouterMergeInfo( jsonObject* into, const jsonObject* part ) {
+	if( !( into && part ) || into->type != part->type )
+		return;
+
+	if( JSON_NUMBER == into->type ) {
+		jsonObjectSetNumber( into, jsonObjectGetNumber( into ) + jsonObjectGetNumber( part ) );
+
+	} else if( JSON_ARRAY == into->type ) {
+		unsigned long i;
+		for( i = 0; i < part->size; ++i )
+			jsonObjectPush( into, jsonObjectClone( jsonObjectGetIndex( part, i ) ) );
+
+	} else if( JSON_HASH == into->type ) {
+		jsonIterator* itr = jsonNewIterator( part );
+		jsonObject* item;
+		while( (item = jsonIteratorNext( itr )) )
+			jsonObjectSetKey( into, itr->key, jsonObjectClone( item ) );
+		jsonIteratorFree( itr );
+	}
+}
+
+/**
+	@brief Send the output that a pass through the main loop has queued.
+	@param router Pointer to the osrfRouter.
+	@param events The events that epoll reported for the pass.
+	@param count How many events there are.
+
+	Send as much as each socket will take without blocking.  Whatever is left goes out
+	as the sockets become writable.
+
+	Only the sockets that were active on the pass can have acquired any output, since a
+	class sends messages only through its own session.  Having sent what we can, we wait
+	for those sockets to become writable if there's anything left, and stop reading any
+	whose output is backed up.
+*/
+static void osrfRouterFlush( osrfRouter* router, const struct epoll_event* events,
+		int count ) {
+	if( router->connection ) {
+		if( client_pending( router->connection ) )
+			client_flush( router->connection, 0 );
+		osrfRouterWatch( router, client_sock_fd( router->connection ), &router->events,
+				EPOLLIN | ( client_pending( router->connection ) ? EPOLLOUT : 0 ) );
+	}
+
+	int i;
+	for( i = 0; i < count; ++i ) {
+		osrfRouterClass* class = osrfListGetIndex( router->fd_classes, events[ i ].data.fd );
+		if( class ) {
+			if( client_pending( class->connection ) )
+				client_flush( class->connection, 0 );
+			osrfRouterWatch( router, class->sock_fd, &class->events,
+					osrfRouterClassEvents( class ) );
+		}
+	}
+}
+
+/**
+	@brief Tell the epoll instance which events we want to hear about for a socket.
+	@param router Pointer to the osrfRouter.
+	@param sock_fd File descriptor of the socket.
+	@param current Pointer to the events we're waiting for now (0 if the socket isn't
+		registered yet), to be updated.
+	@param events The events we want to wait for.
+
+	Do nothing if there's no change, or if the main loop isn't running.
+*/
+static void osrfRouterWatch( osrfRouter* router, int sock_fd, unsigned int* current,
+		unsigned int events ) {
+	if( router->epoll_fd < 0 || *current == events )
+		return;
+
+	struct epoll_event ev;
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = events;
+	ev.data.fd = sock_fd;
+
+	int op = *current ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if( epoll_ctl( router->epoll_fd, op, sock_fd, &ev ) < 0 )
+		osrfLogWarning( OSRF_LOG_MARK, "Unable to watch socket %d: %s",
+				sock_fd, strerror( errno ) );
+	else
+		*current = events;
+}
+
+/**
+	@brief Determine which epoll events we want to hear about for a class's socket.
+	@param rclass Pointer to the osrfRouterClass.
+	@return EPOLLIN unless the class's output is backed up, plus EPOLLOUT if it has any
+		output queued.
+
+	Backpressure implies queued output, so the result is never zero, which
+	osrfRouterWatch() would take to mean an unregistered socket.  EPOLLHUP and EPOLLERR
+	are reported regardless, even for a socket that we aren't reading.
+*/
+static unsigned int osrfRouterClassEvents( osrfRouterClass* rclass ) {
+	unsigned int events = 0;
+	if( client_backpressure( rclass->connection ) )
+		osrfLogDebug( OSRF_LOG_MARK, "Not reading class '%s' until its output drains",
+				rclass->name );
+	else
+		events |= EPOLLIN;
+	if( client_pending( rclass->connection ) )
+		events |= EPOLLOUT;
+	return events;
 }
 
 
@@ -285,16 +1437,19 @@ static void osrfRouterHandleIncoming( osrfRouter* router ) {
 				"osrfRouterHandleIncoming(): investigating message from %s", msg->sender);
 
 			/* if the server is not on a trusted domain, drop the message */
-			int len = strlen(msg->sender) + 1;
-			char domain[len];
-			jid_get_domain( msg->sender, domain, len - 1 );
+			size_t len;
+			const char* domain = jid_find_domain( msg->sender, &len );
 
-			if(osrfStringArrayContains( router->trustedServers, domain)) {
+			if( domain && osrfStringSetContainsN( router->trustedServers, domain, len )) {
 
 				// If there's a command, obey it.  Otherwise, treat
 				// the message as an app session level request.
-				if( msg->router_command && *msg->router_command )
-					osrfRouterHandleCommand( router, msg );
+				if( msg->router_command && *msg->router_command ) {
+					if( router->workers )
+						osrfRouterForwardCommand( router, msg );
+					else
+						osrfRouterHandleCommand( router, msg );
+				}
 				else
 					osrfRouterHandleAppRequest( router, msg );
 			}
@@ -331,53 +1486,58 @@ static void osrfRouterClassHandleIncoming( osrfRouter* router, const char* class
 
 		if( msg->sender ) {
 
+			// A request from a peer router is really from the client that it names
+			if( osrfRouterFromPeer( router, msg ) ) {
+				free( msg->sender );
+				msg->sender = strdup( msg->router_from );
+			}
+
 			osrfLogDebug(OSRF_LOG_MARK,
 				"osrfRouterClassHandleIncoming(): investigating message from %s", msg->sender);
 
 			/* if the client is not from a trusted domain, drop the message */
-			int len = strlen(msg->sender) + 1;
-			char domain[len];
-			jid_get_domain( msg->sender, domain, len - 1 );
+			size_t len;
+			const char* domain = jid_find_domain( msg->sender, &len );
 
-			if(osrfStringArrayContains( router->trustedClients, domain )) {
+			if( domain && osrfStringSetContainsN( router->trustedClients, domain, len )) {
 
 				if( msg->is_error )  {
 
-					// A previous message bounced.  Try to send a clone of it to a
-					// different node of the same class.
-					
+					// A previous message bounced.  If the node hadn't acknowledged it,
+					// try to send it to a different node of the same class.
+
 					// First make a local copy of the class name.  If the class gets
 					// deleted, the classname parameter becomes invalid.
 					char classname_copy[ strlen( classname ) + 1 ];
 					strcpy( classname_copy, classname );
 
-					transport_message* bouncedMessage = osrfRouterClassHandleBounce(
-							router, classname, class, msg );
-					/* handle bounced message */
-					if( !bouncedMessage ) {
-						/* we have no one to send the requested message to on our domain */
-
-                        /* XXX */
-                        /* XXX Here's where we plug in peer domains, inserting this brick into a wall */
-                        /* XXX */
-
-						message_free( msg );
-						osrfLogClearXid();
-						
-						// See if the class still exists
-						if( osrfHashGet( router->classes, classname_copy ) )
-							continue;   // It does; keep going
-						else
-							break;      // It doesn't; don't try to read from it any more
-					}
-					osrfRouterClassHandleMessage( router, class, bouncedMessage );
-					message_free( bouncedMessage );
-				} else
-					osrfRouterClassHandleMessage( router, class, msg );
+					osrfRouterClassHandleBounce( router, classname, class, msg );
+					message_free( msg );
+					osrfLogClearXid();
+
+					// See if the class still exists
+					if( osrfHashGet( router->classes, classname_copy ) )
+						continue;   // It does; keep going
+					else
+						break;      // It doesn't; don't try to read from it any more
+				} else {
+					// Route it ourselves, if we can; else pass it to a peer, if we can
+					int admitted = osrfRouterAdmit( router, class, msg );
+					if( admitted && !osrfRouterClassFull( router, class ) ) {
+						osrfRouterClassHandleMessage( router, class, msg );
+						msg = NULL;   // it's the router's now
+					} else if( osrfRouterForwardToPeer( router, class, msg ) == 0 ) {
+						msg = NULL;   // it's gone to the peer
+					} else if( admitted ) {
+						osrfRouterClassHandleMessage( router, class, msg );
+						msg = NULL;
+					} else
+						osrfRouterReject( class, msg );
+				}
 
 			} else {
 				osrfLogWarning( OSRF_LOG_MARK, 
-						"Received client message from untrusted client domain %s", domain );
+						"Received client message from untrusted client domain %s", msg->sender );
 			}
 		}
 
@@ -395,6 +1555,10 @@ static void osrfRouterClassHandleIncoming( osrfRouter* router, const char* class
 	- "register" -- Add a server class and/or a server node to our lists.
 	- "unregister" -- Remove a node from a class, and the class as well if no nodes are
 	left for it.
+	- "load" -- Update a node's capacity and load.
+
+	The body of a "register" or "load" command may carry load hints; see
+	osrfRouterNodeSetLoad().
 */
 static void osrfRouterHandleCommand( osrfRouter* router, const transport_message* msg ) {
 	if(!(router && msg && msg->router_class)) return;
@@ -409,71 +1573,577 @@ static void osrfRouterHandleCommand( osrfRouter* router, const transport_message
 			class = osrfRouterAddClass( router, msg->router_class );
 
 		// Add the node to the osrfRouterClass's list, if it isn't already there
-		if(class && ! osrfRouterClassFindNode( class, msg->sender ) )
-			osrfRouterClassAddNode( class, msg->sender );
+		if( class ) {
+			osrfRouterNode* node = osrfRouterClassFindNode( class, msg->sender );
+			if( !node )
+				node = osrfRouterClassAddNode( class, msg->sender );
+			osrfRouterNodeSetLoad( node, msg->body );
+		}
+
+	} else if( !strcmp( msg->router_command, ROUTER_UNREGISTER ) ) {
+
+		if( msg->router_class && *msg->router_class ) {
+			osrfLogInfo( OSRF_LOG_MARK, "Unregistering router class %s", msg->router_class );
+			osrfRouterClassRemoveNode( router, msg->router_class, msg->sender );
+		}
+
+	} else if( !strcmp( msg->router_command, ROUTER_LOAD ) ) {
+
+		// Ignore hints from nodes that haven't registered
+		osrfRouterNode* node = osrfRouterClassFindNode(
+				osrfRouterFindClass( router, msg->router_class ), msg->sender );
+		if( node )
+			osrfRouterNodeSetLoad( node, msg->body );
+	}
+}
+
+
+/**
+	@brief Add an osrfRouterClass to a router, and open a connection for it.
+	@param router Pointer to the osrfRouter.
+	@param classname The name of the class this node handles.
+	@return A pointer to the new osrfRouterClass, or NULL upon error.
+
+	Open a Jabber session to be used for this server class.  The Jabber ID incorporates the
+	class name as the resource name.
+*/
+static osrfRouterClass* osrfRouterAddClass( osrfRouter* router, const char* classname ) {
+	if(!(router && router->classes && classname)) return NULL;
+
+	osrfRouterClass* class = safe_malloc(sizeof(osrfRouterClass));
+	class->nodes = osrfNewHash();
+	class->itr = osrfNewHashIterator(class->nodes);
+	osrfHashSetCallback(class->nodes, &osrfRouterNodeFree);
+	// Node ids and message senders are interned, so lookups by
+	// sender usually succeed on a pointer comparison
+	osrfHashSetInternKeys(class->nodes);
+	class->router = router;
+	class->name = strdup( classname );
+	class->sock_fd = -1;
+	class->events = 0;
+	class->messages = 0;
+	class->bytes = 0;
+	class->bounces = 0;
+	class->rerouted = 0;
+	class->rejected = 0;
+	class->forwarded = 0;
+	osrfRouterRateInit( &class->rate );
+
+	const osrfRouterLimit* limit = router->class_limits ?
+			osrfHashGet( router->class_limits, classname ) : NULL;
+	class->limit = limit ? *limit : router->class_limit;
+	class->bucket.tokens = class->limit.burst;
+	class->bucket.filled = osrfRouterClockNanos();
+	class->bucket.in_flight = 0;
+	memset( &class->latency, 0, sizeof( class->latency ) );
+	osrfRouterRingInit( &class->stranded, router->retry_depth );
+
+	class->connection = client_init( router->domain, router->port, NULL, 0 );
+	client_set_compression( class->connection, router->compress );
+
+	if(!client_connect( class->connection, router->name,
+			router->password, classname, 10, AUTH_DIGEST ) ) {
+		// Cast away the constness of classname.  Though ugly, this
+		// cast is benign because osrfRouterClassFree doesn't actually
+		// write through the pointer.  We can't readily change its
+		// signature because it is used for a function pointer, and
+		// we would have to change other signatures the same way.
+		osrfRouterClassFree( (char *) classname, class );
+		return NULL;
+	}
+	client_set_nonblocking( class->connection, 1 );
+	client_set_corked( class->connection, 1 );
+
+	osrfHashSet( router->classes, class, classname );
+	class->sock_fd = client_sock_fd( class->connection );
+	osrfListSet( router->fd_classes, class, class->sock_fd );
+	osrfRouterWatch( router, class->sock_fd, &class->events, EPOLLIN );
+	return class;
+}
+
+
+/**
+	@brief Add a new server node to an osrfRouterClass.
+	@param rclass Pointer to the osrfRouterClass to which we are to add the node.
+	@param remoteId The remote login of the osrfRouterNode.
+	@return Pointer to the new osrfRouterNode, or NULL upon error.
+*/
+static osrfRouterNode* osrfRouterClassAddNode( osrfRouterClass* rclass,
+		const char* remoteId ) {
+	if(!(rclass && rclass->nodes && remoteId)) return NULL;
+
+	osrfLogInfo( OSRF_LOG_MARK, "Adding router node for remote id %s", remoteId );
+
+	osrfRouterNode* node = safe_malloc(sizeof(osrfRouterNode));
+	node->rclass = rclass;
+	node->count = 0;
+	osrfRouterRingInit( &node->sent, rclass->router->retry_depth );
+	node->remoteId = (char*) osrfIntern(remoteId);
+	node->capacity = 1;
+	node->load = 0;
+	node->unreported = 0;
+	node->aged = osrfRouterClockNanos();
+	node->hinted = 0;
+	node->bytes = 0;
+	osrfRouterRateInit( &node->rate );
+
+	osrfHashSet( rclass->nodes, node, remoteId );
+	return node;
+}
+
+/**
+	@brief Update a node's capacity and load from the hints in a command.
+	@param node Pointer to the osrfRouterNode.
+	@param hints The body of the command: a JSON object such as {"capacity":10,"load":3}.
+
+	Either member may be missing.  A body that isn't a JSON object, such as the
+	"registering" sent by listeners that don't give hints, leaves the node as it was.
+
+	A load acknowledges all but that many of the messages we've sent the node.  The first
+	one brings what we'd already sent it into flight (see osrfRouterSetClassLimit()), so
+	that it can be acknowledged like the rest.
+*/
+static void osrfRouterNodeSetLoad( osrfRouterNode* node, const char* hints ) {
+	if( !( node && hints && *hints == '{' ) )
+		return;
+
+	jsonObject* obj = jsonParse( hints );
+	if( obj && JSON_HASH == obj->type ) {
+		const jsonObject* capacity = jsonObjectGetKeyConst( obj, "capacity" );
+		if( capacity && jsonObjectGetNumber( capacity ) >= 1 )
+			node->capacity = (int) jsonObjectGetNumber( capacity );
+
+		const jsonObject* load = jsonObjectGetKeyConst( obj, "load" );
+		if( load && jsonObjectGetNumber( load ) >= 0 ) {
+			node->load = (int) jsonObjectGetNumber( load );
+			node->unreported = 0;
+			if( !node->hinted ) {
+				int i;
+				for( i = 0; i < node->sent.count; ++i )
+					osrfRouterCountInFlight( node->rclass,
+						node->sent.msgs[ ( node->sent.first + i ) % node->sent.size ], 1 );
+				node->hinted = 1;
+			}
+
+			// It's done with everything but the last few we sent it
+			osrfRouterNodeForget( node, node->load );
+		}
+	}
+	jsonObjectFree( obj );
+}
+
+/**
+	@brief Forget, gradually, the messages sent to a node that doesn't report its load.
+	@param node Pointer to the osrfRouterNode.
+	@param now The time, in monotonic nanoseconds.
+
+	Nothing tells us when such a node has finished with a message, so we suppose that it
+	finishes half of them every ROUTER_UNREPORTED_HALF_LIFE.  Otherwise what we'd sent it
+	would only ever grow, and a policy that goes by load would stop picking it.  A node
+	that reports its load says for itself what it has finished.
+*/
+static void osrfRouterNodeAge( osrfRouterNode* node, long long now ) {
+	if( node->hinted )
+		return;
+	long long halves = ( now - node->aged ) / ROUTER_UNREPORTED_HALF_LIFE;
+	if( halves <= 0 )
+		return;
+	node->unreported = halves >= 31 ? 0 : node->unreported >> halves;
+	node->aged += halves * ROUTER_UNREPORTED_HALF_LIFE;
+}
+
+/**
+	@brief Set up an empty osrfRouterRing.
+	@param ring Pointer to the osrfRouterRing.
+	@param size How many messages it can hold.
+*/
+static void osrfRouterRingInit( osrfRouterRing* ring, int size ) {
+	ring->size = size;
+	ring->msgs = safe_malloc( size * sizeof( transport_message* ) );
+	ring->first = 0;
+	ring->count = 0;
+}
+
+/**
+	@brief Add a message to an osrfRouterRing that has room for it.
+	@param ring Pointer to the osrfRouterRing.
+	@param msg Pointer to the message, which becomes the ring's.
+*/
+static void osrfRouterRingPush( osrfRouterRing* ring, transport_message* msg ) {
+	ring->msgs[ ( ring->first + ring->count ) % ring->size ] = msg;
+	ring->count++;
+}
+
+/**
+	@brief Remove the oldest message from an osrfRouterRing.
+	@param ring Pointer to the osrfRouterRing.
+	@return Pointer to the message, which the caller owns; or NULL if the ring is empty.
+*/
+static transport_message* osrfRouterRingShift( osrfRouterRing* ring ) {
+	if( 0 == ring->count )
+		return NULL;
+	transport_message* msg = ring->msgs[ ring->first ];
+	ring->first = ( ring->first + 1 ) % ring->size;
+	ring->count--;
+	return msg;
+}
+
+/**
+	@brief Remove from an osrfRouterRing the message that a bounce is of.
+	@param ring Pointer to the osrfRouterRing.
+	@param bounce Pointer to the error stanza.
+	@return Pointer to the message, which the caller owns; or NULL if it isn't in the ring.
+
+	The messages after it move up to close the gap, so the ring stays oldest first.
+*/
+static transport_message* osrfRouterRingTake( osrfRouterRing* ring,
+		const transport_message* bounce ) {
+	int i;
+	for( i = 0; i < ring->count; ++i ) {
+		transport_message* msg = ring->msgs[ ( ring->first + i ) % ring->size ];
+		if( osrfRouterIsBounceOf( bounce, msg ) ) {
+			for( ; i + 1 < ring->count; ++i )
+				ring->msgs[ ( ring->first + i ) % ring->size ] =
+						ring->msgs[ ( ring->first + i + 1 ) % ring->size ];
+			ring->count--;
+			return msg;
+		}
+	}
+	return NULL;
+}
+
+/**
+	@brief Free an osrfRouterRing's messages, and the ring itself.
+	@param ring Pointer to the osrfRouterRing.
+*/
+static void osrfRouterRingClear( osrfRouterRing* ring ) {
+	transport_message* msg;
+	while( (msg = osrfRouterRingShift( ring )) )
+		message_free( msg );
+	free( ring->msgs );
+	ring->msgs = NULL;
+}
+
+/**
+	@brief Determine whether an error stanza is the bounce of a message that we routed.
+	@param bounce Pointer to the error stanza.
+	@param sent Pointer to the message, as we routed it.
+	@return 1 if it is, or 0 if not.
+
+	It is if it comes from the message's recipient, with the same thread, and the same
+	osrf_xid if it has one.  A client may send several requests on one thread, so the
+	osrf_xid tells them apart when the thread can't.
+*/
+static int osrfRouterIsBounceOf( const transport_message* bounce,
+		const transport_message* sent ) {
+	if( !sent->recipient || strcmp( sent->recipient, bounce->sender ) )
+		return 0;
+	if( strcmp( sent->thread ? sent->thread : "", bounce->thread ? bounce->thread : "" ) )
+		return 0;
+	if( bounce->osrf_xid && *bounce->osrf_xid )
+		return sent->osrf_xid && !strcmp( sent->osrf_xid, bounce->osrf_xid );
+	return 1;
+}
+
+/**
+	@brief Keep a message that we've sent to a node, until the node acknowledges it.
+	@param node Pointer to the osrfRouterNode.
+	@param msg Pointer to the message, which becomes the node's.
+
+	If the ring is full, the oldest message makes room.  Until the node reports its load,
+	we keep only the last message sent to it, since it acknowledges nothing.
+*/
+static void osrfRouterNodeRemember( osrfRouterNode* node, transport_message* msg ) {
+	int room = node->hinted ? node->sent.size : 1;
+	while( node->sent.count >= room )
+		message_free( osrfRouterNodeTakeOldest( node ) );
+	osrfRouterRingPush( &node->sent, msg );
+	if( node->hinted )
+		osrfRouterCountInFlight( node->rclass, msg, 1 );
+}
+
+/**
+	@brief Remove the oldest message from a node's ring.
+	@param node Pointer to the osrfRouterNode.
+	@return Pointer to the message, which the caller owns; or NULL if the ring is empty.
+*/
+static transport_message* osrfRouterNodeTakeOldest( osrfRouterNode* node ) {
+	transport_message* msg = osrfRouterRingShift( &node->sent );
+	if( msg && node->hinted )
+		osrfRouterCountInFlight( node->rclass, msg, -1 );
+	return msg;
+}
+
+/**
+	@brief Remove from a node's ring the message that has bounced.
+	@param node Pointer to the osrfRouterNode.
+	@param bounce Pointer to the error stanza.
+	@return Pointer to the message, which the caller owns; or NULL if the node has
+		acknowledged it, or we've forgotten it.
+*/
+static transport_message* osrfRouterNodeTake( osrfRouterNode* node,
+		const transport_message* bounce ) {
+	transport_message* msg = osrfRouterRingTake( &node->sent, bounce );
+	if( msg && node->hinted )
+		osrfRouterCountInFlight( node->rclass, msg, -1 );
+	return msg;
+}
+
+/**
+	@brief Forget all but the most recent messages sent to a node.
+	@param node Pointer to the osrfRouterNode.
+	@param keep How many messages to keep.
+*/
+static void osrfRouterNodeForget( osrfRouterNode* node, int keep ) {
+	while( node->sent.count > keep )
+		message_free( osrfRouterNodeTakeOldest( node ) );
+}
+
+/**
+	@brief Count a message into or out of flight, for the class and the sending domain.
+	@param rclass Pointer to the osrfRouterClass.
+	@param msg Pointer to the message, as readdressed for a node.
+	@param delta 1 for a message going into a node's ring, or -1 for one leaving it.
+*/
+static void osrfRouterCountInFlight( osrfRouterClass* rclass, const transport_message* msg,
+		int delta ) {
+	rclass->bucket.in_flight += delta;
+	if( rclass->router->domains ) {
+		osrfRouterBucket* domain = osrfRouterFindDomain( rclass->router, msg->router_from, 0 );
+		if( domain )
+			domain->in_flight += delta;
+	}
+}
+
+/**
+	@brief Find the osrfRouterBucket for the domain of a Jabber ID.
+	@param router Pointer to the osrfRouter, which must have domain limits.
+	@param jid The Jabber ID.
+	@param create Boolean: true to add a bucket for a domain that hasn't one yet.
+	@return Pointer to the osrfRouterBucket, or NULL if there isn't one.
+
+	Only trusted client domains get this far, so there are never many buckets.
+*/
+static osrfRouterBucket* osrfRouterFindDomain( osrfRouter* router, const char* jid,
+		int create ) {
+	size_t len;
+	const char* start = jid_find_domain( jid, &len );
+	if( !start )
+		return NULL;
 
-	} else if( !strcmp( msg->router_command, ROUTER_UNREGISTER ) ) {
+	char domain[ len + 1 ];
+	memcpy( domain, start, len );
+	domain[ len ] = '\0';
+
+	osrfRouterBucket* bucket = osrfHashGet( router->domains, domain );
+	if( !bucket && create ) {
+		bucket = safe_malloc( sizeof( osrfRouterBucket ) );
+		bucket->tokens = router->domain_limit.burst;
+		bucket->filled = osrfRouterClockNanos();
+		bucket->in_flight = 0;
+		osrfHashSet( router->domains, bucket, domain );
+	}
+	return bucket;
+}
 
-		if( msg->router_class && *msg->router_class ) {
-			osrfLogInfo( OSRF_LOG_MARK, "Unregistering router class %s", msg->router_class );
-			osrfRouterClassRemoveNode( router, msg->router_class, msg->sender );
-		}
+/**
+	@brief Add the tokens that a bucket has earned since we last filled it.
+	@param bucket Pointer to the osrfRouterBucket.
+	@param limit Pointer to the osrfRouterLimit that it's filled by.
+	@param now The current time, from osrfRouterClockNanos().
+*/
+static void osrfRouterBucketFill( osrfRouterBucket* bucket, const osrfRouterLimit* limit,
+		long long now ) {
+	if( now > bucket->filled ) {
+		bucket->tokens += limit->rate * ( now - bucket->filled ) / 1e9;
+		if( bucket->tokens > limit->burst )
+			bucket->tokens = limit->burst;
+		bucket->filled = now;
 	}
 }
 
+/**
+	@brief Determine whether a bucket has reached either of its limits.
+	@param bucket Pointer to the osrfRouterBucket, freshly filled.
+	@param limit Pointer to its osrfRouterLimit.
+	@return 1 if we should admit no more requests for now, or 0 if we may admit one.
+*/
+static int osrfRouterBucketFull( const osrfRouterBucket* bucket,
+		const osrfRouterLimit* limit ) {
+	if( limit->rate && bucket->tokens < 1 )
+		return 1;
+	if( limit->max_in_flight && bucket->in_flight >= limit->max_in_flight )
+		return 1;
+	return 0;
+}
 
 /**
-	@brief Add an osrfRouterClass to a router, and open a connection for it.
+	@brief Decide whether to route a request, or to turn it away.
 	@param router Pointer to the osrfRouter.
-	@param classname The name of the class this node handles.
-	@return A pointer to the new osrfRouterClass, or NULL upon error.
+	@param rclass Pointer to the osrfRouterClass to which the request is addressed.
+	@param msg Pointer to the request.
+	@return 1 if the request is within the class's limits and its domain's, or 0 if not.
 
-	Open a Jabber session to be used for this server class.  The Jabber ID incorporates the
-	class name as the resource name.
+	A request that we admit takes a token from each bucket.  One that we turn away takes
+	none, so a client that keeps trying doesn't lock itself out for longer.
 */
-static osrfRouterClass* osrfRouterAddClass( osrfRouter* router, const char* classname ) {
-	if(!(router && router->classes && classname)) return NULL;
-
-	osrfRouterClass* class = safe_malloc(sizeof(osrfRouterClass));
-	class->nodes = osrfNewHash();
-	class->itr = osrfNewHashIterator(class->nodes);
-	osrfHashSetCallback(class->nodes, &osrfRouterNodeFree);
-	class->router = router;
+static int osrfRouterAdmit( osrfRouter* router, osrfRouterClass* rclass,
+		const transport_message* msg ) {
+	osrfRouterBucket* domain = NULL;
+	if( router->domains )
+		domain = osrfRouterFindDomain( router, msg->sender, 1 );
+	if( !( rclass->limit.rate || rclass->limit.max_in_flight || domain ) )
+		return 1;
+
+	long long now = osrfRouterClockNanos();
+	osrfRouterBucketFill( &rclass->bucket, &rclass->limit, now );
+	if( osrfRouterBucketFull( &rclass->bucket, &rclass->limit ) )
+		return 0;
+
+	if( domain ) {
+		osrfRouterBucketFill( domain, &router->domain_limit, now );
+		if( osrfRouterBucketFull( domain, &router->domain_limit ) )
+			return 0;
+		domain->tokens -= 1;
+	}
+	rclass->bucket.tokens -= 1;
+	return 1;
+}
 
-	class->connection = client_init( router->domain, router->port, NULL, 0 );
+/**
+	@brief Turn a request away, with a "service unavailable" status for the client.
+	@param rclass Pointer to the osrfRouterClass to which the request was addressed.
+	@param msg Pointer to the request.
 
-	if(!client_connect( class->connection, router->name,
-			router->password, classname, 10, AUTH_DIGEST ) ) {
-		// Cast away the constness of classname.  Though ugly, this
-		// cast is benign because osrfRouterClassFree doesn't actually
-		// write through the pointer.  We can't readily change its
-		// signature because it is used for a function pointer, and
-		// we would have to change other signatures the same way.
-		osrfRouterClassFree( (char *) classname, class );
-		return NULL;
-	}
+	The status is the one that a listener sends when its backlog is full, so clients
+	already know what to make of it.
+*/
+static void osrfRouterReject( osrfRouterClass* rclass, const transport_message* msg ) {
+	rclass->rejected++;
+	osrfLogInfo( OSRF_LOG_MARK, "Turning away a request from %s for %s: over the limit",
+			msg->sender, rclass->name );
+
+	osrfMessage* err = osrf_message_init( STATUS, 1, 1 );
+	osrf_message_set_status_info( err, "osrfMethodException",
+			"Service unavailable: too many requests", OSRF_STATUS_SERVICEUNAVAILABLE );
+	char* data = osrf_message_serialize( err );
+	osrfMessageFree( err );
 
-	osrfHashSet( router->classes, class, classname );
-	return class;
+	transport_message* reply = message_init( data, "", msg->thread, msg->sender, "" );
+	message_set_osrf_xid( reply, msg->osrf_xid );
+	free( data );
+	client_send_message( rclass->connection, reply );
+	message_free( reply );
 }
 
+/**
+	@brief Tell the client that a request failed, because it has nowhere to go.
+	@param rclass Pointer to the osrfRouterClass to which the request was addressed.
+	@param lost Pointer to the request, as we sent it on.
+
+	We send the request back as a Jabber error, as Jabber would if the client had sent it
+	to a listener that had gone away.
+*/
+static void osrfRouterCancel( osrfRouterClass* rclass, const transport_message* lost ) {
+	transport_message* error = message_init(
+		lost->body, lost->subject, lost->thread, lost->router_from, lost->recipient );
+	message_set_osrf_xid( error, lost->osrf_xid );
+	set_msg_error( error, "cancel", 501 );
+
+	/* send the error message back to the original sender */
+	client_send_message( rclass->connection, error );
+	message_free( error );
+}
 
 /**
-	@brief Add a new server node to an osrfRouterClass.
-	@param rclass Pointer to the osrfRouterClass to which we are to add the node.
-	@param remoteId The remote login of the osrfRouterNode.
+	@brief Determine whether every node of a class is working to its capacity.
+	@param router Pointer to the osrfRouter.
+	@param rclass Pointer to the osrfRouterClass.
+	@return 1 if a peer should take the class's next request, or 0 if we should.
+
+	We go by each node's last load hint, plus what we've sent it since.  A node that
+	doesn't report its load is never full.  Without peers, it doesn't matter.
 */
-static void osrfRouterClassAddNode( osrfRouterClass* rclass, const char* remoteId ) {
-	if(!(rclass && rclass->nodes && remoteId)) return;
+static int osrfRouterClassFull( const osrfRouter* router, osrfRouterClass* rclass ) {
+	if( !router->peers )
+		return 0;
 
-	osrfLogInfo( OSRF_LOG_MARK, "Adding router node for remote id %s", remoteId );
+	int full = 1;
+	osrfRouterNode* node;
+	osrfHashIterator* itr = osrfNewHashIterator( rclass->nodes );
+	while( full && (node = osrfHashIteratorNext( itr )) ) {
+		if( !node->hinted || node->load + node->unreported < node->capacity )
+			full = 0;
+	}
+	osrfHashIteratorFree( itr );
+	return full;
+}
 
-	osrfRouterNode* node = safe_malloc(sizeof(osrfRouterNode));
-	node->count = 0;
-	node->lastMessage = NULL;
-	node->remoteId = strdup(remoteId);
+/**
+	@brief Pass a request to the next of our peer routers.
+	@param router Pointer to the osrfRouter.
+	@param rclass Pointer to the osrfRouterClass to which the request is addressed.
+	@param msg Pointer to the request, which becomes the router's if we pass it on.
+	@return 0 if we passed it on, or -1 if we have no peers, or it has been passed on as
+		often as it may be already.
+
+	The request goes to the peer's session for the same class, with the client as its
+	router_from, as if the client had sent it there itself; and with one more hop.  Its
+	router_to names the peer, so that we can tell if it bounces.
+*/
+static int osrfRouterForwardToPeer( osrfRouter* router, osrfRouterClass* rclass,
+		transport_message* msg ) {
+	if( !router->peers || msg->router_hops >= ROUTER_MAX_HOPS )
+		return -1;
+
+	const char* peer = osrfStringArrayGetString( router->peers,
+			router->next_peer++ % router->peers->size );
+	char* peer_jid = va_list_to_string( "%s@%s/%s", router->name, peer, rclass->name );
+
+	const char* client = msg->router_from && *msg->router_from ?
+			msg->router_from : msg->sender;
+	message_readdress( msg, peer_jid, client );
+	msg->router_to = peer_jid;
+	msg->router_hops++;
+
+	osrfLogInfo( OSRF_LOG_MARK, "Passing a request for %s from %s to peer router %s",
+			rclass->name, msg->router_from, msg->recipient );
+	client_send_message( rclass->connection, msg );
+	rclass->forwarded++;
+	message_free( msg );
+	return 0;
+}
 
-	osrfHashSet( rclass->nodes, node, remoteId );
+/**
+	@brief Determine whether a message comes from one of our peer routers, on behalf of a client.
+	@param router Pointer to the osrfRouter.
+	@param msg Pointer to the message.
+	@return 1 if it does, or 0 if not.
+
+	It does if it has been passed on at least once, names a client in its router_from, and
+	was sent by a router of our name on one of our peers' domains.  A request that bounces
+	from a peer qualifies too, since the bounce comes from the peer's address.
+*/
+static int osrfRouterFromPeer( const osrfRouter* router, const transport_message* msg ) {
+	if( !router->peers || msg->router_hops < 1 || !msg->router_from || !*msg->router_from )
+		return 0;
+
+	size_t name_len = strlen( router->name );
+	if( strncmp( msg->sender, router->name, name_len ) || msg->sender[ name_len ] != '@' )
+		return 0;
+
+	size_t len;
+	const char* domain = jid_find_domain( msg->sender, &len );
+	if( !domain )
+		return 0;
+
+	int i;
+	for( i = 0; i < router->peers->size; ++i ) {
+		const char* peer = osrfStringArrayGetString( router->peers, i );
+		if( strlen( peer ) == len && !strncmp( peer, domain, len ) )
+			return 1;
+	}
+	return 0;
 }
 
 /**
@@ -482,67 +2152,90 @@ static void osrfRouterClassAddNode( osrfRouterClass* rclass, const char* remoteI
 	@param classname Name of the class to which the error stanza was sent.
 	@param rclass Pointer to the osrfRouterClass to which the error stanza was sent.
 	@param msg Pointer to the transport_message representing the error stanza.
-	@return Pointer to a newly allocated transport_message; or NULL (see remarks).
 
-	The presumption is that the relevant node is dead.  If another node is available for
-	the same class, then remove the dead one, create a clone of the message to be sent
-	elsewhere, and return a pointer to it.  If there is no other node for the same class,
-	send a cancel message back to the sender, remove both the node and the class it belongs
-	to, and return NULL.  If we can't even do that because the entire class is dead, log
-	a message to that effect and return NULL.
+	The presumption is that the relevant node is dead, so we remove it.  We send the
+	message that bounced to another node of the same class -- provided that it's one we
+	still have, which the node never acknowledged (see osrfRouterSetRetryDepth()).  If
+	there is no other node for the same class, we pass the message to a peer router, or
+	send a cancel message back to its sender, and remove the class too.
+
+	The other messages that the dead node hadn't acknowledged we keep with the class, since
+	they may bounce in their turn; when one does, it goes to another node too.  Whatever
+	doesn't bounce reached the node, and may have been answered, so we don't send it
+	twice.  When the last node goes, so does the class and its session, so nothing else
+	can bounce back to us.
+
+	Either way the class may be gone when we return, in which case @a classname and
+	@a rclass are no longer valid.
 */
-static transport_message* osrfRouterClassHandleBounce( osrfRouter* router,
+static void osrfRouterClassHandleBounce( osrfRouter* router,
 		const char* classname, osrfRouterClass* rclass, const transport_message* msg ) {
 
 	osrfLogDebug( OSRF_LOG_MARK, "osrfRouterClassHandleBounce()");
 
 	osrfLogInfo( OSRF_LOG_MARK, "Received network layer error message from %s", msg->sender );
+	rclass->bounces++;
+	transport_message* lost;
 	osrfRouterNode* node = osrfRouterClassFindNode( rclass, msg->sender );
 	if( ! node ) {
-		osrfLogInfo( OSRF_LOG_MARK,
-			"network error occurred after we removed the class.. ignoring");
-		return NULL;
+		if( msg->router_to && *msg->router_to ) {
+			// Only a request that we passed to a peer has a router_to; the peer lacks
+			// the class, so the request has nowhere left to go
+			osrfLogInfo( OSRF_LOG_MARK, "Peer router %s couldn't take a request for %s",
+					msg->router_to, rclass->name );
+			osrfRouterCancel( rclass, msg );
+		} else if( (lost = osrfRouterRingTake( &rclass->stranded, msg )) ) {
+			osrfLogInfo( OSRF_LOG_MARK, "Sending a message that %s left unacknowledged elsewhere",
+					msg->sender );
+			rclass->rerouted++;
+			osrfRouterClassHandleMessage( router, rclass, lost );
+		} else
+			osrfLogInfo( OSRF_LOG_MARK,
+				"network error occurred after we removed the node.. ignoring");
+		return;
 	}
 
+	lost = osrfRouterNodeTake( node, msg );
+	if( !lost )
+		osrfLogInfo( OSRF_LOG_MARK,
+				"%s bounced a message that it had acknowledged, or we've forgotten; "
+				"not sending it again", msg->sender );
+
 	if( osrfHashGetCount(rclass->nodes) == 1 ) { /* the last node is dead */
 
-		if( node->lastMessage ) {
+		if( lost ) {
 			osrfLogWarning( OSRF_LOG_MARK,
 					"We lost the last node in the class, responding with error and removing...");
 
-			transport_message* error = message_init(
-				node->lastMessage->body, node->lastMessage->subject,
-				node->lastMessage->thread, node->lastMessage->router_from,
-				node->lastMessage->recipient );
-			message_set_osrf_xid(error, node->lastMessage->osrf_xid);
-			set_msg_error( error, "cancel", 501 );
-
-			/* send the error message back to the original sender */
-			client_send_message( rclass->connection, error );
-			message_free( error );
+			// We have no one to send it to on our domain; pass it to our peers, if we
+			// have any that may take it, or else give up on it
+			if( osrfRouterForwardToPeer( router, rclass, lost ) ) {
+				osrfRouterCancel( rclass, lost );
+				message_free( lost );
+			}
 		}
 
 		/* remove the dead node */
 		osrfRouterClassRemoveNode( router, classname, msg->sender);
-		return NULL;
 
 	} else {
 
-		transport_message* lastSent = NULL;
-
-		if( node->lastMessage ) {
-			osrfLogDebug( OSRF_LOG_MARK, "Cloning lastMessage so next node can send it");
-			lastSent = message_init( node->lastMessage->body,
-				node->lastMessage->subject, node->lastMessage->thread, "",
-				node->lastMessage->router_from );
-			message_set_router_info( lastSent, node->lastMessage->router_from,
-				NULL, NULL, NULL, 0 );
-			message_set_osrf_xid( lastSent, node->lastMessage->osrf_xid );
+		// Keep whatever else the node hadn't acknowledged, in case it bounces too
+		transport_message* other;
+		while( (other = osrfRouterNodeTakeOldest( node )) ) {
+			if( rclass->stranded.count == rclass->stranded.size )
+				message_free( osrfRouterRingShift( &rclass->stranded ) );
+			osrfRouterRingPush( &rclass->stranded, other );
 		}
 
 		/* remove the dead node */
 		osrfRouterClassRemoveNode( router, classname, msg->sender);
-		return lastSent;
+
+		if( lost ) {
+			osrfLogInfo( OSRF_LOG_MARK, "Sending the message that bounced elsewhere" );
+			rclass->rerouted++;
+			osrfRouterClassHandleMessage( router, rclass, lost );
+		}
 	}
 }
 
@@ -551,55 +2244,165 @@ static transport_message* osrfRouterClassHandleBounce( osrfRouter* router,
 	@brief Forward a class-level message to a listener for the corresponding service.
 	@param router Pointer to the current osrfRouter.
 	@param rclass Pointer to the class to which the message is directed.
-	@param msg Pointer to the message to be forwarded.
+	@param msg Pointer to the message to be forwarded, which becomes the router's.
 
-	Pick a node for the specified class, and forward the message to it.
+	Pick a node for the specified class, according to the router's policy, and forward
+	the message to it.
 
-	We use an iterator, stored with the class, to maintain a position in the class's list
-	of nodes.  Advance the iterator to pick the next node, and if we reach the end, go
-	back to the beginning of the list.
+	Rather than build a new message, we readdress the one we received, and keep it in the
+	node's ring until the node acknowledges it.  So the body, which may be large and which
+	we never look at, is never copied; it goes straight from the parser into the outgoing
+	stanza.
+
+	We time each message from here until it's queued for sending, for the class's latency
+	histogram, and count it, and its bytes, for the class and the node.
 */
 static void osrfRouterClassHandleMessage(
-		osrfRouter* router, osrfRouterClass* rclass, const transport_message* msg ) {
-	if(!(router && rclass && msg)) return;
+		osrfRouter* router, osrfRouterClass* rclass, transport_message* msg ) {
+	if(!(router && rclass && msg)) {
+		message_free( msg );
+		return;
+	}
 
 	osrfLogDebug( OSRF_LOG_MARK, "osrfRouterClassHandleMessage()");
 
-	// Pick a node, in a round-robin.
-	osrfRouterNode* node = osrfHashIteratorNext( rclass->itr );
-	if(!node) {   // wrap around to the beginning of the list
-		osrfHashIteratorReset(rclass->itr);
-		node = osrfHashIteratorNext( rclass->itr );
-	}
+	long long start = osrfRouterClockNanos();
+	osrfRouterNode* node = router->pick_node( router, rclass );
 
 	if(node) {  // should always be true -- no class without a node
 
-		// Build a transport message
-		transport_message* new_msg = message_init( msg->body,
-				msg->subject, msg->thread, node->remoteId, msg->sender );
-		message_set_router_info( new_msg, msg->sender, NULL, NULL, NULL, 0 );
-		message_set_osrf_xid( new_msg, msg->osrf_xid );
+		message_readdress( msg, node->remoteId, msg->sender );
 
 		osrfLogInfo( OSRF_LOG_MARK,  "Routing message:\nfrom: [%s]\nto: [%s]",
-				new_msg->router_from, new_msg->recipient );
+				msg->router_from, msg->recipient );
 
-		// Save it for possible future reference
-		message_free( node->lastMessage );
-		node->lastMessage = new_msg;
+		// Save it in case the node dies
+		osrfRouterNodeRemember( node, msg );
 
-		// Send it
-		if ( client_send_message( rclass->connection, new_msg ) == 0 )
+		// Send it.  A positive return means it was queued behind a backlog; still counts.
+		if ( client_send_message( rclass->connection, msg ) >= 0 ) {
 			node->count++;
+			node->unreported++;
+
+			size_t bytes = msg->msg_xml ? strlen( msg->msg_xml ) : 0;
+			long long now = osrfRouterClockNanos();
+			node->bytes += bytes;
+			osrfRouterRateCount( &node->rate, now );
+			rclass->messages++;
+			rclass->bytes += bytes;
+			osrfRouterRateCount( &rclass->rate, now );
+			osrfRouterLatencyAdd( &rclass->latency, now - start );
+
+			// Only the message itself is needed again, if it bounces; not its XML
+			free( msg->msg_xml );
+			msg->msg_xml = NULL;
+		}
 
 		else {
-			message_prepare_xml(new_msg);
+			message_prepare_xml(msg);
 			osrfLogWarning( OSRF_LOG_MARK, "Error sending message from %s to %s\n%s",
-					new_msg->sender, new_msg->recipient, new_msg->msg_xml );
+					msg->sender, msg->recipient, msg->msg_xml );
 		}
-		// We don't free new_msg here because we saved it as node->lastMessage.
+		// We don't free msg here because we saved it in the node's ring.
+	} else
+		message_free( msg );
+}
+
+
+/**
+	@brief Routing policy: pick the next node of a class, in a round robin.
+	@param router Pointer to the osrfRouter (not used).
+	@param rclass Pointer to the osrfRouterClass.
+	@return Pointer to the node, or NULL if the class has none.
+
+	We use an iterator, stored with the class, to maintain a position in the class's list
+	of nodes.  Advance the iterator to pick the next node, and if we reach the end, go
+	back to the beginning of the list.
+*/
+static osrfRouterNode* osrfRouterPickRoundRobin( osrfRouter* router,
+		osrfRouterClass* rclass ) {
+	osrfRouterNode* node = osrfHashIteratorNext( rclass->itr );
+	if(!node) {   // wrap around to the beginning of the list
+		osrfHashIteratorReset(rclass->itr);
+		node = osrfHashIteratorNext( rclass->itr );
+	}
+	return node;
+}
+
+/**
+	@brief Compare the loads of two nodes, relative to their capacities.
+	@return True if @a a is less loaded than @a b.
+*/
+static int osrfRouterNodeLighter( const osrfRouterNode* a, const osrfRouterNode* b ) {
+	// a_load / a_capacity < b_load / b_capacity, without dividing
+	return (long long) ( a->load + a->unreported ) * b->capacity
+		< (long long) ( b->load + b->unreported ) * a->capacity;
+}
+
+/**
+	@brief Routing policy: pick the node of a class with the least load for its capacity.
+	@param router Pointer to the osrfRouter (not used).
+	@param rclass Pointer to the osrfRouterClass.
+	@return Pointer to the node, or NULL if the class has none.
+
+	Of nodes equally loaded, we pick the first.  Every message we route to it adds to its
+	load, so the next message goes elsewhere.  A node that doesn't report its load counts
+	as having room for one request, and what we've sent it fades with time.
+*/
+static osrfRouterNode* osrfRouterPickLeastLoaded( osrfRouter* router,
+		osrfRouterClass* rclass ) {
+	long long now = osrfRouterClockNanos();
+	osrfRouterNode* best = NULL;
+	osrfRouterNode* node;
+	osrfHashIteratorReset( rclass->itr );
+	while( (node = osrfHashIteratorNext( rclass->itr )) ) {
+		osrfRouterNodeAge( node, now );
+		if( !best || osrfRouterNodeLighter( node, best ) )
+			best = node;
 	}
+	return best;
 }
 
+/**
+	@brief Routing policy: pick two nodes of a class at random, and take the less loaded.
+	@param router Pointer to the osrfRouter, for its random number state.
+	@param rclass Pointer to the osrfRouterClass.
+	@return Pointer to the node, or NULL if the class has none.
+*/
+static osrfRouterNode* osrfRouterPickTwoChoices( osrfRouter* router,
+		osrfRouterClass* rclass ) {
+	unsigned long count = osrfHashGetCount( rclass->nodes );
+	if( count < 2 ) {
+		osrfHashIteratorReset( rclass->itr );
+		return osrfHashIteratorNext( rclass->itr );
+	}
+
+	// Two distinct positions in the list of nodes
+	unsigned long first = rand_r( &router->seed ) % count;
+	unsigned long second = rand_r( &router->seed ) % ( count - 1 );
+	if( second >= first )
+		++second;
+
+	osrfRouterNode* a = NULL;
+	osrfRouterNode* b = NULL;
+	osrfRouterNode* node;
+	unsigned long i = 0;
+	osrfHashIteratorReset( rclass->itr );
+	while( (node = osrfHashIteratorNext( rclass->itr )) && !( a && b ) ) {
+		if( i == first )
+			a = node;
+		else if( i == second )
+			b = node;
+		++i;
+	}
+
+	if( !( a && b ) )
+		return a ? a : b;
+	long long now = osrfRouterClockNanos();
+	osrfRouterNodeAge( a, now );
+	osrfRouterNodeAge( b, now );
+	return osrfRouterNodeLighter( b, a ) ? b : a;
+}
 
 /**
 	@brief Remove a given osrfRouterClass from an osrfRouter
@@ -653,6 +2456,15 @@ static void osrfRouterClassFree( char* classname, void* c ) {
 	if( !c )
 		return;
 	osrfRouterClass* rclass = (osrfRouterClass*) c;
+	osrfRouter* router = rclass->router;
+
+	// Stop watching the socket before closing it
+	if( rclass->sock_fd >= 0 ) {
+		if( router->epoll_fd >= 0 && rclass->events )
+			epoll_ctl( router->epoll_fd, EPOLL_CTL_DEL, rclass->sock_fd, NULL );
+		if( osrfListGetIndex( router->fd_classes, rclass->sock_fd ) == rclass )
+			osrfListRemove( router->fd_classes, rclass->sock_fd );
+	}
 	client_disconnect( rclass->connection );
 	client_free( rclass->connection );
 
@@ -664,7 +2476,9 @@ static void osrfRouterClassFree( char* classname, void* c ) {
 
 	osrfHashIteratorFree(rclass->itr);
 	osrfHashFree(rclass->nodes);
+	osrfRouterRingClear( &rclass->stranded );
 
+	free(rclass->name);
 	free(rclass);
 }
 
@@ -678,8 +2492,9 @@ static void osrfRouterClassFree( char* classname, void* c ) {
 static void osrfRouterNodeFree( char* remoteId, void* n ) {
 	if(!n) return;
 	osrfRouterNode* node = (osrfRouterNode*) n;
-	free(node->remoteId);
-	message_free(node->lastMessage);
+	osrfInternRelease(node->remoteId);
+	osrfRouterNodeForget( node, 0 );
+	free( node->sent.msgs );
 	free(node);
 }
 
@@ -694,15 +2509,18 @@ static void osrfRouterNodeFree( char* remoteId, void* n ) {
 void osrfRouterFree( osrfRouter* router ) {
 	if(!router) return;
 
-	osrfHashIteratorFree( router->class_itr);
 	osrfHashFree(router->classes);
+	osrfListFree(router->fd_classes);
 	free(router->domain);
 	free(router->name);
 	free(router->resource);
 	free(router->password);
 
-	osrfStringArrayFree( router->trustedClients );
-	osrfStringArrayFree( router->trustedServers );
+	osrfStringSetFree( router->trustedClients );
+	osrfStringSetFree( router->trustedServers );
+	osrfHashFree( router->class_limits );
+	osrfHashFree( router->domains );
+	osrfStringArrayFree( router->peers );
 	osrfListFree( router->message_list );
 
 	client_free( router->connection );
@@ -735,51 +2553,6 @@ static osrfRouterNode* osrfRouterClassFindNode( osrfRouterClass* rclass,
 }
 
 
-/**
-	@brief Fill an fd_set with all the sockets owned by the osrfRouter.
-	@param router Pointer to the osrfRouter whose sockets are to be used.
-	@param set Pointer to the fd_set that is to be filled.
-	@return The largest file descriptor loaded into the fd_set; or -1 upon error.
-
-	There's one socket for the osrfRouter as a whole, and one for each osrfRouterClass
-	that belongs to it.  We load them all.
-*/
-static int _osrfRouterFillFDSet( osrfRouter* router, fd_set* set ) {
-	if(!(router && router->classes && set)) return -1;
-
-	FD_ZERO(set);
-	int maxfd = client_sock_fd( router->connection );
-	FD_SET(maxfd, set);
-
-	int sockid;
-
-	osrfRouterClass* class = NULL;
-	osrfHashIterator* itr = router->class_itr;
-	osrfHashIteratorReset( itr );
-
-	while( (class = osrfHashIteratorNext(itr)) ) {
-		const char* classname = osrfHashIteratorKey(itr);
-
-		if( classname && (class = osrfRouterFindClass( router, classname )) ) {
-			sockid = client_sock_fd( class->connection );
-
-			if( osrfUtilsCheckFileDescriptor( sockid ) ) {
-
-				osrfLogWarning(OSRF_LOG_MARK,
-					"Removing router class '%s' because of a bad top-level file descriptor [%d]",
-					classname, sockid );
-				osrfRouterRemoveClass( router, classname );
-
-			} else {
-				if( sockid > maxfd ) maxfd = sockid;
-				FD_SET(sockid, set);
-			}
-		}
-	}
-
-	return maxfd;
-}
-
 /**
 	@brief Handler a router-level message that isn't a command; presumed to be an app request.
 	@param router Pointer to the current osrfRouter.
@@ -789,9 +2562,49 @@ static int _osrfRouterFillFDSet( osrfRouter* router, fd_set* set ) {
 	Translate the JSON into a series of osrfMessages, one for each element of the JSON
 	array.  Process each osrfMessage in turn.  Each message is either a CONNECT or a
 	REQUEST.
+
+	Only a request for one of our own methods needs its parameters.  For anything else --
+	a CONNECT, a request that we'll answer with "method not found", or a message that we
+	ignore -- a scan of the JSON tells us enough, however big the body is, without
+	building a jsonObject tree for it.
 */
 static void osrfRouterHandleAppRequest( osrfRouter* router, const transport_message* msg ) {
 
+	osrfMessageSummary scanned[ ROUTER_SCAN_MESSAGES ];
+	int count = osrfMessageScan( msg->body, scanned, ROUTER_SCAN_MESSAGES );
+	int parse = count < 0 || count > ROUTER_SCAN_MESSAGES;
+	int n;
+	for( n = 0; n < count && !parse; ++n ) {
+		if( REQUEST == scanned[ n ].m_type && scanned[ n ].method_name && !strncmp(
+				scanned[ n ].method_name, ROUTER_REQUEST_PREFIX, strlen( ROUTER_REQUEST_PREFIX ) ) )
+			parse = 1;
+	}
+
+	if( !parse ) {
+		for( n = 0; n < count; ++n ) {
+			const osrfMessageSummary* summary = &scanned[ n ];
+			switch( summary->m_type ) {
+
+				case CONNECT:
+					osrfRouterRespondConnect( router, msg, summary->thread_trace,
+						summary->protocol );
+					break;
+
+				case REQUEST:
+					if( summary->method_name ) {
+						osrfLogInfo( OSRF_LOG_MARK, "Router received app request: %.*s",
+							(int) summary->method_len, summary->method_name );
+						osrfRouterHandleMethodNFound( router, msg, summary->thread_trace );
+					}
+					break;
+
+				default:
+					break;
+			}
+		}
+		return;
+	}
+
 	// Translate the JSON into a list of osrfMessages
 	router->message_list = osrfMessageDeserialize( msg->body, router->message_list );
 	const osrfMessage* omsg = NULL;
@@ -806,7 +2619,7 @@ static void osrfRouterHandleAppRequest( osrfRouter* router, const transport_mess
 			switch( omsg->m_type ) {
 
 				case CONNECT:
-					osrfRouterRespondConnect( router, msg, omsg );
+					osrfRouterRespondConnect( router, msg, omsg->thread_trace, omsg->protocol );
 					break;
 
 				case REQUEST:
@@ -827,7 +2640,8 @@ static void osrfRouterHandleAppRequest( osrfRouter* router, const transport_mess
 	@brief Respond to a CONNECT message.
 	@param router Pointer to the current osrfRouter.
 	@param msg Pointer to the transport_message that the osrfMessage came from.
-	@param omsg Pointer to the osrfMessage to be processed.
+	@param thread_trace Thread trace of the CONNECT message.
+	@param protocol Protocol of the CONNECT message.
 
 	An application is trying to connect to the router.  Reply with a STATUS message
 	signifying success.
@@ -837,14 +2651,14 @@ static void osrfRouterHandleAppRequest( osrfRouter* router, const transport_mess
 	and that the client has a good address for it.
 */
 static void osrfRouterRespondConnect( osrfRouter* router, const transport_message* msg,
-		const osrfMessage* omsg ) {
-	if(!(router && msg && omsg))
+		int thread_trace, int protocol ) {
+	if(!(router && msg))
 		return;
 
 	osrfLogDebug( OSRF_LOG_MARK, "router received a CONNECT message from %s", msg->sender );
 
 	// Build a success message
-	osrfMessage* success = osrf_message_init( STATUS, omsg->thread_trace, omsg->protocol );
+	osrfMessage* success = osrf_message_init( STATUS, thread_trace, protocol );
 	osrf_message_set_status_info(
 		success, "osrfConnectStatus", "Connection Successful", OSRF_STATUS_OK );
 
@@ -881,6 +2695,8 @@ static void osrfRouterRespondConnect( osrfRouter* router, const transport_messag
 	- "opensrf.router.info.stats.class" -- count for every node of a specified class.
 	- "opensrf.router.info.stats.class.all" -- count for every node of every class.
 	- "opensrf.router.info.stats.class.node.all" -- total count for every class.
+	- "opensrf.router.info.stats" -- rates, byte counts, bounces, backlogs and routing
+	latencies for a specified class, or for every class; see osrfRouterClassStats().
 */
 static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_message* msg,
 		const osrfMessage* omsg ) {
@@ -890,9 +2706,42 @@ static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_mes
 
 	osrfLogInfo( OSRF_LOG_MARK, "Router received app request: %s", omsg->method_name );
 
+	jsonObject* jresponse = NULL;
+	if( osrfRouterInfo( router, omsg->method_name, omsg->_params, &jresponse ) ) {
+		osrfRouterHandleMethodNFound( router, msg, omsg->thread_trace );
+		return;
+	}
+
+	// With workers, the classes are theirs; ask them
+	if( router->workers )
+		osrfRouterGatherInfo( router, omsg->method_name, omsg->_params, jresponse );
+
+	// Send the result back to the requester.
+	osrfRouterSendAppResponse( router, msg, omsg, jresponse );
+	jsonObjectFree(jresponse);
+}
+
+/**
+	@brief Build the answer to a request for information about our classes.
+	@param router Pointer to the current osrfRouter.
+	@param method Name of the request.
+	@param params Parameters of the request, if any.
+	@param result Pointer through which to return the answer, which the caller is
+		responsible for freeing.  It's NULL if a request about a class doesn't name one.
+	@return 0 if successful, or -1 if we don't know the request.
+
+	A class that we don't have counts as having no nodes.
+*/
+static int osrfRouterInfo( osrfRouter* router, const char* method,
+		const jsonObject* params, jsonObject** result ) {
+
+	*result = NULL;
+	if( !method )
+		return -1;
+
 	// Branch on the request type.  Build a jsonObject as an answer to the request.
 	jsonObject* jresponse = NULL;
-	if(!strcmp( omsg->method_name, ROUTER_REQUEST_CLASS_LIST )) {
+	if(!strcmp( method, ROUTER_REQUEST_CLASS_LIST )) {
 
 		// Prepare an array of class names.
 		int i;
@@ -903,22 +2752,22 @@ static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_mes
 			jsonObjectPush( jresponse, jsonNewObject(osrfStringArrayGetString( keys, i )) );
 		osrfStringArrayFree(keys);
 
-	} else if(!strcmp( omsg->method_name, ROUTER_REQUEST_STATS_CLASS_SUMMARY )) {
+	} else if(!strcmp( method, ROUTER_REQUEST_STATS_CLASS_SUMMARY )) {
 
 		// Prepare a count of all the messages successfully routed for a given class.
 		int count = 0;
 
 		// class name is the first parameter
-		const char* classname = jsonObjectGetString( jsonObjectGetIndex( omsg->_params, 0 ) );
+		const char* classname = jsonObjectGetString( jsonObjectGetIndex( params, 0 ) );
 		if (!classname)
-			return;
+			return 0;
 
 		osrfRouterClass* class = osrfHashGet(router->classes, classname);
 
 		// For each node: add the count to the total.
 		osrfRouterNode* node;
-		osrfHashIterator* node_itr = osrfNewHashIterator(class->nodes);
-		while( (node = osrfHashIteratorNext(node_itr)) ) {
+		osrfHashIterator* node_itr = class ? osrfNewHashIterator(class->nodes) : NULL;
+		while( node_itr && (node = osrfHashIteratorNext(node_itr)) ) {
 			count += node->count;
 			// jsonObjectSetKey( class_res, node->remoteId, 
 			//       jsonNewNumberObject( (double) node->count ) );
@@ -927,29 +2776,29 @@ static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_mes
 
 		jresponse = jsonNewNumberObject( (double) count );
 
-	} else if(!strcmp( omsg->method_name, ROUTER_REQUEST_STATS_CLASS )) {
+	} else if(!strcmp( method, ROUTER_REQUEST_STATS_CLASS )) {
 
 		// Prepare a hash for a given class.  Key: the remoteId of a node.  Datum: the
 		// number of messages successfully routed for that node.
 
 		// class name is the first parameter
-		const char* classname = jsonObjectGetString( jsonObjectGetIndex( omsg->_params, 0 ) );
+		const char* classname = jsonObjectGetString( jsonObjectGetIndex( params, 0 ) );
 		if (!classname)
-			return;
+			return 0;
 
 		jresponse = jsonNewObjectType(JSON_HASH);
 		osrfRouterClass* class = osrfHashGet(router->classes, classname);
 
 		// For each node: get the count and store it in the hash.
 		osrfRouterNode* node;
-		osrfHashIterator* node_itr = osrfNewHashIterator(class->nodes);
-		while( (node = osrfHashIteratorNext(node_itr)) ) {
+		osrfHashIterator* node_itr = class ? osrfNewHashIterator(class->nodes) : NULL;
+		while( node_itr && (node = osrfHashIteratorNext(node_itr)) ) {
 			jsonObjectSetKey( jresponse, node->remoteId,
 					jsonNewNumberObject( (double) node->count ) );
 		}
 		osrfHashIteratorFree(node_itr);
 
-	} else if(!strcmp( omsg->method_name, ROUTER_REQUEST_STATS_CLASS_FULL )) {
+	} else if(!strcmp( method, ROUTER_REQUEST_STATS_CLASS_FULL )) {
 
 		// Prepare a hash of hashes, giving the message counts for each node for each class.
 
@@ -977,7 +2826,7 @@ static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_mes
 
 		osrfHashIteratorFree(class_itr);
 
-	} else if(!strcmp( omsg->method_name, ROUTER_REQUEST_STATS_NODE_FULL )) {
+	} else if(!strcmp( method, ROUTER_REQUEST_STATS_NODE_FULL )) {
 
 		// Prepare a hash. Key: class name.  Datum: total number of successfully routed
 		// messages routed for nodes of that class.
@@ -1003,29 +2852,305 @@ static void osrfRouterProcessAppRequest( osrfRouter* router, const transport_mes
 
 		osrfHashIteratorFree(class_itr);
 
+	} else if(!strcmp( method, ROUTER_REQUEST_STATS )) {
+
+		// Prepare a hash.  Key: class name.  Datum: the class's statistics, including
+		// those of each node.  An optional first parameter names the only class wanted.
+
+		const char* classname = jsonObjectGetString( jsonObjectGetIndex( params, 0 ) );
+		jresponse = jsonNewObjectType(JSON_HASH);
+
+		if( classname ) {
+			osrfRouterClass* class = osrfHashGet( router->classes, classname );
+			if( class )
+				jsonObjectSetKey( jresponse, classname, osrfRouterClassStats( class, 1 ) );
+		} else {
+			osrfRouterClass* class;
+			osrfHashIterator* class_itr = osrfNewHashIterator(router->classes);
+			while( (class = osrfHashIteratorNext(class_itr)) )
+				jsonObjectSetKey( jresponse, osrfHashIteratorKey(class_itr),
+						osrfRouterClassStats( class, 1 ) );
+			osrfHashIteratorFree(class_itr);
+		}
+
 	} else {  // None of the above
+		return -1;
+	}
+
+	*result = jresponse;
+	return 0;
+}
+
+
+/**
+	@brief Read a monotonic clock, with the precision needed to time a routed message.
+	@return Nanoseconds since some unspecified starting point.
+*/
+static long long osrfRouterClockNanos( void ) {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+	@brief Start a message rate at zero.
+	@param rate Pointer to the osrfRouterRate.
+*/
+static void osrfRouterRateInit( osrfRouterRate* rate ) {
+	rate->rate = 0.0;
+	rate->second = osrfRouterClockNanos() / 1000000000LL;
+	rate->count = 0;
+}
 
-		osrfRouterHandleMethodNFound( router, msg, omsg );
+/**
+	@brief Bring a message rate up to date, folding in the seconds that have ended.
+	@param rate Pointer to the osrfRouterRate.
+	@param second The current second, by the monotonic clock.
+
+	Each quiet second decays the average by ROUTER_RATE_DECAY.  After ten minutes of them
+	there's nothing worth keeping.
+*/
+static void osrfRouterRateAdvance( osrfRouterRate* rate, long long second ) {
+	if( second <= rate->second )
 		return;
+
+	rate->rate = rate->rate * ROUTER_RATE_DECAY
+		+ (double) rate->count * ( 1.0 - ROUTER_RATE_DECAY );
+	rate->count = 0;
+
+	long long quiet = second - rate->second - 1;
+	if( quiet > 600 )
+		rate->rate = 0.0;
+	else
+		while( quiet-- > 0 )
+			rate->rate *= ROUTER_RATE_DECAY;
+	rate->second = second;
+}
+
+/**
+	@brief Count a message toward a rate.
+	@param rate Pointer to the osrfRouterRate.
+	@param now The current time, from osrfRouterClockNanos().
+*/
+static void osrfRouterRateCount( osrfRouterRate* rate, long long now ) {
+	osrfRouterRateAdvance( rate, now / 1000000000LL );
+	rate->count++;
+}
+
+/**
+	@brief Report a rate.
+	@param rate Pointer to the osrfRouterRate.
+	@param now The current time, from osrfRouterClockNanos().
+	@return Messages per second, averaged over the seconds that have ended.
+*/
+static double osrfRouterRateGet( osrfRouterRate* rate, long long now ) {
+	osrfRouterRateAdvance( rate, now / 1000000000LL );
+	return rate->rate;
+}
+
+/**
+	@brief Find the bucket of a latency histogram that a latency belongs to.
+	@param ns The latency, in nanoseconds.
+	@return The index of the bucket.
+
+	As in an HDR histogram, the buckets are linear within each power of two, and
+	logarithmic across them.  Latencies below 16 ns have a bucket apiece; above that, each
+	power of two is split into 8 buckets, so that a bucket's width is never more than an
+	eighth of the latencies in it.  The last bucket, from about 2^40 ns (18 minutes), takes
+	anything longer.
+*/
+static int osrfRouterLatencyBucket( long long ns ) {
+	if( ns < 8 )
+		return ns < 0 ? 0 : (int) ns;
+
+	int shift = 0;
+	while( ( ns >> shift ) >= 16 )
+		shift++;
+	int index = ( shift + 1 ) * 8 + (int) ( ( ns >> shift ) - 8 );
+	return index < ROUTER_LATENCY_BUCKETS ? index : ROUTER_LATENCY_BUCKETS - 1;
+}
+
+/**
+	@brief Record a latency in a histogram.
+	@param latency Pointer to the osrfRouterLatency.
+	@param ns The latency, in nanoseconds.
+*/
+static void osrfRouterLatencyAdd( osrfRouterLatency* latency, long long ns ) {
+	latency->buckets[ osrfRouterLatencyBucket( ns ) ]++;
+	latency->count++;
+	if( ns > latency->max )
+		latency->max = ns;
+}
+
+/**
+	@brief Estimate a percentile of the latencies in a histogram.
+	@param latency Pointer to the osrfRouterLatency.
+	@param fraction Which percentile, as a fraction: 0.99 for the 99th.
+	@return The latency, in microseconds, below which that fraction of them fall; or 0
+		if there are none.
+
+	We report the top of the bucket where the percentile falls (but no more than the
+	greatest latency), so the estimate errs on the high side, by up to an eighth.
+*/
+static double osrfRouterLatencyPercentile( const osrfRouterLatency* latency,
+		double fraction ) {
+	if( 0 == latency->count )
+		return 0.0;
+
+	unsigned long rank = (unsigned long) ( fraction * latency->count );
+	if( rank < latency->count * fraction || 0 == rank )
+		rank++;
+
+	unsigned long seen = 0;
+	int i;
+	for( i = 0; i < ROUTER_LATENCY_BUCKETS - 1; ++i ) {
+		seen += latency->buckets[ i ];
+		if( seen >= rank )
+			break;
 	}
 
-	// Send the result back to the requester.
-	osrfRouterSendAppResponse( router, msg, omsg, jresponse );
-	jsonObjectFree(jresponse);
+	long long top;
+	if( i < 8 )
+		top = i;
+	else {
+		int shift = i / 8 - 1;
+		top = ( (long long) ( i % 8 + 9 ) << shift ) - 1;
+	}
+	if( top > latency->max )
+		top = latency->max;
+	return top / 1000.0;
+}
+
+/**
+	@brief Make a JSON number of a rate or a latency, to three decimal places.
+	@param num The number.
+	@return A JSON number, which the caller is responsible for freeing.
+
+	More digits than that would be noise, and would clutter the log.
+*/
+static jsonObject* osrfRouterStatNumber( double num ) {
+	char buf[ 64 ];
+	snprintf( buf, sizeof( buf ), "%.3f", num );
+	return jsonNewNumberStringObject( buf );
+}
+
+/**
+	@brief Describe a class's traffic, for "opensrf.router.info.stats" or the log.
+	@param rclass Pointer to the osrfRouterClass.
+	@param with_nodes Boolean: true to describe each node as well.
+	@return A JSON hash, which the caller is responsible for freeing.
+
+	The hash holds:
+	- "messages" -- how many messages we've routed to the class;
+	- "rate" -- how many per second, averaged over about a minute;
+	- "bytes" -- how many bytes of stanzas we've routed to it;
+	- "bounces" -- how many messages have bounced from its nodes;
+	- "rerouted" -- how many we've sent to another node after a bounce;
+	- "rejected" -- how many requests we've turned away, over the limits;
+	- "forwarded" -- how many we've passed to peer routers;
+	- "in_flight" -- how many messages its nodes that report their load haven't
+	acknowledged, as far as we count;
+	- "backlog" -- how many requests we reckon its nodes have in hand, from their last
+	load hints and what we've sent them since (so it's only as fresh as their hints);
+	- "queued_bytes" -- how much output we've queued, waiting for Jabber to take it;
+	- "latency" -- how long we've taken to route a message, from receiving it to queuing
+	it: "count", and "p50", "p99", "p999" and "max" in microseconds;
+	- "nodes" -- if requested, a hash of each node's "messages", "rate", "bytes",
+	"capacity", "load" and "backlog".
+*/
+static jsonObject* osrfRouterClassStats( osrfRouterClass* rclass, int with_nodes ) {
+	long long now = osrfRouterClockNanos();
+	jsonObject* stats = jsonNewObjectType( JSON_HASH );
+	jsonObject* nodes = with_nodes ? jsonNewObjectType( JSON_HASH ) : NULL;
+	long backlog = 0;
+
+	osrfRouterNode* node;
+	osrfHashIterator* node_itr = osrfNewHashIterator( rclass->nodes );
+	while( (node = osrfHashIteratorNext( node_itr )) ) {
+		osrfRouterNodeAge( node, now );
+		backlog += node->load + node->unreported;
+		if( !nodes )
+			continue;
+
+		jsonObject* node_stats = jsonNewObjectType( JSON_HASH );
+		jsonObjectSetKey( node_stats, "messages", jsonNewNumberObject( node->count ) );
+		jsonObjectSetKey( node_stats, "rate",
+				osrfRouterStatNumber( osrfRouterRateGet( &node->rate, now ) ) );
+		jsonObjectSetKey( node_stats, "bytes", jsonNewNumberObject( node->bytes ) );
+		jsonObjectSetKey( node_stats, "capacity", jsonNewNumberObject( node->capacity ) );
+		jsonObjectSetKey( node_stats, "load", jsonNewNumberObject( node->load ) );
+		jsonObjectSetKey( node_stats, "backlog",
+				jsonNewNumberObject( node->load + node->unreported ) );
+		jsonObjectSetKey( nodes, node->remoteId, node_stats );
+	}
+	osrfHashIteratorFree( node_itr );
+
+	jsonObjectSetKey( stats, "messages", jsonNewNumberObject( rclass->messages ) );
+	jsonObjectSetKey( stats, "rate",
+			osrfRouterStatNumber( osrfRouterRateGet( &rclass->rate, now ) ) );
+	jsonObjectSetKey( stats, "bytes", jsonNewNumberObject( rclass->bytes ) );
+	jsonObjectSetKey( stats, "bounces", jsonNewNumberObject( rclass->bounces ) );
+	jsonObjectSetKey( stats, "rerouted", jsonNewNumberObject( rclass->rerouted ) );
+	jsonObjectSetKey( stats, "rejected", jsonNewNumberObject( rclass->rejected ) );
+	jsonObjectSetKey( stats, "forwarded", jsonNewNumberObject( rclass->forwarded ) );
+	jsonObjectSetKey( stats, "in_flight", jsonNewNumberObject( rclass->bucket.in_flight ) );
+	jsonObjectSetKey( stats, "backlog", jsonNewNumberObject( backlog ) );
+	jsonObjectSetKey( stats, "queued_bytes",
+			jsonNewNumberObject( client_pending( rclass->connection ) ) );
+
+	const osrfRouterLatency* latency = &rclass->latency;
+	jsonObject* latency_stats = jsonNewObjectType( JSON_HASH );
+	jsonObjectSetKey( latency_stats, "count", jsonNewNumberObject( latency->count ) );
+	jsonObjectSetKey( latency_stats, "p50",
+			osrfRouterStatNumber( osrfRouterLatencyPercentile( latency, 0.5 ) ) );
+	jsonObjectSetKey( latency_stats, "p99",
+			osrfRouterStatNumber( osrfRouterLatencyPercentile( latency, 0.99 ) ) );
+	jsonObjectSetKey( latency_stats, "p999",
+			osrfRouterStatNumber( osrfRouterLatencyPercentile( latency, 0.999 ) ) );
+	jsonObjectSetKey( latency_stats, "max", osrfRouterStatNumber( latency->max / 1000.0 ) );
+	jsonObjectSetKey( stats, "latency", latency_stats );
+
+	if( nodes )
+		jsonObjectSetKey( stats, "nodes", nodes );
+	return stats;
 }
 
+/**
+	@brief Log a one-line summary of every class's traffic.
+	@param router Pointer to the osrfRouter.
+
+	A process with no classes -- such as the control process, when there are workers --
+	has nothing to say.
+*/
+static void osrfRouterLogStats( osrfRouter* router ) {
+	if( 0 == osrfHashGetCount( router->classes ) )
+		return;
+
+	jsonObject* summary = jsonNewObjectType( JSON_HASH );
+	osrfRouterClass* class;
+	osrfHashIterator* class_itr = osrfNewHashIterator( router->classes );
+	while( (class = osrfHashIteratorNext( class_itr )) )
+		jsonObjectSetKey( summary, osrfHashIteratorKey( class_itr ),
+				osrfRouterClassStats( class, 0 ) );
+	osrfHashIteratorFree( class_itr );
+
+	char* json = jsonObjectToJSON( summary );
+	osrfLogInfo( OSRF_LOG_MARK, "Router stats: %s", json );
+	free( json );
+	jsonObjectFree( summary );
+}
 
 /**
 	@brief Respond to an invalid REQUEST message.
 	@param router Pointer to the current osrfRouter.
 	@param msg Pointer to the transport_message that contained the REQUEST message.
-	@param omsg Pointer to the osrfMessage that contained the REQUEST.
+	@param thread_trace Thread trace of the REQUEST message.
 */
 static void osrfRouterHandleMethodNFound( osrfRouter* router,
-		const transport_message* msg, const osrfMessage* omsg ) {
+		const transport_message* msg, int thread_trace ) {
 
 	// Create an exception message
-	osrfMessage* err = osrf_message_init( STATUS, omsg->thread_trace, 1 );
+	osrfMessage* err = osrf_message_init( STATUS, thread_trace, 1 );
 	osrf_message_set_status_info( err,
 			"osrfMethodException", "Router method not found", OSRF_STATUS_NOTFOUND );
 
@@ -7,8 +7,10 @@
 
 	The router receives messages from clients and passes each one to a listener for the
 	targeted service.  Where there are multiple listeners for the same service, the router
-	picks one on a round-robin basis.  If a message bounces because the listener has died,
-	the router sends it to another listener for the same service, if one is available.
+	picks one on a round-robin basis, or according to the load that the listeners report.
+	If a message bounces because the listener has died, the router sends it, along with any
+	others that the listener hadn't finished with, to another listener for the same service,
+	if one is available.
 
 	The server's response to the client, if any, bypasses the router.  If the server needs to
 	set up a stateful session with a client, it does so directly (well, via Jabber).  Only the
@@ -20,6 +22,9 @@
 
 	It also responds to requests for information about the number of messages routed to
 	different services and listeners.
+
+	A busy router may shard its services across several worker processes, so as to route
+	on more than one CPU.
 */
 
 /*
@@ -38,6 +43,24 @@ osrfRouter* osrfNewRouter( const char* domain, const char* name, const char* res
 	const char* password, int port, osrfStringArray* trustedClients,
 	osrfStringArray* trustedServers );
 
+void osrfRouterSetCompression( osrfRouter* router, int compress );
+
+int osrfRouterSetPolicy( osrfRouter* router, const char* policy );
+
+void osrfRouterSetRetryDepth( osrfRouter* router, int depth );
+
+void osrfRouterSetWorkers( osrfRouter* router, int count );
+
+void osrfRouterSetStatsInterval( osrfRouter* router, int seconds );
+
+void osrfRouterSetClassLimit( osrfRouter* router, const char* classname, double rate,
+	double burst, int max_in_flight );
+
+void osrfRouterSetDomainLimit( osrfRouter* router, double rate, double burst,
+	int max_in_flight );
+
+void osrfRouterAddPeer( osrfRouter* router, const char* domain );
+
 int osrfRouterConnect( osrfRouter* router );
 
 void osrfRouterRun( osrfRouter* router );
@@ -32,6 +32,7 @@ static osrfRouter* router = NULL;
 static volatile sig_atomic_t stop_signal = 0;
 
 static void setupRouter( const jsonObject* configChunk, int configPos );
+static void setupLimits( const jsonObject* limits );
 
 /* I think it's important these following things not be static */
 pid_t* daemon_pid_list;
@@ -253,11 +254,16 @@ static void setupRouter( const jsonObject* configChunk, int configPos ) {
 	const char* username = jsonObjectGetString( jsonObjectGetKeyConst( transport_cfg, "username" ));
 	const char* password = jsonObjectGetString( jsonObjectGetKeyConst( transport_cfg, "password" ));
 	const char* resource = jsonObjectGetString( jsonObjectGetKeyConst( transport_cfg, "resource" ));
+	const char* compress = jsonObjectGetString( jsonObjectGetKeyConst( transport_cfg, "compress" ));
 
 	const char* level    = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "loglevel" ));
 	const char* log_file = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "logfile" ));
 	const char* log_tag  = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "logtag" ));
 	const char* facility = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "syslog" ));
+	const char* policy   = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "routing_policy" ));
+	const char* workers  = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "workers" ));
+	const char* retry_depth = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "retry_depth" ));
+	const char* stats_interval = jsonObjectGetString( jsonObjectGetKeyConst( configChunk, "stats_interval" ));
 
 	int llevel = 1;
 	if(level) llevel = atoi(level);
@@ -329,6 +335,37 @@ static void setupRouter( const jsonObject* configChunk, int configPos ) {
 	router = osrfNewRouter( server,
 			username, resource, password, iport, tclients, tservers );
 
+	if( compress && !strcasecmp( compress, "true" ) )
+		osrfRouterSetCompression( router, 1 );
+
+	if( policy && osrfRouterSetPolicy( router, policy ) )
+		osrfLogWarning( OSRF_LOG_MARK, "Unknown routing policy \"%s\"; using round_robin",
+			policy );
+
+	if( retry_depth )
+		osrfRouterSetRetryDepth( router, atoi( retry_depth ) );
+
+	if( workers )
+		osrfRouterSetWorkers( router, atoi( workers ) );
+
+	if( stats_interval )
+		osrfRouterSetStatsInterval( router, atoi( stats_interval ) );
+
+	setupLimits( jsonObjectGetKeyConst( configChunk, "limits" ));
+
+	jsonObject* peers = jsonObjectFindPath( configChunk, "/peers/peer" );
+	if( peers && peers->type == JSON_ARRAY ) {
+		for( i = 0; i != peers->size; i++ ) {
+			const char* peer = jsonObjectGetString( jsonObjectGetIndex( peers, i ));
+			osrfLogInfo( OSRF_LOG_MARK, "Router adding peer: %s", peer );
+			osrfRouterAddPeer( router, peer );
+		}
+	} else if( peers && jsonObjectGetString( peers ) ) {
+		osrfLogInfo( OSRF_LOG_MARK, "Router adding peer: %s", jsonObjectGetString( peers ));
+		osrfRouterAddPeer( router, jsonObjectGetString( peers ));
+	}
+	jsonObjectFree( peers );
+
 	signal(SIGHUP,routerSignalHandler);
 	signal(SIGINT,routerSignalHandler);
 	signal(SIGTERM,routerSignalHandler);
@@ -356,3 +393,56 @@ void storeRouterDaemonPid( pid_t p, int i ) {
 	if( i != -1 )
 		daemon_pid_list[i] = p;
 }
+
+/**
+	@brief Load the router's admission limits from its configuration.
+	@param limits Pointer to the "limits" element of the router's configuration, if any.
+
+	Each <service> element gives a <rate>, <burst> and <max_in_flight> for the service
+	named by its <name>, or, if it has no <name>, for every service not named elsewhere.
+	A <domain> element gives the same for each sending domain.  Anything left out is
+	unlimited.
+*/
+static void setupLimits( const jsonObject* limits ) {
+	if( !limits )
+		return;
+
+	const jsonObject* services = jsonObjectGetKeyConst( limits, "service" );
+	const jsonObject* service = services;
+	int i = 0;
+	if( services && services->type == JSON_ARRAY )
+		service = jsonObjectGetIndex( services, 0 );
+
+	while( service ) {
+		const char* name = jsonObjectGetString( jsonObjectGetKeyConst( service, "name" ));
+		const char* rate = jsonObjectGetString( jsonObjectGetKeyConst( service, "rate" ));
+		const char* burst = jsonObjectGetString( jsonObjectGetKeyConst( service, "burst" ));
+		const char* max_in_flight =
+			jsonObjectGetString( jsonObjectGetKeyConst( service, "max_in_flight" ));
+
+		osrfLogInfo( OSRF_LOG_MARK, "Router limits for %s: rate %s, burst %s, in flight %s",
+			name ? name : "each service", rate ? rate : "-", burst ? burst : "-",
+			max_in_flight ? max_in_flight : "-" );
+		osrfRouterSetClassLimit( router, name, rate ? atof( rate ) : 0,
+			burst ? atof( burst ) : 0, max_in_flight ? atoi( max_in_flight ) : 0 );
+
+		if( services->type == JSON_ARRAY )
+			service = jsonObjectGetIndex( services, ++i );
+		else
+			service = NULL;
+	}
+
+	const jsonObject* domain = jsonObjectGetKeyConst( limits, "domain" );
+	if( domain ) {
+		const char* rate = jsonObjectGetString( jsonObjectGetKeyConst( domain, "rate" ));
+		const char* burst = jsonObjectGetString( jsonObjectGetKeyConst( domain, "burst" ));
+		const char* max_in_flight =
+			jsonObjectGetString( jsonObjectGetKeyConst( domain, "max_in_flight" ));
+
+		osrfLogInfo( OSRF_LOG_MARK, "Router limits for each domain: rate %s, burst %s, "
+			"in flight %s", rate ? rate : "-", burst ? burst : "-",
+			max_in_flight ? max_in_flight : "-" );
+		osrfRouterSetDomainLimit( router, rate ? atof( rate ) : 0,
+			burst ? atof( burst ) : 0, max_in_flight ? atoi( max_in_flight ) : 0 );
+	}
+}
@@ -529,22 +529,12 @@ static void log_request(const char* service, osrfMessage* msg) {
     char* method = msg->method_name;
     const jsonObject* obj = NULL;
     int i = 0;
-    const char* str;
-    int redactParams = 0;
 
     buffer_fadd(act, "[%s] [%s] %s %s", client_ip, "", service, method);
 
-    while ( (str = osrfStringArrayGetString(log_protect_arr, i++)) ) {
-        if (!strncmp(method, str, strlen(str))) {
-            redactParams = 1;
-            break;
-        }
-    }
-
-    if (redactParams) {
+    if (osrfPrefixMatcherMatch(log_protect_matcher, method)) {
         OSRF_BUFFER_ADD(act, " **PARAMS REDACTED**");
     } else {
-        i = 0;
         while ((obj = jsonObjectGetIndex(params, i++))) {
             char* str = jsonObjectToJSON(obj);
             if (i == 1)
@@ -0,0 +1,157 @@
+#include <check.h>
+#include "opensrf/osrf_big_hash.h"
+
+osrfBigHash *testHash;
+int freeCount;
+
+//Set up the test fixture
+void setup(void) {
+  testHash = osrfNewBigHash();
+  osrfBigHashSet(testHash, "circ", "open-ils.%s", "circ");
+  osrfBigHashSet(testHash, "actor", "open-ils.actor");
+  freeCount = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfBigHashFree(testHash);
+}
+
+// Helper functions
+static void countFree(char* key, void* item) {
+  freeCount++;
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_big_hash_osrfBigHashSet)
+  fail_unless(osrfBigHashSet(NULL, "x", "key") == NULL,
+      "osrfBigHashSet should return NULL if passed a NULL hash");
+  fail_unless(osrfBigHashSet(testHash, NULL, "key") == NULL,
+      "osrfBigHashSet should return NULL if passed a NULL item");
+  fail_unless(osrfBigHashSet(testHash, "circ2", "open-ils.circ") != NULL,
+      "osrfBigHashSet should return the displaced item if there is no freeItem");
+  testHash->freeItem = countFree;
+  fail_unless(osrfBigHashSet(testHash, "circ3", "open-ils.circ") == NULL,
+      "osrfBigHashSet should free the displaced item if there is a freeItem");
+  fail_unless(freeCount == 1,
+      "osrfBigHashSet should call the freeItem callback once");
+  fail_unless(strcmp(osrfBigHashGet(testHash, "open-ils.circ"), "circ3") == 0,
+      "The replacement item should be stored");
+  fail_unless(osrfBigHashGetCount(testHash) == 2,
+      "Replacing an item should not change the count");
+END_TEST
+
+START_TEST(test_osrf_big_hash_osrfBigHashGet)
+  fail_unless(strcmp(osrfBigHashGet(testHash, "open-ils.actor"), "actor") == 0,
+      "osrfBigHashGet should find a stored item");
+  fail_unless(strcmp(osrfBigHashGet(testHash, "open-ils.%s", "circ"), "circ") == 0,
+      "osrfBigHashGet should format the key");
+  fail_unless(osrfBigHashGet(testHash, "open-ils.acto") == NULL,
+      "osrfBigHashGet should return NULL for a missing key");
+  fail_unless(osrfBigHashGet(NULL, "open-ils.actor") == NULL,
+      "osrfBigHashGet should return NULL if passed a NULL hash");
+END_TEST
+
+START_TEST(test_osrf_big_hash_osrfBigHashRemove)
+  fail_unless(strcmp(osrfBigHashRemove(testHash, "open-ils.actor"), "actor") == 0,
+      "osrfBigHashRemove should return the removed item if there is no freeItem");
+  fail_unless(osrfBigHashGet(testHash, "open-ils.actor") == NULL,
+      "The removed item should be gone");
+  fail_unless(osrfBigHashRemove(testHash, "open-ils.actor") == NULL,
+      "osrfBigHashRemove should return NULL for a missing key");
+  fail_unless(osrfBigHashGetCount(testHash) == 1,
+      "testHash should contain 1 item");
+END_TEST
+
+START_TEST(test_osrf_big_hash_growth)
+  char key[32];
+  long i;
+  testHash->freeItem = countFree;
+  for (i = 1; i <= 5000; i++) {
+    snprintf(key, sizeof(key), "key%ld", i);
+    osrfBigHashSet(testHash, (void*) i, key);
+  }
+  fail_unless(osrfBigHashGetCount(testHash) == 5002,
+      "testHash should contain 5002 items");
+  for (i = 1; i <= 5000; i += 2) {
+    snprintf(key, sizeof(key), "key%ld", i);
+    osrfBigHashRemove(testHash, key);
+  }
+  fail_unless(freeCount == 2500,
+      "osrfBigHashRemove should call the freeItem callback");
+  for (i = 1; i <= 5000; i++) {
+    snprintf(key, sizeof(key), "key%ld", i);
+    fail_unless(osrfBigHashGet(testHash, key) == ((i % 2) ? NULL : (void*) i),
+        "Only the even-numbered keys should remain");
+  }
+
+  osrfStringArray* keys = osrfBigHashKeys(testHash);
+  fail_unless(keys->size == 2502,
+      "osrfBigHashKeys should return a key for every item");
+  osrfStringArrayFree(keys);
+
+  int seen = 0;
+  osrfBigHashIterator* itr = osrfNewBigHashIterator(testHash);
+  while (osrfBigHashIteratorNext(itr))
+    seen++;
+  fail_unless(seen == 2502,
+      "The iterator should visit every item");
+  osrfBigHashIteratorReset(itr);
+  fail_unless(osrfBigHashIteratorNext(itr) != NULL,
+      "A reset iterator should start over");
+  osrfBigHashIteratorFree(itr);
+  testHash->freeItem = NULL;
+END_TEST
+
+START_TEST(test_osrf_big_hash_iterator_current)
+  osrfBigHashIterator* itr = osrfNewBigHashIterator(testHash);
+  fail_unless(itr->current == NULL, "A new iterator should have no current key");
+
+  const char* item;
+  int seen = 0;
+  while ((item = osrfBigHashIteratorNext(itr))) {
+    fail_unless(itr->current != NULL && osrfBigHashGet(testHash, itr->current) == item,
+        "current should be the key of the item just returned");
+    char* key = strdup(itr->current);
+    osrfBigHashRemove(testHash, key);
+    fail_unless(strcmp(itr->current, key) == 0,
+        "current should outlive the removal of its entry");
+    free(key);
+    seen++;
+  }
+  fail_unless(seen == 2, "The iterator should visit both items");
+
+  osrfBigHashSet(testHash, "circ", "open-ils.circ");
+  osrfBigHashIteratorReset(itr);
+  fail_unless(itr->current == NULL, "A reset iterator should have no current key");
+  osrfBigHashIteratorNext(itr);
+  fail_unless(strcmp(itr->current, "open-ils.circ") == 0,
+      "current should follow the iterator after a reset");
+  osrfBigHashIteratorFree(itr);
+END_TEST
+
+//END TESTS
+
+Suite *osrf_big_hash_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_big_hash");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_big_hash_osrfBigHashSet);
+  tcase_add_test(tc_core, test_osrf_big_hash_osrfBigHashGet);
+  tcase_add_test(tc_core, test_osrf_big_hash_osrfBigHashRemove);
+  tcase_add_test(tc_core, test_osrf_big_hash_growth);
+  tcase_add_test(tc_core, test_osrf_big_hash_iterator_current);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_big_hash_suite());
+}
@@ -0,0 +1,120 @@
+#include <check.h>
+#include <limits.h>
+#include "opensrf/osrf_big_list.h"
+
+osrfBigList *testList;
+int freeCount;
+
+//Set up the test fixture
+void setup(void) {
+  testList = osrfNewBigList();
+  osrfBigListPush(testList, "zero");
+  osrfBigListPush(testList, "one");
+  osrfBigListPush(testList, "two");
+  freeCount = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfBigListFree(testList);
+}
+
+// Helper functions
+static void countFree(void* item) {
+  freeCount++;
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_big_list_osrfBigListPush)
+  fail_unless(osrfBigListPush(NULL, "x") == -1,
+      "osrfBigListPush should return -1 if passed a NULL list");
+  fail_unless(osrfBigListPush(testList, NULL) == -1,
+      "osrfBigListPush should return -1 if passed a NULL item");
+  fail_unless(osrfBigListPush(testList, "three") == 0,
+      "osrfBigListPush should return 0 on success");
+  fail_unless(testList->size == 4 && osrfBigListGetCount(testList) == 4,
+      "testList should contain 4 items");
+  fail_unless(strcmp(osrfBigListGetIndex(testList, 3), "three") == 0,
+      "The pushed item should be at the end");
+END_TEST
+
+START_TEST(test_osrf_big_list_osrfBigListSet)
+  fail_unless(strcmp(osrfBigListSet(testList, "uno", 1), "one") == 0,
+      "osrfBigListSet should return the displaced item if there is no freeItem");
+  fail_unless(osrfBigListSet(testList, "far", 100000) == NULL,
+      "osrfBigListSet should return NULL for an empty position");
+  fail_unless(testList->size == 100001,
+      "size should be one past the highest position");
+  fail_unless(osrfBigListGetCount(testList) == 4,
+      "osrfBigListGetCount should count only the items");
+  fail_unless(osrfBigListGetIndex(testList, 50000) == NULL,
+      "An unused position should be empty");
+  fail_unless(osrfBigListFind(testList, osrfBigListGetIndex(testList, 100000)) == 100000,
+      "osrfBigListFind should find a stored item");
+
+  int seen = 0;
+  osrfBigBigListIterator* itr = osrfNewBigListIterator(testList);
+  while (osrfBigBigListIteratorNext(itr))
+    seen++;
+  osrfBigBigListIteratorFree(itr);
+  fail_unless(seen == 4,
+      "The iterator should skip empty positions");
+END_TEST
+
+START_TEST(test_osrf_big_list_osrfBigListSet_range)
+  fail_unless(osrfBigListSet(testList, "x", ULONG_MAX) == NULL,
+      "osrfBigListSet should return NULL for a position past INT_MAX");
+  fail_unless(osrfBigListSet(testList, "x", (unsigned long) INT_MAX) == NULL,
+      "osrfBigListSet should return NULL for a position of INT_MAX");
+  fail_unless(osrfBigListSet(testList, "x", (1UL << 32) + 1) == NULL,
+      "osrfBigListSet should not truncate a large position");
+  fail_unless(testList->size == 3 && osrfBigListGetCount(testList) == 3,
+      "An out of range position should leave the list unchanged");
+  fail_unless(strcmp(osrfBigListGetIndex(testList, 1), "one") == 0,
+      "An out of range position should not clobber a small index");
+END_TEST
+
+START_TEST(test_osrf_big_list_osrfBigListRemove)
+  osrfBigListSet(testList, "far", 5000);
+  fail_unless(strcmp(osrfBigListRemove(testList, 5000), "far") == 0,
+      "osrfBigListRemove should return the removed item if there is no freeItem");
+  fail_unless(testList->size == 3,
+      "Removing the last item should shrink the size");
+  fail_unless(osrfBigListRemove(testList, 5000) == NULL,
+      "osrfBigListRemove should return NULL for an empty position");
+
+  testList->freeItem = countFree;
+  fail_unless(osrfBigListPop(testList) == NULL && freeCount == 1,
+      "osrfBigListPop should free the item if there is a freeItem");
+  fail_unless(testList->size == 2 && osrfBigListGetCount(testList) == 2,
+      "testList should contain 2 items");
+  osrfBigListRemove(testList, 0);
+  fail_unless(testList->size == 2 && osrfBigListGetCount(testList) == 1,
+      "Removing a leading item should leave the size unchanged");
+  testList->freeItem = NULL;
+END_TEST
+
+//END TESTS
+
+Suite *osrf_big_list_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_big_list");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_big_list_osrfBigListPush);
+  tcase_add_test(tc_core, test_osrf_big_list_osrfBigListSet);
+  tcase_add_test(tc_core, test_osrf_big_list_osrfBigListSet_range);
+  tcase_add_test(tc_core, test_osrf_big_list_osrfBigListRemove);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_big_list_suite());
+}
@@ -0,0 +1,128 @@
+#include <check.h>
+#include "opensrf/osrf_hash.h"
+
+#define KEY_COUNT 1000
+
+osrfHash *testOsrfHash;
+int items[KEY_COUNT];
+
+//Keep track of how many items have been freed by the callback
+unsigned int freedItemsSize;
+
+//Define a callback for freeing hash items
+void osrfCustomHashFree(char* key, void* item) {
+  freedItemsSize++;
+}
+
+//Set up the test fixture
+void setup(void) {
+  freedItemsSize = 0;
+  //Set up a hash with enough keys that every bucket holds many of them
+  testOsrfHash = osrfNewHash();
+  int i;
+  for (i = 0; i < KEY_COUNT; ++i) {
+    items[i] = i;
+    osrfHashSet(testOsrfHash, &items[i], "key%d", i);
+  }
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfHashFree(testOsrfHash);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_hash_osrfHashGet)
+  int i;
+  for (i = 0; i < KEY_COUNT; ++i) {
+    int* item = osrfHashGetFmt(testOsrfHash, "key%d", i);
+    fail_unless(item == &items[i], "osrfHashGet should find every key that was set");
+  }
+  fail_unless(osrfHashGet(testOsrfHash, "key") == NULL
+      && osrfHashGet(testOsrfHash, "key1000") == NULL,
+      "osrfHashGet should not find keys that were never set");
+  fail_unless(osrfHashGetCount(testOsrfHash) == KEY_COUNT,
+      "osrfHashGetCount should count every key");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashSet)
+  int other = -1;
+  fail_unless(osrfHashSet(testOsrfHash, &other, "key500") == &items[500],
+      "osrfHashSet should return the item that it replaces");
+  fail_unless(osrfHashGet(testOsrfHash, "key500") == &other,
+      "osrfHashGet should find the replacement");
+  fail_unless(osrfHashGetCount(testOsrfHash) == KEY_COUNT,
+      "Replacing an item should not add a key");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashRemove)
+  int i;
+  for (i = 0; i < KEY_COUNT; i += 2)
+    fail_unless(osrfHashRemove(testOsrfHash, "key%d", i) == &items[i],
+        "osrfHashRemove should return the item that it removes");
+  for (i = 0; i < KEY_COUNT; ++i) {
+    int* item = osrfHashGetFmt(testOsrfHash, "key%d", i);
+    fail_unless(item == (i % 2 ? &items[i] : NULL),
+        "osrfHashGet should find only the keys that remain");
+  }
+
+  // A removed key may be set again
+  osrfHashSet(testOsrfHash, &items[0], "key0");
+  fail_unless(osrfHashGet(testOsrfHash, "key0") == &items[0],
+      "osrfHashGet should find a key that was set again");
+  fail_unless(osrfHashGetCount(testOsrfHash) == KEY_COUNT / 2 + 1,
+      "osrfHashGetCount should count only the keys that remain");
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashIteratorNext)
+  osrfHashRemove(testOsrfHash, "key1");
+  osrfHashIterator* itr = osrfNewHashIterator(testOsrfHash);
+  int* item;
+  int expected = 0;
+  while ((item = osrfHashIteratorNext(itr))) {
+    if (expected == 1)
+      expected++;
+    fail_unless(item == &items[expected], "Iteration should follow the order of insertion");
+    expected++;
+  }
+  fail_unless(expected == KEY_COUNT, "Iteration should reach every key that remains");
+  osrfHashIteratorFree(itr);
+END_TEST
+
+START_TEST(test_osrf_hash_osrfHashFree)
+  osrfHash* hash = osrfNewHash();
+  osrfHashSetCallback(hash, osrfCustomHashFree);
+  int i;
+  for (i = 0; i < KEY_COUNT; ++i)
+    osrfHashSet(hash, &items[i], "key%d", i);
+  osrfHashRemove(hash, "key7");
+  osrfHashFree(hash);
+  fail_unless(freedItemsSize == KEY_COUNT,
+      "osrfHashFree should free every item once, including removed ones");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_hash_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_hash");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashGet);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashSet);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashRemove);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashIteratorNext);
+  tcase_add_test(tc_core, test_osrf_hash_osrfHashFree);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_hash_suite());
+}
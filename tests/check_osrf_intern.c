@@ -0,0 +1,177 @@
+#include <check.h>
+#include <pthread.h>
+#include "opensrf/osrf_intern.h"
+#include "opensrf/osrf_json.h"
+
+unsigned long baseCount;
+
+//Set up the test fixture
+void setup(void) {
+  baseCount = osrfInternCount();
+}
+
+//Clean up the test fixture
+void teardown(void) {
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_intern_osrfIntern)
+  fail_unless(osrfIntern(NULL) == NULL,
+      "osrfIntern should return NULL if passed NULL");
+
+  char buf[] = "opensrf@private.localhost/router";
+  const char* a = osrfIntern(buf);
+  const char* b = osrfIntern("opensrf@private.localhost/router");
+  fail_unless(a == b,
+      "Interning equal strings should yield the same pointer");
+  fail_unless(a != buf,
+      "osrfIntern should return a shared copy, not the original");
+  fail_unless(strcmp(a, buf) == 0,
+      "The interned copy should equal the original");
+  fail_unless(osrfInternCount() == baseCount + 1,
+      "Interning the same string twice should add only one entry");
+  fail_unless(osrfInternLength(a) == strlen(buf),
+      "osrfInternLength should report the length of the string");
+  fail_unless(osrfInternHash(a) == osrfInternHash(b),
+      "Equal interned strings should have equal hashes");
+
+  const char* c = osrfInternN("opensrf@private.localhost/router/extra", 32);
+  fail_unless(c == a,
+      "osrfInternN should intern only the specified number of characters");
+
+  osrfInternRelease(a);
+  osrfInternRelease(b);
+  osrfInternRelease(c);
+  fail_unless(osrfInternCount() == baseCount,
+      "Releasing every reference should remove the entry");
+END_TEST
+
+START_TEST(test_osrf_intern_osrfInternRetain)
+  const char* a = osrfIntern("aou");
+  fail_unless(osrfInternRetain(a) == a,
+      "osrfInternRetain should return its argument");
+  fail_unless(osrfInternRetain(NULL) == NULL,
+      "osrfInternRetain should return NULL if passed NULL");
+  osrfInternRelease(a);
+  fail_unless(osrfInternCount() == baseCount + 1,
+      "The entry should survive while a retained reference remains");
+  fail_unless(strcmp(a, "aou") == 0,
+      "The retained string should still be intact");
+  osrfInternRelease(a);
+  fail_unless(osrfInternCount() == baseCount,
+      "The entry should be removed with its last reference");
+END_TEST
+
+START_TEST(test_osrf_intern_growth)
+  char buf[32];
+  const char* held[2000];
+  int i;
+  for (i = 0; i < 2000; i++) {
+    snprintf(buf, sizeof(buf), "field_%d", i);
+    held[i] = osrfIntern(buf);
+  }
+  fail_unless(osrfInternCount() == baseCount + 2000,
+      "2000 distinct strings should be interned");
+  // Release every other one, then make sure the rest can still be found
+  for (i = 0; i < 2000; i += 2)
+    osrfInternRelease(held[i]);
+  for (i = 1; i < 2000; i += 2) {
+    snprintf(buf, sizeof(buf), "field_%d", i);
+    const char* again = osrfIntern(buf);
+    fail_unless(again == held[i],
+        "Surviving strings should still be found after removals");
+    osrfInternRelease(again);
+    osrfInternRelease(held[i]);
+  }
+  fail_unless(osrfInternCount() == baseCount,
+      "Every entry should be gone once all references are released");
+END_TEST
+
+START_TEST(test_osrf_intern_jsonObject)
+  // Class names are public members, so each jsonObject owns a copy of its own
+  jsonObject* a = jsonNewObject(NULL);
+  jsonObjectSetClass(a, "aou");
+  jsonObject* c = jsonObjectClone(a);
+  fail_unless(strcmp(jsonObjectGetClass(c), "aou") == 0
+      && jsonObjectGetClass(c) != jsonObjectGetClass(a),
+      "A clone should have its own copy of the class name");
+  free(a->classname);
+  a->classname = strdup("aout");
+  jsonObjectFree(a);
+  jsonObjectFree(c);
+  fail_unless(osrfInternCount() == baseCount,
+      "Class names should not be interned");
+
+  jsonObject* h = jsonNewObjectType(JSON_HASH);
+  jsonObjectSetKey(h, "shortname", jsonNewObject("BR1"));
+  jsonObjectSetKey(h, "shortname", jsonNewObject("BR2"));
+  fail_unless(strcmp(jsonObjectGetString(jsonObjectGetKey(h, "shortname")), "BR2") == 0,
+      "Replacing a value under an interned key should work");
+  jsonObjectRemoveKey(h, "shortname");
+  fail_unless(jsonObjectGetKey(h, "shortname") == NULL,
+      "Removing an interned key should work");
+  jsonObjectSetKey(h, "name", jsonNewObject("Branch 1"));
+  jsonObjectFree(h);
+  fail_unless(osrfInternCount() == baseCount,
+      "Freeing a JSON hash should release its keys");
+END_TEST
+
+#define INTERN_THREADS 4
+
+static void* intern_worker(void* arg) {
+  char buf[32];
+  int i;
+  for (i = 0; i < 20000; i++) {
+    snprintf(buf, sizeof(buf), "key_%d", i % 500);
+    const char* a = osrfIntern(buf);
+    const char* b = osrfInternRetain(a);
+    if (strcmp(a, buf))
+      return arg;
+    osrfInternRelease(a);
+    osrfInternRelease(b);
+  }
+  return NULL;
+}
+
+START_TEST(test_osrf_intern_threads)
+  pthread_t threads[INTERN_THREADS];
+  int i;
+  for (i = 0; i < INTERN_THREADS; i++)
+    pthread_create(&threads[i], NULL, intern_worker, threads);
+  int ok = 1;
+  for (i = 0; i < INTERN_THREADS; i++) {
+    void* result;
+    pthread_join(threads[i], &result);
+    if (result)
+      ok = 0;
+  }
+  fail_unless(ok, "Every thread should get back the strings it interned");
+  fail_unless(osrfInternCount() == baseCount,
+      "Every entry should be gone once all threads release their references");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_intern_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_intern");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_intern_osrfIntern);
+  tcase_add_test(tc_core, test_osrf_intern_osrfInternRetain);
+  tcase_add_test(tc_core, test_osrf_intern_growth);
+  tcase_add_test(tc_core, test_osrf_intern_jsonObject);
+  tcase_add_test(tc_core, test_osrf_intern_threads);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_intern_suite());
+}
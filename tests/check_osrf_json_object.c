@@ -302,6 +302,42 @@ START_TEST(test_osrf_json_object_jsonBoolIsTrue)
       "jsonBoolIsTrue should return 1 if the value of boolObj is not 0");
 END_TEST
 
+START_TEST(test_osrf_json_object_jsonObjectRemoveIndex)
+  jsonObject* arr = jsonParse("[1,2,3,4]");
+  fail_unless(jsonObjectRemoveIndex(arr, 1) == 4,
+      "jsonObjectRemoveIndex should leave the size alone when it leaves a hole");
+  char* json = jsonObjectToJSON(arr);
+  fail_unless(strcmp(json, "[1,null,3,4]") == 0,
+      "jsonObjectRemoveIndex should leave the later elements where they are");
+  free(json);
+
+  fail_unless(jsonObjectRemoveIndexShift(arr, 1) == 3,
+      "jsonObjectRemoveIndexShift should report the remaining size");
+  json = jsonObjectToJSON(arr);
+  fail_unless(strcmp(json, "[1,3,4]") == 0,
+      "jsonObjectRemoveIndexShift should close the gap");
+  free(json);
+
+  jsonObject* item = jsonObjectExtractIndexShift(arr, 0);
+  fail_unless(item != NULL && item->parent == NULL && arr->size == 2
+      && strcmp(jsonObjectGetString(jsonObjectGetIndex(arr, 0)), "3") == 0,
+      "jsonObjectExtractIndexShift should detach the element and close the gap");
+  jsonObjectFree(item);
+
+  item = jsonObjectExtractIndex(arr, 0);
+  fail_unless(item != NULL && arr->size == 2 && jsonObjectGetIndex(arr, 0) == NULL,
+      "jsonObjectExtractIndex should leave a hole");
+  jsonObjectFree(item);
+
+  jsonObject* clone = jsonObjectClone(arr);
+  json = jsonObjectToJSON(clone);
+  fail_unless(strcmp(json, "[null,4]") == 0,
+      "A cloned JSON array should serialize like the original");
+  free(json);
+  jsonObjectFree(clone);
+  jsonObjectFree(arr);
+END_TEST
+
 //END Tests
 
 
@@ -335,6 +371,7 @@ Suite *osrf_json_object_suite (void) {
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectSetIndex);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectGetIndex);
   tcase_add_test(tc_core, test_osrf_json_object_jsonObjectClone);
+  tcase_add_test(tc_core, test_osrf_json_object_jsonObjectRemoveIndex);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);
@@ -261,6 +261,54 @@ START_TEST(test_osrf_list_osrfListExtract)
        isn't removing the last element in the list");
 END_TEST
 
+START_TEST(test_osrf_list_osrfListRemoveShift)
+  fail_unless(osrfListRemoveShift(NULL, 0) == NULL,
+      "osrfListRemoveShift should return NULL when not given a list");
+  fail_unless(osrfListRemoveShift(testOsrfList, 1000) == NULL,
+      "osrfListRemoveShift should return NULL when given a position \
+       exceeding the size of the list");
+  fail_unless(osrfListRemoveShift(testOsrfList, 0) == NULL && freedItemsSize == 1,
+      "osrfListRemoveShift should call a custom item freeing function if \
+       defined");
+  fail_unless(testOsrfList->size == 2
+      && osrfListGetIndex(testOsrfList, 0) == NULL
+      && osrfListGetIndex(testOsrfList, 1) == &globalItem3,
+      "osrfListRemoveShift should move the later items down");
+  fail_unless(osrfListRemoveShift(testOsrfList, 0) == NULL && freedItemsSize == 1,
+      "osrfListRemoveShift should not call the freeing function for a NULL");
+  fail_unless(testOsrfList->size == 1
+      && osrfListGetIndex(testOsrfList, 0) == &globalItem3,
+      "osrfListRemoveShift should shrink the list by one");
+END_TEST
+
+START_TEST(test_osrf_list_osrfListExtractShift)
+  fail_unless(osrfListExtractShift(NULL, 0) == NULL,
+      "osrfListExtractShift should return NULL when not given a list");
+  fail_unless(osrfListExtractShift(testOsrfList, 0) == &globalItem1,
+      "osrfListExtractShift should return the value that it has removed \
+       from the list");
+  fail_unless(freedItemsSize == 0,
+      "osrfListExtractShift should not call the freeing function");
+  fail_unless(testOsrfList->size == 2
+      && osrfListGetIndex(testOsrfList, 1) == &globalItem3
+      && osrfListGetIndex(testOsrfList, 2) == NULL,
+      "osrfListExtractShift should move the later items down");
+END_TEST
+
+START_TEST(test_osrf_list_growth)
+  osrfList* big = osrfNewListSize(10);
+  int i;
+  for (i = 0; i < 10000; i++)
+    osrfListPush(big, &globalItem1);
+  fail_unless(big->size == 10000 && osrfListGetIndex(big, 9999) == &globalItem1,
+      "A long list should keep everything pushed onto it");
+  fail_unless(big->arrsize < 20000,
+      "A long list should grow geometrically, not far beyond its size");
+  fail_unless(osrfListGetIndex(big, 10000) == NULL && big->arrlist[big->arrsize - 1] == NULL,
+      "The slots past the end of a list should be NULL");
+  osrfListFree(big);
+END_TEST
+
 START_TEST(test_osrf_list_osrfListFind)
   int* notInList1 = malloc(sizeof(int));
   int* notInList2 = malloc(sizeof(int));
@@ -371,6 +419,9 @@ Suite *osrf_list_suite(void) {
   tcase_add_test(tc_core, test_osrf_list_osrfListSwap);
   tcase_add_test(tc_core, test_osrf_list_osrfListRemove);
   tcase_add_test(tc_core, test_osrf_list_osrfListExtract);
+  tcase_add_test(tc_core, test_osrf_list_osrfListRemoveShift);
+  tcase_add_test(tc_core, test_osrf_list_osrfListExtractShift);
+  tcase_add_test(tc_core, test_osrf_list_growth);
   tcase_add_test(tc_core, test_osrf_list_osrfListFind);
   tcase_add_test(tc_core, test_osrf_list_osrfListGetCount);
   tcase_add_test(tc_core, test_osrf_list_osrfListPop);
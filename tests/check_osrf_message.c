@@ -71,6 +71,56 @@ START_TEST(test_osrf_message_set_params)
   jsonObjectFree(testJSONObject);
 END_TEST
 
+START_TEST(test_osrf_message_scan)
+  osrfMessageSummary sums[2];
+  const char* json = "[{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":\"3\","
+      "\"type\":\"CONNECT\",\"api_level\":2}},"
+      "{\"__c\":\"osrfMessage\",\"__p\":{\"threadTrace\":4,\"type\":\"REQUEST\","
+      "\"payload\":{\"__c\":\"osrfMethod\",\"__p\":{\"params\":[{\"a\":[1,\"}\"]}],"
+      "\"method\":\"opensrf.system.echo\"}}}}]";
+  fail_unless(osrfMessageScan(json, sums, 2) == 2,
+      "osrfMessageScan should find both messages");
+  fail_unless(sums[0].m_type == CONNECT && sums[0].thread_trace == 3
+      && sums[0].protocol == 2,
+      "osrfMessageScan should read the type, threadTrace and api_level");
+  fail_unless(sums[1].m_type == REQUEST && sums[1].thread_trace == 4
+      && sums[1].method_len == strlen("opensrf.system.echo")
+      && strncmp(sums[1].method_name, "opensrf.system.echo", sums[1].method_len) == 0,
+      "osrfMessageScan should find the method name past the params");
+
+  // It agrees with a full parse
+  osrfList* list = osrfMessageDeserialize(json, NULL);
+  osrfMessage* req = osrfListGetIndex(list, 1);
+  fail_unless(list->size == 2 && req->thread_trace == sums[1].thread_trace
+      && strcmp(req->method_name, "opensrf.system.echo") == 0,
+      "osrfMessageScan should agree with osrfMessageDeserialize");
+  osrfListFree(list);
+
+  fail_unless(osrfMessageScan(json, sums, 1) == 2,
+      "osrfMessageScan should count messages beyond the space for them");
+  fail_unless(osrfMessageScan("[1,\"x\",{\"__c\":\"other\",\"__p\":{}}]", sums, 2) == 0,
+      "osrfMessageScan should skip elements that aren't messages");
+  fail_unless(osrfMessageScan("", sums, 2) == 0,
+      "osrfMessageScan should find nothing in an empty string");
+END_TEST
+
+START_TEST(test_osrf_message_scan_declines)
+  osrfMessageSummary sums[2];
+  fail_unless(osrfMessageScan("{\"a\":1}", sums, 2) == -1,
+      "osrfMessageScan should decline anything but an array");
+  fail_unless(osrfMessageScan("[{\"__c\":\"osrfMessage\",\"__p\":{}}", sums, 2) == -1,
+      "osrfMessageScan should decline malformed JSON");
+  fail_unless(osrfMessageScan("[] []", sums, 2) == -1,
+      "osrfMessageScan should decline extra material");
+  fail_unless(osrfMessageScan("[{\"__c\":\"osrfMessage\",\"__p\":{\"type\":\"REQUEST\","
+      "\"payload\":{\"__c\":\"osrfMethod\",\"__p\":{\"method\":\"opensrf.\\u0073ystem\"}}}}]",
+      sums, 2) == -1,
+      "osrfMessageScan should decline an escaped method name");
+  fail_unless(osrfMessageScan("[{\"__c\":\"osrfMessage\",\"__p\":{\"type\":\"REQUEST\","
+      "\"type\":\"CONNECT\"}}]", sums, 2) == -1,
+      "osrfMessageScan should decline a duplicate key");
+END_TEST
+
 //END Tests
 
 Suite *osrf_message_suite(void) {
@@ -86,6 +136,8 @@ Suite *osrf_message_suite(void) {
   tcase_add_test(tc_core, test_osrf_message_set_default_locale);
   tcase_add_test(tc_core, test_osrf_message_set_method);
   tcase_add_test(tc_core, test_osrf_message_set_params);
+  tcase_add_test(tc_core, test_osrf_message_scan);
+  tcase_add_test(tc_core, test_osrf_message_scan_declines);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);
@@ -0,0 +1,589 @@
+#include <check.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "opensrf/transport_message.h"
+
+// Included rather than linked, so that we can get at the statistics, which are static
+#include "osrf_router.c"
+
+// The router logs in to a stand-in Jabber server: this process, which plays every other
+// party as well -- clients, listeners, and Jabber itself
+#define DOMAIN "localhost"
+#define CLASS "open-ils.check"
+
+int listener, port;
+pid_t router_pid;
+int router_fd;     // the router's own session
+int class_fd;      // the session the router opens for CLASS
+int max_in_flight; // the limit for every class, if any
+pid_t peer_pid;    // a peer router, which the router passes requests to
+int peer_fd, peer_class_fd;
+
+static int listen_any(int* port) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+      || listen(fd, 16) < 0
+      || getsockname(fd, (struct sockaddr*) &addr, &addr_len) < 0)
+    return -1;
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static int read_until(int fd, growing_buffer* got, const char* marker) {
+  char buf[4096];
+  while (!strstr(OSRF_BUFFER_C_STR(got), marker)) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return -1;
+    buffer_add_n(got, buf, n);
+  }
+  return 0;
+}
+
+static void write_str(int fd, const char* data) {
+  fail_unless(write(fd, data, strlen(data)) == (ssize_t) strlen(data), "Unable to write");
+}
+
+// Log in a session, whatever its credentials
+static int accept_session(void) {
+  int fd = accept(listener, NULL, NULL);
+  growing_buffer* got = buffer_init(1024);
+  fail_unless(fd >= 0 && read_until(fd, got, "streams'>") == 0, "No stream from the router");
+  write_str(fd, "<stream:stream xmlns='jabber:client' "
+      "xmlns:stream='http://etherx.jabber.org/streams' id='check'>");
+  buffer_reset(got);
+  fail_unless(read_until(fd, got, "</iq>") == 0, "No login from the router");
+  write_str(fd, "<iq type='result' id='123456789'/>");
+  buffer_free(got);
+  return fd;
+}
+
+// Start a router with a given policy, optionally a peer, and a number of workers
+static pid_t spawn_router(const char* policy, const char* peer, int workers) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (0 == pid) {
+    close(listener);
+    osrfStringArray* clients = osrfNewStringArray(1);
+    osrfStringArray* servers = osrfNewStringArray(1);
+    osrfStringArrayAdd(clients, DOMAIN);
+    osrfStringArrayAdd(servers, DOMAIN);
+    osrfRouter* router = osrfNewRouter(DOMAIN, "router", "router", "password", port,
+        clients, servers);
+    osrfRouterSetClassLimit(router, NULL, 0, 0, max_in_flight);
+    if (!router || osrfRouterSetPolicy(router, policy) || osrfRouterConnect(router))
+      _exit(1);
+    if (peer)
+      osrfRouterAddPeer(router, peer);
+    osrfRouterSetWorkers(router, workers);
+    osrfRouterRun(router);
+    _exit(0);
+  }
+  return pid;
+}
+
+// Start the router under test, and log in its session
+static void start_router(const char* policy, const char* peer, int workers) {
+  router_pid = spawn_router(policy, peer, workers);
+  router_fd = accept_session();
+}
+
+// Send a command from a listener to the router on a session
+static void send_command(int fd, const char* cmd, const char* node, const char* body) {
+  transport_message* msg = message_init(body, NULL, cmd, "router@" DOMAIN "/router", node);
+  message_set_router_info(msg, NULL, NULL, CLASS, cmd, 0);
+  message_prepare_xml(msg);
+  write_str(fd, msg->msg_xml);
+  message_free(msg);
+}
+
+// Send a command to the router under test from a listener
+static void command(const char* cmd, const char* node, const char* body) {
+  send_command(router_fd, cmd, node, body);
+}
+
+/*
+  Start a peer router, with a node of its own for CLASS, and log in its sessions.  The
+  router under test knows it as "peer.localhost"; it knows the router under test by the
+  domain that they share here.
+*/
+static void start_peer(const char* node, const char* body) {
+  peer_pid = spawn_router("round_robin", DOMAIN, 0);
+  peer_fd = accept_session();
+  send_command(peer_fd, "register", node, body);
+  peer_class_fd = accept_session();
+}
+
+// Register a listener, and the first time, log in the session the router opens for CLASS
+static void register_node(const char* node, const char* body) {
+  command("register", node, body);
+  if (class_fd < 0)
+    class_fd = accept_session();
+}
+
+// Send a request for CLASS from a client, with a thread and an osrf_xid of its own
+static void request(int n) {
+  char* xml = va_list_to_string("<message from='client@" DOMAIN "/check' "
+      "to='router@" DOMAIN "/" CLASS "'><opensrf osrf_xid='xid%d'/>"
+      "<thread>thread%d</thread><body>[%d]</body></message>", n, n, n);
+  write_str(class_fd, xml);
+  free(xml);
+}
+
+// Bounce request n back to the router from a node, as Jabber does when the node has gone
+static void bounce(const char* node, int n) {
+  char* xml = va_list_to_string("<message from='%s' to='router@" DOMAIN "/" CLASS "' "
+      "type='error'><error type='cancel' code='503'/><opensrf osrf_xid='xid%d'/>"
+      "<thread>thread%d</thread><body>[%d]</body></message>", node, n, n, n);
+  write_str(class_fd, xml);
+  free(xml);
+}
+
+/*
+  Read the stanzas that the router sends on a session, until there are @a max of them, or
+  none arrive for @a ms milliseconds.
+*/
+static int collect(int fd, transport_message** msgs, int max, int ms) {
+  growing_buffer* got = buffer_init(1024);
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  int count = 0;
+  while (count < max && poll(&pfd, 1, ms) > 0) {
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    buffer_add_n(got, buf, n);
+
+    char* end;
+    while (count < max && (end = strstr(got->buf, "</message>"))) {
+      size_t len = end - got->buf + strlen("</message>");
+      char* xml = strndup(got->buf, len);
+      msgs[count++] = new_message_from_xml(strstr(xml, "<message"));
+      free(xml);
+      memmove(got->buf, got->buf + len, got->n_used - len + 1);
+      got->n_used -= len;
+    }
+  }
+  buffer_free(got);
+  return count;
+}
+
+// Check that the router sends request n to a node, or nothing at all if the node is NULL
+static void expect_routed(int n, const char* node, const char* why) {
+  transport_message* msgs[2];
+  int count = collect(class_fd, msgs, 2, 300);
+  char thread[32];
+  snprintf(thread, sizeof(thread), "thread%d", n);
+  if (node)
+    fail_unless(count == 1 && strcmp(msgs[0]->recipient, node) == 0
+        && strcmp(msgs[0]->thread, thread) == 0, why);
+  else
+    fail_unless(count == 0, why);
+  while (count)
+    message_free(msgs[--count]);
+}
+
+// Ask the router for information, and return what it says, or what it has said so far
+static char* ask(const char* method) {
+  char* xml = va_list_to_string("<message from='client@" DOMAIN "/check' "
+      "to='router@" DOMAIN "/router'><thread>ask</thread><body>[{\"__c\":\"osrfMessage\","
+      "\"__p\":{\"threadTrace\":\"1\",\"type\":\"REQUEST\",\"payload\":{"
+      "\"__c\":\"osrfMethod\",\"__p\":{\"method\":\"%s\",\"params\":[]}}}}]</body>"
+      "</message>", method);
+  write_str(router_fd, xml);
+  free(xml);
+
+  growing_buffer* got = buffer_init(1024);
+  struct pollfd pfd = { router_fd, POLLIN, 0 };
+  while (!strstr(got->buf, "Request Complete") && poll(&pfd, 1, 3000) > 0) {
+    char buf[4096];
+    ssize_t n = read(router_fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    buffer_add_n(got, buf, n);
+  }
+  return buffer_release(got);
+}
+
+// Route one request, and return the recipient that the router picked
+static char* route_one(int n) {
+  transport_message* msg;
+  request(n);
+  fail_unless(collect(class_fd, &msg, 1, 1000) == 1, "The request should be routed");
+  char* recipient = strdup(msg->recipient);
+  message_free(msg);
+  return recipient;
+}
+
+//Set up the test fixture
+void setup(void) {
+  listener = listen_any(&port);
+  fail_unless(listener >= 0, "Unable to listen");
+  router_pid = peer_pid = -1;
+  router_fd = class_fd = peer_fd = peer_class_fd = -1;
+  max_in_flight = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  if (router_pid > 0) {
+    kill(router_pid, SIGKILL);
+    waitpid(router_pid, NULL, 0);
+  }
+  if (peer_pid > 0) {
+    kill(peer_pid, SIGKILL);
+    waitpid(peer_pid, NULL, 0);
+  }
+  if (class_fd >= 0)
+    close(class_fd);
+  if (router_fd >= 0)
+    close(router_fd);
+  if (peer_class_fd >= 0)
+    close(peer_class_fd);
+  if (peer_fd >= 0)
+    close(peer_fd);
+  close(listener);
+}
+
+//BEGIN TESTS
+
+START_TEST(test_osrf_router_unhinted_not_starved)
+  // A Perl listener, which sends no load hints, beside a C one with room for ten
+  start_router("least_loaded", NULL, 0);
+  register_node("perl@" DOMAIN "/node", "registering");
+  register_node("c@" DOMAIN "/node", "{\"capacity\":10,\"load\":0}");
+
+  char* first = route_one(1);
+  fail_unless(strcmp(first, "perl@" DOMAIN "/node") == 0,
+      "Equally loaded, the first node should be picked");
+  char* second = route_one(2);
+  fail_unless(strcmp(second, "c@" DOMAIN "/node") == 0,
+      "The unhinted node, having one request, should look full");
+
+  // Nothing tells the router that the Perl listener has finished, but it forgets in time
+  usleep(1100000);
+  command("load", "c@" DOMAIN "/node", "{\"load\":0}");
+  char* third = route_one(3);
+  fail_unless(strcmp(third, "perl@" DOMAIN "/node") == 0,
+      "The unhinted node should have room again after a while");
+
+  free(first);
+  free(second);
+  free(third);
+END_TEST
+
+START_TEST(test_osrf_router_bounce_unhinted)
+  // Two Perl listeners, which send no load hints
+  start_router("round_robin", NULL, 0);
+  register_node("a@" DOMAIN "/node", "registering");
+  register_node("b@" DOMAIN "/node", "registering");
+  char* recipients[3];
+  int i;
+  for (i = 0; i < 3; ++i)
+    recipients[i] = route_one(i + 1);
+  fail_unless(strcmp(recipients[0], "a@" DOMAIN "/node") == 0
+      && strcmp(recipients[1], "b@" DOMAIN "/node") == 0
+      && strcmp(recipients[2], "a@" DOMAIN "/node") == 0, "The nodes should take turns");
+
+  // The router keeps only the last request sent to such a node, so the first one, which
+  // may have been answered, isn't sent again
+  bounce("a@" DOMAIN "/node", 1);
+  expect_routed(1, NULL, "An older request should not be sent again");
+
+  // The last one goes elsewhere when it bounces in its turn, but only once
+  bounce("a@" DOMAIN "/node", 3);
+  expect_routed(3, "b@" DOMAIN "/node", "The last request should go to the other node");
+  bounce("a@" DOMAIN "/node", 3);
+  expect_routed(3, NULL, "A request should be sent elsewhere only once");
+
+  for (i = 0; i < 3; ++i)
+    free(recipients[i]);
+END_TEST
+
+START_TEST(test_osrf_router_bounce_acknowledged)
+  // Two C listeners, which say how many requests they're working on
+  start_router("round_robin", NULL, 0);
+  register_node("a@" DOMAIN "/node", "{\"capacity\":10,\"load\":0}");
+  register_node("b@" DOMAIN "/node", "{\"capacity\":10,\"load\":0}");
+  int i;
+  for (i = 1; i <= 5; ++i)
+    free(route_one(i));
+
+  // Node a has had requests 1, 3 and 5, and is done with all but the last
+  command("load", "a@" DOMAIN "/node", "{\"load\":1}");
+  usleep(100000);
+
+  bounce("a@" DOMAIN "/node", 5);
+  expect_routed(5, "b@" DOMAIN "/node", "The unacknowledged request should go elsewhere");
+  bounce("a@" DOMAIN "/node", 3);
+  expect_routed(3, NULL, "An acknowledged request should not be sent again");
+END_TEST
+
+START_TEST(test_osrf_router_limit_unhinted)
+  // A Perl listener acknowledges nothing, so nothing sent to it counts against the limit
+  max_in_flight = 1;
+  start_router("round_robin", NULL, 0);
+  register_node("perl@" DOMAIN "/node", "registering");
+  int i;
+  for (i = 1; i <= 5; ++i) {
+    char* recipient = route_one(i);
+    fail_unless(strcmp(recipient, "perl@" DOMAIN "/node") == 0,
+        "Requests to a node that never acknowledges them should not be turned away");
+    free(recipient);
+  }
+
+  // Once it reports its load, it does count
+  command("load", "perl@" DOMAIN "/node", "{\"load\":0}");
+  usleep(100000);
+  char* admitted = route_one(6);
+  fail_unless(strcmp(admitted, "perl@" DOMAIN "/node") == 0,
+      "A request within the limit should be routed");
+  char* rejected = route_one(7);
+  fail_unless(strcmp(rejected, "client@" DOMAIN "/check") == 0,
+      "A request over the limit should be turned away");
+  free(admitted);
+  free(rejected);
+END_TEST
+
+START_TEST(test_osrf_router_peers)
+  transport_message* msgs[2];
+  start_router("least_loaded", "peer." DOMAIN, 0);
+  register_node("a@" DOMAIN "/node", "{\"capacity\":1,\"load\":1}");
+  start_peer("b@" DOMAIN "/node", "{\"capacity\":1,\"load\":0}");
+
+  // Its only node full, the router passes a request to its peer, which routes it
+  request(1);
+  fail_unless(collect(class_fd, msgs, 2, 300) == 1
+      && strcmp(msgs[0]->recipient, "router@peer." DOMAIN "/" CLASS) == 0
+      && strcmp(msgs[0]->router_from, "client@" DOMAIN "/check") == 0
+      && msgs[0]->router_hops == 1, "A request for a full class should go to the peer");
+  message_prepare_xml(msgs[0]);
+  write_str(peer_class_fd, msgs[0]->msg_xml);
+  message_free(msgs[0]);
+  fail_unless(collect(peer_class_fd, msgs, 2, 300) == 1
+      && strcmp(msgs[0]->recipient, "b@" DOMAIN "/node") == 0
+      && strcmp(msgs[0]->router_from, "client@" DOMAIN "/check") == 0,
+      "The peer should route the request to its own node, for the client");
+  message_free(msgs[0]);
+
+  // If the peer can't take one, it bounces, and the client hears that it failed
+  request(2);
+  fail_unless(collect(class_fd, msgs, 2, 300) == 1, "The request should go to the peer");
+  message_free(msgs[0]);
+  write_str(class_fd, "<message from='router@peer." DOMAIN "/" CLASS "' "
+      "to='router@" DOMAIN "/" CLASS "' type='error'><error type='cancel' code='503'/>"
+      "<opensrf router_from='client@" DOMAIN "/check' router_to='router@peer." DOMAIN "/"
+      CLASS "' router_hops='1' osrf_xid='xid2'/><thread>thread2</thread><body>[2]</body>"
+      "</message>");
+  fail_unless(collect(class_fd, msgs, 2, 300) == 1
+      && strcmp(msgs[0]->recipient, "client@" DOMAIN "/check") == 0
+      && strcmp(msgs[0]->thread, "thread2") == 0,
+      "A request that bounces from the peer should be cancelled");
+  message_free(msgs[0]);
+
+  // When the last node dies, what it hadn't acknowledged goes to the peer
+  command("load", "a@" DOMAIN "/node", "{\"load\":0}");
+  usleep(100000);
+  char* recipient = route_one(3);
+  fail_unless(strcmp(recipient, "a@" DOMAIN "/node") == 0,
+      "With room, the router should route locally");
+  free(recipient);
+  bounce("a@" DOMAIN "/node", 3);
+  fail_unless(collect(class_fd, msgs, 2, 300) == 1
+      && strcmp(msgs[0]->recipient, "router@peer." DOMAIN "/" CLASS) == 0
+      && strcmp(msgs[0]->thread, "thread3") == 0,
+      "A request that bounces from the last node should go to the peer");
+  message_free(msgs[0]);
+END_TEST
+
+START_TEST(test_osrf_router_workers_timeout)
+  start_router("round_robin", NULL, 2);
+  register_node("perl@" DOMAIN "/node", "registering");
+  char* answer = ask("opensrf.router.info.class.list");
+  fail_unless(strstr(answer, CLASS) != NULL, "The workers should answer");
+  free(answer);
+
+  // Workers that don't answer in time are left out
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/task/%d/children", router_pid, router_pid);
+  FILE* children = fopen(path, "r");
+  fail_unless(children != NULL, "Unable to find the workers");
+  int workers[2];
+  fail_unless(fscanf(children, "%d %d", &workers[0], &workers[1]) == 2,
+      "There should be two workers");
+  fclose(children);
+  kill(workers[0], SIGSTOP);
+  kill(workers[1], SIGSTOP);
+
+  long long start = get_monotonic_millis();
+  answer = ask("opensrf.router.info.class.list");
+  long long waited = get_monotonic_millis() - start;
+  fail_unless(strstr(answer, "Request Complete") != NULL && strstr(answer, CLASS) == NULL,
+      "The router should answer without the workers");
+  fail_unless(waited < 2500, "The router should not wait long for the workers");
+  free(answer);
+
+  // Their late answers are thrown away, rather than taken for answers to later requests
+  kill(workers[0], SIGCONT);
+  kill(workers[1], SIGCONT);
+  usleep(200000);
+  answer = ask("opensrf.router.info.stats");
+  fail_unless(strstr(answer, CLASS) != NULL,
+      "The workers should answer the next request with their own answers");
+  free(answer);
+END_TEST
+
+START_TEST(test_osrf_router_latency_buckets)
+  fail_unless(osrfRouterLatencyBucket(-5) == 0 && osrfRouterLatencyBucket(7) == 7
+      && osrfRouterLatencyBucket(15) == 15 && osrfRouterLatencyBucket(16) == 16
+      && osrfRouterLatencyBucket(17) == 16 && osrfRouterLatencyBucket(18) == 17,
+      "Short latencies should have a bucket apiece, then two apiece");
+  fail_unless(osrfRouterLatencyBucket(1LL << 50) == ROUTER_LATENCY_BUCKETS - 1,
+      "The last bucket should take anything longer");
+
+  // Buckets run in order, and none is wider than an eighth of what it holds
+  long long ns;
+  int last = 0;
+  for (ns = 0; ns < 1000000; ns += 1 + ns / 64) {
+    int bucket = osrfRouterLatencyBucket(ns);
+    fail_unless(bucket == last || bucket == last + 1, "Buckets should run in order");
+    last = bucket;
+  }
+  for (ns = 16; ns < 1LL << 40; ns = ns * 3 / 2) {
+    long long lo = ns, hi = ns;
+    while (osrfRouterLatencyBucket(lo - 1) == osrfRouterLatencyBucket(ns))
+      lo--;
+    while (osrfRouterLatencyBucket(hi + 1) == osrfRouterLatencyBucket(ns))
+      hi++;
+    fail_unless(hi - lo + 1 <= lo / 8, "A bucket should be no wider than an eighth");
+    if (hi - lo > 4096)
+      break;
+  }
+END_TEST
+
+START_TEST(test_osrf_router_latency_percentiles)
+  osrfRouterLatency latency;
+  memset(&latency, 0, sizeof(latency));
+  fail_unless(osrfRouterLatencyPercentile(&latency, 0.5) == 0.0,
+      "No latencies should make every percentile 0");
+
+  // 980 messages in 1 ms, 20 in 10 ms
+  int i;
+  for (i = 0; i < 980; i++)
+    osrfRouterLatencyAdd(&latency, 1000000);
+  for (i = 0; i < 20; i++)
+    osrfRouterLatencyAdd(&latency, 10000000);
+  fail_unless(latency.count == 1000 && latency.max == 10000000,
+      "Every latency should be counted");
+
+  double p50 = osrfRouterLatencyPercentile(&latency, 0.5);
+  fail_unless(p50 >= 1000.0 && p50 <= 1125.0,
+      "The median should be 1 ms, give or take an eighth");
+  fail_unless(osrfRouterLatencyPercentile(&latency, 0.98) == p50,
+      "The 98th percentile should still be in the 1 ms bucket");
+  fail_unless(osrfRouterLatencyPercentile(&latency, 0.99) == 10000.0,
+      "The 99th percentile should be 10 ms, capped at the greatest latency");
+  fail_unless(osrfRouterLatencyPercentile(&latency, 0.0) == p50,
+      "The 0th percentile should be the least bucket");
+END_TEST
+
+START_TEST(test_osrf_router_rates)
+  osrfRouterRate rate = { 0.0, 100, 0 };
+  int i;
+  for (i = 0; i < 50; i++)
+    osrfRouterRateCount(&rate, 100500000000LL);
+  fail_unless(osrfRouterRateGet(&rate, 100900000000LL) == 0.0,
+      "A second should count only once it has ended");
+  double first = osrfRouterRateGet(&rate, 101000000000LL);
+  fail_unless(fabs(first - 50 * (1.0 - ROUTER_RATE_DECAY)) < 1e-9,
+      "An ended second should be folded into the average");
+  fail_unless(fabs(osrfRouterRateGet(&rate, 103000000000LL)
+      - first * ROUTER_RATE_DECAY * ROUTER_RATE_DECAY) < 1e-9,
+      "Each quiet second should decay the average");
+
+  // A steady 10 per second, for ten minutes
+  long long second;
+  rate.rate = 0.0;
+  for (second = 200; second < 800; second++)
+    for (i = 0; i < 10; i++)
+      osrfRouterRateCount(&rate, second * 1000000000LL);
+  fail_unless(fabs(osrfRouterRateGet(&rate, 800000000000LL) - 10.0) < 0.01,
+      "A steady rate should be reported as that rate");
+  fail_unless(osrfRouterRateGet(&rate, 1500000000000LL) == 0.0,
+      "Ten quiet minutes should forget the rate");
+END_TEST
+
+START_TEST(test_osrf_router_class_stats)
+  osrfRouterClass* rclass = safe_malloc(sizeof(osrfRouterClass));
+  rclass->nodes = osrfNewHash();
+  rclass->messages = 100;
+  // A second that hasn't ended yet, so the rate stands as we set it
+  rclass->rate.rate = 12.5;
+  rclass->rate.second = osrfRouterClockNanos() / 1000000000LL + 3600;
+  int i;
+  for (i = 0; i < 100; i++)
+    osrfRouterLatencyAdd(&rclass->latency, i < 99 ? 2000 : 3000000);
+
+  jsonObject* stats = osrfRouterClassStats(rclass, 0);
+  fail_unless(jsonObjectGetNumber(jsonObjectGetKeyConst(stats, "messages")) == 100,
+      "The message count should be reported");
+  fail_unless(!strcmp(jsonObjectGetString(jsonObjectGetKeyConst(stats, "rate")), "12.500"),
+      "The rate should be reported");
+  const jsonObject* latency = jsonObjectGetKeyConst(stats, "latency");
+  fail_unless(jsonObjectGetNumber(jsonObjectGetKeyConst(latency, "count")) == 100,
+      "The latency count should be reported");
+  fail_unless(!strcmp(jsonObjectGetString(jsonObjectGetKeyConst(latency, "p50")), "2.047"),
+      "The median should be reported in microseconds, at the top of its bucket");
+  fail_unless(!strcmp(jsonObjectGetString(jsonObjectGetKeyConst(latency, "p99")), "2.047"),
+      "The 99th percentile should be reported");
+  fail_unless(!strcmp(jsonObjectGetString(jsonObjectGetKeyConst(latency, "p999")),
+      "3000.000"), "The 99.9th percentile should be reported");
+  fail_unless(!strcmp(jsonObjectGetString(jsonObjectGetKeyConst(latency, "max")),
+      "3000.000"), "The greatest latency should be reported");
+  jsonObjectFree(stats);
+
+  osrfHashFree(rclass->nodes);
+  free(rclass);
+END_TEST
+
+//END TESTS
+
+Suite *osrf_router_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_router");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_router_unhinted_not_starved);
+  tcase_add_test(tc_core, test_osrf_router_bounce_unhinted);
+  tcase_add_test(tc_core, test_osrf_router_bounce_acknowledged);
+  tcase_add_test(tc_core, test_osrf_router_limit_unhinted);
+  tcase_add_test(tc_core, test_osrf_router_peers);
+  tcase_add_test(tc_core, test_osrf_router_workers_timeout);
+
+  // The statistics need no router
+  TCase *tc_stats = tcase_create("Stats");
+  tcase_add_test(tc_stats, test_osrf_router_latency_buckets);
+  tcase_add_test(tc_stats, test_osrf_router_latency_percentiles);
+  tcase_add_test(tc_stats, test_osrf_router_rates);
+  tcase_add_test(tc_stats, test_osrf_router_class_stats);
+
+  //Add test cases to test suite
+  suite_add_tcase(s, tc_core);
+  suite_add_tcase(s, tc_stats);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_router_suite());
+}
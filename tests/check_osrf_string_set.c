@@ -0,0 +1,185 @@
+#include <check.h>
+#include "opensrf/osrf_string_set.h"
+
+osrfStringSet *testSet;
+osrfPrefixMatcher *testMatcher;
+
+//Set up the test fixture
+void setup(void) {
+  testSet = osrfNewStringSet(0);
+  osrfStringSetAdd(testSet, "private.localhost");
+  osrfStringSetAdd(testSet, "public.localhost");
+
+  testMatcher = osrfNewPrefixMatcher();
+  osrfPrefixMatcherAdd(testMatcher, "open-ils.auth.authenticate");
+  osrfPrefixMatcherAdd(testMatcher, "open-ils.actor.patron.password");
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfStringSetFree(testSet);
+  osrfPrefixMatcherFree(testMatcher);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_string_set_osrfStringSetAdd)
+  fail_unless(osrfStringSetAdd(NULL, "foo") == 0,
+      "osrfStringSetAdd should return 0 for a NULL set");
+  fail_unless(osrfStringSetAdd(testSet, NULL) == 0,
+      "osrfStringSetAdd should return 0 for a NULL string");
+  fail_unless(osrfStringSetAdd(testSet, "public.localhost") == 0,
+      "osrfStringSetAdd should return 0 for a duplicate string");
+  fail_unless(osrfStringSetCount(testSet) == 2,
+      "testSet should still contain 2 strings");
+  fail_unless(osrfStringSetAdd(testSet, "brick1.localhost") == 1,
+      "osrfStringSetAdd should return 1 for a new string");
+  fail_unless(osrfStringSetCount(testSet) == 3,
+      "testSet should contain 3 strings");
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfStringSetContains)
+  fail_unless(osrfStringSetContains(testSet, "private.localhost") == 1,
+      "testSet should contain private.localhost");
+  fail_unless(osrfStringSetContains(testSet, "private.localhos") == 0,
+      "testSet should not contain private.localhos");
+  fail_unless(osrfStringSetContains(testSet, "Public.localhost") == 0,
+      "osrfStringSetContains should be case-sensitive");
+  fail_unless(osrfStringSetContains(NULL, "public.localhost") == 0,
+      "osrfStringSetContains should return 0 for a NULL set");
+
+  const char* jid = "opensrf@private.localhost/router";
+  fail_unless(osrfStringSetContainsN(testSet, jid + 8, 17) == 1,
+      "osrfStringSetContainsN should match a substring of the given length");
+  fail_unless(osrfStringSetContainsN(testSet, jid + 8, 16) == 0,
+      "osrfStringSetContainsN should not match a truncated substring");
+END_TEST
+
+START_TEST(test_osrf_string_set_growth)
+  char buf[32];
+  int i;
+  for (i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "domain%d.example", i);
+    osrfStringSetAdd(testSet, buf);
+  }
+  fail_unless(osrfStringSetCount(testSet) == 1002,
+      "testSet should contain 1002 strings after growing");
+  for (i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "domain%d.example", i);
+    fail_unless(osrfStringSetContains(testSet, buf) == 1,
+        "every added string should still be present after growing");
+  }
+  fail_unless(osrfStringSetContains(testSet, "private.localhost") == 1,
+      "private.localhost should still be present after growing");
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfStringSetRemove)
+  char buf[32];
+  int i;
+  for (i = 0; i < 200; i++) {
+    snprintf(buf, sizeof(buf), "d%d", i);
+    osrfStringSetAdd(testSet, buf);
+  }
+  fail_unless(osrfStringSetRemove(testSet, "nothere") == 0,
+      "osrfStringSetRemove should return 0 for a missing string");
+  for (i = 0; i < 200; i += 2) {
+    snprintf(buf, sizeof(buf), "d%d", i);
+    fail_unless(osrfStringSetRemove(testSet, buf) == 1,
+        "osrfStringSetRemove should return 1 for a present string");
+  }
+  fail_unless(osrfStringSetCount(testSet) == 102,
+      "testSet should contain 102 strings after removals");
+  for (i = 0; i < 200; i++) {
+    snprintf(buf, sizeof(buf), "d%d", i);
+    fail_unless(osrfStringSetContains(testSet, buf) == (i % 2),
+        "only the odd-numbered strings should remain");
+  }
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfNewStringSetFromArray)
+  osrfStringArray *arr = osrfNewStringArray(4);
+  osrfStringArrayAdd(arr, "a.localhost");
+  osrfStringArrayAdd(arr, "b.localhost");
+  osrfStringArrayAdd(arr, "a.localhost");
+  osrfStringSet *set = osrfNewStringSetFromArray(arr);
+  fail_unless(osrfStringSetCount(set) == 2,
+      "duplicates in the array should be stored only once");
+  fail_unless(osrfStringSetContains(set, "b.localhost") == 1,
+      "set should contain b.localhost");
+  osrfStringSetFree(set);
+  osrfStringArrayFree(arr);
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfPrefixMatcherMatch)
+  fail_unless(osrfPrefixMatcherMatch(testMatcher,
+      "open-ils.auth.authenticate.complete") == 1,
+      "a method beginning with a stored prefix should match");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher,
+      "open-ils.auth.authenticate") == 1,
+      "a method equal to a stored prefix should match");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "open-ils.auth.session.retrieve") == 0,
+      "a method sharing only part of a prefix should not match");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "open-ils.actor.patron.retrieve") == 0,
+      "a method sorting between two prefixes should not match");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "aaa") == 0,
+      "a method sorting before every prefix should not match");
+  fail_unless(osrfPrefixMatcherMatch(NULL, "open-ils.auth.authenticate") == 0,
+      "osrfPrefixMatcherMatch should return 0 for a NULL matcher");
+END_TEST
+
+START_TEST(test_osrf_string_set_osrfPrefixMatcherAdd)
+  osrfPrefixMatcherAdd(testMatcher, "open-ils.auth.authenticate.init");
+  fail_unless(osrfPrefixMatcherCount(testMatcher) == 2,
+      "a prefix covered by a shorter one should be ignored");
+  osrfPrefixMatcherAdd(testMatcher, "open-ils.a");
+  fail_unless(osrfPrefixMatcherCount(testMatcher) == 1,
+      "a shorter prefix should replace the prefixes it covers");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "open-ils.actor.user.retrieve") == 1,
+      "the shorter prefix should now match");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "open-ils.circ") == 0,
+      "the shorter prefix should not match unrelated methods");
+
+  char buf[32];
+  int i;
+  for (i = 0; i < 50; i++) {
+    snprintf(buf, sizeof(buf), "svc%02d.", i);
+    osrfPrefixMatcherAdd(testMatcher, buf);
+  }
+  fail_unless(osrfPrefixMatcherCount(testMatcher) == 51,
+      "testMatcher should hold 51 prefixes");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "svc37.method") == 1,
+      "svc37.method should match after growth");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "svc3.method") == 0,
+      "svc3.method should not match");
+
+  osrfPrefixMatcherAdd(testMatcher, "");
+  fail_unless(osrfPrefixMatcherMatch(testMatcher, "anything") == 1,
+      "an empty prefix should match everything");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_string_set_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_string_set");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_string_set_osrfStringSetAdd);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfStringSetContains);
+  tcase_add_test(tc_core, test_osrf_string_set_growth);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfStringSetRemove);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfNewStringSetFromArray);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfPrefixMatcherMatch);
+  tcase_add_test(tc_core, test_osrf_string_set_osrfPrefixMatcherAdd);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_string_set_suite());
+}
@@ -0,0 +1,326 @@
+#include <check.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "opensrf/osrf_transgroup.h"
+
+// Two domains, both on this host, each served by a stand-in Jabber server
+#define DOMAIN_A "localhost"
+#define DOMAIN_B "127.0.0.1"
+
+int port_a, port_b;
+pid_t server_pid;
+osrfTransportGroup *grp;
+osrfTransportGroupNode *node_a, *node_b;
+
+static int listen_any(int* port) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+      || listen(fd, 16) < 0
+      || getsockname(fd, (struct sockaddr*) &addr, &addr_len) < 0)
+    return -1;
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static int read_until(int fd, growing_buffer* got, const char* marker) {
+  char buf[4096];
+  while (!strstr(OSRF_BUFFER_C_STR(got), marker)) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return -1;
+    buffer_add_n(got, buf, n);
+  }
+  return 0;
+}
+
+static void write_str(int fd, const char* data) {
+  if (write(fd, data, strlen(data)) < 0)
+    _exit(1);
+}
+
+// Log in a session, whatever its credentials
+static int accept_session(int listener) {
+  int fd = accept(listener, NULL, NULL);
+  growing_buffer* got = buffer_init(1024);
+  if (read_until(fd, got, "streams'>"))
+    _exit(1);
+  write_str(fd, "<stream:stream xmlns='jabber:client' "
+      "xmlns:stream='http://etherx.jabber.org/streams' id='check'>");
+  buffer_reset(got);
+  if (read_until(fd, got, "</iq>"))
+    _exit(1);
+  write_str(fd, "<iq type='result' id='123456789'/>");
+  buffer_free(got);
+  return fd;
+}
+
+/*
+  In a child process: send each message back to its sender, until killed.  A message to
+  "close@..." closes every session on the same port, and the port, as if the server
+  had gone down.
+*/
+static void serve(int listener_a, int listener_b) {
+  struct pollfd fds[32];
+  growing_buffer* bufs[32];
+  int nfds = 2;
+  fds[0].fd = listener_a;
+  fds[1].fd = listener_b;
+
+  for (;;) {
+    int i;
+    for (i = 0; i < nfds; i++)
+      fds[i].events = POLLIN;
+    if (poll(fds, nfds, -1) < 0)
+      _exit(1);
+
+    for (i = 0; i < 2; i++) {
+      if (fds[i].fd >= 0 && (fds[i].revents & POLLIN) && nfds < 32) {
+        bufs[nfds] = buffer_init(1024);
+        fds[nfds].fd = accept_session(fds[i].fd);
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        // Remember which port it came in on, in the buffer's first byte
+        buffer_add_char(bufs[nfds], (char) i);
+        nfds++;
+      }
+    }
+
+    for (i = 2; i < nfds; i++) {
+      if (fds[i].fd < 0 || !(fds[i].revents & POLLIN))
+        continue;
+      char buf[4096];
+      ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+      if (n <= 0) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        continue;
+      }
+      buffer_add_n(bufs[i], buf, n);
+
+      char* end;
+      while ((end = strstr(bufs[i]->buf + 1, "</message>"))) {
+        size_t len = end - bufs[i]->buf + strlen("</message>");
+        char* xml = strndup(bufs[i]->buf + 1, len - 1);
+        int port_index = bufs[i]->buf[0];
+        memmove(bufs[i]->buf + 1, bufs[i]->buf + len, bufs[i]->n_used - len + 1);
+        bufs[i]->n_used -= len - 1;
+
+        transport_message* msg = new_message_from_xml(strstr(xml, "<message"));
+        free(xml);
+        if (!strncmp(msg->recipient, "close@", 6)) {
+          int j;
+          for (j = 2; j < nfds; j++) {
+            if (fds[j].fd >= 0 && bufs[j]->buf[0] == port_index) {
+              close(fds[j].fd);
+              fds[j].fd = -1;
+            }
+          }
+          close(fds[port_index].fd);
+          fds[port_index].fd = -1;
+        } else {
+          transport_message* reply = message_init(msg->body, NULL, msg->thread,
+              msg->sender, msg->recipient);
+          message_prepare_xml(reply);
+          write_str(fds[i].fd, reply->msg_xml);
+          message_free(reply);
+        }
+        message_free(msg);
+        if (fds[i].fd < 0)
+          break;
+      }
+    }
+  }
+}
+
+//Set up the test fixture
+void setup(void) {
+  int listener_a = listen_any(&port_a);
+  int listener_b = listen_any(&port_b);
+  fflush(stdout);
+  server_pid = fork();
+  if (0 == server_pid)
+    serve(listener_a, listener_b);
+  close(listener_a);
+  close(listener_b);
+
+  node_a = osrfNewTransportGroupPool(DOMAIN_A, port_a, "user", "pass", "check", 2);
+  node_b = osrfNewTransportGroupNode(DOMAIN_B, port_b, "user", "pass", "check");
+  osrfTransportGroupNode* nodes[] = { node_a, node_b };
+  grp = osrfNewTransportGroup(nodes, 2);
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfTransportGroupFree(grp);
+  kill(server_pid, SIGTERM);
+  waitpid(server_pid, NULL, 0);
+}
+
+static transport_message* request(const char* recipient, const char* body) {
+  return message_init(body, NULL, "thread", recipient, NULL);
+}
+
+// Make a connection fail on its next send, after it has built the message's XML
+static void break_conn(osrfTransportGroupConn* conn) {
+  shutdown(conn->connection->session->sock_id, SHUT_WR);
+}
+
+// Check that the server saw the message as sent, from the answer it echoed back
+static void check_echo(transport_message* msg, const char* why) {
+  transport_message* reply = osrfTransportGroupRecvAll(grp, 5);
+  fail_unless(reply != NULL, "The answer should arrive");
+  fail_unless(strcmp(reply->sender, msg->recipient) == 0
+      && strcmp(reply->recipient, msg->sender) == 0, why);
+  message_free(reply);
+}
+
+//BEGIN TESTS
+
+START_TEST(test_osrf_transgroup_connect)
+  fail_unless(osrfTransportGroupConnectAll(grp) == 2,
+      "Both domains should be connected");
+  fail_unless(node_a->active == 2 && node_b->active == 1,
+      "Every connection in each pool should be active");
+  fail_unless(strcmp(node_a->conns[0].connection->xmpp_id, "user@localhost/check") == 0
+      && strcmp(node_a->conns[1].connection->xmpp_id, "user@localhost/check_1") == 0,
+      "Each connection after the first should have its own resource");
+END_TEST
+
+START_TEST(test_osrf_transgroup_send_match)
+  osrfTransportGroupConnectAll(grp);
+
+  // Consecutive sends to a domain take turns on its connections
+  int i;
+  for (i = 0; i < 2; i++) {
+    transport_message* msg = request("echo@" DOMAIN_A "/x", "hello");
+    fail_unless(osrfTransportGroupSendMatch(grp, msg) == 0, "The send should succeed");
+    message_free(msg);
+  }
+  fail_unless(node_a->conns[0].awaiting && node_a->conns[1].awaiting,
+      "Both connections should be awaiting answers");
+
+  for (i = 0; i < 2; i++) {
+    transport_message* reply = osrfTransportGroupRecvAll(grp, 5);
+    fail_unless(reply != NULL && strcmp(reply->body, "hello") == 0,
+        "Each answer should arrive");
+    message_free(reply);
+  }
+  fail_unless(node_a->latency > 0.0, "The answers should have been timed");
+  fail_unless(node_b->latency == 0.0, "The other domain should have no timing yet");
+  fail_unless(osrfTransportGroupRecvAll(grp, 0) == NULL, "Nothing more should arrive");
+END_TEST
+
+START_TEST(test_osrf_transgroup_send_rewrites)
+  osrfTransportGroupConnectAll(grp);
+
+  // Messages to a domain of ours go to either domain, with the recipient to match
+  int to_a = 0, to_b = 0;
+  int i;
+  for (i = 0; i < 4; i++) {
+    transport_message* msg = request("echo@" DOMAIN_A "/x", "hello");
+    fail_unless(osrfTransportGroupSend(grp, msg) == 0, "The send should succeed");
+    if (strcmp(msg->recipient, "echo@" DOMAIN_A "/x") == 0)
+      to_a++;
+    else if (strcmp(msg->recipient, "echo@" DOMAIN_B "/x") == 0)
+      to_b++;
+    message_free(msg);
+
+    transport_message* reply = osrfTransportGroupRecvAll(grp, 5);
+    fail_unless(reply != NULL, "The answer should arrive");
+    message_free(reply);
+  }
+  fail_unless(to_a > 0 && to_b > 0 && to_a + to_b == 4,
+      "Both domains should have had messages, each with its own recipient");
+
+  // A recipient elsewhere is left alone
+  transport_message* msg = request("echo@elsewhere/x", "hello");
+  fail_unless(osrfTransportGroupSend(grp, msg) == 0, "The send should succeed");
+  fail_unless(strcmp(msg->recipient, "echo@elsewhere/x") == 0,
+      "A recipient in a domain not ours should not be rewritten");
+  message_free(msg);
+END_TEST
+
+START_TEST(test_osrf_transgroup_failover)
+  osrfTransportGroupConnectAll(grp);
+
+  // The server for one domain goes away
+  transport_message* msg = request("close@" DOMAIN_B "/x", "");
+  fail_unless(osrfTransportGroupSendMatch(grp, msg) == 0, "The send should succeed");
+  message_free(msg);
+
+  // We notice when the connection closes
+  fail_unless(osrfTransportGroupRecvAll(grp, 1) == NULL, "Nothing should arrive");
+  fail_unless(node_b->active == 0, "The lost domain should have no active connections");
+  fail_unless(node_b->failures == 1 && node_b->retry_at >= time(NULL),
+      "The lost domain should be put off");
+
+  // And everything goes to the other domain, until the lost one is due to reconnect
+  int i;
+  for (i = 0; i < 3; i++) {
+    msg = request("echo@" DOMAIN_B "/x", "hello");
+    fail_unless(osrfTransportGroupSend(grp, msg) == 0, "The send should succeed");
+    fail_unless(strcmp(msg->recipient, "echo@" DOMAIN_A "/x") == 0,
+        "Messages should go to the domain that's left");
+    message_free(msg);
+  }
+
+  msg = request("echo@" DOMAIN_B "/x", "hello");
+  fail_unless(osrfTransportGroupSendMatch(grp, msg) == -1,
+      "A send to exactly the lost domain should fail");
+  message_free(msg);
+END_TEST
+
+START_TEST(test_osrf_transgroup_retry_rebuilds)
+  osrfTransportGroupConnectAll(grp);
+
+  // The pool's next connection fails, and the message goes out on the other one
+  break_conn(&node_a->conns[node_a->next_conn]);
+  transport_message* msg = request("echo@" DOMAIN_A "/x", "hello");
+  fail_unless(osrfTransportGroupSendMatch(grp, msg) == 0, "The send should succeed");
+  fail_unless(node_a->active == 1, "The failed connection should be dropped");
+  check_echo(msg, "A retry should be sent from the connection that sends it");
+  message_free(msg);
+
+  // The other domain fails, and its messages go to this one
+  break_conn(&node_b->conns[0]);
+  int i;
+  for (i = 0; i < 4 && node_b->active; i++) {
+    msg = request("echo@" DOMAIN_B "/x", "hello");
+    fail_unless(osrfTransportGroupSend(grp, msg) == 0, "The send should succeed");
+    check_echo(msg, "A message that fails over should be sent to the new recipient");
+    message_free(msg);
+  }
+  fail_unless(node_b->active == 0, "The failed domain should have been tried");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_transgroup_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_transgroup");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_transgroup_connect);
+  tcase_add_test(tc_core, test_osrf_transgroup_send_match);
+  tcase_add_test(tc_core, test_osrf_transgroup_send_rewrites);
+  tcase_add_test(tc_core, test_osrf_transgroup_failover);
+  tcase_add_test(tc_core, test_osrf_transgroup_retry_rebuilds);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_transgroup_suite());
+}
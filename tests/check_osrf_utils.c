@@ -1,4 +1,5 @@
 #include <check.h>
+#include <limits.h>
 #include "opensrf/utils.h"
 
 
@@ -21,6 +22,23 @@ START_TEST(test_osrfXmlEscapingLength)
   ck_assert_int_eq(osrfXmlEscapingLength(special), 38);
 END_TEST
 
+START_TEST(test_timeout_to_millis)
+  ck_assert_int_eq(timeout_to_millis(0), 0);
+  ck_assert_int_eq(timeout_to_millis(3), 3000);
+  ck_assert_int_eq(timeout_to_millis(-1), -1);
+  ck_assert_int_eq(timeout_to_millis(-5), -1);
+  fail_unless(timeout_to_millis(INT_MAX) == INT_MAX,
+      "timeout_to_millis should clamp timeouts too long to express in milliseconds");
+END_TEST
+
+START_TEST(test_get_monotonic_millis)
+  long long start = get_monotonic_millis();
+  usleep(20000);
+  long long elapsed = get_monotonic_millis() - start;
+  fail_unless(elapsed >= 20 && elapsed < 1000,
+      "get_monotonic_millis should measure elapsed time in milliseconds");
+END_TEST
+
 //END TESTS
 
 Suite *osrf_utils_suite(void) {
@@ -31,6 +49,8 @@ Suite *osrf_utils_suite(void) {
 
   //Add tests to test case
   tcase_add_test(tc_core, test_osrfXmlEscapingLength);
+  tcase_add_test(tc_core, test_timeout_to_millis);
+  tcase_add_test(tc_core, test_get_monotonic_millis);
 
   //Add test case to test suite
   suite_add_tcase(s, tc_core);
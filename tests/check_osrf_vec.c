@@ -0,0 +1,170 @@
+#include <check.h>
+#include "opensrf/osrf_vec.h"
+
+osrfVec *testVec;
+int freeCount;
+
+//Set up the test fixture
+void setup(void) {
+  testVec = osrfNewVec(sizeof(int));
+  int i;
+  for (i = 0; i < 5; i++)
+    osrfVecPush(testVec, &i);
+  freeCount = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  osrfVecFree(testVec);
+}
+
+// Helper functions
+static void countFree(void* elem) {
+  freeCount++;
+}
+
+static int compareInts(const void* a, const void* b) {
+  int x = *(const int*) a;
+  int y = *(const int*) b;
+  return (x > y) - (x < y);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_osrf_vec_osrfVecPush)
+  fail_unless(osrfVecPush(NULL, NULL) == NULL,
+      "osrfVecPush should return NULL if passed a NULL vec");
+  int val = 42;
+  int* slot = osrfVecPush(testVec, &val);
+  fail_unless(*slot == 42,
+      "osrfVecPush should return a pointer to the stored copy");
+  fail_unless(osrfVecCount(testVec) == 6,
+      "testVec should have 6 elements");
+  int i;
+  for (i = 0; i < 1000; i++)
+    osrfVecPush(testVec, &i);
+  fail_unless(osrfVecCount(testVec) == 1006,
+      "testVec should have 1006 elements after growing");
+  fail_unless(testVec->capacity >= 1006 && testVec->capacity < 2012,
+      "testVec should grow geometrically");
+  fail_unless(*(int*) osrfVecGet(testVec, 5) == 42 &&
+      *(int*) osrfVecGet(testVec, 1005) == 999,
+      "Elements should survive growth");
+END_TEST
+
+START_TEST(test_osrf_vec_osrfVecAppend)
+  int vals[] = { 10, 11, 12 };
+  int* first = osrfVecAppend(testVec, vals, 3);
+  fail_unless(first == osrfVecGet(testVec, 5),
+      "osrfVecAppend should return a pointer to the first new element");
+  fail_unless(osrfVecCount(testVec) == 8,
+      "testVec should have 8 elements");
+  fail_unless(*(int*) osrfVecGet(testVec, 7) == 12,
+      "The appended elements should be stored in order");
+
+  osrfVecReserve(testVec, 500);
+  fail_unless(testVec->capacity == 500,
+      "osrfVecReserve should grow to the requested capacity");
+  osrfVecReserve(testVec, 10);
+  fail_unless(testVec->capacity == 500,
+      "osrfVecReserve should never shrink a vec");
+END_TEST
+
+START_TEST(test_osrf_vec_osrfVecSet)
+  int val = 7;
+  osrfVecSet(testVec, 2, &val);
+  fail_unless(*(int*) osrfVecGet(testVec, 2) == 7,
+      "osrfVecSet should replace an existing element");
+  osrfVecSet(testVec, 9, &val);
+  fail_unless(osrfVecCount(testVec) == 10,
+      "osrfVecSet beyond the end should extend the vec");
+  fail_unless(*(int*) osrfVecGet(testVec, 7) == 0,
+      "osrfVecSet should zero the intervening elements");
+  fail_unless(osrfVecGet(testVec, 10) == NULL,
+      "osrfVecGet should return NULL past the end");
+END_TEST
+
+START_TEST(test_osrf_vec_osrfVecRemove)
+  testVec->freeItem = countFree;
+  fail_unless(osrfVecRemove(testVec, 5) == -1,
+      "osrfVecRemove should return -1 for an out-of-range index");
+  fail_unless(osrfVecRemove(testVec, 1) == 0,
+      "osrfVecRemove should return 0 on success");
+  fail_unless(freeCount == 1,
+      "osrfVecRemove should call the freeItem callback");
+  fail_unless(osrfVecCount(testVec) == 4,
+      "testVec should have 4 elements after a removal");
+  fail_unless(*(int*) osrfVecGet(testVec, 1) == 2 &&
+      *(int*) osrfVecGet(testVec, 3) == 4,
+      "osrfVecRemove should close the gap");
+
+  int out = -1;
+  fail_unless(osrfVecExtract(testVec, 0, &out) == 0 && out == 0,
+      "osrfVecExtract should copy out the removed element");
+  fail_unless(osrfVecPop(testVec, &out) == 0 && out == 4,
+      "osrfVecPop should copy out the last element");
+  fail_unless(freeCount == 1,
+      "osrfVecExtract and osrfVecPop should not call the freeItem callback");
+  fail_unless(osrfVecCount(testVec) == 2,
+      "testVec should have 2 elements left");
+
+  int val = 99;
+  osrfVecInsert(testVec, 0, &val);
+  fail_unless(*(int*) osrfVecGet(testVec, 0) == 99 &&
+      *(int*) osrfVecGet(testVec, 1) == 2,
+      "osrfVecInsert should shift later elements up");
+
+  osrfVecClear(testVec);
+  fail_unless(osrfVecCount(testVec) == 0 && freeCount == 4,
+      "osrfVecClear should free and remove every element");
+END_TEST
+
+START_TEST(test_osrf_vec_osrfVecSort)
+  int vals[] = { 40, 3, 17, 8 };
+  osrfVecAppend(testVec, vals, 4);
+  osrfVecSort(testVec, compareInts);
+  int i;
+  for (i = 1; i < osrfVecCount(testVec); i++)
+    fail_unless(*(int*) osrfVecGet(testVec, i - 1) <= *(int*) osrfVecGet(testVec, i),
+        "osrfVecSort should sort the elements");
+
+  int key = 17;
+  int* found = osrfVecBsearch(testVec, &key, compareInts);
+  fail_unless(found != NULL && *found == 17,
+      "osrfVecBsearch should find a present key");
+  key = 5;
+  fail_unless(osrfVecBsearch(testVec, &key, compareInts) == NULL,
+      "osrfVecBsearch should return NULL for a missing key");
+
+  key = 8;
+  fail_unless(osrfVecFind(testVec, &key, NULL) == 6,
+      "osrfVecFind should return the index of a matching element");
+  key = 1000;
+  fail_unless(osrfVecFind(testVec, &key, compareInts) == -1,
+      "osrfVecFind should return -1 if there is no match");
+END_TEST
+
+//END TESTS
+
+Suite *osrf_vec_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("osrf_vec");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_osrf_vec_osrfVecPush);
+  tcase_add_test(tc_core, test_osrf_vec_osrfVecAppend);
+  tcase_add_test(tc_core, test_osrf_vec_osrfVecSet);
+  tcase_add_test(tc_core, test_osrf_vec_osrfVecRemove);
+  tcase_add_test(tc_core, test_osrf_vec_osrfVecSort);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, osrf_vec_suite());
+}
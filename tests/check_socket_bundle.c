@@ -0,0 +1,341 @@
+#include <check.h>
+#include "opensrf/socket_bundle.h"
+
+#define CLIENTS 3
+
+socket_manager *testMgr;
+char testPath[64];
+int listener;
+int clients[CLIENTS];
+
+// What the callbacks saw
+int servers[CLIENTS];
+int serverCount;
+int received;
+int callbacks;
+long checksum;
+int closed;
+int parent;
+int disconnectOthers;
+
+static void data_received(void* blob, socket_manager* mgr, int sock_fd, char* data,
+    size_t len, int parent_id) {
+  size_t i;
+  received += len;
+  callbacks++;
+  for (i = 0; i < len; i++)
+    checksum += (unsigned char) data[i];
+  parent = parent_id;
+  for (i = 0; i < serverCount; i++) {
+    if (servers[i] == sock_fd)
+      break;
+  }
+  if (i == serverCount && serverCount < CLIENTS)
+    servers[serverCount++] = sock_fd;
+
+  if (disconnectOthers) {
+    for (i = 0; i < serverCount; i++) {
+      if (servers[i] != sock_fd)
+        socket_disconnect(mgr, servers[i]);
+    }
+    disconnectOthers = 0;
+  }
+}
+
+static void socket_closed(void* blob, int sock_fd) {
+  closed++;
+}
+
+static int connect_client(void) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, testPath);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+//Set up the test fixture
+void setup(void) {
+  int i;
+  testMgr = safe_malloc(sizeof(socket_manager));
+  testMgr->data_received = data_received;
+  testMgr->on_socket_closed = socket_closed;
+  snprintf(testPath, sizeof(testPath), "/tmp/check_socket_bundle_%ld.sock", (long) getpid());
+  unlink(testPath);
+  listener = socket_open_unix_server(testMgr, testPath);
+
+  for (i = 0; i < CLIENTS; i++) {
+    clients[i] = connect_client();
+    socket_wait_all(testMgr, 1);   // accept it
+  }
+
+  serverCount = received = callbacks = closed = parent = disconnectOthers = 0;
+  checksum = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  int i;
+  for (i = 0; i < CLIENTS; i++)
+    close(clients[i]);
+  socket_manager_free(testMgr);
+  unlink(testPath);
+}
+
+// BEGIN TESTS
+
+START_TEST(test_socket_bundle_socket_wait_all)
+  int i;
+  fail_unless(listener >= 0, "socket_open_unix_server should return a socket");
+  for (i = 0; i < CLIENTS; i++)
+    fail_unless(clients[i] >= 0, "Each client should be able to connect");
+
+  for (i = 0; i < CLIENTS; i++)
+    send(clients[i], "hello", 5, 0);
+  while (received < 5 * CLIENTS)
+    fail_unless(socket_wait_all(testMgr, 1) == 0,
+        "socket_wait_all should return 0 while data is arriving");
+
+  fail_unless(received == 5 * CLIENTS,
+      "socket_wait_all should deliver all the data, exactly once");
+  fail_unless(serverCount == CLIENTS,
+      "Data should arrive on a separate socket for each client");
+  fail_unless(parent == listener,
+      "parent_id should be the listener that accepted the socket");
+  fail_unless(socket_wait_all(testMgr, 0) == 0 && received == 5 * CLIENTS,
+      "socket_wait_all should not report data that has already been read");
+END_TEST
+
+START_TEST(test_socket_bundle_closed)
+  send(clients[0], "x", 1, 0);
+  while (received < 1)
+    socket_wait_all(testMgr, 1);
+
+  close(clients[0]);
+  clients[0] = -1;
+  socket_wait_all(testMgr, 1);
+  fail_unless(closed == 1,
+      "socket_wait_all should call on_socket_closed when a client hangs up");
+
+  send(clients[1], "y", 1, 0);
+  socket_wait_all(testMgr, 1);
+  fail_unless(received == 2 && closed == 1,
+      "The remaining sockets should still work after one is closed");
+END_TEST
+
+START_TEST(test_socket_bundle_disconnect_in_callback)
+  int i;
+  for (i = 0; i < CLIENTS; i++)
+    send(clients[i], "a", 1, 0);
+  while (received < CLIENTS)
+    socket_wait_all(testMgr, 1);
+
+  // Now make all the sockets ready at once, and close the others from the first callback
+  disconnectOthers = 1;
+  for (i = 0; i < CLIENTS; i++)
+    send(clients[i], "b", 1, 0);
+  usleep(10000);
+  socket_wait_all(testMgr, 1);
+  socket_wait_all(testMgr, 0);
+  fail_unless(received == CLIENTS + 1,
+      "A socket closed by a callback should not be read afterwards");
+END_TEST
+
+START_TEST(test_socket_bundle_large_data)
+  // A megabyte of binary data, including nuls
+  int total = 1024 * 1024;
+  char* data = safe_malloc(total);
+  long expected = 0;
+  int i;
+  for (i = 0; i < total; i++) {
+    data[i] = (char) (i % 251);
+    expected += (unsigned char) data[i];
+  }
+
+  int sent = 0;
+  while (sent < total) {
+    int n = send(clients[0], data + sent, total - sent, MSG_DONTWAIT);
+    if (n > 0)
+      sent += n;
+    socket_wait_all(testMgr, 0);
+  }
+  while (received < total)
+    socket_wait_all(testMgr, 1);
+  free(data);
+
+  fail_unless(received == total && checksum == expected,
+      "The data callback should receive every byte, nuls and all");
+  fail_unless(callbacks < total / 4096,
+      "Large transfers should arrive in large chunks");
+END_TEST
+
+START_TEST(test_socket_bundle_socket_connected)
+  fail_unless(socket_connected(clients[0]) == 1,
+      "socket_connected should return 1 for a connected socket");
+
+  int fd = connect_client();
+  socket_wait_all(testMgr, 1);
+  close(fd);
+  fail_unless(socket_connected(fd) == 0,
+      "socket_connected should return 0 for a closed descriptor");
+
+  // Hang up on the client from the server side
+  send(clients[1], "z", 1, 0);
+  while (received < 1)
+    socket_wait_all(testMgr, 1);
+  socket_disconnect(testMgr, servers[0]);
+  fail_unless(socket_connected(clients[1]) == 0,
+      "socket_connected should return 0 when the peer has hung up");
+END_TEST
+
+START_TEST(test_socket_bundle_send_nowait)
+  send(clients[0], "q", 1, 0);
+  while (received < 1)
+    socket_wait_all(testMgr, 1);
+  int server = servers[0];
+
+  // More than the socket will hold, so that some of it has to be queued
+  size_t total = 4 * 1024 * 1024;
+  char* data = safe_malloc(total);
+  size_t i;
+  for (i = 0; i < total; i++)
+    data[i] = (char) (i % 253);
+
+  testMgr->high_water = 64 * 1024;
+  fail_unless(socket_send_nowait(testMgr, server, data, total) == 1,
+      "socket_send_nowait should ask for backpressure when the queue is over the high-water mark");
+  fail_unless(socket_pending(testMgr, server) > 0 && socket_backpressure(testMgr, server),
+      "socket_pending should report the queued data");
+  fail_unless(socket_flush(testMgr, server, 0) == 1,
+      "socket_flush should not wait if told not to");
+
+  // A short message queued behind the big one should come out after it
+  fail_unless(socket_send_nowait(testMgr, server, "!", 1) == 1,
+      "socket_send_nowait should queue behind data already queued");
+
+  char* got = safe_malloc(total + 1);
+  size_t got_len = 0;
+  while (got_len < total + 1) {
+    ssize_t n = recv(clients[0], got + got_len, total + 1 - got_len, MSG_DONTWAIT);
+    if (n > 0)
+      got_len += n;
+    socket_wait_all(testMgr, 0);
+  }
+
+  fail_unless(socket_pending(testMgr, server) == 0 && !socket_backpressure(testMgr, server),
+      "socket_wait_all should drain the queue as the socket becomes writable");
+  fail_unless(memcmp(got, data, total) == 0 && got[total] == '!',
+      "Queued data should arrive intact and in order");
+  free(got);
+  free(data);
+END_TEST
+
+START_TEST(test_socket_bundle_send_nowait_closed)
+  send(clients[0], "q", 1, 0);
+  while (received < 1)
+    socket_wait_all(testMgr, 1);
+  int server = servers[0];
+
+  close(clients[0]);
+  clients[0] = -1;
+  fail_unless(socket_send_nowait(testMgr, server, "x", 1) <= 0,
+      "socket_send_nowait to a closed peer should not queue data indefinitely");
+  fail_unless(socket_send_nowait(testMgr, 12345, "x", 1) == -1,
+      "socket_send_nowait should reject an unknown socket");
+  fail_unless(socket_send(server, "x") == -1,
+      "socket_send should fail once the peer has hung up");
+END_TEST
+
+START_TEST(test_socket_bundle_send_corked)
+  send(clients[0], "q", 1, 0);
+  while (received < 1)
+    socket_wait_all(testMgr, 1);
+  int server = servers[0];
+  char got[16];
+
+  fail_unless(socket_send_corked(testMgr, server, "abc", 3) == 0
+      && socket_send_corked(testMgr, server, "def", 3) == 0,
+      "socket_send_corked should accept data");
+  fail_unless(socket_pending(testMgr, server) == 6
+      && recv(clients[0], got, sizeof(got), MSG_DONTWAIT) < 0,
+      "socket_send_corked should hold small amounts of data back");
+
+  fail_unless(socket_flush(testMgr, server, -1) == 0,
+      "socket_flush should send corked data");
+  fail_unless(recv(clients[0], got, sizeof(got), 0) == 6 && memcmp(got, "abcdef", 6) == 0,
+      "Corked data should arrive in one piece, in order");
+
+  // The next pass of the event loop sends it too
+  socket_send_corked(testMgr, server, "ghi", 3);
+  socket_wait_all(testMgr, 0);
+  fail_unless(socket_pending(testMgr, server) == 0
+      && recv(clients[0], got, sizeof(got), 0) == 3 && memcmp(got, "ghi", 3) == 0,
+      "socket_wait_all should send corked data");
+
+  // A full batch goes out right away
+  char* data = safe_malloc(SOCKET_CORK_SIZE);
+  memset(data, 'x', SOCKET_CORK_SIZE);
+  socket_send_corked(testMgr, server, data, SOCKET_CORK_SIZE / 2);
+  socket_send_corked(testMgr, server, data, SOCKET_CORK_SIZE / 2);
+  fail_unless(socket_pending(testMgr, server) < SOCKET_CORK_SIZE,
+      "socket_send_corked should send the queue once it reaches SOCKET_CORK_SIZE");
+  free(data);
+END_TEST
+
+START_TEST(test_socket_bundle_wait_ms)
+  long long start = get_monotonic_millis();
+  fail_unless(socket_wait_all_ms(testMgr, 50) == 0,
+      "socket_wait_all_ms should return 0 on a timeout");
+  long long elapsed = get_monotonic_millis() - start;
+  fail_unless(elapsed >= 40 && elapsed < 1000,
+      "socket_wait_all_ms should wait for about the given number of milliseconds");
+
+  send(clients[0], "q", 1, 0);
+  while (received < 1)
+    socket_wait_all_ms(testMgr, 10);
+  int server = servers[0];
+
+  start = get_monotonic_millis();
+  socket_wait_ms(testMgr, 50, server);
+  elapsed = get_monotonic_millis() - start;
+  fail_unless(elapsed >= 40 && elapsed < 1000,
+      "socket_wait_ms should wait for about the given number of milliseconds");
+
+  send(clients[0], "r", 1, 0);
+  fail_unless(socket_wait_ms(testMgr, 1000, server) == 0 && received == 2,
+      "socket_wait_ms should read data that arrives before the timeout");
+END_TEST
+
+//END TESTS
+
+Suite *socket_bundle_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("socket_bundle");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_socket_bundle_socket_wait_all);
+  tcase_add_test(tc_core, test_socket_bundle_closed);
+  tcase_add_test(tc_core, test_socket_bundle_disconnect_in_callback);
+  tcase_add_test(tc_core, test_socket_bundle_large_data);
+  tcase_add_test(tc_core, test_socket_bundle_socket_connected);
+  tcase_add_test(tc_core, test_socket_bundle_send_nowait);
+  tcase_add_test(tc_core, test_socket_bundle_send_nowait_closed);
+  tcase_add_test(tc_core, test_socket_bundle_send_corked);
+  tcase_add_test(tc_core, test_socket_bundle_wait_ms);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, socket_bundle_suite());
+}
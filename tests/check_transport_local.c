@@ -0,0 +1,235 @@
+#include <check.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include "opensrf/transport_local.h"
+
+#define JID_A "opensrf@private.localhost/client_a"
+#define JID_B "opensrf@private.localhost/server_b"
+
+char dir[64];
+socket_manager *mgr_a, *mgr_b;
+transport_local *local_a, *local_b;
+
+// What each side's message callback saw
+transport_message *received_a, *received_b;
+int count_a, count_b;
+
+static void message_received(void* user_data, transport_message* msg) {
+  if (user_data == &received_a) {
+    message_free(received_a);
+    received_a = msg;
+    count_a++;
+  } else {
+    message_free(received_b);
+    received_b = msg;
+    count_b++;
+  }
+}
+
+static void other_data(void* blob, socket_manager* mgr, int sock_fd, char* data,
+    size_t len, int parent_id) {
+}
+
+//Set up the test fixture: two peers, each with its own socket_manager
+void setup(void) {
+  strcpy(dir, "/tmp/check_transport_local_XXXXXX");
+  fail_unless(mkdtemp(dir) != NULL, "Unable to make a socket directory");
+  mgr_a = safe_malloc(sizeof(socket_manager));
+  mgr_b = safe_malloc(sizeof(socket_manager));
+  mgr_a->data_received = other_data;
+  mgr_b->data_received = other_data;
+  local_a = local_init(mgr_a, dir, JID_A, &received_a, message_received);
+  local_b = local_init(mgr_b, dir, JID_B, &received_b, message_received);
+  received_a = received_b = NULL;
+  count_a = count_b = 0;
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  local_free(local_a);
+  local_free(local_b);
+  socket_manager_free(mgr_a);
+  socket_manager_free(mgr_b);
+  message_free(received_a);
+  message_free(received_b);
+  rmdir(dir);
+}
+
+// Wait until a peer has received a given number of messages
+static void wait_for(socket_manager* mgr, int* count, int expected) {
+  int tries = 0;
+  while (*count < expected && tries++ < 100)
+    socket_wait_all_ms(mgr, 50);
+}
+
+//BEGIN TESTS
+
+START_TEST(test_transport_local_round_trip)
+  fail_unless(local_a != NULL && local_b != NULL, "Both peers should be listening");
+
+  transport_message* msg = message_init("request body", NULL, "thread", JID_B, JID_A);
+  fail_unless(local_send_msg(local_a, msg) == 0, "A local peer should take a message");
+  wait_for(mgr_b, &count_b, 1);
+  fail_unless(count_b == 1 && strcmp(received_b->body, "request body") == 0
+      && strcmp(received_b->thread, "thread") == 0
+      && strcmp(received_b->sender, JID_A) == 0,
+      "The message should arrive intact");
+
+  // The reply goes back to the sender's own socket
+  transport_message* reply = message_init("reply body", NULL, "thread",
+      received_b->sender, JID_B);
+  fail_unless(local_send_msg(local_b, reply) == 0, "The sender should be a local peer too");
+  wait_for(mgr_a, &count_a, 1);
+  fail_unless(count_a == 1 && strcmp(received_a->body, "reply body") == 0,
+      "The reply should arrive intact");
+
+  // Later messages reuse the connection
+  fail_unless(local_send_msg(local_a, msg) == 0 && local_send_msg(local_a, msg) == 0,
+      "More messages should go the same way");
+  wait_for(mgr_b, &count_b, 3);
+  fail_unless(count_b == 3, "All of the messages should arrive");
+  fail_unless(osrfHashGetCount(local_a->peers) == 1,
+      "There should be one connection per peer");
+
+  message_free(msg);
+  message_free(reply);
+END_TEST
+
+START_TEST(test_transport_local_not_local)
+  transport_message* msg = message_init("body", NULL, "thread",
+      "opensrf@elsewhere/remote", JID_A);
+  fail_unless(local_send_msg(local_a, msg) == 1,
+      "A recipient without a socket should be left to Jabber");
+  message_free(msg);
+END_TEST
+
+START_TEST(test_transport_local_framing)
+  // Write frames by hand: two in one piece, then one a few bytes at a time
+  transport_message* msg = message_init("framed", NULL, "thread", JID_B, JID_A);
+  message_prepare_xml(msg);
+  size_t len = strlen(msg->msg_xml);
+  uint32_t header = htonl(len);
+  char frame[len + 4];
+  memcpy(frame, &header, 4);
+  memcpy(frame + 4, msg->msg_xml, len);
+
+  int fd = socket_open_unix_client(mgr_a, local_b->path);
+  fail_unless(fd > 0, "We should be able to connect to a peer's socket");
+  char two[2 * (len + 4)];
+  memcpy(two, frame, len + 4);
+  memcpy(two + len + 4, frame, len + 4);
+  fail_unless(write(fd, two, sizeof(two)) == sizeof(two), "Unable to write");
+  wait_for(mgr_b, &count_b, 2);
+  fail_unless(count_b == 2, "Two frames in one read should make two messages");
+
+  size_t i;
+  for (i = 0; i < len + 4; i += 7) {
+    size_t n = len + 4 - i < 7 ? len + 4 - i : 7;
+    fail_unless(write(fd, frame + i, n) == (ssize_t) n, "Unable to write");
+    socket_wait_all_ms(mgr_b, 10);
+  }
+  wait_for(mgr_b, &count_b, 3);
+  fail_unless(count_b == 3 && strcmp(received_b->body, "framed") == 0,
+      "A frame in pieces should make one message");
+
+  // An impossible frame gets us disconnected
+  header = htonl(LOCAL_MAX_FRAME + 1);
+  fail_unless(write(fd, &header, 4) == 4, "Unable to write");
+  socket_wait_all_ms(mgr_b, 50);
+  char c;
+  fail_unless(read(fd, &c, 1) == 0, "An oversized frame should close the connection");
+
+  socket_disconnect(mgr_a, fd);
+  message_free(msg);
+END_TEST
+
+START_TEST(test_transport_local_peer_gone)
+  transport_message* msg = message_init("body", NULL, "thread", JID_B, JID_A);
+  fail_unless(local_send_msg(local_a, msg) == 0, "A local peer should take a message");
+
+  local_free(local_b);
+  local_b = NULL;
+  fail_unless(local_send_msg(local_a, msg) == 1,
+      "A message for a departed peer should be left to Jabber");
+  fail_unless(local_send_msg(local_a, msg) == 1,
+      "A departed peer's socket should be gone from the directory");
+  fail_unless(mgr_b->data_received == other_data,
+      "The socket_manager should get its callback back");
+  message_free(msg);
+END_TEST
+
+START_TEST(test_transport_local_stalled_peer)
+  // Far more than the socket buffers hold, and B never reads
+  size_t size = 8 * 1024 * 1024;
+  char* body = safe_malloc(size + 1);
+  memset(body, 'x', size);
+  transport_message* msg = message_init(body, NULL, "thread", JID_B, JID_A);
+  free(body);
+
+  time_t start = time(NULL);
+  fail_unless(local_send_msg(local_a, msg) == 1,
+      "A message a peer won't take should be left to Jabber");
+  fail_unless(time(NULL) - start <= LOCAL_SEND_TIMEOUT + 1,
+      "A send shouldn't wait on a stalled peer for long");
+  message_free(msg);
+
+  // The cut-off frame is never delivered; the next message goes on a new connection
+  msg = message_init("body", NULL, "thread", JID_B, JID_A);
+  fail_unless(local_send_msg(local_a, msg) == 0, "A local peer should take a message");
+  wait_for(mgr_b, &count_b, 1);
+  socket_wait_all_ms(mgr_b, 100);
+  fail_unless(count_b == 1 && !strcmp(received_b->body, "body"),
+      "Only the whole message should arrive");
+  message_free(msg);
+END_TEST
+
+START_TEST(test_transport_local_private)
+  struct stat st;
+  fail_unless(stat(local_a->path, &st) == 0 && (st.st_mode & 077) == 0,
+      "Our socket should be open to nobody else");
+
+  // Nobody else may write to the directory
+  socket_manager* mgr = safe_malloc(sizeof(socket_manager));
+  chmod(dir, 0770);
+  fail_unless(local_init(mgr, dir, "opensrf@private.localhost/other", NULL,
+      message_received) == NULL, "A group-writable directory should be refused");
+  chmod(dir, 0700);
+  fail_unless(local_init(mgr, "/nonexistent", "opensrf@private.localhost/other", NULL,
+      message_received) == NULL, "A missing directory should be refused");
+  socket_manager_free(mgr);
+
+  // A socket belonging to somebody else isn't a peer
+  if (geteuid() == 0) {
+    fail_unless(chown(local_b->path, 12345, -1) == 0, "Unable to chown");
+    transport_message* msg = message_init("body", NULL, "thread", JID_B, JID_A);
+    fail_unless(local_send_msg(local_a, msg) == 1,
+        "A socket belonging to another user should be left alone");
+    message_free(msg);
+  }
+END_TEST
+
+//END TESTS
+
+Suite *transport_local_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("transport_local");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_transport_local_round_trip);
+  tcase_add_test(tc_core, test_transport_local_not_local);
+  tcase_add_test(tc_core, test_transport_local_framing);
+  tcase_add_test(tc_core, test_transport_local_peer_gone);
+  tcase_add_test(tc_core, test_transport_local_stalled_peer);
+  tcase_add_test(tc_core, test_transport_local_private);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, transport_local_suite());
+}
@@ -137,6 +137,31 @@ START_TEST(test_transport_message_new_message_from_xml_populated)
       "new_message_from_xml should store the original xml msg in msg_xml");
 END_TEST
 
+START_TEST(test_transport_message_new_message_from_xml_escapes)
+  const char* xml_jabber_msg =
+    "<?xml version=\"1.0\"?>\n<message from='a&amp;b' to=\"caf&#xE9;\">\n"
+    "  <!-- comment --><opensrf router_from=\"rf&lt;\" router_to='a\tb' broadcast=\"0\"/>\n"
+    "  <body>x &lt; y &#65;&#x42;\r\n<![CDATA[<raw>&amp;]]><skip>me</skip> z</body>\n"
+    "</message>";
+
+  transport_message *my_msg = new_message_from_xml(xml_jabber_msg);
+  fail_if(my_msg == NULL, "new_message_from_xml failed to create a transport_message");
+  fail_unless(strcmp(my_msg->recipient, "caf\xc3\xa9") == 0,
+      "new_message_from_xml should decode character references in attributes");
+  fail_unless(strcmp(my_msg->sender, "rf<") == 0,
+      "new_message_from_xml should decode entity references in attributes");
+  fail_unless(strcmp(my_msg->router_to, "a b") == 0,
+      "new_message_from_xml should normalize whitespace in attributes");
+  fail_unless(my_msg->broadcast == 0,
+      "new_message_from_xml should treat a broadcast value of 0 as false");
+  fail_unless(strcmp(my_msg->body, "x < y AB\n<raw>&amp; z") == 0,
+      "new_message_from_xml should unescape text, keep CDATA and skip nested elements");
+  message_free(my_msg);
+
+  fail_unless(new_message_from_xml("<message from='s'><body>unterminated") == NULL,
+      "new_message_from_xml should return NULL for a malformed message");
+END_TEST
+
 START_TEST(test_transport_message_set_osrf_xid)
   message_set_osrf_xid(a_message, "abcd");
   fail_unless(strcmp(a_message->osrf_xid, "abcd") == 0,
@@ -174,6 +199,58 @@ START_TEST(test_transport_message_set_router_info_populated)
       "message_set_router_info should set msg->broadcast to the value of the broadcast_enabled arg");
 END_TEST
 
+START_TEST(test_transport_message_readdress)
+  message_set_router_info(a_message, "routerfrom", "routerto", "routerclass", "routercommand", 1);
+  message_set_osrf_xid(a_message, "osrfxid");
+  set_msg_error(a_message, "errortype", 123);
+  message_prepare_xml(a_message);
+  char* body = a_message->body;
+
+  message_readdress(a_message, "node", a_message->sender);
+  fail_unless(a_message->body == body,
+      "message_readdress should leave the body where it is");
+  fail_unless(strcmp(a_message->recipient, "node") == 0,
+      "message_readdress should set msg->recipient to the value of the recipient arg");
+  fail_unless(strcmp(a_message->router_from, "sender") == 0,
+      "message_readdress should set msg->router_from to the value of the router_from arg");
+  fail_unless(a_message->msg_xml == NULL,
+      "message_readdress should discard the old xml");
+  fail_unless(a_message->is_error == 0,
+      "message_readdress should clear any error");
+
+  message_prepare_xml(a_message);
+  fail_unless(strcmp(a_message->msg_xml, "<message to=\"node\" from=\"sender\"><opensrf router_from=\"sender\" router_to=\"\" router_class=\"\" router_command=\"\" osrf_xid=\"osrfxid\"/><thread>thread</thread><subject>subject</subject><body>body</body></message>") == 0,
+      "message_readdress should yield the xml of a message built afresh");
+END_TEST
+
+START_TEST(test_transport_message_router_hops)
+  fail_unless(a_message->router_hops == 0,
+      "message_init should set msg->router_hops to 0");
+  a_message->router_hops = 2;
+  message_readdress(a_message, "peer", a_message->sender);
+  fail_unless(a_message->router_hops == 2,
+      "message_readdress should keep the hop count");
+
+  message_prepare_xml(a_message);
+  fail_unless(strstr(a_message->msg_xml, " router_hops=\"2\"/>") != NULL,
+      "message_prepare_xml should add a router_hops attribute when there are hops");
+  transport_message* copy = new_message_from_xml(a_message->msg_xml);
+  fail_unless(copy->router_hops == 2,
+      "new_message_from_xml should populate the router_hops field");
+  message_free(copy);
+
+  copy = new_message_from_xml("<message to=\"node\" from=\"sender\">"
+      "<opensrf router_hops=\"99999\"/><body>body</body></message>");
+  fail_unless(copy->router_hops == MESSAGE_MAX_HOPS,
+      "new_message_from_xml should read too many hops as MESSAGE_MAX_HOPS");
+  message_free(copy);
+  fail_unless(message_read_hops("1000", 4) == MESSAGE_MAX_HOPS
+      && message_read_hops("-3", 2) == MESSAGE_MAX_HOPS,
+      "message_read_hops should read too many hops, or negative ones, as MESSAGE_MAX_HOPS");
+  fail_unless(message_read_hops("12x", 3) == 12 && message_read_hops("", 0) == 0,
+      "message_read_hops should read digits up to the first non-digit");
+END_TEST
+
 START_TEST(test_transport_message_free)
   fail_unless(message_free(NULL) == 0,
       "message_free should return 0 if passed a NULL msg arg");
@@ -204,6 +281,19 @@ START_TEST(test_transport_message_prepare_xml)
       "message_prepare_xml should store the correct xml in msg->msg_xml");
 END_TEST
 
+START_TEST(test_transport_message_prepare_xml_escapes)
+  transport_message *msg = message_init("a<b>&\"c'\r\n\t\xc3\xa9", NULL, NULL,
+      "caf\xc3\xa9 <\"x\">\n\t\xf0\x9f\x98\x80", "sender");
+  fail_unless(message_prepare_xml(msg) == 1,
+      "message_prepare_xml should return 1 upon success");
+  fail_unless(strcmp(msg->msg_xml, "<message to=\"caf&#xE9; &lt;&quot;x&quot;&gt;&#10;&#9;"
+      "&#x1F600;\" from=\"sender\"><opensrf router_from=\"\" router_to=\"\" router_class=\"\" "
+      "router_command=\"\" osrf_xid=\"\"/><body>a&lt;b&gt;&amp;\"c'&#13;\n\t\xc3\xa9</body>"
+      "</message>") == 0,
+      "message_prepare_xml should escape text and attribute values as libxml2 does");
+  message_free(msg);
+END_TEST
+
 START_TEST(test_transport_message_jid_get_username)
   int buf_size = 15;
   char buffer[buf_size];
@@ -234,6 +324,19 @@ START_TEST(test_transport_message_jid_get_domain)
       "jid_get_domain should set the buffer to an empty string if the jid is malformed");
 END_TEST
 
+START_TEST(test_transport_message_jid_find_domain)
+  size_t len = 99;
+  const char* jid = "testuser@domain.com/stuff";
+  fail_unless(jid_find_domain(jid, &len) == jid + 9,
+      "jid_find_domain should return a pointer to the start of the domain");
+  fail_unless(len == 10,
+      "jid_find_domain should report the length of the domain");
+  fail_unless(jid_find_domain("ksdljflksd", &len) == NULL,
+      "jid_find_domain should return NULL if the jid is malformed");
+  fail_unless(len == 0,
+      "jid_find_domain should report a zero length if the jid is malformed");
+END_TEST
+
 START_TEST(test_transport_message_set_msg_error)
   set_msg_error(a_message, NULL, 111);
   fail_unless(a_message->is_error == 1,
@@ -259,14 +362,19 @@ Suite *transport_message_suite(void) {
   tcase_add_test(tc_core, test_transport_message_init_populated);
   tcase_add_test(tc_core, test_transport_message_new_message_from_xml_empty);
   tcase_add_test(tc_core, test_transport_message_new_message_from_xml_populated);
+  tcase_add_test(tc_core, test_transport_message_new_message_from_xml_escapes);
   tcase_add_test(tc_core, test_transport_message_set_osrf_xid);
   tcase_add_test(tc_core, test_transport_message_set_router_info_empty);
   tcase_add_test(tc_core, test_transport_message_set_router_info_populated);
+  tcase_add_test(tc_core, test_transport_message_readdress);
+  tcase_add_test(tc_core, test_transport_message_router_hops);
   tcase_add_test(tc_core, test_transport_message_free);
   tcase_add_test(tc_core, test_transport_message_prepare_xml);
+  tcase_add_test(tc_core, test_transport_message_prepare_xml_escapes);
   tcase_add_test(tc_core, test_transport_message_jid_get_username);
   tcase_add_test(tc_core, test_transport_message_jid_get_resource);
   tcase_add_test(tc_core, test_transport_message_jid_get_domain);
+  tcase_add_test(tc_core, test_transport_message_jid_find_domain);
   tcase_add_test(tc_core, test_transport_message_set_msg_error);
 
   //Add test case to test suite
@@ -0,0 +1,280 @@
+#include <check.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include "opensrf/transport_session.h"
+
+transport_session *a_session;
+
+// What the message callback saw
+transport_message *received[2];
+int receivedCount;
+
+static void message_received(void* user_data, transport_message* msg) {
+  if (receivedCount < 2)
+    received[receivedCount++] = msg;
+  else
+    message_free(msg);
+}
+
+// Pass XML to the session as if it had arrived from the socket
+static void feed(const char* xml) {
+  socket_manager* mgr = a_session->sock_mgr;
+  mgr->data_received(mgr->blob, mgr, 0, (char*) xml, strlen(xml), 0);
+}
+
+//Set up the test fixture
+void setup(void) {
+  a_session = init_transport("localhost", 5222, NULL, NULL, 0);
+  a_session->message_callback = message_received;
+  receivedCount = 0;
+  received[0] = received[1] = NULL;
+  feed("<stream:stream xmlns:stream='http://etherx.jabber.org/streams'>");
+}
+
+//Clean up the test fixture
+void teardown(void) {
+  message_free(received[0]);
+  message_free(received[1]);
+  session_free(a_session);
+}
+
+//BEGIN TESTS
+
+START_TEST(test_transport_session_small_message)
+  feed("<message from='sender@host/res' to='recipient@host/res'>"
+      "<thread>thread</thread><subject>subject</subject>"
+      "<body>a &lt;small&gt; body</body></message>");
+
+  fail_unless(receivedCount == 1, "A complete message should reach the message callback");
+  fail_unless(strcmp(received[0]->body, "a <small> body") == 0,
+      "The body should be unescaped");
+  fail_unless(strcmp(received[0]->thread, "thread") == 0
+      && strcmp(received[0]->subject, "subject") == 0
+      && strcmp(received[0]->sender, "sender@host/res") == 0
+      && strcmp(received[0]->recipient, "recipient@host/res") == 0,
+      "The other fields of the message should be filled in");
+END_TEST
+
+START_TEST(test_transport_session_large_message)
+  // A body much bigger than the session's buffer, arriving in pieces
+  size_t size = 1024 * 1024;
+  char* body = safe_malloc(size + 1);
+  size_t i;
+  for (i = 0; i < size; i++)
+    body[i] = 'a' + (i % 26);
+
+  feed("<message from='sender' to='recipient'><thread>big</thread><body>");
+  char chunk[4097];
+  for (i = 0; i < size; i += 4096) {
+    memcpy(chunk, body + i, 4096);
+    chunk[4096] = '\0';
+    feed(chunk);
+  }
+  feed("&amp;</body></message>");
+  body[size] = '&';
+
+  // Then a small one, which mustn't see any of the big one
+  feed("<message from='sender' to='recipient'><thread>small</thread>"
+      "<body>small</body></message>");
+
+  fail_unless(receivedCount == 2, "Both messages should reach the message callback");
+  fail_unless(strlen(received[0]->body) == size + 1
+      && memcmp(received[0]->body, body, size + 1) == 0,
+      "A large body should arrive intact");
+  fail_unless(strcmp(received[0]->thread, "big") == 0,
+      "The fields of a large message should be filled in");
+  fail_unless(strcmp(received[1]->body, "small") == 0
+      && strcmp(received[1]->thread, "small") == 0,
+      "The session's buffers should be empty for the next message");
+  free(body);
+END_TEST
+
+// A stand-in Jabber server, for a client session to connect to over a UNIX socket.
+// It offers zlib compression (if asked to) and logs anybody in; then it reads one
+// message, sends it back, and waits for the end of the stream.
+
+#define SERVER_PATH "/tmp/check_transport_session.sock"
+
+// Read until what we've read contains a marker, inflating it if z is not NULL
+static int server_read_until(int fd, z_stream* z, growing_buffer* got,
+    const char* marker) {
+  char buf[4096];
+  char out[16384];
+  while (!strstr(OSRF_BUFFER_C_STR(got), marker)) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      return -1;
+    if (!z) {
+      buffer_add_n(got, buf, n);
+      continue;
+    }
+    z->next_in = (Bytef*) buf;
+    z->avail_in = n;
+    do {
+      z->next_out = (Bytef*) out;
+      z->avail_out = sizeof(out);
+      if (inflate(z, Z_SYNC_FLUSH) == Z_DATA_ERROR)
+        return -1;
+      buffer_add_n(got, out, sizeof(out) - z->avail_out);
+    } while (z->avail_out == 0);
+  }
+  return 0;
+}
+
+// Send some XML, deflating it if z is not NULL
+static int server_send(int fd, z_stream* z, const char* xml) {
+  size_t len = strlen(xml);
+  if (!z)
+    return write(fd, xml, len) == (ssize_t) len ? 0 : -1;
+
+  size_t size = deflateBound(z, len) + 16;
+  char* out = safe_malloc(size);
+  z->next_in = (Bytef*) xml;
+  z->avail_in = len;
+  z->next_out = (Bytef*) out;
+  z->avail_out = size;
+  deflate(z, Z_SYNC_FLUSH);
+  len = size - z->avail_out;
+  int ret = write(fd, out, len) == (ssize_t) len ? 0 : -1;
+  free(out);
+  return ret;
+}
+
+static void serve_session(int listener, int offer_compression) {
+  int fd = accept(listener, NULL, NULL);
+  if (fd < 0)
+    _exit(1);
+
+  z_stream zin, zout;
+  memset(&zin, 0, sizeof(zin));
+  memset(&zout, 0, sizeof(zout));
+  z_stream* in = NULL;
+  z_stream* out = NULL;
+  growing_buffer* got = buffer_init(4096);
+
+  if (server_read_until(fd, NULL, got, "version='1.0'>"))
+    _exit(2);
+  server_send(fd, NULL, "<stream:stream xmlns='jabber:client' "
+      "xmlns:stream='http://etherx.jabber.org/streams' id='plain' version='1.0'>"
+      "<stream:features><mechanisms xmlns='urn:ietf:params:xml:ns:xmpp-sasl'>"
+      "<mechanism>PLAIN</mechanism></mechanisms>");
+  if (offer_compression) {
+    server_send(fd, NULL, "<compression xmlns='http://jabber.org/features/compress'>"
+        "<method>lzw</method><method>zlib</method></compression>");
+  }
+  server_send(fd, NULL, "</stream:features>");
+
+  if (offer_compression) {
+    if (server_read_until(fd, NULL, got, "</compress>"))
+      _exit(3);
+    server_send(fd, NULL, "<compressed xmlns='http://jabber.org/protocol/compress'/>");
+    inflateInit(&zin);
+    deflateInit(&zout, Z_DEFAULT_COMPRESSION);
+    in = &zin;
+    out = &zout;
+    buffer_reset(got);
+    if (server_read_until(fd, in, got, "version='1.0'>"))
+      _exit(4);
+    server_send(fd, out, "<stream:stream xmlns='jabber:client' "
+        "xmlns:stream='http://etherx.jabber.org/streams' id='compressed' version='1.0'>"
+        "<stream:features/>");
+  }
+
+  buffer_reset(got);
+  if (server_read_until(fd, in, got, "</iq>"))
+    _exit(5);
+  server_send(fd, out, "<iq type='result' id='123456789'/>");
+
+  // Echo the message back, as if it had been sent to us
+  buffer_reset(got);
+  if (server_read_until(fd, in, got, "</message>"))
+    _exit(6);
+  server_send(fd, out, strstr(OSRF_BUFFER_C_STR(got), "<message"));
+
+  buffer_reset(got);
+  if (server_read_until(fd, in, got, "</stream:stream>"))
+    _exit(7);
+  _exit(0);
+}
+
+// Connect to the stand-in server, and send a message through it and back
+static void round_trip(int offer_compression) {
+  unlink(SERVER_PATH);
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, SERVER_PATH);
+  fail_unless(listener >= 0
+      && bind(listener, (struct sockaddr*) &addr, sizeof(addr)) == 0
+      && listen(listener, 1) == 0, "The stand-in server should be listening");
+
+  pid_t pid = fork();
+  if (pid == 0)
+    serve_session(listener, offer_compression);
+  close(listener);
+
+  transport_session* ses = init_transport("localhost", 0, SERVER_PATH, NULL, 0);
+  ses->message_callback = message_received;
+  ses->compress = 1;
+
+  fail_unless(session_connect(ses, "user", "pass", "res", 5, AUTH_DIGEST) == 1,
+      "The session should connect");
+  fail_unless(session_compressed(ses) == offer_compression,
+      "The stream should be compressed if and only if the server offers it");
+
+  // Something big and repetitive, like a fieldmapper response
+  growing_buffer* body = buffer_init(65536);
+  int i;
+  for (i = 0; i < 2000; i++)
+    buffer_fadd(body, "{\"__c\":\"aou\",\"__p\":[%d,\"Branch & Co\",null]}", i);
+  transport_message* msg = message_init(OSRF_BUFFER_C_STR(body), "subject", "thread",
+      "user@localhost/res", "user@localhost/res");
+  fail_unless(session_send_msg(ses, msg) == 0, "The message should be sent");
+
+  while (receivedCount < 1 && session_wait(ses, 5) == 0)
+    ;
+  fail_unless(receivedCount == 1 && strcmp(received[0]->body, msg->body) == 0,
+      "The message should come back intact");
+
+  session_free(ses);
+  int status;
+  waitpid(pid, &status, 0);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+      "The stand-in server should see the whole conversation");
+  unlink(SERVER_PATH);
+  message_free(msg);
+  buffer_free(body);
+}
+
+START_TEST(test_transport_session_compression)
+  round_trip(1);
+END_TEST
+
+START_TEST(test_transport_session_compression_not_offered)
+  round_trip(0);
+END_TEST
+
+//END TESTS
+
+Suite *transport_session_suite(void) {
+  //Create test suite, test case, initialize fixture
+  Suite *s = suite_create("transport_session");
+  TCase *tc_core = tcase_create("Core");
+  tcase_add_checked_fixture(tc_core, setup, teardown);
+
+  //Add tests to test case
+  tcase_add_test(tc_core, test_transport_session_small_message);
+  tcase_add_test(tc_core, test_transport_session_large_message);
+  tcase_add_test(tc_core, test_transport_session_compression);
+  tcase_add_test(tc_core, test_transport_session_compression_not_offered);
+
+  //Add test case to test suite
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+void run_tests(SRunner *sr) {
+  srunner_add_suite(sr, transport_session_suite());
+}